@@ -0,0 +1,38 @@
+/* benchmark.h
+
+   Minimal timing helpers shared by the benchmarks
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+namespace Pistache {
+namespace Benchmark {
+
+// Keeps the compiler from optimizing a computed value away
+template<typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs fn iterations times and prints the mean duration of one run
+template<typename Fn>
+double run(const char* name, size_t iterations, Fn fn) {
+    // Warm up the caches and the branch predictors
+    for (size_t i = 0; i < iterations / 10; ++i)
+        fn();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    std::printf("%-40s %10.1f ns/op\n", name, ns);
+    return ns;
+}
+
+} // namespace Benchmark
+} // namespace Pistache
@@ -0,0 +1,84 @@
+/* date_benchmark.cc
+
+   Compares the hand-written HTTP-date parser and formatter of FullDate with
+   the generic date.h stream-based ones they replaced
+*/
+
+#include <sstream>
+#include <string>
+
+#include <pistache/date.h>
+#include <pistache/http_defs.h>
+
+#include "benchmark.h"
+
+using namespace Pistache;
+
+namespace {
+
+const size_t Iterations = 1000000;
+
+const std::string RFC1123 = "Sun, 06 Nov 1994 08:49:37 GMT";
+const std::string RFC850 = "Sunday, 06-Nov-94 08:49:37 GMT";
+const std::string AscTime = "Sun Nov  6 08:49:37 1994";
+
+Http::FullDate::time_point streamParse(const std::string& str) {
+    Http::FullDate::time_point tp;
+    const char* formats[] = {
+        "%a, %d %b %Y %T %Z", "%a, %d-%b-%y %T %Z", "%a %b %d %T %Y"
+    };
+    for (const char* format: formats) {
+        std::istringstream in{str};
+        in >> date::parse(format, tp);
+        if (!in.fail())
+            break;
+    }
+    return tp;
+}
+
+std::string streamFormat(Http::FullDate::time_point tp) {
+    std::ostringstream os;
+    date::to_stream(os, "%a, %d %b %Y %T %Z", tp);
+    return os.str();
+}
+
+}
+
+int main() {
+    using Benchmark::doNotOptimize;
+    using Benchmark::run;
+
+    const char* names[] = { "RFC 1123", "RFC 850", "asctime" };
+    const std::string* dates[] = { &RFC1123, &RFC850, &AscTime };
+
+    for (size_t i = 0; i < 3; ++i) {
+        const auto& str = *dates[i];
+        std::printf("parse %s\n", names[i]);
+        auto slow = run("  date.h", Iterations / 10, [&]() {
+            doNotOptimize(streamParse(str));
+        });
+        auto fast = run("  FullDate::fromString", Iterations, [&]() {
+            doNotOptimize(Http::FullDate::fromString(str));
+        });
+        std::printf("  speedup: %.1fx\n", slow / fast);
+    }
+
+    auto date = Http::FullDate::fromString(RFC1123);
+
+    std::printf("format RFC 1123\n");
+    auto slow = run("  date.h", Iterations / 10, [&]() {
+        doNotOptimize(streamFormat(date.date()));
+    });
+    auto fast = run("  FullDate::format", Iterations, [&]() {
+        char buf[Http::FullDate::RFC1123Length];
+        date.format(buf);
+        doNotOptimize(buf);
+    });
+    std::printf("  speedup: %.1fx\n", slow / fast);
+
+    run("  FullDate::now", Iterations, []() {
+        doNotOptimize(Http::FullDate::now());
+    });
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+/* idle_connections_benchmark.cc
+
+   Opens N connections to an endpoint and reports the memory they take once
+   idle, first right after they were accepted and then after each of them
+   went through one keep-alive request
+
+   Usage: run_idle_connections_benchmark [connections]
+*/
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+
+using namespace Pistache;
+
+namespace {
+
+class OkHandler : public Http::Handler {
+public:
+    HTTP_PROTOTYPE(OkHandler)
+
+    void onRequest(const Http::Request&, Http::ResponseWriter response) override {
+        response.send(Http::Code::Ok, "ok");
+    }
+};
+
+struct Usage {
+    size_t heap;
+    size_t rss;
+};
+
+Usage usage() {
+    Usage res;
+    res.heap = mallinfo2().uordblks;
+
+    size_t pages, resident;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    res.rss = resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return res;
+}
+
+void report(const char* phase, const Usage& before, const Usage& after, size_t count) {
+    auto perConnection = [&](size_t b, size_t a) {
+        return a > b ? static_cast<double>(a - b) / count : 0.0;
+    };
+
+    std::printf("%-32s %10.1f heap bytes/conn %10.1f rss bytes/conn\n", phase,
+            perConnection(before.heap, after.heap), perConnection(before.rss, after.rss));
+}
+
+// Gives the transport time to handle what the clients just did
+void settle() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+int connectTo(Port port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1) {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool request(int fd) {
+    static const char Request[] = "GET / HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    if (::send(fd, Request, sizeof(Request) - 1, 0) != sizeof(Request) - 1)
+        return false;
+
+    std::string response;
+    char buffer[512];
+    while (response.size() < 2 || response.compare(response.size() - 2, 2, "ok") != 0) {
+        auto bytes = ::recv(fd, buffer, sizeof buffer, 0);
+        if (bytes <= 0)
+            return false;
+        response.append(buffer, static_cast<size_t>(bytes));
+    }
+
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+
+    // Both ends of every connection live in this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (2 * count + 64 > limit.rlim_cur) {
+        count = (limit.rlim_cur - 64) / 2;
+        std::printf("Limited to %zu connections by RLIMIT_NOFILE\n", count);
+    }
+
+    Http::Endpoint endpoint(Address(Ipv4::loopback(), Port(0)));
+    endpoint.init(Http::Endpoint::options().threads(1).flags(Tcp::Options::ReuseAddr));
+    endpoint.setHandler(Http::make_handler<OkHandler>());
+    endpoint.serveThreaded();
+
+    const auto port = endpoint.getPort();
+
+    // One connection first so that the first time allocations are not counted
+    int warmup = connectTo(port);
+    if (warmup == -1 || !request(warmup)) {
+        std::fprintf(stderr, "Could not reach the endpoint\n");
+        return 1;
+    }
+    ::close(warmup);
+    settle();
+
+    auto start = usage();
+
+    std::vector<int> fds;
+    fds.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        int fd = connectTo(port);
+        if (fd == -1) {
+            std::fprintf(stderr, "Connection %zu failed: %s\n", i, std::strerror(errno));
+            break;
+        }
+        fds.push_back(fd);
+    }
+    settle();
+
+    // Not counting the vector holding the client fds
+    auto connected = usage();
+    connected.heap -= fds.capacity() * sizeof(int);
+    report("connected", start, connected, fds.size());
+
+    for (int fd: fds) {
+        if (!request(fd)) {
+            std::fprintf(stderr, "Request failed\n");
+            return 1;
+        }
+    }
+    settle();
+
+    auto served = usage();
+    served.heap -= fds.capacity() * sizeof(int);
+    report("idle after a request", start, served, fds.size());
+
+    for (int fd: fds)
+        ::close(fd);
+
+    endpoint.shutdown();
+}
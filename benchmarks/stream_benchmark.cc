@@ -0,0 +1,105 @@
+/* stream_benchmark.cc
+
+   Compares the pointer-based StreamCursor scanning primitives with the
+   byte-at-a-time streambuf loops they replaced, and measures the parsing of
+   a request with many headers
+*/
+
+#include <string>
+
+#include <pistache/http.h>
+#include <pistache/stream.h>
+
+#include "benchmark.h"
+
+using namespace Pistache;
+
+namespace {
+
+const size_t Iterations = 200000;
+
+std::string headerHeavyRequest() {
+    std::string request =
+        "GET /api/v1/users/42?fields=name,email&expand=groups HTTP/1.1\r\n"
+        "Host: api.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=31d4d96e407aad42; theme=dark; lang=en-US; tracking=abcdef0123456789\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Referer: https://www.example.com/some/long/path/to/a/page?with=query&and=more\r\n";
+    for (int i = 0; i < 12; ++i)
+        request += "X-Custom-Header-" + std::to_string(i) + ": some value that is not that short " + std::to_string(i) + "\r\n";
+    request += "\r\n";
+    return request;
+}
+
+// The loops the parser used before, going through the streambuf accessors
+bool slowUntil(char c, StreamBuf<char>& buf) {
+    while (buf.sgetc() != std::char_traits<char>::eof()) {
+        if (buf.sgetc() == c)
+            return true;
+        buf.sbumpc();
+    }
+    return false;
+}
+
+bool slowUntilEol(StreamBuf<char>& buf) {
+    while (buf.in_avail() > 0) {
+        if (buf.sgetc() == CR && buf.in_avail() > 1 && buf.snext() == LF)
+            return true;
+        buf.sbumpc();
+    }
+    return false;
+}
+
+size_t slowScan(std::string& request) {
+    RawStreamBuf<> buf(&request[0], request.size());
+    size_t headers = 0;
+    while (slowUntil(':', buf) && slowUntilEol(buf)) {
+        buf.sbumpc();
+        buf.sbumpc();
+        ++headers;
+    }
+    return headers;
+}
+
+size_t fastScan(std::string& request) {
+    RawStreamBuf<> buf(&request[0], request.size());
+    StreamCursor cursor(&buf);
+    size_t headers = 0;
+    while (match_until(':', cursor) && match_until_eol(cursor)) {
+        cursor.advance(2);
+        ++headers;
+    }
+    return headers;
+}
+
+}
+
+int main() {
+    using Benchmark::doNotOptimize;
+    using Benchmark::run;
+
+    auto request = headerHeavyRequest();
+    std::printf("scan %zu bytes of headers\n", request.size());
+
+    auto slow = run("  streambuf loops", Iterations, [&]() {
+        doNotOptimize(slowScan(request));
+    });
+    auto fast = run("  StreamCursor", Iterations, [&]() {
+        doNotOptimize(fastScan(request));
+    });
+    std::printf("  speedup: %.1fx\n\n", slow / fast);
+
+    Http::Private::Parser<Http::Request> parser;
+    run("parse request", Iterations, [&]() {
+        parser.reset();
+        parser.feed(request.data(), request.size());
+        doNotOptimize(parser.parse());
+    });
+
+    return 0;
+}
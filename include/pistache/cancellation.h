@@ -0,0 +1,146 @@
+/* cancellation.h
+
+   Cancellation tokens, telling the work done on behalf of a request that
+   its result is no longer wanted
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <pistache/async.h>
+
+namespace Pistache {
+namespace Async {
+
+class Cancelled : public std::runtime_error {
+public:
+    Cancelled()
+        : std::runtime_error("Cancelled")
+    { }
+};
+
+/* A token is a shared handle: copies see the same state, and cancelling any
+ * of them runs the callbacks registered on all of them, once, from the
+ * thread that cancelled. A default-constructed token is never cancelled
+ * and costs nothing, use create() for one that can be.
+ */
+class CancellationToken {
+public:
+    using Callback = std::function<void()>;
+    using Registration = uint64_t;
+
+    CancellationToken();
+
+    static CancellationToken create();
+
+    void cancel() const;
+    bool isCancelled() const;
+
+    // False for a default-constructed token
+    bool isCancellable() const { return state_ != nullptr; }
+
+    // Throws Cancelled, e.g. between the steps of a promise chain
+    void throwIfCancelled() const;
+
+    // Whether callbacks, or children, are still registered on the token
+    bool hasListeners() const;
+
+    // The callback runs right away if the token is already cancelled
+    Registration onCancel(Callback callback) const;
+    void unregister(Registration registration) const;
+
+    /* A token cancelled along with this one, that can also be cancelled on
+     * its own. It stops listening to this one once it is destroyed.
+     */
+    CancellationToken child() const;
+
+private:
+    struct State;
+
+    explicit CancellationToken(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> state_;
+};
+
+namespace Private {
+
+    // Only the first of the promise and the token gets to settle
+    struct CancellableLink {
+        CancellableLink(Resolver resolve, Rejection reject, CancellationToken token)
+            : resolve(std::move(resolve))
+            , reject(std::move(reject))
+            , token(std::move(token))
+            , settled(false)
+            , registration(0)
+        { }
+
+        bool settle() {
+            if (settled.exchange(true))
+                return false;
+
+            token.unregister(registration);
+            return true;
+        }
+
+        Resolver resolve;
+        Rejection reject;
+        CancellationToken token;
+        std::atomic<bool> settled;
+        CancellationToken::Registration registration;
+    };
+
+    template<typename T>
+    void forward(Promise<T>& promise, const std::shared_ptr<CancellableLink>& link) {
+        // By value, the resolver checks the exact type it is given
+        promise.then([link](T value) {
+            if (link->settle())
+                link->resolve(std::move(value));
+        }, [link](std::exception_ptr exc) {
+            if (link->settle())
+                link->reject(exc);
+        });
+    }
+
+    inline void forward(Promise<void>& promise, const std::shared_ptr<CancellableLink>& link) {
+        promise.then([link]() {
+            if (link->settle())
+                link->resolve();
+        }, [link](std::exception_ptr exc) {
+            if (link->settle())
+                link->reject(exc);
+        });
+    }
+
+} // namespace Private
+
+/* Settles like the promise, unless the token is cancelled first, in which
+ * case it is rejected with Cancelled
+ */
+template<typename T>
+Promise<T> cancellable(Promise<T>& promise, const CancellationToken& token) {
+    return Promise<T>([&](Resolver& resolve, Rejection& reject) {
+        auto link = std::make_shared<Private::CancellableLink>(
+                std::move(resolve), std::move(reject), token);
+
+        // The token does not keep the link alive, the promise does
+        std::weak_ptr<Private::CancellableLink> weak = link;
+        link->registration = token.onCancel([weak]() {
+            auto link = weak.lock();
+            if (link && link->settle())
+                link->reject(Cancelled());
+        });
+
+        Private::forward(promise, link);
+    });
+}
+
+} // namespace Async
+} // namespace Pistache
@@ -12,17 +12,25 @@
 #include <pistache/timer_pool.h>
 #include <pistache/reactor.h>
 #include <pistache/view.h>
+#include <pistache/optional.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace Pistache {
 namespace Http {
@@ -30,11 +38,25 @@ namespace Http {
 class ConnectionPool;
 class Transport;
 
+// Rejects the requests that got no response within their timeout
+class TimeoutError : public std::runtime_error {
+public:
+    TimeoutError()
+        : std::runtime_error("Timeout")
+    { }
+};
+
 struct Connection : public std::enable_shared_from_this<Connection> {
 
     friend class ConnectionPool;
 
     using OnDone = std::function<void()>;
+    // Called once with the status line and headers of the response (and no
+    // data), then with every piece of the body as it is received. The
+    // connection is not read any further until the returned promise settled
+    using OnData = std::function<Async::Promise<void>(const Response&, const char*, size_t)>;
+
+    static constexpr size_t DefaultRequestBufferSize = 512;
 
     Connection();
 
@@ -42,14 +64,16 @@ struct Connection : public std::enable_shared_from_this<Connection> {
 
         RequestData(
                 Async::Resolver resolve, Async::Rejection reject,
-                const Http::Request& request,
+                Http::Request request,
                 std::chrono::milliseconds timeout,
-                OnDone onDone)
+                OnDone onDone,
+                OnData onData = nullptr)
             : resolve(std::move(resolve))
             , reject(std::move(reject))
-            , request(request)
+            , request(std::move(request))
             , timeout(timeout)
             , onDone(std::move(onDone))
+            , onData(std::move(onData))
         { }
         Async::Resolver resolve;
         Async::Rejection reject;
@@ -57,6 +81,7 @@ struct Connection : public std::enable_shared_from_this<Connection> {
         Http::Request request;
         std::chrono::milliseconds timeout;
         OnDone onDone;
+        OnData onData;
     };
 
     enum State : uint32_t {
@@ -77,50 +102,83 @@ struct Connection : public std::enable_shared_from_this<Connection> {
     bool hasTransport() const;
     void associateTransport(const std::shared_ptr<Transport>& transport);
 
+    /* When onData is given, the body is handed over to it as it arrives
+     * instead of being accumulated, and the response the promise is resolved
+     * with has an empty body.
+     */
     Async::Promise<Response> perform(
-            const Http::Request& request,
+            Http::Request request,
             std::chrono::milliseconds timeout,
-            OnDone onDone);
+            OnDone onDone,
+            OnData onData = nullptr);
 
     Async::Promise<Response> asyncPerform(
-            const Http::Request& request,
+            Http::Request request,
             std::chrono::milliseconds timeout,
-            OnDone onDone);
+            OnDone onDone,
+            OnData onData = nullptr);
+
+    // Rejects the requests queued by asyncPerform, when connect() failed,
+    // without calling their onDone
+    void abortRequestQueue(const char* error);
 
     void performImpl(
-            const Http::Request& request,
+            Http::Request request,
             std::chrono::milliseconds timeout,
             Async::Resolver resolve,
             Async::Rejection reject,
-            OnDone onDone);
+            OnDone onDone,
+            OnData onData = nullptr);
 
     Fd fd() const;
-    void handleResponsePacket(const char* buffer, size_t totalBytes);
+    // Returns false when the response can not be parsed any further and the
+    // connection must be closed
+    bool handleResponsePacket(const char* buffer, size_t totalBytes);
     void handleError(const char* error);
     void handleTimeout();
 
     std::string dump() const;
 
 private:
+    struct ConnectCandidate {
+        int family;
+        int socktype;
+        int protocol;
+        sockaddr_storage addr;
+        socklen_t addrLen;
+    };
+
+    using ConnectCandidates = std::vector<ConnectCandidate>;
+
+    void connectTo(std::shared_ptr<const ConnectCandidates> candidates, size_t index);
+    void failRequestQueue(const char* error);
     void processRequestQueue();
 
     struct RequestEntry {
         RequestEntry(
                 Async::Resolver resolve, Async::Rejection reject,
                 std::shared_ptr<TimerPool::Entry> timer,
-                OnDone onDone)
+                OnDone onDone,
+                OnData onData)
           : resolve(std::move(resolve))
           , reject(std::move(reject))
           , timer(std::move(timer))
           , onDone(std::move(onDone))
+          , onData(std::move(onData))
+          , headDelivered(false)
         { }
 
         Async::Resolver resolve;
         Async::Rejection reject;
         std::shared_ptr<TimerPool::Entry> timer;
         OnDone onDone;
+        OnData onData;
+        bool headDelivered;
     };
 
+    void deliverBody();
+    void pace(Async::Promise<void> until);
+
     Fd fd_;
 
     struct sockaddr_in saddr;
@@ -132,6 +190,11 @@ private:
 
     TimerPool timerPool_;
     Private::Parser<Http::Response> parser;
+
+    // Request line and headers are serialized here. The buffer is reused
+    // from one request to the next and is only read by the transport while
+    // the connection is in use, so the bytes are never copied.
+    DynamicStreamBuf requestBuf_;
 };
 
 class ConnectionPool {
@@ -172,17 +235,31 @@ public:
     Transport()
       : requestsQueue()
       , connectionsQueue()
+      , timersQueue()
       , connections()
       , timeouts()
+      , pendingRequests()
+      , timerFd(-1)
+      , timerSequence(0)
+      , timers()
+      , suspended()
     { }
 
     Transport(const Transport &)
       : requestsQueue()
       , connectionsQueue()
+      , timersQueue()
       , connections()
       , timeouts()
+      , pendingRequests()
+      , timerFd(-1)
+      , timerSequence(0)
+      , timers()
+      , suspended()
     { }
 
+    ~Transport();
+
     void onReady(const Aio::FdSet& fds) override;
     void registerPoller(Polling::Epoll& poller) override;
 
@@ -192,7 +269,27 @@ public:
     Async::Promise<ssize_t> asyncSendRequest(
             std::shared_ptr<Connection> connection,
             std::shared_ptr<TimerPool::Entry> timer,
-            std::string buffer);
+            StringView head,
+            Http::Request request);
+
+    // Forget about the part of a request that has not been sent yet, because
+    // it completed early (error response, timeout, ...)
+    void abortPendingRequest(Fd fd);
+
+    // Stops polling the connection and closes its socket
+    void closeConnection(const std::shared_ptr<Connection>& connection);
+
+    // Calls the callback from the transport thread once the delay expired
+    void armTimer(std::chrono::microseconds delay, std::function<void()> callback);
+
+    // Drops the timers that did not fire, along with their callbacks. Only
+    // once the reactor stopped
+    void cancelTimers();
+
+    // Stops polling the connection for reads until resumeReads() was called
+    // with every suspension returned. Must be called from the transport thread
+    std::weak_ptr<size_t> suspendReads(Fd fd);
+    void resumeReads(Fd fd, const std::weak_ptr<size_t>& suspension);
 
 private:
 
@@ -222,40 +319,88 @@ private:
         socklen_t addr_len;
     };
 
+    /* The head (request line + headers) points into the connection's own
+     * buffer and the body is owned by the request itself. Both are sent as
+     * separate iovecs so that the payload is never copied.
+     */
     struct RequestEntry {
         RequestEntry(
                 Async::Resolver resolve, Async::Rejection reject,
                 std::shared_ptr<Connection> connection,
                 std::shared_ptr<TimerPool::Entry> timer,
-                std::string buf)
+                StringView head,
+                Http::Request request)
             : resolve(std::move(resolve))
             , reject(std::move(reject))
             , connection(connection)
             , timer(std::move(timer))
-            , buffer(std::move(buf))
+            , head(head)
+            , request(std::move(request))
+            , bytesWritten(0)
         {
         }
 
+        size_t size() const {
+            return head.size() + request.body().size();
+        }
+
         Async::Resolver resolve;
         Async::Rejection reject;
         std::weak_ptr<Connection> connection;
         std::shared_ptr<TimerPool::Entry> timer;
-        std::string buffer;
+        StringView head;
+        Http::Request request;
+        size_t bytesWritten;
+    };
+
+
+    struct TimerEntry {
+        TimerEntry(std::chrono::steady_clock::time_point deadline, std::function<void()> callback)
+            : deadline(deadline)
+            , sequence(0)
+            , callback(std::move(callback))
+        { }
+
+        std::chrono::steady_clock::time_point deadline;
+        // Keeps the timers of a same deadline in the order they were armed
+        uint64_t sequence;
+        std::function<void()> callback;
     };
 
+    // Orders the heap of timers with the earliest deadline on top
+    struct Later {
+        bool operator()(const TimerEntry& lhs, const TimerEntry& rhs) const {
+            if (lhs.deadline != rhs.deadline)
+                return lhs.deadline > rhs.deadline;
+            return lhs.sequence > rhs.sequence;
+        }
+    };
 
     PollableQueue<RequestEntry> requestsQueue;
     PollableQueue<ConnectionEntry> connectionsQueue;
+    PollableQueue<TimerEntry> timersQueue;
 
     std::unordered_map<Fd, ConnectionEntry> connections;
     std::unordered_map<Fd, std::shared_ptr<Connection>> timeouts;
+    std::unordered_map<Fd, RequestEntry> pendingRequests;
+    // A single timerfd, set to the earliest deadline of the heap
+    Fd timerFd;
+    uint64_t timerSequence;
+    std::vector<TimerEntry> timers;
+    // Number of suspensions of the connections that are not read. Resuming
+    // through an expired count does nothing, the fd was closed since
+    std::unordered_map<Fd, std::shared_ptr<size_t>> suspended;
 
-    void asyncSendRequestImpl(const RequestEntry& req, WriteStatus status = FirstTry);
+    void asyncSendRequestImpl(RequestEntry& req, WriteStatus status = FirstTry);
 
     void handleRequestsQueue();
     void handleConnectionQueue();
+    void handleTimersQueue();
+    void handleTimer();
+    void armTimerFd();
+    void handleWritable(Fd fd);
     void handleIncoming(std::shared_ptr<Connection> connection);
-    void handleResponsePacket(const std::shared_ptr<Connection>& connection, const char* buffer, size_t totalBytes);
+    bool handleResponsePacket(const std::shared_ptr<Connection>& connection, const char* buffer, size_t totalBytes);
     void handleTimeout(const std::shared_ptr<Connection>& connection);
 
 };
@@ -265,8 +410,215 @@ namespace Default {
     constexpr int Threads = 1;
     constexpr int MaxConnectionsPerHost = 8;
     constexpr bool KeepAlive = true;
+    constexpr size_t RetryBudgetCapacity = 10;
+    constexpr double RetryBudgetRefill = 1.0;
+    constexpr size_t MaxConsecutiveFailures = 5;
+    constexpr std::chrono::milliseconds EjectionTime(30000);
+    constexpr std::chrono::milliseconds ServiceRefresh(30000);
 }
 
+/* Keeps track of the latency of the last responses received from a host, so
+ * that a request can be hedged once it has been outstanding for longer than
+ * a given percentile.
+ */
+class LatencyTracker {
+public:
+    static constexpr size_t DefaultCapacity = 128;
+    static constexpr size_t MinSamples = 16;
+
+    explicit LatencyTracker(size_t capacity = DefaultCapacity);
+
+    void record(std::chrono::microseconds latency);
+    size_t samples() const;
+
+    // Empty until at least MinSamples latencies have been recorded
+    Optional<std::chrono::microseconds> percentile(double p) const;
+
+private:
+    using Lock = std::mutex;
+    using Guard = std::lock_guard<Lock>;
+
+    mutable Lock lock_;
+    size_t capacity_;
+    std::vector<std::chrono::microseconds> samples_;
+    size_t next_;
+};
+
+/* A token bucket limiting the number of extra requests (hedges and retries)
+ * sent to a host, so that a struggling backend is not overloaded by them.
+ */
+class RetryBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RetryBudget(size_t capacity, double refillPerSecond);
+
+    bool tryAcquire(Clock::time_point now = Clock::now());
+    size_t available(Clock::time_point now = Clock::now()) const;
+
+private:
+    using Lock = std::mutex;
+    using Guard = std::lock_guard<Lock>;
+
+    void refill(Clock::time_point now) const;
+
+    mutable Lock lock_;
+    double capacity_;
+    double refillPerSecond_;
+    mutable double tokens_;
+    mutable Clock::time_point lastRefill_;
+};
+
+/* One of the addresses ("host:port") a service can be reached at. The
+ * statistics are maintained by the BackendSet the backend belongs to.
+ */
+struct Backend {
+    explicit Backend(std::string address)
+        : address(std::move(address))
+        , inFlight(0)
+        , latencyEwma(0.0)
+        , failures(0)
+        , ejectedUntil()
+    { }
+
+    const std::string address;
+
+    size_t inFlight;
+    double latencyEwma;
+    size_t failures;
+    std::chrono::steady_clock::time_point ejectedUntil;
+};
+
+/* A logical service made of several backends. Requests are balanced with
+ * the "power of two choices": two backends are drawn at random and the
+ * one with the lowest load, weighted by its latency, is picked. A backend
+ * that failed too many times in a row is ejected for a while.
+ */
+class BackendSet {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double EwmaWeight = 0.3;
+
+    explicit BackendSet(
+            const std::vector<std::string>& addresses,
+            size_t maxFailures = Default::MaxConsecutiveFailures,
+            std::chrono::milliseconds ejectionTime = Default::EjectionTime);
+
+    // When every backend is ejected, one is picked anyway
+    std::shared_ptr<Backend> pick(Clock::time_point now = Clock::now());
+
+    void release(
+            const std::shared_ptr<Backend>& backend,
+            bool success,
+            std::chrono::microseconds latency,
+            Clock::time_point now = Clock::now());
+
+    // Backends still listed keep their statistics, an empty list is ignored
+    void update(const std::vector<std::string>& addresses);
+
+    size_t size() const;
+    size_t available(Clock::time_point now = Clock::now()) const;
+
+private:
+    using Lock = std::mutex;
+    using Guard = std::lock_guard<Lock>;
+
+    static double score(const Backend& backend);
+
+    mutable Lock lock_;
+    std::vector<std::shared_ptr<Backend>> backends_;
+    size_t maxFailures_;
+    std::chrono::milliseconds ejectionTime_;
+    std::minstd_rand random_;
+};
+
+/* An in-memory cache of the responses to GET requests, honouring the
+ * Cache-Control directives and the entity tag sent by the server. It is
+ * split in shards, each with its own lock and LRU list, and is bounded by
+ * the total size of the cached responses.
+ *
+ * The cache is shared by all the callers of a client: private responses
+ * and those varying on every request (Vary: *) are not stored. The request
+ * headers listed by the Vary header of the last response to a resource
+ * are part of the key.
+ */
+class ResponseCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t DefaultShards = 16;
+    // Rough accounting of what an entry costs besides its body
+    static constexpr size_t EntryOverhead = 256;
+
+    enum class Lookup {
+        Miss,
+        Fresh,
+        // Expired, must be revalidated with the returned entity tag
+        Stale
+    };
+
+    explicit ResponseCache(size_t maxBytes, size_t shards = DefaultShards);
+
+    std::string keyFor(const std::string& resource, const Header::Collection& headers) const;
+
+    Lookup lookup(
+            const std::string& key, Response& response, std::string& etag,
+            Clock::time_point now = Clock::now());
+
+    // Does nothing if the response must not be cached. The headers are those
+    // of the request the response answers.
+    void store(
+            const std::string& resource, const Header::Collection& headers,
+            const Response& response, Clock::time_point now = Clock::now());
+
+    // Gives a new lifetime to a stale entry after a 304 Not Modified
+    void refresh(const std::string& key, const Response& notModified, Clock::time_point now = Clock::now());
+
+    void erase(const std::string& key);
+
+    size_t bytes() const;
+    size_t entries() const;
+
+private:
+    using Lock = std::mutex;
+    using Guard = std::lock_guard<Lock>;
+
+    struct Entry {
+        Response response;
+        std::string etag;
+        size_t size;
+        Clock::time_point expires;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+        Shard()
+            : lock()
+            , lru()
+            , entries()
+            , bytes(0)
+        { }
+
+        mutable Lock lock;
+        std::list<std::string> lru;
+        std::unordered_map<std::string, Entry> entries;
+        size_t bytes;
+    };
+
+    Shard& shardFor(const std::string& key) const;
+    void eraseLocked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+
+    void storeAt(const std::string& key, const Response& response, Clock::time_point now);
+
+    size_t maxBytesPerShard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    // Lowercase names of the request headers each resource varies on
+    mutable Lock varyLock_;
+    std::unordered_map<std::string, std::vector<std::string>> vary_;
+};
+
 class Client;
 
 class RequestBuilder {
@@ -277,6 +629,7 @@ public:
     RequestBuilder& resource(const std::string& val);
     RequestBuilder& params(const Uri::Query& query);
     RequestBuilder& header(const std::shared_ptr<Header::Header>& header);
+    RequestBuilder& header(const Header::Raw& header);
 
     template<typename H, typename... Args>
     typename
@@ -290,8 +643,23 @@ public:
     RequestBuilder& cookie(const Cookie& cookie);
     RequestBuilder& body(const std::string& val);
     RequestBuilder& body(std::string&& val);
+    // A body owned elsewhere, e.g. the one of a request being forwarded,
+    // which is kept alive and sent without being copied
+    RequestBuilder& body(std::shared_ptr<const std::string> val);
 
     RequestBuilder& timeout(std::chrono::milliseconds val);
+    // Number of times an idempotent request is sent again when it fails, as
+    // long as the retry budget of the host allows it
+    RequestBuilder& retries(int val);
+
+    // Streams the response to the callback as it arrives instead of
+    // buffering its body, at the pace of the promises it returns. Streamed
+    // requests are neither cached, hedged nor retried
+    RequestBuilder& stream(Connection::OnData onData);
+
+    // The response is rejected with Async::Cancelled as soon as the token is
+    // cancelled, and the request is neither retried nor hedged anymore
+    RequestBuilder& cancellation(Async::CancellationToken token);
 
     Async::Promise<Response> send();
 
@@ -300,12 +668,18 @@ private:
         : client_(client)
         , request_()
         , timeout_(std::chrono::milliseconds(0))
+        , retries_(0)
+        , onData_()
+        , cancellation_()
     { }
 
     Client* const client_;
 
     Request request_;
     std::chrono::milliseconds timeout_;
+    int retries_;
+    Connection::OnData onData_;
+    Async::CancellationToken cancellation_;
 };
 
 
@@ -321,16 +695,48 @@ public:
            : threads_(Default::Threads)
            , maxConnectionsPerHost_(Default::MaxConnectionsPerHost)
            , keepAlive_(Default::KeepAlive)
+           , hedgeDelay_(0)
+           , hedgePercentile_(0.0)
+           , retryBudgetCapacity_(Default::RetryBudgetCapacity)
+           , retryBudgetRefill_(Default::RetryBudgetRefill)
+           , maxFailures_(Default::MaxConsecutiveFailures)
+           , ejectionTime_(Default::EjectionTime)
+           , cacheBytes_(0)
        { }
 
        Options& threads(int val);
        Options& keepAlive(bool val);
        Options& maxConnectionsPerHost(int val);
 
+       /* Idempotent requests that did not complete after the hedge delay are
+        * sent a second time, the first response wins and the other one is
+        * dropped. When a percentile is set, the delay is the latency of the
+        * host at that percentile, and the fixed delay is only used until
+        * enough samples are known.
+        */
+       Options& hedgeDelay(std::chrono::milliseconds val);
+       Options& hedgePercentile(double val);
+       Options& retryBudget(size_t capacity, double refillPerSecond);
+
+       // Backends of a service failing that many times in a row are left
+       // aside for the given duration
+       Options& outlierEjection(size_t consecutiveFailures, std::chrono::milliseconds duration);
+
+       // Caches GET responses, up to maxBytes. Concurrent identical GETs
+       // are then coalesced into a single backend request
+       Options& cache(size_t maxBytes);
+
    private:
        int threads_;
        int maxConnectionsPerHost_;
        bool keepAlive_;
+       std::chrono::milliseconds hedgeDelay_;
+       double hedgePercentile_;
+       size_t retryBudgetCapacity_;
+       double retryBudgetRefill_;
+       size_t maxFailures_;
+       std::chrono::milliseconds ejectionTime_;
+       size_t cacheBytes_;
    };
 
    Client();
@@ -345,6 +751,18 @@ public:
    RequestBuilder patch(const std::string& resource);
    RequestBuilder del(const std::string& resource);
 
+   /* Requests whose host is the name of a service are balanced over the
+    * backends of the service, either a static list of "host:port" or all
+    * the addresses the host resolves to. Once the refresh interval elapsed,
+    * the next request has the host resolved again by a thread of the client,
+    * and goes on with the current backends meanwhile. The Host header sent to
+    * a backend is the name of the service.
+    */
+   void registerService(const std::string& name, const std::vector<std::string>& addresses);
+   void registerService(
+           const std::string& name, const std::string& host, Port port,
+           std::chrono::milliseconds refresh = Default::ServiceRefresh);
+
    void shutdown();
 
 private:
@@ -362,11 +780,89 @@ private:
    std::unordered_map<std::string, MPMCQueue<std::shared_ptr<Connection::RequestData>, 2048>> requestsQueues;
    bool stopProcessPequestsQueues;
 
+   struct HostStats {
+       HostStats(size_t budgetCapacity, double budgetRefill)
+           : latency()
+           , budget(budgetCapacity, budgetRefill)
+       { }
+
+       LatencyTracker latency;
+       RetryBudget budget;
+   };
+
+   struct Call;
+
+   std::chrono::microseconds hedgeDelay_;
+   double hedgePercentile_;
+   size_t retryBudgetCapacity_;
+   double retryBudgetRefill_;
+
+   Lock hostsLock;
+   std::unordered_map<std::string, std::shared_ptr<HostStats>> hostStats;
+
+   size_t maxFailures_;
+   std::chrono::milliseconds ejectionTime_;
+
+   struct ResolvedService {
+       std::string host;
+       Port port;
+       std::chrono::milliseconds refresh;
+       std::chrono::steady_clock::time_point nextRefresh;
+   };
+
+   Lock servicesLock;
+   std::unordered_map<std::string, std::shared_ptr<BackendSet>> services;
+   std::unordered_map<std::string, ResolvedService> resolvedServices;
+
+   // Resolves the services due for a refresh, so that a slow name server
+   // never holds up a thread sending requests. Guarded by servicesLock
+   std::thread resolverThread;
+   std::condition_variable resolverCv;
+   std::deque<std::string> pendingResolutions;
+   bool stopResolver;
+
+   struct Waiter;
+
+   std::shared_ptr<ResponseCache> cache_;
+   Lock inflightLock;
+   std::unordered_map<std::string, std::vector<std::shared_ptr<Waiter>>> inflight;
+
    RequestBuilder prepareRequest(const std::string& resource, Http::Method method);
 
    Async::Promise<Response> doRequest(
            Http::Request request,
-           std::chrono::milliseconds timeout);
+           std::chrono::milliseconds timeout,
+           int retries = 0,
+           Async::CancellationToken cancellation = Async::CancellationToken());
+
+   Async::Promise<Response> doRequestImpl(
+           Http::Request request,
+           std::chrono::milliseconds timeout,
+           int retries,
+           Async::CancellationToken cancellation = Async::CancellationToken());
+
+   Async::Promise<Response> doCachedRequest(
+           Http::Request request,
+           std::chrono::milliseconds timeout,
+           int retries);
+
+   Async::Promise<Response> sendRequest(
+           Http::Request request,
+           std::chrono::milliseconds timeout,
+           Connection::OnData onData = nullptr);
+
+   Async::Promise<Response> sendToBackend(
+           Http::Request request,
+           std::chrono::milliseconds timeout,
+           std::shared_ptr<BackendSet> service,
+           Connection::OnData onData);
+
+   static std::vector<std::string> resolveService(const std::string& host, Port port);
+   void runResolver();
+   std::shared_ptr<BackendSet> serviceFor(const std::string& name);
+   std::shared_ptr<HostStats> statsFor(const std::string& host);
+   Optional<std::chrono::microseconds> hedgeDelayFor(const HostStats& stats) const;
+   void launch(const std::shared_ptr<Call>& call);
 
    void processRequestQueue();
 
@@ -66,5 +66,11 @@ namespace Const {
     // Defined from CMakeLists.txt in project root
     static constexpr size_t DefaultMaxPayload = 4096;
     static constexpr size_t ChunkSize  = 1024;
+
+    static constexpr size_t DefaultWriteLowWatermark  = 64 * 1024;
+    static constexpr size_t DefaultWriteHighWatermark = 1024 * 1024;
+
+    static constexpr size_t DefaultReadBudgetBytes    = 64 * 1024;
+    static constexpr size_t DefaultReadBudgetRequests = 16;
 } // namespace Const
 } // namespace Pistache
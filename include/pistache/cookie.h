@@ -6,12 +6,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <mutex>
+#include <streambuf>
 #include <string>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
+#include <vector>
 
 #include <pistache/optional.h>
 #include <pistache/http_defs.h>
@@ -20,8 +25,6 @@ namespace Pistache {
 namespace Http {
 
 struct Cookie {
-    friend std::ostream& operator<<(std::ostream& os, const Cookie& cookie);
-
     Cookie(std::string name, std::string value);
 
     std::string name;
@@ -40,98 +43,81 @@ struct Cookie {
     static Cookie fromRaw(const char* str, size_t len);
     static Cookie fromString(const std::string& str);
 
-private:
-    void write(std::ostream& os) const;
+    /* Serializes the cookie straight into the buffer, as the value of a
+     * Set-Cookie header. Returns false if the buffer refused the bytes.
+     */
+    bool write(std::streambuf& buf) const;
 };
 
 std::ostream& operator<<(std::ostream& os, const Cookie& cookie);
 
+/* Cookies are kept in a flat vector, in the order they were added. A raw
+ * Cookie header is only split into name/value slices when it is added: the
+ * Cookie objects, and the attributes of Set-Cookie headers, are built the
+ * first time the jar is looked at, so that requests whose handler never
+ * reads its cookies do not pay for them. That first look may come from
+ * several threads sharing a const request at once, so it is serialized.
+ */
 class CookieJar {
 public:
-    using HashMapCookies = std::unordered_map<std::string, Cookie>; // "value" -> Cookie  
-    using Storage = std::unordered_map<std::string, HashMapCookies>; // "name" -> Hashmap("value" -> Cookie)
-
-    struct iterator : std::iterator<std::bidirectional_iterator_tag, Cookie> {
-        iterator(const Storage::const_iterator& _iterator)
-            : iter_storage(_iterator)
-            , iter_cookie_values()
-            , iter_storage_end()
-        { }
-
-        iterator(const Storage::const_iterator& _iterator, const Storage::const_iterator& end)
-            : iter_storage(_iterator)
-            , iter_cookie_values()
-            , iter_storage_end(end)
-        {
-            if(iter_storage != iter_storage_end) {
-                iter_cookie_values = iter_storage->second.begin();
-            }
-        }
-
-        Cookie operator*() const {
-            return iter_cookie_values->second; // return iter_storage->second;
-        }
-
-        const Cookie* operator->() const {
-            return &(iter_cookie_values->second);
-        }
-
-        iterator& operator++() {
-            ++iter_cookie_values;
-            if(iter_cookie_values == iter_storage->second.end()) {
-                ++iter_storage;
-                if(iter_storage != iter_storage_end)
-                    iter_cookie_values = iter_storage->second.begin();
-            }
-            return *this;
-        }
-
-        iterator operator++(int) {
-            iterator ret(iter_storage,iter_storage_end);
-            ++iter_cookie_values;
-            if(iter_cookie_values == iter_storage->second.end()) {
-                ++iter_storage;
-                if(iter_storage != iter_storage_end)   // this check is important
-                    iter_cookie_values = iter_storage->second.begin();
-            }
-
-            return ret;
-        }
-
-        bool operator !=(iterator other) const {
-            return iter_storage != other.iter_storage;
-        }
-
-        bool operator==(iterator other) const {
-            return iter_storage == other.iter_storage;
-        }
-
-    private:
-        Storage::const_iterator iter_storage;
-        HashMapCookies::const_iterator iter_cookie_values;
-        Storage::const_iterator iter_storage_end; // we need to know where main hashmap ends. 
-    };
+    typedef std::vector<Cookie>::const_iterator iterator;
 
     CookieJar();
+    CookieJar(const CookieJar& other);
+    CookieJar(CookieJar&& other);
+    CookieJar& operator=(const CookieJar& other);
+    CookieJar& operator=(CookieJar&& other);
 
     void add(const Cookie& cookie);
     void removeAllCookies();
 
+    // Adds the cookies of a Cookie header to the ones already in the jar
     void addFromRaw(const char *str, size_t len);
+
+    // Adds the cookie of a Set-Cookie header, whose attributes are parsed lazily
+    void addSetCookieRaw(const char *str, size_t len);
+
     Cookie get(const std::string& name) const;
 
     bool has(const std::string& name) const;
+    size_t size() const;
 
     iterator begin() const {
-        return iterator(cookies.begin(), cookies.end());
+        materialize();
+        return cookies.begin();
     }
 
     iterator end() const {
-        return iterator(cookies.end());
+        materialize();
+        return cookies.end();
     }
 
 private:
-    Storage cookies;
+    // A cookie that is still in raw form, as offsets into raw
+    struct Slice {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t nameLength;
+        uint32_t valueOffset;
+        uint32_t valueLength;
+        // Set-Cookie header, with attributes after the value
+        bool hasAttributes;
+    };
+
+    void appendRaw(const char* str, size_t len, bool setCookie);
+
+    void append(Cookie cookie) const;
+    void materialize() const;
+
+    mutable std::vector<Cookie> cookies;
+    // "name=value" of the cookies, which are not repeated
+    mutable std::unordered_set<std::string> keys;
+    mutable std::string raw;
+    mutable std::vector<Slice> slices;
+
+    // Set while slices are waiting to be materialized
+    mutable std::atomic<bool> pending;
+    mutable std::mutex materializeLock;
 };
 
 } // namespace Net
@@ -22,12 +22,33 @@ public:
         Options& flags(Flags<Tcp::Options> flags);
         Options& backlog(int val);
         Options& maxPayload(size_t val);
+        Options& connectionLimiter(std::shared_ptr<RateLimiter> limiter);
+
+        // Bytes queued for a peer past which it is no longer writable, and
+        // below which it becomes writable again
+        Options& writeWatermarks(size_t low, size_t high);
+
+        // Peers that stay above the high watermark for that long are
+        // disconnected
+        template<typename Duration>
+        Options& slowPeerTimeout(Duration timeout) {
+            writeLimits_.stallTimeout =
+                std::chrono::duration_cast<std::chrono::milliseconds>(timeout);
+            return *this;
+        }
+
+        // What a peer may read before the other ready peers get their turn,
+        // zero means no limit
+        Options& readBudget(size_t bytes, size_t requests);
 
     private:
         int threads_;
         Flags<Tcp::Options> flags_;
         int backlog_;
         size_t maxPayload_;
+        std::shared_ptr<RateLimiter> connectionLimiter_;
+        Tcp::WriteLimits writeLimits_;
+        Tcp::ReadBudget readBudget_;
         Options();
     };
     Endpoint();
@@ -24,6 +24,7 @@
 #include <pistache/stream.h>
 #include <pistache/mime.h>
 #include <pistache/async.h>
+#include <pistache/cancellation.h>
 #include <pistache/peer.h>
 #include <pistache/tcp.h>
 #include <pistache/transport.h>
@@ -73,6 +74,11 @@ public:
     friend class Private::BodyStep;
     friend class Private::ParserBase;
 
+    /* Spare capacity reserved after a body received with a Content-Length,
+     * so that a parser reading it by blocks can run past its end in place
+     */
+    static constexpr size_t BodyPadding = 64;
+
     Message();
 
     Message(const Message& other) = default;
@@ -105,8 +111,17 @@ namespace Uri {
         // Return empty string or "?key1=value1&key2=value2" if query exist
         std::string as_str() const;
 
+        /* The query as received, without the '?', for the queries parsed from
+         * a request. Unlike the parameters, it keeps the repeated keys, their
+         * order and the keys without a value. Emptied once a parameter is added
+         */
+        const std::string& raw() const {
+            return raw_;
+        }
+
         void clear() {
             params.clear();
+            raw_.clear();
         }
 
         // \brief Return iterator to the beginning of the parameters map
@@ -133,6 +148,9 @@ namespace Uri {
     private:
         //first is key second is value
         std::unordered_map<std::string, std::string> params;
+
+        friend class Private::RequestLineStep;
+        std::string raw_;
     };
 } // namespace Uri
 
@@ -146,6 +164,7 @@ public:
     friend class RequestBuilder;
     // @Todo: try to remove the need for friend-ness here
     friend class Client;
+    friend class Handler;
 
     Request();
 
@@ -159,13 +178,21 @@ public:
     Method method() const;
     std::string resource() const;
 
-    std::string body() const;
+    const std::string& body() const;
 
     const Header::Collection& headers() const;
     const Uri::Query& query() const;
 
     const CookieJar& cookies() const;
 
+    // Address of the peer the request was received from
+    const Address& address() const;
+
+    /* Cancelled when the peer disconnects or the response times out, so
+     * that the work done for the request can be abandoned
+     */
+    const Async::CancellationToken& cancellation() const;
+
     /* @Investigate: this is disabled because of a lock in the shared_ptr / weak_ptr
         implementation of libstdc++. Under contention, we experience a performance
         drop of 5x with that lock
@@ -191,6 +218,12 @@ private:
     Method method_;
     std::string resource_;
     Uri::Query query_;
+    Address address_;
+    Async::CancellationToken cancellation_;
+
+    // Set by the client, which keeps every body there so that the copies of
+    // a request, one per attempt, share it. It takes the place of body_
+    std::shared_ptr<const std::string> sharedBody_;
 
 #ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
     std::weak_ptr<Tcp::Peer> peer_;
@@ -199,11 +232,13 @@ private:
 
 class Handler;
 class ResponseWriter;
+class ResponseStream;
 
 class Timeout {
 public:
 
     friend class ResponseWriter;
+    friend class ResponseStream;
 
     Timeout(Timeout&& other)
         : handler(other.handler)
@@ -269,7 +304,7 @@ private:
 
     Timeout(Tcp::Transport* transport_,
             Handler* handler_,
-            Request request_)
+            std::shared_ptr<const Request> request_)
         : handler(handler_)
         , request(std::move(request_))
         , transport(transport_)
@@ -286,7 +321,7 @@ private:
     void onTimeout(uint64_t numWakeup);
 
     Handler* handler;
-    Request request;
+    std::shared_ptr<const Request> request;
     Tcp::Transport* transport;
     bool armed;
     Fd timerFd;
@@ -303,6 +338,8 @@ public:
         , buf_(std::move(other.buf_))
         , transport_(other.transport_)
         , timeout_(std::move(other.timeout_))
+        , cancellation_(other.cancellation_)
+        , chunked_(other.chunked_)
     { }
 
     ResponseStream& operator=(ResponseStream&& other) {
@@ -311,6 +348,8 @@ public:
         buf_ = std::move(other.buf_);
         transport_ = other.transport_;
         timeout_ = std::move(other.timeout_);
+        cancellation_ = other.cancellation_;
+        chunked_ = other.chunked_;
 
         return *this;
     }
@@ -321,6 +360,10 @@ public:
 
     std::streamsize write(const char * data, std::streamsize sz) {
         std::ostream os(&buf_);
+        if (!chunked_) {
+            os.write(data, sz);
+            return sz;
+        }
         os << std::hex << sz << crlf;
         os.write(data, sz);
         os << crlf;
@@ -339,7 +382,12 @@ public:
         return code_;
     }
 
-    void flush();
+    const Async::CancellationToken& cancellation() const {
+        return cancellation_;
+    }
+
+    // Resolves once the peer can take more data, see Tcp::WriteLimits
+    Async::Promise<void> flush();
     void ends();
 
 private:
@@ -348,6 +396,7 @@ private:
             std::weak_ptr<Tcp::Peer> peer,
             Tcp::Transport* transport,
             Timeout timeout,
+            Async::CancellationToken cancellation,
             size_t streamSize);
 
     std::shared_ptr<Tcp::Peer> peer() const {
@@ -361,6 +410,10 @@ private:
     DynamicStreamBuf buf_;
     Tcp::Transport* transport_;
     Timeout timeout_;
+    // Kept apart from the timeout, which gives up its request when moved
+    Async::CancellationToken cancellation_;
+    // False when the length of the body was set upfront
+    bool chunked_;
 };
 
 inline ResponseStream& ends(ResponseStream &stream) {
@@ -378,6 +431,10 @@ ResponseStream& operator<<(ResponseStream& stream, const T& val) {
     Size<T> size;
 
     std::ostream os(&stream.buf_);
+    if (!stream.chunked_) {
+        os << val;
+        return stream;
+    }
     os << std::hex << size(val) << crlf;
     os << val << crlf;
 
@@ -463,6 +520,8 @@ public:
         , buf_(std::move(other.buf_))
         , transport_(other.transport_)
         , timeout_(std::move(other.timeout_))
+        , wireObserver_(std::move(other.wireObserver_))
+        , cancellation_(other.cancellation_)
     { }
     ResponseWriter& operator=(ResponseWriter&& other) {
         Response::operator=(std::move(other));
@@ -470,6 +529,8 @@ public:
         transport_ = other.transport_;
         buf_ = std::move(other.buf_);
         timeout_ = std::move(other.timeout_);
+        wireObserver_ = std::move(other.wireObserver_);
+        cancellation_ = other.cancellation_;
         return *this;
     }
 
@@ -529,11 +590,32 @@ public:
         return putOnWire(arr, N - 1);
     }
 
+    /* Writes the body straight to the buffer of the response, after the head,
+     * instead of building it in a string first. The Content-Length is filled
+     * in once the writer returns.
+     */
+    using BodyWriter = std::function<void(std::streambuf&)>;
+
+    Async::Promise<ssize_t> send(
+            Code code,
+            const BodyWriter& body,
+            const Mime::MediaType& mime = Mime::MediaType());
+
+    /* The body is sent in chunks, unless a Content-Length header was set
+     * beforehand: it is then sent as is and must be of that length
+     */
     ResponseStream stream(Code code, size_t streamSize = DefaultStreamSize) {
         code_ = code;
 
         return ResponseStream(
-                std::move(*this), peer_, transport_, std::move(timeout_), streamSize);
+                std::move(*this), peer_, transport_, std::move(timeout_), cancellation_, streamSize);
+    }
+
+    /* Makes room upfront for a response of about size bytes, head included,
+     * so that its buffer is only allocated once
+     */
+    void sizeHint(size_t size) {
+        buf_.reserve(size);
     }
 
     template<typename Duration>
@@ -552,6 +634,22 @@ public:
         return peer_.lock();
     }
 
+    /* The observer sees the serialized response (status line, headers and
+     * body) right before it is handed to the transport, e.g. to cache it.
+     */
+    using WireObserver = std::function<void(const Response&, const char*, size_t)>;
+
+    void observeWire(WireObserver observer) {
+        wireObserver_ = std::move(observer);
+    }
+
+    /* Writes a response that was serialized beforehand, as is. The parts
+     * (e.g. the head, a few more headers then the blank line and body) go
+     * out in order with a single write
+     */
+    Async::Promise<ssize_t> sendSerialized(
+            Code code, const std::vector<RawBuffer>& parts, ConnectionControl control);
+
     // Unsafe API
 
     DynamicStreamBuf *rdbuf() {
@@ -567,13 +665,26 @@ public:
         return ResponseWriter(*this);
     }
 
+    /* The request this response answers. It is shared by the handler, the
+     * timeout and every clone of the response instead of being copied.
+     */
+    const std::shared_ptr<const Request>& request() const {
+        return timeout_.request;
+    }
+
+    const Async::CancellationToken& cancellation() const {
+        return cancellation_;
+    }
+
 private:
-    ResponseWriter(Tcp::Transport* transport, Request request, Handler* handler)
-        : Response(request.version())
+    ResponseWriter(Tcp::Transport* transport, std::shared_ptr<const Request> request, Handler* handler)
+        : Response(request->version())
         , peer_()
         , buf_(DefaultStreamSize)
         , transport_(transport)
-        , timeout_(transport, handler, std::move(request))
+        , timeout_(transport, handler, request)
+        , wireObserver_()
+        , cancellation_(request->cancellation())
     { }
 
     ResponseWriter(const ResponseWriter& other)
@@ -582,6 +693,8 @@ private:
         , buf_(DefaultStreamSize)
         , transport_(other.transport_)
         , timeout_(other.timeout_)
+        , wireObserver_(other.wireObserver_)
+        , cancellation_(other.cancellation_)
     { }
 
     template<typename Ptr>
@@ -594,11 +707,18 @@ private:
     }
 
     Async::Promise<ssize_t> putOnWire(const char* data, size_t len);
+    Async::Promise<ssize_t> putOnWire(const BodyWriter& body);
+    ConnectionControl writeHead();
+    template<typename Buf>
+    Async::Promise<ssize_t> writeOnWire(const Buf& buffer, ConnectionControl control);
 
     std::weak_ptr<Tcp::Peer> peer_;
     DynamicStreamBuf buf_;
     Tcp::Transport *transport_;
     Timeout timeout_;
+    WireObserver wireObserver_;
+    // Copied on moves, so that a moved-from writer still has it
+    Async::CancellationToken cancellation_;
 };
 
 Async::Promise<ssize_t> serveFile(
@@ -709,6 +829,16 @@ namespace Private {
 
         State parse();
 
+        // The status or request line and the headers are known
+        bool headersParsed() const {
+            return currentStep == StepsCount - 1;
+        }
+
+        // Nothing of the next message was received yet
+        bool idle() const {
+            return currentStep == 0 && buffer.empty();
+        }
+
         ArrayStreamBuf<char> buffer;
         StreamCursor cursor;
 
@@ -729,6 +859,7 @@ namespace Private {
         Parser()
             : ParserBase()
             , request()
+            , headChecked(false)
         {
             allSteps[0].reset(new RequestLineStep(&request));
             allSteps[1].reset(new HeadersStep(&request));
@@ -738,6 +869,7 @@ namespace Private {
         Parser(const char* data, size_t len)
             : ParserBase()
             , request()
+            , headChecked(false)
         {
             allSteps[0].reset(new RequestLineStep(&request));
             allSteps[1].reset(new HeadersStep(&request));
@@ -749,13 +881,16 @@ namespace Private {
         void reset() {
             ParserBase::reset();
 
-            request.headers_.clear();
-            request.body_.clear();
-            request.resource_.clear();
-            request.query_.clear();
+            // The request may have been moved out to be handled
+            request = Request();
+
+            headChecked = false;
         }
 
         Request request;
+
+        // The head of the current request went through Handler::onHeaders
+        bool headChecked;
     };
 
     template<> class Parser<Http::Response> : public ParserBase {
@@ -780,6 +915,18 @@ namespace Private {
             feed(data, len);
         }
 
+        // Part of the body parsed so far, when the body is consumed as it
+        // arrives
+        const std::string& partialBody() const {
+            return response.body_;
+        }
+
+        // Must not be called while parse() is running
+        void consumeBody() {
+            response.body_.clear();
+            buffer.compact();
+        }
+
         Response response;
     };
 
@@ -789,17 +936,25 @@ class Handler : public Tcp::Handler {
 public:
     void onInput(const char* buffer, size_t len, const std::shared_ptr<Tcp::Peer>& peer);
 
-    void onConnection(const std::shared_ptr<Tcp::Peer>& peer);
     void onDisconnection(const std::shared_ptr<Tcp::Peer>& peer);
 
     virtual void onRequest(const Request& request, ResponseWriter response) = 0;
 
+    /* Called once the head of a request carrying a body is received, before
+     * the body itself is read. Throwing an HttpError rejects the request right
+     * away and closes the connection, otherwise the client is told to go on
+     * with a 100 Continue if it asked for one.
+     */
+    virtual void onHeaders(const Request& request);
+
     virtual void onTimeout(const Request& request, ResponseWriter response);
 
     virtual ~Handler() { }
 
 private:
     Private::Parser<Http::Request>& getParser(const std::shared_ptr<Tcp::Peer>& peer) const;
+    void releaseParser(const std::shared_ptr<Tcp::Peer>& peer) const;
+    void checkHead(const Request& request, const std::shared_ptr<Tcp::Peer>& peer, bool bodyPending);
 };
 
 template<typename H, typename... Args>
@@ -197,11 +197,23 @@ public:
         : date_(date)
     { }
 
+    // Length of a date written in the RFC 1123 format
+    static constexpr size_t RFC1123Length = 29;
+
     time_point date() const { return date_; }
     void write(std::ostream& os, Type type = Type::RFC1123) const;
 
+    // Writes the RFC 1123 form of the date, without any allocation
+    void format(char (&out)[RFC1123Length]) const;
+
     static FullDate fromString(const std::string& str);
 
+    /* The current date in the RFC 1123 format, for the Date header of the
+     * responses. It is computed at most once per second on each thread and
+     * stays valid until the next call from the same thread.
+     */
+    static const char* now();
+
 private:
     time_point date_;
 };
@@ -210,6 +222,15 @@ const char* methodString(Method method);
 const char* versionString(Version version);
 const char* codeString(Code code);
 
+// Allocation-free parsing of the tokens of a request line
+bool parseMethod(const char* str, size_t len, Method& method);
+bool parseVersion(const char* str, size_t len, Version& version);
+
+/* The whole status line of a response, CRLF included, for a code that is one
+ * of STATUS_CODES. Returns nullptr for any other code.
+ */
+const char* statusLine(Version version, Code code, size_t& length);
+
 std::ostream& operator<<(std::ostream& os, Version version);
 std::ostream& operator<<(std::ostream& os, Method method);
 std::ostream& operator<<(std::ostream& os, Code code);
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <type_traits>
 #include <memory>
@@ -148,21 +151,41 @@ private:
     std::vector<Http::Method> methods_;
 };
 
+/* Only the list is checked when the header is parsed: the media ranges are
+ * built the first time they are asked for, so that the requests whose Accept
+ * header is never looked at, or whose choice is already known from the raw
+ * value, do not pay for them. That first look may come from several threads
+ * sharing a const request at once, so it is serialized.
+ */
 class Accept : public Header {
 public:
     NAME("Accept")
 
     Accept()
         : mediaRange_()
+        , raw_()
+        , pending_(false)
+        , parseLock_()
     { }
 
     void parseRaw(const char *str, size_t len) override;
     void write(std::ostream& os) const override;
 
-    const std::vector<Mime::MediaType> media() const { return mediaRange_; }
+    // Throws if one of the media ranges is ill-formed
+    const std::vector<Mime::MediaType>& media() const;
+
+    // The value the media ranges are parsed from
+    const std::string& raw() const { return raw_; }
 
 private:
-    std::vector<Mime::MediaType> mediaRange_;
+    void parseMedia() const;
+
+    mutable std::vector<Mime::MediaType> mediaRange_;
+    std::string raw_;
+
+    // Set while the media ranges are waiting to be parsed
+    mutable std::atomic<bool> pending_;
+    mutable std::mutex parseLock_;
 };
 
 class AccessControlAllowOrigin : public Header {
@@ -308,10 +331,12 @@ public:
 
     Connection()
         : control_(ConnectionControl::KeepAlive)
+        , options_()
     { }
 
     explicit Connection(ConnectionControl control)
         : control_(control)
+        , options_()
     { }
 
     void parseRaw(const char* str, size_t len) override;
@@ -319,8 +344,13 @@ public:
 
     ConnectionControl control() const { return control_; }
 
+    // The tokens of the header other than close and keep-alive, e.g. the
+    // names of headers that only apply to the current connection
+    const std::vector<std::string>& options() const { return options_; }
+
 private:
     ConnectionControl control_;
+    std::vector<std::string> options_;
 };
 
 class EncodingHeader : public Header {
@@ -503,6 +533,79 @@ private:
     std::string location_;
 };
 
+class ETag : public Header {
+public:
+    NAME("ETag")
+
+    ETag()
+        : tag_()
+    { }
+
+    // The tag is kept as sent on the wire, quotes and weak prefix included
+    explicit ETag(std::string tag)
+        : tag_(std::move(tag))
+    { }
+
+    void parse(const std::string& data) override;
+    void write(std::ostream& os) const override;
+
+    std::string tag() const { return tag_; }
+    bool isWeak() const;
+
+private:
+    std::string tag_;
+};
+
+class IfNoneMatch : public Header {
+public:
+    NAME("If-None-Match")
+
+    IfNoneMatch()
+        : tags_()
+    { }
+
+    explicit IfNoneMatch(const std::string& tag)
+        : tags_({ tag })
+    { }
+
+    explicit IfNoneMatch(const std::vector<std::string>& tags)
+        : tags_(tags)
+    { }
+
+    void parse(const std::string& data) override;
+    void write(std::ostream& os) const override;
+
+    std::vector<std::string> tags() const { return tags_; }
+
+    // Weak comparison (RFC 7232 2.3.2), "*" matches any tag
+    bool matches(const std::string& tag) const;
+
+private:
+    std::vector<std::string> tags_;
+};
+
+class RetryAfter : public Header {
+public:
+    NAME("Retry-After")
+
+    RetryAfter()
+        : delay_(0)
+    { }
+
+    explicit RetryAfter(std::chrono::seconds delay)
+        : delay_(delay)
+    { }
+
+    // Only the delay-seconds form is understood, an HTTP-date yields 0
+    void parse(const std::string& data) override;
+    void write(std::ostream& os) const override;
+
+    std::chrono::seconds delay() const { return delay_; }
+
+private:
+    std::chrono::seconds delay_;
+};
+
 class Server : public Header {
 public:
     NAME("Server")
@@ -18,6 +18,8 @@
 #include <pistache/flags.h>
 #include <pistache/async.h>
 #include <pistache/reactor.h>
+#include <pistache/rate_limiter.h>
+#include <pistache/transport.h>
 
 #ifdef PISTACHE_USE_SSL
 #include <openssl/ssl.h>
@@ -53,6 +55,13 @@ public:
             int backlog = Const::MaxBacklog);
     void setHandler(const std::shared_ptr<Handler>& handler);
 
+    // Connections from an address that exceeds its rate are closed right away
+    void setConnectionLimiter(const std::shared_ptr<RateLimiter>& limiter);
+
+    // Must be called before bind()
+    void setWriteLimits(const WriteLimits& limits);
+    void setReadBudget(const ReadBudget& budget);
+
     void bind();
     void bind(const Address& address);
 
@@ -86,12 +95,15 @@ private:
 
     size_t workers_;
     std::shared_ptr<Handler> handler_;
+    std::shared_ptr<RateLimiter> connectionLimiter_;
+    WriteLimits writeLimits_;
+    ReadBudget readBudget_;
 
     Aio::Reactor reactor_;
     Aio::Reactor::Key transportKey;
 
     void handleNewConnection();
-    int acceptConnection(struct sockaddr_in& peer_addr) const;
+    int acceptConnection(struct sockaddr_storage& peer_addr) const;
     void dispatchPeer(const std::shared_ptr<Peer>& peer);
 
     bool useSSL_;
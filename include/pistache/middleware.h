@@ -0,0 +1,189 @@
+/* middleware.h
+
+   Composition of filters around Rest route handlers
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <pistache/http.h>
+#include <pistache/rate_limiter.h>
+#include <pistache/router.h>
+
+namespace Pistache {
+namespace Rest {
+namespace Middleware {
+
+/* A filter is any copyable callable with the signature
+ *
+ *     Route::Result (const Rest::Request& request,
+ *                    Http::ResponseWriter response,
+ *                    const Next& next) const
+ *
+ * It can short-circuit the chain by answering on the response itself, or
+ * hand the request over to the rest of the chain with
+ * next(request, std::move(response)), possibly after having added headers
+ * to the response or installed a wire observer on it.
+ *
+ * Filters are composed when the route is registered:
+ *
+ *     Routes::Get(router, "/users/:id",
+ *                 Middleware::chain(Auth(keys), Cors("*")).to(getUser));
+ *
+ * The whole chain is a single object whose type is known at compile time,
+ * so calls from a filter to the next one can be inlined. Routes that are
+ * registered without any filter are not affected.
+ */
+
+namespace details {
+
+    template<typename Handler>
+    Route::Result invoke(const Handler& handler, const Rest::Request& request,
+                         Http::ResponseWriter response, std::true_type /* returns void */) {
+        handler(request, std::move(response));
+        return Route::Result::Ok;
+    }
+
+    template<typename Handler>
+    Route::Result invoke(const Handler& handler, const Rest::Request& request,
+                         Http::ResponseWriter response, std::false_type) {
+        return handler(request, std::move(response));
+    }
+
+    template<typename Handler, typename... Filters>
+    class Pipeline;
+
+    template<typename Handler>
+    class Pipeline<Handler> {
+    public:
+        explicit Pipeline(Handler handler)
+            : handler_(std::move(handler))
+        { }
+
+        Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response) const {
+            using ReturnsVoid = std::is_void<
+                decltype(std::declval<const Handler&>()(request, std::move(response)))>;
+            return invoke(handler_, request, std::move(response), ReturnsVoid());
+        }
+
+    private:
+        Handler handler_;
+    };
+
+    template<typename Handler, typename Filter, typename... Others>
+    class Pipeline<Handler, Filter, Others...> {
+    public:
+        Pipeline(Handler handler, Filter filter, Others... others)
+            : filter_(std::move(filter))
+            , next_(std::move(handler), std::move(others)...)
+        { }
+
+        Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response) const {
+            return filter_(request, std::move(response), next_);
+        }
+
+    private:
+        Filter filter_;
+        Pipeline<Handler, Others...> next_;
+    };
+
+} // namespace details
+
+template<typename... Filters>
+class Chain {
+public:
+    explicit Chain(Filters... filters)
+        : filters_(std::move(filters)...)
+    { }
+
+    // Returns a new chain with the filter appended (it runs after the others)
+    template<typename Filter>
+    Chain<Filters..., typename std::decay<Filter>::type> with(Filter&& filter) const {
+        return with(std::forward<Filter>(filter), std::index_sequence_for<Filters...>());
+    }
+
+    // Terminates the chain with the handler of the route
+    template<typename Handler>
+    Route::Handler to(Handler handler) const {
+        return to(std::move(handler), std::index_sequence_for<Filters...>());
+    }
+
+private:
+    template<typename Filter, size_t... Is>
+    Chain<Filters..., typename std::decay<Filter>::type>
+    with(Filter&& filter, std::index_sequence<Is...>) const {
+        return Chain<Filters..., typename std::decay<Filter>::type>(
+                std::get<Is>(filters_)..., std::forward<Filter>(filter));
+    }
+
+    template<typename Handler, size_t... Is>
+    Route::Handler to(Handler handler, std::index_sequence<Is...>) const {
+        return details::Pipeline<Handler, Filters...>(std::move(handler), std::get<Is>(filters_)...);
+    }
+
+    std::tuple<Filters...> filters_;
+};
+
+template<typename... Filters>
+Chain<typename std::decay<Filters>::type...> chain(Filters&&... filters) {
+    return Chain<typename std::decay<Filters>::type...>(std::forward<Filters>(filters)...);
+}
+
+/* Answers 429 Too Many Requests with a Retry-After header, before the
+ * handler runs, to the requests whose key exceeded its rate. Requests are
+ * keyed by client address unless told otherwise.
+ */
+class RateLimit {
+public:
+    using Key = std::function<std::string (const Rest::Request&)>;
+
+    explicit RateLimit(std::shared_ptr<RateLimiter> limiter, Key key = byAddress)
+        : limiter_(std::move(limiter))
+        , key_(std::move(key))
+    { }
+
+    static std::string byAddress(const Rest::Request& request) {
+        return RateLimiter::keyOf(request.address().ip());
+    }
+
+    // Requests without the header are keyed by the fallback instead of all
+    // sharing one bucket. A newline cannot appear in a header value, so the
+    // fallback keys never collide with the header ones.
+    static Key byHeader(std::string name, Key fallback = byAddress) {
+        return [name, fallback](const Rest::Request& request) {
+            auto header = request.headers().tryGetRaw(name);
+            if (header.isEmpty())
+                return '\n' + fallback(request);
+            return header.unsafeGet().value();
+        };
+    }
+
+    template<typename Next>
+    Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response,
+                             const Next& next) const {
+        auto decision = limiter_->acquire(key_(request));
+        if (!decision) {
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                    decision.retryAfter + std::chrono::milliseconds(999));
+            response.headers().add<Http::Header::RetryAfter>(seconds);
+            response.send(Http::Code::Too_Many_Requests, "Too Many Requests");
+            return Route::Result::Ok;
+        }
+
+        return next(request, std::move(response));
+    }
+
+private:
+    std::shared_ptr<RateLimiter> limiter_;
+    Key key_;
+};
+
+} // namespace Middleware
+} // namespace Rest
+} // namespace Pistache
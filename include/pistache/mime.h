@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <ostream>
 #include <string>
 #include <unordered_map>
 #include <stdexcept>
@@ -129,6 +130,7 @@ public:
         , rawSuffixIndex()
         , params()
         , q_()
+        , interned_(nullptr)
     { }
 
     MediaType(std::string raw, Parse parse = DontParse)
@@ -140,6 +142,7 @@ public:
         , rawSuffixIndex()
         , params()
         , q_()
+        , interned_(nullptr)
     {
         if (parse == DoParse) {
             parseRaw(raw.c_str(), raw.length());
@@ -158,6 +161,7 @@ public:
         , rawSuffixIndex()
         , params()
         , q_()
+        , interned_(intern(top, sub, Suffix::None))
     { }
 
     MediaType(Mime::Type top, Mime::Subtype sub, Mime::Suffix suffix)
@@ -169,6 +173,7 @@ public:
         , rawSuffixIndex()
         , params()
         , q_()
+        , interned_(intern(top, sub, suffix))
     { }
 
 
@@ -197,8 +202,16 @@ public:
     void setParam(std::string name, std::string value);
 
     std::string toString() const;
+
+    // Writes the same text as toString(), without building a string when it is known
+    void write(std::ostream& os) const;
+
     bool isValid() const;
 private:
+    /* The text of every type/subtype+suffix made of known values is built
+     * once and shared by all the MediaTypes built from these values.
+     */
+    static const std::string* intern(Mime::Type top, Mime::Subtype sub, Mime::Suffix suffix);
 
     Mime::Type top_;
     Mime::Subtype sub_;
@@ -226,6 +239,8 @@ private:
     std::unordered_map<std::string, std::string> params;
 
     Optional<Q> q_;
+
+    const std::string* interned_;
 };
 
 inline bool operator==(const MediaType& lhs, const MediaType& rhs) {
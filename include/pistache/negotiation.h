@@ -0,0 +1,59 @@
+/* negotiation.h
+
+   Proactive content negotiation (RFC 7231, section 5.3) of the
+   representations a resource produces against the Accept header
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <pistache/http.h>
+#include <pistache/mime.h>
+
+namespace Pistache {
+namespace Http {
+
+/* Picks, among the media types a resource produces, the one that the Accept
+ * header of a request prefers. The most specific media range that matches a
+ * type gives its quality, and types of equal quality are preferred in the
+ * order they are produced. A request without an Accept header gets the first
+ * type.
+ *
+ * Clients only send a handful of distinct Accept headers: each thread
+ * remembers the choices made for the last CacheSize raw values, all the
+ * negotiators together. A known value is answered without parsing its media
+ * ranges, and without any lock.
+ */
+class ContentNegotiator {
+public:
+    static constexpr size_t CacheSize = 64;
+
+    explicit ContentNegotiator(std::vector<Mime::MediaType> produces);
+
+    ContentNegotiator(const ContentNegotiator&) = delete;
+    ContentNegotiator& operator=(const ContentNegotiator&) = delete;
+
+    /* An invalid MediaType if the request accepts none of the produced types.
+     * Throws an HttpError if the Accept header is ill-formed
+     */
+    Mime::MediaType negotiate(const Request& request) const;
+
+    // Index in produces() of the best type for the media ranges, -1 if none fits
+    int select(const std::vector<Mime::MediaType>& ranges) const;
+
+    const std::vector<Mime::MediaType>& produces() const { return produces_; }
+
+private:
+    int cachedSelect(const Header::Accept& accept) const;
+
+    std::vector<Mime::MediaType> produces_;
+
+    // Tells the choices of this negotiator apart in the caches of the threads
+    const uint64_t id_;
+};
+
+} // namespace Http
+} // namespace Pistache
@@ -12,6 +12,7 @@
 #include <limits>
 
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <netdb.h>
 
 #ifndef _KERNEL_FASTOPEN
@@ -123,6 +124,72 @@ private:
     uint16_t h;
 };
 
+/* An IPv4 or IPv6 address, kept as its raw bytes in network order. Parsing
+ * and formatting neither allocate nor go through the locale aware libc
+ * functions, so that they can run for every connection or request.
+ */
+class IpAddress {
+public:
+    friend class Cidr;
+
+    // Longest text of an address, with the terminating NUL
+    static constexpr size_t MaxLength = INET6_ADDRSTRLEN;
+
+    // An unspecified address, formatted as an empty string
+    IpAddress();
+    explicit IpAddress(const in_addr& addr);
+    explicit IpAddress(const in6_addr& addr);
+    IpAddress(Ipv4 ip);
+    IpAddress(Ipv6 ip);
+
+    // Returns false when the data is not an address, leaving out untouched
+    static bool parse(const char* data, size_t size, IpAddress& out);
+    static IpAddress fromString(const std::string& data);
+    static IpAddress fromUnix(const struct sockaddr* addr);
+
+    int family() const { return family_; }
+    const uint8_t* bytes() const { return bytes_; }
+    size_t size() const;
+
+    // Writes the address and a NUL to out, which holds MaxLength chars, and returns its length
+    size_t format(char* out) const;
+    std::string toString() const;
+
+    // An IPv6 address holding an IPv4 one, as ::ffff:a.b.c.d
+    bool isV4Mapped() const;
+
+    bool operator==(const IpAddress& other) const;
+    bool operator!=(const IpAddress& other) const { return !(*this == other); }
+
+private:
+    int family_;
+    uint8_t bytes_[16];
+};
+
+// A block of addresses, as in 10.0.0.0/8 or fe80::/10
+class Cidr {
+public:
+    Cidr();
+    // The bits of the network past the prefix are cleared
+    Cidr(const IpAddress& network, uint8_t prefix);
+
+    /* A bare address is a block of its own. Returns false when the data is
+     * not a block, leaving out untouched
+     */
+    static bool parse(const char* data, size_t size, Cidr& out);
+    static Cidr fromString(const std::string& data);
+
+    const IpAddress& network() const { return network_; }
+    uint8_t prefix() const { return prefix_; }
+
+    // IPv4 blocks also contain the IPv4-mapped IPv6 form of their addresses
+    bool contains(const IpAddress& ip) const;
+
+private:
+    IpAddress network_;
+    uint8_t prefix_;
+};
+
 class AddressParser {
 public:
     explicit AddressParser(const std::string& data);
@@ -152,15 +219,17 @@ public:
 
     static Address fromUnix(struct sockaddr *addr);
 
+    // The host as it was given, or else formatted from the address
     std::string host() const;
+    const IpAddress& ip() const;
     Port port() const;
     int family() const;
 
 private:
     void init(const std::string& addr);
+    IpAddress ip_;
     std::string host_;
     Port port_;
-    int family_ = AF_INET;
 };
 
 class Error : public std::runtime_error {
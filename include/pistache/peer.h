@@ -9,7 +9,9 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <unordered_map>
+#include <vector>
 
 #include <pistache/net.h>
 #include <pistache/os.h>
@@ -31,6 +33,26 @@ namespace Pistache {
 namespace Tcp {
 
 class Transport;
+class Peer;
+
+/* A per-connection storage slot holding a T. Slots are registered once,
+ * typically at static initialization time, and every peer then has room for
+ * one value per slot, reached by index without any lookup.
+ */
+template<typename T>
+class PeerSlot {
+public:
+    friend class Peer;
+
+    size_t index() const { return index_; }
+
+private:
+    explicit PeerSlot(size_t index)
+        : index_(index)
+    { }
+
+    size_t index_;
+};
 
 class Peer {
 public:
@@ -49,8 +71,66 @@ public:
     void associateSSL(void *ssl);
     void *ssl(void) const;
 
+    template<typename T>
+    static PeerSlot<T> registerSlot() {
+        return PeerSlot<T>(nextSlot());
+    }
+
+    template<typename T>
+    void putData(const PeerSlot<T>& slot, std::shared_ptr<T> data) {
+        auto& entry = slotAt(slot.index());
+        if (entry)
+            throw std::runtime_error("The data already exists");
+
+        entry = std::move(data);
+    }
+
+    template<typename T>
+    T* tryGetData(const PeerSlot<T>& slot) {
+        if (slot.index() >= slots_.size())
+            return nullptr;
+
+        return static_cast<T*>(slots_[slot.index()].get());
+    }
+
+    template<typename T>
+    const T* tryGetData(const PeerSlot<T>& slot) const {
+        return const_cast<Peer*>(this)->tryGetData(slot);
+    }
+
+    // Removes the data from the slot and hands it over
+    template<typename T>
+    std::shared_ptr<T> takeData(const PeerSlot<T>& slot) {
+        if (slot.index() >= slots_.size())
+            return nullptr;
+
+        std::shared_ptr<void> data;
+        data.swap(slots_[slot.index()]);
+        return std::static_pointer_cast<T>(data);
+    }
+
+    template<typename T>
+    T& getData(const PeerSlot<T>& slot) {
+        auto data = tryGetData(slot);
+        if (data == nullptr)
+            throw std::runtime_error("The data does not exist");
+
+        return *data;
+    }
+
+    template<typename T>
+    const T& getData(const PeerSlot<T>& slot) const {
+        return const_cast<Peer*>(this)->getData(slot);
+    }
+
+    /* The former string-keyed storage, kept for existing callers. Each call
+     * hashes and compares the name, the slots above do not.
+     */
+    [[deprecated("Register a PeerSlot and use the slot overloads")]]
     void putData(std::string name, std::shared_ptr<Pistache::Http::Private::ParserBase> data);
+    [[deprecated("Register a PeerSlot and use the slot overloads")]]
     std::shared_ptr<Pistache::Http::Private::ParserBase> getData(std::string name) const;
+    [[deprecated("Register a PeerSlot and use the slot overloads")]]
     std::shared_ptr<Pistache::Http::Private::ParserBase> tryGetData(std::string name) const;
 
     Async::Promise<ssize_t> send(const RawBuffer& buffer, int flags = 0);
@@ -59,11 +139,16 @@ private:
     void associateTransport(Transport* transport);
     Transport* transport() const;
 
+    static size_t nextSlot();
+    static size_t slotsCount();
+    std::shared_ptr<void>& slotAt(size_t index);
+
     Transport* transport_;
     Address addr;
     Fd fd_;
 
     std::string hostname_;
+    std::vector<std::shared_ptr<void>> slots_;
     std::unordered_map<std::string, std::shared_ptr<Pistache::Http::Private::ParserBase>> data_;
 
     void *ssl_;
@@ -0,0 +1,52 @@
+/* proxy.h
+
+   A Rest route handler forwarding requests to an upstream server
+*/
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <pistache/client.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+namespace Pistache {
+namespace Rest {
+
+/* Forwards the requests of the routes it handles to an upstream, which is
+ * either a "host:port" or the name of a service registered on the client,
+ * and streams the response back as it arrives.
+ *
+ * Hop-by-hop headers, along with the ones named by the Connection header,
+ * are not forwarded in either direction and the address of the client is
+ * appended to X-Forwarded-For. The upstream connections are the ones of the
+ * client pool, and are kept alive between requests.
+ */
+class Proxy {
+public:
+    Proxy(std::shared_ptr<Http::Client> client, std::string upstream);
+
+    // Removed from the beginning of the resource before it is forwarded
+    Proxy& stripPrefix(std::string prefix);
+    Proxy& timeout(std::chrono::milliseconds timeout);
+
+    Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response) const;
+
+    static bool isHopByHop(const std::string& name);
+
+private:
+    struct Exchange;
+
+    std::string upstreamResource(const Rest::Request& request) const;
+
+    std::shared_ptr<Http::Client> client_;
+    std::string upstream_;
+    std::string prefix_;
+    std::chrono::milliseconds timeout_;
+};
+
+} // namespace Rest
+} // namespace Pistache
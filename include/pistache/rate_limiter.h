@@ -0,0 +1,83 @@
+/* rate_limiter.h
+
+   Per-key token buckets, used to limit connections and requests
+*/
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pistache/net.h>
+
+namespace Pistache {
+
+/* Gives every key (a client address, an API key...) a token bucket that is
+ * refilled at `rate` tokens per second and holds at most `burst` tokens.
+ *
+ * Keys are spread over independently locked shards so that concurrent
+ * workers rarely contend on the same lock. Each shard only remembers its
+ * least recently used keys: a key that was evicted comes back with a full
+ * bucket, which makes the limit approximate under a very large key space.
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t DefaultMaxKeys = 65536;
+    static constexpr size_t DefaultShards = 16;
+
+    struct Decision {
+        bool allowed;
+        // When not allowed, time until a token will be available
+        std::chrono::milliseconds retryAfter;
+
+        explicit operator bool() const { return allowed; }
+    };
+
+    RateLimiter(double rate, double burst,
+                size_t maxKeys = DefaultMaxKeys, size_t shards = DefaultShards);
+
+    Decision acquire(const std::string& key, Clock::time_point now = Clock::now());
+
+    size_t size() const;
+
+    // The key of a client address: its raw bytes, which are cheaper to get
+    // than its text
+    static std::string keyOf(const IpAddress& ip);
+
+private:
+    struct Bucket {
+        double tokens;
+        Clock::time_point last;
+    };
+
+    using Lru = std::list<std::pair<std::string, Bucket>>;
+
+    struct Shard {
+        Shard()
+            : lock()
+            , lru()
+            , index()
+        { }
+
+        mutable std::mutex lock;
+        // Most recently used first
+        Lru lru;
+        std::unordered_map<std::string, Lru::iterator> index;
+    };
+
+    Shard& shardFor(const std::string& key);
+
+    double rate_;
+    double burst_;
+    size_t keysPerShard_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace Pistache
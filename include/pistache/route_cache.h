@@ -0,0 +1,116 @@
+/* route_cache.h
+
+   A cache of fully serialized responses that can be attached to Rest routes
+*/
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+namespace Pistache {
+namespace Rest {
+
+/* Stores the bytes of the successful responses of the GET routes it wraps
+ * (status line, headers and body) and writes them back while they are
+ * fresh, without running the handler nor serializing anything. Only the
+ * Date and Connection headers are written again for every request, the
+ * latter after the request being answered.
+ *
+ * Entries are keyed by method, resource, query and the values of the
+ * request headers the response varies on. Concurrent misses on the same key
+ * only run the handler once: the other requests wait for its response. Once
+ * full, the least recently used entry makes room for the new one.
+ *
+ * Responses that might be specific to a user are not shared unless the
+ * route opts in: those to requests with credentials (Authorization or
+ * Cookie), and those that set a cookie or are marked Cache-Control:
+ * private. Responses marked Cache-Control: no-store are never kept.
+ */
+class RouteCache : public std::enable_shared_from_this<RouteCache> {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t DefaultMaxEntries = 1024;
+
+    explicit RouteCache(
+            std::chrono::milliseconds ttl,
+            std::vector<std::string> vary = std::vector<std::string>(),
+            size_t maxEntries = DefaultMaxEntries);
+
+    enum class Sharing {
+        PublicOnly,
+        // Also shares the responses that might be specific to a user
+        Everything
+    };
+
+    Route::Handler wrap(Route::Handler handler, Sharing sharing = Sharing::PublicOnly);
+
+    // Drops all the cached variants of a resource
+    void invalidate(const std::string& resource);
+    void clear();
+
+    size_t size() const;
+
+private:
+    using Lock = std::mutex;
+    using Guard = std::lock_guard<Lock>;
+
+    struct Entry {
+        // Status line and headers, without Date and Connection
+        RawBuffer head;
+        // Blank line and body
+        RawBuffer rest;
+        Http::Code code;
+        Clock::time_point expires;
+        // Position of the key in lru_
+        std::list<std::string>::iterator position;
+    };
+
+    struct Waiter {
+        Waiter(const Rest::Request& request, Http::ResponseWriter response)
+            : request(request)
+            , response(std::move(response))
+        { }
+
+        Rest::Request request;
+        Http::ResponseWriter response;
+    };
+
+    class Flight;
+
+    Route::Result handle(
+            const Route::Handler& handler,
+            Sharing sharing,
+            const Rest::Request& request,
+            Http::ResponseWriter response);
+
+    std::string keyFor(const Rest::Request& request) const;
+    void insertLocked(const std::string& key, Entry entry);
+    void eraseLocked(std::unordered_map<std::string, Entry>::iterator it);
+
+    static void serve(const Entry& entry, const Rest::Request& request, Http::ResponseWriter& response);
+    static void run(const Route::Handler& handler, Waiter& waiter);
+
+    std::chrono::milliseconds ttl_;
+    std::vector<std::string> vary_;
+    size_t maxEntries_;
+
+    mutable Lock lock_;
+    std::unordered_map<std::string, Entry> entries_;
+    // Keys of the entries, the most recently used first
+    std::list<std::string> lru_;
+    // Owned by the response being produced, see Flight
+    std::unordered_map<std::string, std::weak_ptr<Flight>> flights_;
+};
+
+} // namespace Rest
+} // namespace Pistache
@@ -16,6 +16,7 @@
 #include <pistache/http.h>
 #include <pistache/http_defs.h>
 #include <pistache/flags.h>
+#include <pistache/negotiation.h>
 
 #include "pistache/string_view.h"
 
@@ -74,7 +75,11 @@ struct Route {
 
     typedef std::function<Result(const Request, Http::ResponseWriter)> Handler;
 
-    explicit Route(Route::Handler handler) : handler_(std::move(handler)) { }
+    explicit Route(Route::Handler handler,
+                   std::shared_ptr<Http::ContentNegotiator> negotiator = nullptr)
+        : handler_(std::move(handler))
+        , negotiator_(std::move(negotiator))
+    { }
 
     template<typename... Args>
     void invokeHandler(Args&& ...args) const {
@@ -82,6 +87,9 @@ struct Route {
     }
 
     Handler handler_;
+
+    // Set when the route declares the media types it produces
+    std::shared_ptr<Http::ContentNegotiator> negotiator_;
 };
 
 namespace Private {
@@ -174,10 +182,13 @@ public:
      * - auth//login is invalid
      * \param[in] handler Handler to associate to path.
      * \param[in] resource_reference \see SegmentTreeNode::resource_ref_
+     * \param[in] negotiator Negotiates the representations the route produces,
+     * if any.
      * \throws std::runtime_error An empty path was given
      */
     void addRoute(const std::string_view& path, const Route::Handler &handler,
-            const std::shared_ptr<char> &resource_reference);
+            const std::shared_ptr<char> &resource_reference,
+            const std::shared_ptr<Http::ContentNegotiator> &negotiator = nullptr);
 
     /**
      * Removes the route handler associated to a given path.
@@ -210,6 +221,8 @@ public:
 
 class Router {
 public:
+    typedef std::function<void(const Request&)> HeadersHandler;
+
     static Router fromDescription(const Rest::Description& desc);
 
     std::shared_ptr<Private::RouterHandler>
@@ -227,11 +240,36 @@ public:
     void options(const std::string& resource, Route::Handler handler);
     void removeRoute(Http::Method method, const std::string& resource);
 
+    /**
+     * Adds a route that produces the given media types. The one that fits
+     * best the Accept header of a request is found before the handler is
+     * invoked, and is available through Rest::Request::representation(). A
+     * request that accepts none of them is answered with a 406 without
+     * invoking the handler.
+     */
+    void addRoute(Http::Method method, const std::string& resource,
+                  Route::Handler handler, std::vector<Http::Mime::MediaType> produces);
+
     void addCustomHandler(Route::Handler handler);
 
     void addNotFoundHandler(Route::Handler handler);
     inline bool hasNotFoundHandler() { return notFoundHandler != nullptr; }
-    void invokeNotFoundHandler(const Http::Request &req, Http::ResponseWriter resp) const;
+    void invokeNotFoundHandler(std::shared_ptr<const Http::Request> req, Http::ResponseWriter resp) const;
+
+    /**
+     * Adds a check run on the head of requests carrying a body, before the
+     * body is received. The check rejects the request by throwing an
+     * Http::HttpError.
+     */
+    void addHeadersHandler(HeadersHandler handler);
+
+    /**
+     * Runs the header-phase checks of a request: a request that no route can
+     * handle is rejected with a 404, one that accepts none of the media types
+     * of its route with a 406, then the headers handlers are invoked.
+     * \throws Http::HttpError The request is rejected
+     */
+    void checkHeaders(const Http::Request& request) const;
 
     Route::Status route(const Http::Request& request, Http::ResponseWriter response);
 
@@ -239,6 +277,7 @@ public:
       : routes()
       , customHandlers()
       , notFoundHandler()
+      , headersHandlers()
     { }
 
 private:
@@ -251,6 +290,8 @@ private:
     std::vector<Route::Handler> customHandlers;
 
     Route::Handler notFoundHandler;
+
+    std::vector<HeadersHandler> headersHandlers;
 };
 
 namespace Private {
@@ -276,6 +317,8 @@ namespace Private {
                 const Http::Request& req,
                 Http::ResponseWriter response);
 
+        void onHeaders(const Http::Request& req);
+
     private:
         std::shared_ptr<Tcp::Handler> clone() const final {
             return std::make_shared<RouterHandler>(router);
@@ -285,24 +328,70 @@ namespace Private {
     };
 }
 
-class Request : public Http::Request {
+/* The request handed to the routes. It refers to the parsed request, which
+ * is shared with the response and never copied, along with what routing
+ * extracted from it.
+ *
+ * It used to derive from Http::Request and no longer does. It still has all
+ * the accessors of Http::Request, and converts implicitly to a
+ * const Http::Request&, so handlers passing it where such a reference is
+ * expected keep compiling. Code that took its address as an Http::Request*,
+ * or relied on the inheritance otherwise (e.g. dynamic_cast or
+ * std::is_base_of), has to go through http() instead.
+ */
+class Request {
 public:
     friend class Router;
 
+    Http::Version version() const;
+    Http::Method method() const;
+    std::string resource() const;
+
+    const std::string& body() const;
+
+    const Http::Header::Collection& headers() const;
+    const Http::Uri::Query& query() const;
+
+    const Http::CookieJar& cookies() const;
+
+    // Address of the peer the request was received from
+    const Address& address() const;
+
+    // See Http::Request::cancellation
+    const Async::CancellationToken& cancellation() const;
+
+#ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
+    std::shared_ptr<Tcp::Peer> peer() const;
+#endif
+
+    // The parsed request, for code written against Http::Request
+    const Http::Request& http() const;
+    operator const Http::Request&() const {
+        return http();
+    }
+
     bool hasParam(const std::string& name) const;
     TypedParam param(const std::string& name) const;
 
     TypedParam splatAt(size_t index) const;
     std::vector<TypedParam> splat() const;
 
+    /* The media type negotiated for the response. It is only valid for a
+     * route that declares the media types it produces.
+     */
+    const Http::Mime::MediaType& representation() const;
+
 private:
     explicit Request(
-            const Http::Request& request,
+            std::shared_ptr<const Http::Request> request,
             std::vector<TypedParam>&& params,
-            std::vector<TypedParam>&& splats);
+            std::vector<TypedParam>&& splats,
+            Http::Mime::MediaType representation = Http::Mime::MediaType());
 
+    std::shared_ptr<const Http::Request> request_;
     std::vector<TypedParam> params_;
     std::vector<TypedParam> splats_;
+    Http::Mime::MediaType representation_;
 };
 
 
@@ -0,0 +1,41 @@
+/* body.h
+
+   Serialization of request and response bodies
+*/
+
+#pragma once
+
+#include <streambuf>
+
+#include <pistache/http.h>
+
+namespace Pistache {
+namespace Rest {
+namespace Serializer {
+
+/* A format tells how values are written to and read from bodies:
+ *
+ *   typedef ... Document;
+ *   static Http::Mime::MediaType mime();
+ *   template<typename T> static void write(std::streambuf& buf, const T& value);
+ *   static Document parse(const std::string& body);
+ *
+ * Values are written straight to the buffer of the response, after its
+ * head, and bodies are parsed from the buffer of the request. parse throws
+ * an HttpError (Bad_Request) when the body is malformed.
+ */
+template<typename Format, typename T>
+Async::Promise<ssize_t> send(Http::ResponseWriter& response, Http::Code code, const T& value) {
+    return response.send(code, [&value](std::streambuf& buf) {
+        Format::write(buf, value);
+    }, Format::mime());
+}
+
+template<typename Format>
+typename Format::Document parse(const Http::Request& request) {
+    return Format::parse(request.body());
+}
+
+} // namespace Serializer
+} // namespace Rest
+} // namespace Pistache
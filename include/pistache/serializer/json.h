@@ -0,0 +1,35 @@
+/* json.h
+
+   The JSON body serializer selected when configuring the build, through
+   PISTACHE_JSON_BACKEND
+*/
+
+#pragma once
+
+#if defined(PISTACHE_USE_SIMDJSON)
+
+#include <pistache/serializer/simdjson.h>
+
+namespace Pistache {
+namespace Rest {
+namespace Serializer {
+    typedef SimdJson Json;
+} // namespace Serializer
+} // namespace Rest
+} // namespace Pistache
+
+#elif defined(PISTACHE_USE_RAPIDJSON)
+
+#include <pistache/serializer/rapidjson.h>
+
+namespace Pistache {
+namespace Rest {
+namespace Serializer {
+    typedef RapidJson Json;
+} // namespace Serializer
+} // namespace Rest
+} // namespace Pistache
+
+#else
+#error "No JSON backend, set PISTACHE_JSON_BACKEND to rapidjson or simdjson"
+#endif
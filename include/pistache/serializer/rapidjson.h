@@ -1,16 +1,23 @@
 /* 
    Mathieu Stefani, 14 mai 2016
    
-   Swagger serializer for RapidJSON
+   Swagger and body serializers for RapidJSON
 */
 
 #pragma once
 
+#include <streambuf>
+#include <type_traits>
+
+#include <rapidjson/document.h>
+#include <rapidjson/error/en.h>
 #include <rapidjson/prettywriter.h>
+#include <rapidjson/writer.h>
 
 #include <pistache/description.h>
 #include <pistache/http_defs.h>
 #include <pistache/mime.h>
+#include <pistache/serializer/body.h>
 
 namespace Pistache {
 namespace Rest {
@@ -210,6 +217,79 @@ inline std::string rapidJson(const Description& desc) {
     return sb.GetString();
 }
 
+// A RapidJSON output stream writing to a buffer
+class StreamBufStream {
+public:
+    typedef char Ch;
+
+    explicit StreamBufStream(std::streambuf& buf)
+        : buf_(buf)
+    { }
+
+    void Put(Ch c) {
+        buf_.sputc(c);
+    }
+
+    void Flush() { }
+
+private:
+    std::streambuf& buf_;
+};
+
+struct RapidJson {
+    typedef rapidjson::Writer<StreamBufStream> Writer;
+    typedef rapidjson::Document Document;
+
+    static Http::Mime::MediaType mime() {
+        return MIME(Application, Json);
+    }
+
+    /* Writes a DOM value, or anything callable with a Writer& that emits
+     * the value through the SAX interface
+     */
+    template<typename T>
+    static void write(std::streambuf& buf, const T& value) {
+        StreamBufStream stream(buf);
+        Writer writer(stream);
+        emit(writer, value, std::is_base_of<rapidjson::Value, T>());
+    }
+
+    /* The request is left untouched, which only costs copying the strings
+     * into the document
+     */
+    static Document parse(const std::string& body) {
+        Document document;
+        document.Parse(body.data(), body.size());
+        check(document);
+        return document;
+    }
+
+    // The strings of the document point into the body, which must outlive it
+    static Document parseInsitu(std::string& body) {
+        Document document;
+        document.ParseInsitu(&body[0]);
+        check(document);
+        return document;
+    }
+
+private:
+    template<typename T>
+    static void emit(Writer& writer, const T& value, std::true_type) {
+        value.Accept(writer);
+    }
+
+    template<typename Fn>
+    static void emit(Writer& writer, const Fn& fn, std::false_type) {
+        fn(writer);
+    }
+
+    static void check(const Document& document) {
+        if (document.HasParseError())
+            throw Http::HttpError(Http::Code::Bad_Request,
+                                  rapidjson::GetParseError_En(document.GetParseError()));
+    }
+};
+
 } // namespace Serializer
 } // namespace Rest
 } // namespace Pistache
@@ -0,0 +1,51 @@
+/* simdjson.h
+
+   Body serializer for simdjson
+*/
+
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include <simdjson.h>
+
+#include <pistache/http_defs.h>
+#include <pistache/mime.h>
+#include <pistache/serializer/body.h>
+
+namespace Pistache {
+namespace Rest {
+namespace Serializer {
+
+struct SimdJson {
+    /* The document lives in a parser owned by the calling thread, and is
+     * valid until that thread parses the next body
+     */
+    typedef simdjson::dom::element Document;
+
+    static Http::Mime::MediaType mime() {
+        return MIME(Application, Json);
+    }
+
+    static void write(std::streambuf& buf, const simdjson::dom::element& value) {
+        std::ostream os(&buf);
+        os << value;
+    }
+
+    static Document parse(const std::string& body) {
+        thread_local simdjson::dom::parser parser;
+
+        // The body is only copied when the request left no padding after it
+        const bool padded = body.capacity() - body.size() >= simdjson::SIMDJSON_PADDING;
+        auto result = parser.parse(body.data(), body.size(), !padded);
+        if (result.error())
+            throw Http::HttpError(Http::Code::Bad_Request, simdjson::error_message(result.error()));
+
+        return result.value_unsafe();
+    }
+};
+
+} // namespace Serializer
+} // namespace Rest
+} // namespace Pistache
@@ -8,6 +8,7 @@
 
 #include <pistache/os.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <stdexcept>
 #include <cstring>
@@ -15,6 +16,7 @@
 #include <vector>
 #include <limits>
 #include <iostream>
+#include <memory>
 #include <string>
 
 
@@ -115,6 +117,24 @@ public:
         Base::setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
     }
 
+    size_t available() const {
+        return bytes.size() < maxSize ? maxSize - bytes.size() : 0;
+    }
+
+    bool empty() const {
+        return bytes.empty();
+    }
+
+    // Drops the bytes that were already read
+    void compact() {
+        size_t readOffset = static_cast<size_t>(this->gptr() - this->eback());
+        if (readOffset == 0)
+            return;
+
+        bytes.erase(bytes.begin(), bytes.begin() + readOffset);
+        Base::setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+    }
+
 private:
     std::vector<CharT> bytes;
 };
@@ -122,18 +142,49 @@ private:
 template<typename CharT>
 size_t ArrayStreamBuf<CharT>::maxSize = Const::DefaultMaxPayload;
 
+/* Blocks of storage for the output buffers, recycled through a freelist
+ * owned by each thread, hence by each transport worker. The sizes of the
+ * blocks are powers of two and their bytes are never zero-filled.
+ */
+class BufferPool {
+public:
+    static constexpr size_t MinBlockSize = 512;
+    // Larger blocks go straight back to the allocator
+    static constexpr size_t MaxPooledSize = 1 << 20;
+    // Bytes kept in the freelists of a thread, all size classes together
+    static constexpr size_t MaxFreeBytes = 4 << 20;
+
+    // A block of at least size bytes, whose actual size is put in capacity
+    static char* acquire(size_t size, size_t& capacity);
+    static void release(char* block, size_t capacity);
+
+    // Blocks, and their bytes, in the freelists of the calling thread
+    static size_t freeBlocks();
+    static size_t freeBytes();
+};
+
+/* A slice of bytes whose storage is shared by all its copies and slices.
+ * The bytes are copied at most once, when the buffer is built from a raw
+ * pointer: copying or detaching a RawBuffer only bumps a reference count.
+ */
 struct RawBuffer
 {
+    friend class DynamicStreamBuf;
+
     RawBuffer();
     RawBuffer(std::string data, size_t length, bool isDetached = false);
     RawBuffer(const char* data, size_t length, bool isDetached = false);
 
-    RawBuffer detach(size_t fromIndex);
-    const std::string& data() const;
+    // The bytes from fromIndex on, sharing the storage of this buffer
+    RawBuffer detach(size_t fromIndex) const;
+    const char* data() const;
     size_t size() const;
     bool isDetached() const;
 private:
-    std::string data_;
+    RawBuffer(std::shared_ptr<const char> storage, size_t offset, size_t length, bool isDetached);
+
+    std::shared_ptr<const char> storage_;
+    size_t offset_;
     size_t length_;
     bool isDetached_;
 };
@@ -151,6 +202,10 @@ private:
     size_t size_;
 };
 
+/* An output buffer whose storage comes from the BufferPool. The first
+ * block is only taken on the first write, and the block goes back to the
+ * pool once the buffer and every RawBuffer released from it are gone.
+ */
 class DynamicStreamBuf : public StreamBuf<char> {
 public:
 
@@ -162,9 +217,14 @@ public:
             size_t size,
             size_t maxSize = std::numeric_limits<uint32_t>::max())
         : maxSize_(maxSize)
-        , data_()
-    {
-        reserve(size);
+        , initialSize_(size)
+        , data_(nullptr)
+        , capacity_(0)
+    { }
+
+    ~DynamicStreamBuf() {
+        if (data_)
+            BufferPool::release(data_, capacity_);
     }
 
     DynamicStreamBuf(const DynamicStreamBuf& other) = delete;
@@ -172,36 +232,72 @@ public:
 
     DynamicStreamBuf(DynamicStreamBuf&& other)
        : maxSize_(other.maxSize_)
-       , data_(std::move(other.data_)) {
+       , initialSize_(other.initialSize_)
+       , data_(other.data_)
+       , capacity_(other.capacity_) {
            setp(other.pptr(), other.epptr());
+           other.data_ = nullptr;
+           other.capacity_ = 0;
            other.setp(nullptr, nullptr);
     }
 
     DynamicStreamBuf& operator=(DynamicStreamBuf&& other) {
+        if (data_)
+            BufferPool::release(data_, capacity_);
+
         maxSize_ = other.maxSize_;
-        data_ = std::move(other.data_);
+        initialSize_ = other.initialSize_;
+        data_ = other.data_;
+        capacity_ = other.capacity_;
         setp(other.pptr(), other.epptr());
+        other.data_ = nullptr;
+        other.capacity_ = 0;
         other.setp(nullptr, nullptr);
         return *this;
     }
 
+    // A copy of the bytes written so far
     RawBuffer buffer() const {
-        return RawBuffer((const char*) data_.data(), pptr() - &data_[0]);
+        return RawBuffer(data(), size());
+    }
+
+    /* Hands the bytes written so far over without copying them. The buffer
+     * starts over empty, with a new block on the next write
+     */
+    RawBuffer release();
+
+    // Direct access to the bytes written so far, without copying them
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return pptr() - data_;
     }
 
+    // Rewind the put area, keeping the storage around for the next write
     void clear() {
-        data_.clear();
-        this->setp(&data_[0], &data_[0] + data_.capacity());
+        this->setp(data_, data_ + std::min(capacity_, maxSize_));
     }
 
+    // Overwrites bytes already written, e.g. a length only known afterwards
+    void overwrite(size_t offset, const char* data, size_t size) {
+        if (offset > this->size() || size > this->size() - offset)
+            throw std::range_error("Overwriting past the bytes written.");
+        std::memcpy(data_ + offset, data, size);
+    }
+
+    // Makes room for size bytes in all, e.g. when the size of the output is known upfront
+    void reserve(size_t size);
+
   protected:
     int_type overflow(int_type ch);
 
 private:
-    void reserve(size_t size);
-
     size_t maxSize_;
-    std::vector<char> data_;
+    size_t initialSize_;
+    char* data_;
+    size_t capacity_;
 };
 
 class StreamCursor {
@@ -315,6 +411,12 @@ bool match_string(const char *str, size_t len, StreamCursor& cursor,
 bool match_literal(char c, StreamCursor& cursor, CaseSensitivity cs = CaseSensitivity::Insensitive);
 bool match_until(char c, StreamCursor& cursor, CaseSensitivity cs = CaseSensitivity::Insensitive);
 bool match_until(std::initializer_list<char> chars, StreamCursor& cursor, CaseSensitivity cs = CaseSensitivity::Insensitive);
+
+/* Moves the cursor to the next CRLF and returns true if there is one.
+ * Otherwise, the cursor stops at the end of the buffer, or on a last CR whose
+ * LF might still be to come, and false is returned.
+ */
+bool match_until_eol(StreamCursor& cursor);
 bool match_double(double* val, StreamCursor& cursor);
 
 void skip_whitespaces(StreamCursor& cursor);
@@ -16,7 +16,9 @@
 #include <deque>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <vector>
 
 namespace Pistache {
 namespace Tcp {
@@ -24,13 +26,49 @@ namespace Tcp {
 class Peer;
 class Handler;
 
+/* Bounds on the bytes queued for writing to a peer. Once more than
+ * highWatermark bytes are queued, the peer stops being writable until its
+ * queue drains below lowWatermark. A peer that stays above the high mark for
+ * longer than stallTimeout is disconnected, a zero timeout never does.
+ *
+ * Only bytes held in memory are counted, files sent from disk are not.
+ */
+struct WriteLimits {
+    WriteLimits()
+        : lowWatermark(Const::DefaultWriteLowWatermark)
+        , highWatermark(Const::DefaultWriteHighWatermark)
+        , stallTimeout(0)
+    { }
+
+    size_t lowWatermark;
+    size_t highWatermark;
+    std::chrono::milliseconds stallTimeout;
+};
+
+/* What a peer may read in one go before the other ready peers of the worker
+ * get their turn. A peer that used up its budget is read again once the
+ * events that were already pending have been handled. Zero means no limit.
+ */
+struct ReadBudget {
+    ReadBudget()
+        : bytes(Const::DefaultReadBudgetBytes)
+        , requests(Const::DefaultReadBudgetRequests)
+    { }
+
+    size_t bytes;
+    size_t requests;
+};
+
 class Transport : public Aio::Handler {
 public:
     explicit Transport(const std::shared_ptr<Tcp::Handler>& handler);
     Transport(const Transport&) = delete;
     Transport& operator=(const Transport&) = delete;
+    ~Transport();
 
     void init(const std::shared_ptr<Tcp::Handler>& handler);
+    void setWriteLimits(const WriteLimits& limits);
+    void setReadBudget(const ReadBudget& budget);
 
     void registerPoller(Polling::Epoll& poller) override;
 
@@ -42,14 +80,24 @@ public:
         // Always enqueue reponses for sending. Giving preference to consumer
         // context means chunked responses could be sent out of order.
         return Async::Promise<ssize_t>([=](Async::Deferred<ssize_t> deferred) mutable {
-            BufferHolder holder(buffer);
-            auto detached = holder.detach();
-            WriteEntry write(std::move(deferred), detached, flags);
+            WriteEntry write(std::move(deferred), BufferHolder(buffer), flags);
             write.peerFd = fd;
+            write.generation = enqueued(fd, write.buffer.inMemory() ? write.buffer.size() : 0);
             writesQueue.push(std::move(write));
         });
     }
 
+    // Resolves right away when nothing is blocked for the fd, which is also
+    // the case once the peer went away, otherwise once its queue drained
+    // below the low watermark. Rejected if the peer goes away meanwhile
+    Async::Promise<void> whenWritable(Fd fd);
+
+    size_t queuedBytes(Fd fd);
+
+    // Called by protocol handlers from onInput for every full request they
+    // read, so that requests count against the read budget of the peer
+    void requestRead() { ++requestsRead_; }
+
     Async::Promise<rusage> load() {
         return Async::Promise<rusage>([=](Async::Deferred<rusage> deferred) {
             loadRequest_ = std::move(deferred);
@@ -77,17 +125,34 @@ private:
     };
 
     struct BufferHolder {
-        enum Type { Raw, File };
+        enum Type { Raw, Chain, File };
 
         explicit BufferHolder(const RawBuffer& buffer, off_t offset = 0)
             : _raw(buffer)
+            , _chain()
+            , _fd(-1)
             , size_(buffer.size())
             , offset_(offset)
             , type(Raw)
         { }
 
+        // Buffers written one after the other with a single system call
+        explicit BufferHolder(const std::vector<RawBuffer>& chain, off_t offset = 0)
+            : _raw()
+            , _chain(chain)
+            , _fd(-1)
+            , size_(0)
+            , offset_(offset)
+            , type(Chain)
+        {
+            for (const auto& buffer: _chain)
+                size_ += buffer.size();
+        }
+
         explicit BufferHolder(const FileBuffer& buffer, off_t offset = 0)
-            : _fd(buffer.fd())
+            : _raw()
+            , _chain()
+            , _fd(buffer.fd())
             , size_(buffer.size())
             , offset_(offset)
             , type(File)
@@ -95,6 +160,9 @@ private:
 
         bool isFile() const { return type == File; }
         bool isRaw() const { return type == Raw; }
+        bool isChain() const { return type == Chain; }
+        // Bytes held in memory count against the write limits
+        bool inMemory() const { return type != File; }
         size_t size() const { return size_; }
         size_t offset() const { return offset_; }
 
@@ -104,33 +172,40 @@ private:
             return _fd;
         }
 
-        RawBuffer raw() const {
+        const RawBuffer& raw() const {
             if (!isRaw())
                 throw std::runtime_error("Tried to retrieve raw data of a non-buffer");
             return _raw;
         }
 
-        BufferHolder detach(size_t offset = 0) {
+        const std::vector<RawBuffer>& chain() const {
+            if (!isChain())
+                throw std::runtime_error("Tried to retrieve the chain of a non-chain buffer");
+            return _chain;
+        }
+
+        // Raw buffers share their bytes, only the write offset is kept
+        BufferHolder detach(size_t offset = 0) const {
+            if (isChain())
+                return BufferHolder(_chain, offset);
             if (!isRaw())
                 return BufferHolder(_fd, size_, offset);
 
-            if (_raw.isDetached())
-                return BufferHolder(_raw, offset);
-
-            auto detached = _raw.detach(offset);
-            return BufferHolder(detached);
-
+            return BufferHolder(_raw, offset);
         }
 
       private:
         BufferHolder(Fd fd, size_t size, off_t offset = 0)
-         : _fd(fd)
+         : _raw()
+         , _chain()
+         , _fd(fd)
          , size_(size)
          , offset_(offset)
          , type(File)
         { }
 
         RawBuffer _raw;
+        std::vector<RawBuffer> _chain;
         Fd _fd;
 
         size_t size_= 0;
@@ -145,12 +220,15 @@ private:
             , buffer(std::move(buffer_))
             , flags(flags_)
             , peerFd(-1)
+            , generation(0)
         { }
 
         Async::Deferred<ssize_t> deferred;
         BufferHolder buffer;
         int flags;
         Fd peerFd;
+        // Of the peer the write was counted for, zero if it was already gone
+        uint64_t generation;
     };
 
     struct TimerEntry {
@@ -192,13 +270,51 @@ private:
 
         std::shared_ptr<Peer> peer;
     };
+    struct WriteQueue {
+        WriteQueue()
+            : bytes(0)
+            , blocked(false)
+            , closing(false)
+        { }
+
+        std::deque<WriteEntry> entries;
+
+        // Counted as soon as asyncWrite is called, entries might still be in
+        // writesQueue
+        size_t bytes;
+
+        // Above the high watermark and not below the low one yet
+        bool blocked;
+        std::chrono::steady_clock::time_point blockedSince;
+        bool closing;
+
+        std::vector<Async::Deferred<void>> waiters;
+    };
+
     using Lock = std::mutex;
     using Guard = std::lock_guard<Lock>;
 
     PollableQueue<WriteEntry> writesQueue;
-    std::unordered_map<Fd, std::deque<WriteEntry>> toWrite;
+    std::unordered_map<Fd, WriteQueue> toWrite;
+    // Tells apart the successive peers of a reused fd, for the writes that
+    // were made to a peer that went away meanwhile
+    std::unordered_map<Fd, uint64_t> generations_;
+    uint64_t nextGeneration_ = 0;
     Lock toWriteLock;
 
+    WriteLimits writeLimits_;
+    Fd stallTimer_ = -1;
+    bool stallTimerArmed_ = false;
+
+    ReadBudget readBudget_;
+    size_t requestsRead_ = 0;
+
+    // Peers that used up their read budget, revisited when readableNotifier
+    // fires
+    std::deque<Fd> readable_;
+    std::unordered_set<Fd> readableSet_;
+    NotifyFd readableNotifier;
+
     PollableQueue<TimerEntry> timersQueue;
     std::unordered_map<Fd, TimerEntry> timers;
 
@@ -230,8 +346,17 @@ private:
     // This will attempt to drain the write queue for the fd
     void asyncWriteImpl(Fd fd);
 
+    // Counts the bytes against the queue of the peer and returns its
+    // generation, or zero when there is no such peer
+    uint64_t enqueued(Fd fd, size_t bytes);
+    void written(WriteQueue& queue, size_t bytes,
+                 std::vector<Async::Deferred<void>>& writable);
+    void armStallTimer(std::chrono::steady_clock::duration delay);
+    void handleStalledPeers();
+
     void handlePeerDisconnection(const std::shared_ptr<Peer>& peer);
     void handleIncoming(const std::shared_ptr<Peer>& peer);
+    void handleReadable();
     void handleWriteQueue();
     void handleTimerQueue();
     void handlePeerQueue();
@@ -10,10 +10,15 @@
 #include <pistache/net.h>
 
 #include <sys/sendfile.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <netdb.h>
+#include <strings.h>
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
+#include <random>
 #include <sstream>
 #include <string>
 
@@ -47,6 +52,32 @@ namespace
     }
 }
 
+namespace {
+    // Only these can safely be sent twice when hedging
+    bool isIdempotent(Http::Method method) {
+        switch (method) {
+        case Http::Method::Get:
+        case Http::Method::Head:
+        case Http::Method::Options:
+        case Http::Method::Put:
+        case Http::Method::Delete:
+        case Http::Method::Trace:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Whether the server keeps its side of the connection open
+    bool isReusable(const Response& response) {
+        auto connection = response.headers().tryGet<Header::Connection>();
+        if (connection)
+            return connection->control() == ConnectionControl::KeepAlive;
+
+        return response.version() == Version::Http11;
+    }
+}
+
 struct ExceptionPrinter {
     void operator()(std::exception_ptr exc) const {
         try {
@@ -59,88 +90,115 @@ struct ExceptionPrinter {
 
 namespace {
     template<typename H, typename... Args>
-    void writeHeader(std::stringstream& streamBuf, Args&& ...args) {
+    void writeHeader(std::ostream& os, Args&& ...args) {
         using Http::crlf;
 
         H header(std::forward<Args>(args)...);
 
-        streamBuf << H::Name << ": ";
-        header.write(streamBuf);
+        os << H::Name << ": ";
+        header.write(os);
 
-        streamBuf << crlf;
+        os << crlf;
     }
 
-    void writeHeaders(std::stringstream& streamBuf, const Http::Header::Collection& headers) {
+    void writeHeaders(std::ostream& os, const Http::Header::Collection& headers) {
         using Http::crlf;
 
         for (const auto& header: headers.list()) {
-            streamBuf << header->name() << ": ";
-            header->write(streamBuf);
-            streamBuf << crlf;
+            os << header->name() << ": ";
+            header->write(os);
+            os << crlf;
+        }
+
+        for (const auto& raw: headers.rawList()) {
+            os << raw.second.name() << ": " << raw.second.value() << crlf;
         }
     }
 
-    void writeCookies(std::stringstream& streamBuf, const Http::CookieJar& cookies) {
+    void writeCookies(std::ostream& os, const Http::CookieJar& cookies) {
         using Http::crlf;
 
-        streamBuf << "Cookie: ";
+        os << "Cookie: ";
         bool first = true;
         for (const auto& cookie: cookies) {
             if (!first) {
-                streamBuf << "; ";
+                os << "; ";
             }
             else {
                 first = false;
             }
-            streamBuf << cookie.name << "=" << cookie.value;
+            os << cookie.name << "=" << cookie.value;
         }
 
-        streamBuf << crlf;
+        os << crlf;
     }
 
-    void writeRequest(std::stringstream& streamBuf, const Http::Request& request) {
+    /* Only serializes the request line and the headers. The body is left
+     * where it is and is handed to the transport as a separate buffer.
+     */
+    void writeRequestHead(std::ostream& os, const Http::Request& request) {
         using Http::crlf;
 
-        auto res = request.resource();
+        const auto& res = request.resource();
         auto s = splitUrl(res);
-        auto body = request.body();
+        const auto& body = request.body();
 
         auto host = s.first;
         auto path = s.second;
 
-        auto pathStr = path.toString();
+        os << request.method() << " ";
+        if (path.size() == 0 || path[0] != '/')
+            os << '/';
+        os.write(path.data(), path.size());
+        os << request.query().as_str();
+        os << " HTTP/1.1" << crlf;
 
-        streamBuf << request.method() << " ";
-        if (pathStr[0] != '/')
-            streamBuf << '/';
-        streamBuf << pathStr;
-        streamBuf << " HTTP/1.1" << crlf;
+        writeCookies(os, request.cookies());
+        writeHeaders(os, request.headers());
 
-        writeCookies(streamBuf, request.cookies());
-        writeHeaders(streamBuf, request.headers());
-
-        writeHeader<Http::Header::UserAgent>(streamBuf, UA);
-        writeHeader<Http::Header::Host>(streamBuf, host.toString());
+        writeHeader<Http::Header::UserAgent>(os, UA);
+        // Set when the request is sent to one of the backends of a service
+        if (!request.headers().has<Http::Header::Host>())
+            writeHeader<Http::Header::Host>(os, host.toString());
         if (!body.empty()) {
-            writeHeader<Http::Header::ContentLength>(streamBuf, body.size());
-        }
-        streamBuf << crlf;
-
-        if (!body.empty()) {
-            streamBuf << body;
+            writeHeader<Http::Header::ContentLength>(os, body.size());
         }
+        os << crlf;
     }
 }
 
 void
 Transport::onReady(const Aio::FdSet& fds) {
     for (const auto& entry: fds) {
+        // A hangup is reported even without interest, it is seen once the
+        // reads are resumed
+        if (suspended.count(entry.getTag().value()))
+            continue;
+
         if (entry.getTag() == connectionsQueue.tag()) {
             handleConnectionQueue();
         }
         else if (entry.getTag() == requestsQueue.tag()) {
             handleRequestsQueue();
         }
+        else if (entry.getTag() == timersQueue.tag()) {
+            handleTimersQueue();
+        }
+        else if (entry.getTag() == Polling::Tag(timerFd)) {
+            handleTimer();
+        }
+
+        else if (entry.isWritable() && pendingRequests.count(entry.getTag().value())) {
+            handleWritable(entry.getTag().value());
+            if (entry.isReadable()) {
+                auto connIt = connections.find(entry.getTag().value());
+                if (connIt != std::end(connections)) {
+                    auto connection = connIt->second.connection.lock();
+                    if (connection)
+                        handleIncoming(connection);
+                }
+            }
+        }
 
         else if (entry.isReadable()) {
             auto tag = entry.getTag();
@@ -170,8 +228,11 @@ Transport::onReady(const Aio::FdSet& fds) {
             auto connIt = connections.find(fd);
             if (connIt != std::end(connections)) {
                 auto& conn = connIt->second;
-                if (entry.isHangup())
-                    conn.reject(Error::system("Could not connect"));
+                if (entry.isHangup()) {
+                    auto reject = std::move(conn.reject);
+                    connections.erase(connIt);
+                    reject(Error::system("Could not connect"));
+                }
                 else {
                     conn.resolve();
                     // We are connected, we can start reading data now
@@ -193,6 +254,14 @@ void
 Transport::registerPoller(Polling::Epoll& poller) {
     requestsQueue.bind(poller);
     connectionsQueue.bind(poller);
+    timersQueue.bind(poller);
+
+    timerFd = TRY_RET(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    poller.addFd(timerFd, NotifyOn::Read, Polling::Tag(timerFd), Polling::Mode::Edge);
+}
+
+Transport::~Transport() {
+    cancelTimers();
 }
 
 Async::Promise<void>
@@ -208,11 +277,14 @@ Async::Promise<ssize_t>
 Transport::asyncSendRequest(
         std::shared_ptr<Connection> connection,
         std::shared_ptr<TimerPool::Entry> timer,
-        std::string buffer) {
+        StringView head,
+        Http::Request request) {
 
     return Async::Promise<ssize_t>([&](Async::Resolver& resolve, Async::Rejection& reject) {
         auto ctx = context();
-        RequestEntry req(std::move(resolve), std::move(reject), connection, std::move(timer), std::move(buffer));
+        RequestEntry req(
+                std::move(resolve), std::move(reject), connection, std::move(timer),
+                head, std::move(request));
         if (std::this_thread::get_id() != ctx.thread()) {
             requestsQueue.push(std::move(req));
         } else {
@@ -224,48 +296,195 @@ Transport::asyncSendRequest(
 
 void
 Transport::asyncSendRequestImpl(
-        const RequestEntry& req, WriteStatus status)
+        RequestEntry& req, WriteStatus status)
 {
-    const auto& buffer = req.buffer;
     auto conn = req.connection.lock();
     if (!conn)
         throw std::runtime_error("Send request error");
 
     auto fd = conn->fd();
+    const auto& body = req.request.body();
+    const size_t total = req.size();
 
-    ssize_t totalWritten = 0;
     for (;;) {
-        ssize_t bytesWritten = 0;
-        ssize_t len = buffer.size() - totalWritten;
-        auto ptr = buffer.data() + totalWritten;
-        bytesWritten = ::send(fd, ptr, len, 0);
+        // Gather whatever is left of the head and the body in one syscall
+        struct iovec iov[2];
+        int iovcnt = 0;
+        size_t offset = req.bytesWritten;
+        if (offset < req.head.size()) {
+            iov[iovcnt].iov_base = const_cast<char *>(req.head.data() + offset);
+            iov[iovcnt].iov_len = req.head.size() - offset;
+            ++iovcnt;
+            offset = 0;
+        } else {
+            offset -= req.head.size();
+        }
+        if (offset < body.size()) {
+            iov[iovcnt].iov_base = const_cast<char *>(body.data() + offset);
+            iov[iovcnt].iov_len = body.size() - offset;
+            ++iovcnt;
+        }
+
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof msg);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t bytesWritten = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
         if (bytesWritten < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The socket buffer is full: keep the remainder around and
+                // wait for the fd to become writable again, without losing
+                // interest for the response
                 if (status == FirstTry) {
-                    throw std::runtime_error("Unimplemented, fix me!");
+                    auto fdToPoll = fd;
+                    pendingRequests.erase(fdToPoll);
+                    pendingRequests.insert(std::make_pair(fdToPoll, std::move(req)));
                 }
-                reactor()->modifyFd(key(), fd, NotifyOn::Write, Polling::Mode::Edge);
+                reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write, Polling::Mode::Edge);
             }
             else {
                 req.reject(Error::system("Could not send request"));
+                if (status == Retry)
+                    pendingRequests.erase(fd);
             }
             break;
         }
         else {
-            totalWritten += bytesWritten;
-            if (totalWritten == len) {
+            req.bytesWritten += bytesWritten;
+            if (req.bytesWritten == total) {
                 if (req.timer) {
                     timeouts.insert(
                           std::make_pair(req.timer->fd, conn));
                     req.timer->registerReactor(key(), reactor());
                 }
-                req.resolve(totalWritten);
+                req.resolve(static_cast<ssize_t>(total));
+                if (status == Retry) {
+                    reactor()->modifyFd(key(), fd, NotifyOn::Read);
+                    pendingRequests.erase(fd);
+                }
                 break;
             }
         }
     }
 }
 
+void
+Transport::abortPendingRequest(Fd fd) {
+    pendingRequests.erase(fd);
+}
+
+void
+Transport::armTimer(std::chrono::microseconds delay, std::function<void()> callback) {
+    timersQueue.push(TimerEntry(std::chrono::steady_clock::now() + delay, std::move(callback)));
+}
+
+void
+Transport::cancelTimers() {
+    while (timersQueue.popSafe()) ;
+    timers.clear();
+
+    if (timerFd != -1) {
+        ::close(timerFd);
+        timerFd = -1;
+    }
+}
+
+std::weak_ptr<size_t>
+Transport::suspendReads(Fd fd) {
+    auto& count = suspended[fd];
+    if (!count) {
+        count = std::make_shared<size_t>(0);
+        reactor()->modifyFd(key(), fd, NotifyOn::None, Polling::Mode::Edge);
+    }
+
+    ++*count;
+    return count;
+}
+
+void
+Transport::resumeReads(Fd fd, const std::weak_ptr<size_t>& suspension) {
+    auto count = suspension.lock();
+    auto it = suspended.find(fd);
+    if (!count || it == std::end(suspended) || it->second != count)
+        return;
+
+    if (--*count > 0)
+        return;
+
+    suspended.erase(it);
+    if (pendingRequests.count(fd))
+        reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write, Polling::Mode::Edge);
+    else
+        reactor()->modifyFd(key(), fd, NotifyOn::Read);
+}
+
+void
+Transport::handleTimersQueue() {
+    for (;;) {
+        auto entry = timersQueue.popSafe();
+        if (!entry) break;
+
+        entry->sequence = timerSequence++;
+        timers.push_back(std::move(*entry));
+        std::push_heap(timers.begin(), timers.end(), Later());
+    }
+
+    armTimerFd();
+}
+
+void
+Transport::handleTimer() {
+    uint64_t numWakeups;
+    while (::read(timerFd, &numWakeups, sizeof numWakeups) > 0) ;
+
+    // Timers armed by the callbacks go through the queue, after these ones
+    std::vector<std::function<void()>> expired;
+    auto now = std::chrono::steady_clock::now();
+    while (!timers.empty() && timers.front().deadline <= now) {
+        std::pop_heap(timers.begin(), timers.end(), Later());
+        expired.push_back(std::move(timers.back().callback));
+        timers.pop_back();
+    }
+
+    armTimerFd();
+
+    for (auto& callback: expired) {
+        if (callback)
+            callback();
+    }
+}
+
+void
+Transport::armTimerFd() {
+    itimerspec spec;
+    std::memset(&spec, 0, sizeof spec);
+
+    // Left all-zero when there is no timer, which disarms it
+    if (!timers.empty()) {
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                timers.front().deadline - std::chrono::steady_clock::now());
+        // An all-zero value would disarm the timer instead of firing it
+        if (delay.count() < 1)
+            delay = std::chrono::nanoseconds(1);
+
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(delay);
+        spec.it_value.tv_sec = secs.count();
+        spec.it_value.tv_nsec = (delay - secs).count();
+    }
+
+    TRY(timerfd_settime(timerFd, 0, &spec, 0));
+}
+
+void
+Transport::handleWritable(Fd fd) {
+    auto it = pendingRequests.find(fd);
+    if (it == std::end(pendingRequests))
+        return;
+
+    asyncSendRequestImpl(it->second, Retry);
+}
+
 void
 Transport::handleRequestsQueue() {
     // Let's drain the queue
@@ -321,28 +540,49 @@ Transport::handleIncoming(std::shared_ptr<Connection> connection) {
         }
         else if (bytes == 0) {
             if (totalBytes > 0) {
-                handleResponsePacket(connection, buffer, totalBytes);
+                if (!handleResponsePacket(connection, buffer, totalBytes))
+                    break;
             } else {
                 connection->handleError("Remote closed connection");
             }
-            connections.erase(connection->fd());
-            connection->close();
+            // Already closed if the response said so
+            if (connection->isConnected())
+                closeConnection(connection);
             break;
         }
 
         else {
             totalBytes += bytes;
-            if (static_cast<size_t>(totalBytes) > Const::MaxBuffer) {
-                std::cerr << "Client: Too long packet" << std::endl;
-                break;
+            // A response (a streamed one in particular) can be larger than
+            // the buffer, hand it over piece by piece
+            if (static_cast<size_t>(totalBytes) == Const::MaxBuffer) {
+                if (!handleResponsePacket(connection, buffer, totalBytes))
+                    break;
+                // The connection might already have been handed out again
+                if (!connection->isConnected() || suspended.count(connection->fd()))
+                    break;
+                totalBytes = 0;
             }
         }
     }
 }
 
-void
+bool
 Transport::handleResponsePacket(const std::shared_ptr<Connection>& connection, const char* buffer, size_t totalBytes) {
-    connection->handleResponsePacket(buffer, totalBytes);
+    if (connection->handleResponsePacket(buffer, totalBytes))
+        return true;
+
+    // The rest of the response can not be told apart from the next one
+    closeConnection(connection);
+    connection->handleError("Response exceeded maximum buffer size");
+    return false;
+}
+
+void
+Transport::closeConnection(const std::shared_ptr<Connection>& connection) {
+    connections.erase(connection->fd());
+    suspended.erase(connection->fd());
+    connection->close();
 }
 
 void
@@ -353,6 +593,7 @@ Transport::handleTimeout(const std::shared_ptr<Connection>& connection) {
 Connection::Connection()
     : fd_(-1)
     , requestEntry(nullptr)
+    , requestBuf_(DefaultRequestBufferSize)
 {
     state_.store(static_cast<uint32_t>(State::Idle));
     connectionState_.store(NotConnected);
@@ -375,31 +616,84 @@ Connection::connect(const Address& addr)
     
     TRY(addressInfo.invoke(host.c_str(), port.c_str(), &hints));
     const addrinfo *addrs = addressInfo.get_info_ptr();
-    
-    int sfd = -1;
 
+    auto candidates = std::make_shared<ConnectCandidates>();
     for (const addrinfo *addr = addrs; addr; addr = addr->ai_next) {
-        sfd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-        if (sfd < 0) continue;
+        ConnectCandidate candidate;
+        candidate.family = addr->ai_family;
+        candidate.socktype = addr->ai_socktype;
+        candidate.protocol = addr->ai_protocol;
+        candidate.addrLen = addr->ai_addrlen;
+        std::memcpy(&candidate.addr, addr->ai_addr, addr->ai_addrlen);
+        candidates->push_back(candidate);
+    }
 
-        make_non_blocking(sfd);
+    if (candidates->empty())
+        throw std::runtime_error("Failed to connect");
 
-        connectionState_.store(Connecting);
-        fd_ = sfd;
+    connectTo(std::move(candidates), 0);
+}
 
-        transport_->asyncConnect(shared_from_this(), addr->ai_addr, addr->ai_addrlen)
-            .then([=]() {
-                socklen_t len = sizeof(saddr);
-                getsockname(sfd, (struct sockaddr *)&saddr, &len);
-                connectionState_.store(Connected);
-                processRequestQueue();
-            }, ExceptionPrinter());
-        break;
+/* Tries every resolved address in turn until one of them accepts the
+ * connection. If none of them does, the pending requests are rejected.
+ */
+void
+Connection::connectTo(std::shared_ptr<const ConnectCandidates> candidates, size_t index)
+{
+    int sfd = -1;
+    for (; index < candidates->size(); ++index) {
+        const auto& candidate = (*candidates)[index];
+        sfd = ::socket(candidate.family, candidate.socktype, candidate.protocol);
+        if (sfd >= 0) break;
+    }
 
+    if (sfd < 0) {
+        failRequestQueue("Failed to connect");
+        return;
     }
 
-    if (sfd < 0)
-        throw std::runtime_error("Failed to connect");
+    make_non_blocking(sfd);
+
+    connectionState_.store(Connecting);
+    fd_ = sfd;
+
+    const auto& candidate = (*candidates)[index];
+    transport_->asyncConnect(
+            shared_from_this(),
+            reinterpret_cast<const struct sockaddr *>(&candidate.addr), candidate.addrLen)
+        .then([=]() {
+            socklen_t len = sizeof(saddr);
+            getsockname(sfd, (struct sockaddr *)&saddr, &len);
+            connectionState_.store(Connected);
+            processRequestQueue();
+        }, [=](std::exception_ptr) {
+            ::close(sfd);
+            fd_ = -1;
+            connectionState_.store(NotConnected);
+            connectTo(candidates, index + 1);
+        });
+}
+
+void
+Connection::failRequestQueue(const char* error) {
+    for (;;) {
+        auto req = requestsQueue.popSafe();
+        if (!req) break;
+
+        req->reject(Error(error));
+        if (req->onDone)
+            req->onDone();
+    }
+}
+
+void
+Connection::abortRequestQueue(const char* error) {
+    for (;;) {
+        auto req = requestsQueue.popSafe();
+        if (!req) break;
+
+        req->reject(Error(error));
+    }
 }
 
 std::string
@@ -445,11 +739,43 @@ Fd Connection::fd() const
     return fd_;
 }
 
-void
+bool
 Connection::handleResponsePacket(const char* buffer, size_t totalBytes) {
 
-    parser.feed(buffer, totalBytes);
-    if (parser.parse() == Private::State::Done) {
+    auto state = Private::State::Again;
+    for (;;) {
+        const bool streaming = requestEntry && requestEntry->onData && parser.headersParsed();
+
+        // A streamed body does not stay in the parser, so it can be fed as
+        // much as the parser holds at a time
+        size_t len = totalBytes;
+        if (streaming)
+            len = std::min(len, parser.buffer.available());
+
+        if ((len == 0 && totalBytes > 0) || !parser.feed(buffer, len)) {
+            parser.reset();
+            return false;
+        }
+        buffer += len;
+        totalBytes -= len;
+
+        state = parser.parse();
+
+        if (requestEntry && requestEntry->onData && parser.headersParsed())
+            deliverBody();
+
+        if (state == Private::State::Done || totalBytes == 0)
+            break;
+    }
+
+    if (state == Private::State::Done) {
+        transport_->abortPendingRequest(fd_);
+
+        // Close before the connection goes back to the pool, so that the next
+        // request opens a new one instead of racing with the server
+        if (!isReusable(parser.response))
+            transport_->closeConnection(shared_from_this());
+
         if (requestEntry) {
             if (requestEntry->timer) {
                 requestEntry->timer->disarm();
@@ -467,10 +793,53 @@ Connection::handleResponsePacket(const char* buffer, size_t totalBytes) {
                 onDone();
         }
     }
+
+    return true;
+}
+
+void
+Connection::deliverBody() {
+    auto& response = parser.response;
+
+    if (!requestEntry->headDelivered) {
+        requestEntry->headDelivered = true;
+        pace(requestEntry->onData(response, nullptr, 0));
+    }
+
+    const auto& body = parser.partialBody();
+    if (!body.empty())
+        pace(requestEntry->onData(response, body.data(), body.size()));
+
+    // The body is not kept, nor are the bytes it was parsed from, so that a
+    // response of any size can go through
+    parser.consumeBody();
+}
+
+/* What was already received is still handed over, but the socket is not read
+ * any further until the consumer caught up. The promise settles from any
+ * thread, the reads are resumed from the transport one.
+ */
+void
+Connection::pace(Async::Promise<void> until) {
+    if (!until.isPending())
+        return;
+
+    auto transport = transport_;
+    auto fd = fd_;
+    auto suspension = transport->suspendReads(fd);
+    auto resume = [transport, fd, suspension]() {
+        auto self = transport.get();
+        transport->armTimer(std::chrono::microseconds(0), [self, fd, suspension]() {
+            self->resumeReads(fd, suspension);
+        });
+    };
+
+    until.then(resume, [resume](std::exception_ptr) { resume(); });
 }
 
 void
 Connection::handleError(const char* error) {
+    transport_->abortPendingRequest(fd_);
     if (requestEntry) {
         if (requestEntry->timer) {
             requestEntry->timer->disarm();
@@ -490,13 +859,13 @@ Connection::handleError(const char* error) {
 
 void
 Connection::handleTimeout() {
+    transport_->abortPendingRequest(fd_);
     if (requestEntry) {
         timerPool_.releaseTimer(requestEntry->timer);
 
         auto onDone = requestEntry->onDone;
 
-        /* @API: create a TimeoutException */
-        requestEntry->reject(std::runtime_error("Timeout"));
+        requestEntry->reject(TimeoutError());
 
         requestEntry.reset(nullptr);
 
@@ -508,43 +877,54 @@ Connection::handleTimeout() {
 
 Async::Promise<Response>
 Connection::perform(
-        const Http::Request& request,
+        Http::Request request,
         std::chrono::milliseconds timeout,
-        Connection::OnDone onDone) {
-    return Async::Promise<Response>([=](Async::Resolver& resolve, Async::Rejection& reject) {
-        performImpl(request, timeout, std::move(resolve), std::move(reject), std::move(onDone));
+        Connection::OnDone onDone,
+        Connection::OnData onData) {
+    return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
+        performImpl(
+                std::move(request), timeout, std::move(resolve), std::move(reject),
+                std::move(onDone), std::move(onData));
     });
 }
 
 Async::Promise<Response>
 Connection::asyncPerform(
-        const Http::Request& request,
+        Http::Request request,
         std::chrono::milliseconds timeout,
-        Connection::OnDone onDone) {
-    return Async::Promise<Response>([=](Async::Resolver& resolve, Async::Rejection& reject) {
+        Connection::OnDone onDone,
+        Connection::OnData onData) {
+    return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
         requestsQueue.push(
             RequestData(
                 std::move(resolve),
                 std::move(reject),
-                request,
+                std::move(request),
                 timeout,
-                std::move(onDone)));
+                std::move(onDone),
+                std::move(onData)));
     });
 }
 
 void
 Connection::performImpl(
-        const Http::Request& request,
+        Http::Request request,
         std::chrono::milliseconds timeout,
         Async::Resolver resolve,
         Async::Rejection reject,
-        Connection::OnDone onDone) {
+        Connection::OnDone onDone,
+        Connection::OnData onData) {
 
-    std::stringstream streamBuf;
-    writeRequest(streamBuf, request);
-    if (!streamBuf)
+    requestBuf_.clear();
+    std::ostream os(&requestBuf_);
+    writeRequestHead(os, request);
+    if (!os) {
         reject(std::runtime_error("Could not write request"));
-    std::string buffer = streamBuf.str();
+        if (onDone)
+            onDone();
+        return;
+    }
+    StringView head(requestBuf_.data(), requestBuf_.size());
 
     std::shared_ptr<TimerPool::Entry> timer(nullptr);
     if (timeout.count() > 0) {
@@ -552,12 +932,15 @@ Connection::performImpl(
         timer->arm(timeout);
     }
 
-    auto rejectClone = reject.clone();
+    requestEntry.reset(new RequestEntry(
+                std::move(resolve), std::move(reject), timer, std::move(onDone), std::move(onData)));
 
-    requestEntry.reset(new RequestEntry(std::move(resolve), std::move(reject), timer, std::move(onDone)));
-    transport_->asyncSendRequest(shared_from_this(), timer, std::move(buffer)).then(
+    // The request might also fail on the reading side, so it is only ever
+    // rejected through the entry
+    auto self = shared_from_this();
+    transport_->asyncSendRequest(self, timer, head, std::move(request)).then(
         [](size_t /*bytes*/) {},
-        [&](std::exception_ptr e) { rejectClone(e); });
+        [self](std::exception_ptr) { self->handleError("Could not send request"); });
 }
 
 void
@@ -567,8 +950,9 @@ Connection::processRequestQueue() {
         if (!req) break;
 
         performImpl(
-                req->request,
-                req->timeout, std::move(req->resolve), std::move(req->reject), std::move(req->onDone));
+                std::move(req->request),
+                req->timeout, std::move(req->resolve), std::move(req->reject),
+                std::move(req->onDone), std::move(req->onData));
     }
 
 }
@@ -683,6 +1067,12 @@ RequestBuilder::header(const std::shared_ptr<Header::Header>& header) {
     return *this;
 }
 
+RequestBuilder&
+RequestBuilder::header(const Header::Raw& header) {
+    request_.headers_.addRaw(header);
+    return *this;
+}
+
 RequestBuilder&
 RequestBuilder::cookie(const Cookie& cookie) {
     request_.cookies_.add(cookie);
@@ -691,13 +1081,22 @@ RequestBuilder::cookie(const Cookie& cookie) {
 
 RequestBuilder&
 RequestBuilder::body(const std::string& val) {
-    request_.body_ = val;
+    request_.body_.clear();
+    request_.sharedBody_ = std::make_shared<const std::string>(val);
     return *this;
 }
 
 RequestBuilder&
 RequestBuilder::body(std::string&& val) {
-    request_.body_ = std::move(val);
+    request_.body_.clear();
+    request_.sharedBody_ = std::make_shared<const std::string>(std::move(val));
+    return *this;
+}
+
+RequestBuilder&
+RequestBuilder::body(std::shared_ptr<const std::string> val) {
+    request_.body_.clear();
+    request_.sharedBody_ = std::move(val);
     return *this;
 }
 
@@ -707,9 +1106,507 @@ RequestBuilder::timeout(std::chrono::milliseconds val) {
     return *this;
 }
 
+RequestBuilder&
+RequestBuilder::retries(int val) {
+    retries_ = val;
+    return *this;
+}
+
+RequestBuilder&
+RequestBuilder::stream(Connection::OnData onData) {
+    onData_ = std::move(onData);
+    return *this;
+}
+
+RequestBuilder&
+RequestBuilder::cancellation(Async::CancellationToken token) {
+    cancellation_ = std::move(token);
+    return *this;
+}
+
+// The request is copied so that the builder can send it again, but its body
+// is shared: only the head is copied, here and for every attempt
 Async::Promise<Response>
 RequestBuilder::send() {
-    return client_->doRequest(request_, timeout_);
+    if (!cancellation_.isCancellable()) {
+        if (onData_)
+            return client_->sendRequest(request_, timeout_, onData_);
+
+        return client_->doRequest(request_, timeout_, retries_);
+    }
+
+    if (cancellation_.isCancelled())
+        return Async::Promise<Response>::rejected(Async::Cancelled());
+
+    auto response = onData_
+        ? client_->sendRequest(request_, timeout_, onData_)
+        : client_->doRequest(request_, timeout_, retries_, cancellation_);
+    return Async::cancellable(response, cancellation_);
+}
+
+LatencyTracker::LatencyTracker(size_t capacity)
+    : lock_()
+    , capacity_(capacity)
+    , samples_()
+    , next_(0)
+{
+    samples_.reserve(capacity_);
+}
+
+void
+LatencyTracker::record(std::chrono::microseconds latency) {
+    Guard guard(lock_);
+    if (samples_.size() < capacity_) {
+        samples_.push_back(latency);
+    } else {
+        samples_[next_] = latency;
+        next_ = (next_ + 1) % capacity_;
+    }
+}
+
+size_t
+LatencyTracker::samples() const {
+    Guard guard(lock_);
+    return samples_.size();
+}
+
+Optional<std::chrono::microseconds>
+LatencyTracker::percentile(double p) const {
+    std::vector<std::chrono::microseconds> sorted;
+    {
+        Guard guard(lock_);
+        if (samples_.size() < MinSamples)
+            return None();
+        sorted = samples_;
+    }
+
+    p = std::min(std::max(p, 0.0), 1.0);
+    auto index = std::min(
+            static_cast<size_t>(p * sorted.size()), sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return Some(sorted[index]);
+}
+
+RetryBudget::RetryBudget(size_t capacity, double refillPerSecond)
+    : lock_()
+    , capacity_(static_cast<double>(capacity))
+    , refillPerSecond_(refillPerSecond)
+    , tokens_(static_cast<double>(capacity))
+    , lastRefill_(Clock::now())
+{ }
+
+void
+RetryBudget::refill(Clock::time_point now) const {
+    if (now <= lastRefill_)
+        return;
+
+    std::chrono::duration<double> elapsed = now - lastRefill_;
+    tokens_ = std::min(capacity_, tokens_ + elapsed.count() * refillPerSecond_);
+    lastRefill_ = now;
+}
+
+bool
+RetryBudget::tryAcquire(Clock::time_point now) {
+    Guard guard(lock_);
+    refill(now);
+    if (tokens_ < 1.0)
+        return false;
+
+    tokens_ -= 1.0;
+    return true;
+}
+
+size_t
+RetryBudget::available(Clock::time_point now) const {
+    Guard guard(lock_);
+    refill(now);
+    return static_cast<size_t>(tokens_);
+}
+
+BackendSet::BackendSet(
+        const std::vector<std::string>& addresses,
+        size_t maxFailures,
+        std::chrono::milliseconds ejectionTime)
+    : lock_()
+    , backends_()
+    , maxFailures_(maxFailures)
+    , ejectionTime_(ejectionTime)
+    , random_(std::random_device()())
+{
+    for (const auto& address: addresses)
+        backends_.push_back(std::make_shared<Backend>(address));
+}
+
+double
+BackendSet::score(const Backend& backend) {
+    return (backend.inFlight + 1) * (backend.latencyEwma + 1.0);
+}
+
+std::shared_ptr<Backend>
+BackendSet::pick(Clock::time_point now) {
+    Guard guard(lock_);
+
+    std::vector<size_t> healthy;
+    healthy.reserve(backends_.size());
+    for (size_t i = 0; i < backends_.size(); ++i) {
+        if (backends_[i]->ejectedUntil <= now)
+            healthy.push_back(i);
+    }
+
+    // Panic mode: better try an ejected backend than failing right away
+    if (healthy.empty()) {
+        for (size_t i = 0; i < backends_.size(); ++i)
+            healthy.push_back(i);
+    }
+
+    std::shared_ptr<Backend> chosen;
+    if (healthy.size() == 1) {
+        chosen = backends_[healthy[0]];
+    } else {
+        std::uniform_int_distribution<size_t> dist(0, healthy.size() - 1);
+        auto first = dist(random_);
+        auto second = dist(random_);
+        if (second == first)
+            second = (first + 1) % healthy.size();
+
+        const auto& a = backends_[healthy[first]];
+        const auto& b = backends_[healthy[second]];
+        chosen = score(*b) < score(*a) ? b : a;
+    }
+
+    ++chosen->inFlight;
+    return chosen;
+}
+
+void
+BackendSet::release(
+        const std::shared_ptr<Backend>& backend,
+        bool success,
+        std::chrono::microseconds latency,
+        Clock::time_point now) {
+    Guard guard(lock_);
+
+    if (backend->inFlight > 0)
+        --backend->inFlight;
+
+    if (success) {
+        backend->failures = 0;
+        if (backend->latencyEwma == 0.0)
+            backend->latencyEwma = static_cast<double>(latency.count());
+        else
+            backend->latencyEwma = EwmaWeight * latency.count()
+                                 + (1.0 - EwmaWeight) * backend->latencyEwma;
+    }
+    else if (++backend->failures >= maxFailures_) {
+        backend->failures = 0;
+        backend->ejectedUntil = now + ejectionTime_;
+    }
+}
+
+void
+BackendSet::update(const std::vector<std::string>& addresses) {
+    if (addresses.empty())
+        return;
+
+    Guard guard(lock_);
+
+    std::vector<std::shared_ptr<Backend>> backends;
+    backends.reserve(addresses.size());
+    for (const auto& address: addresses) {
+        auto it = std::find_if(backends_.begin(), backends_.end(), [&](const std::shared_ptr<Backend>& backend) {
+            return backend->address == address;
+        });
+        backends.push_back(it != backends_.end() ? *it : std::make_shared<Backend>(address));
+    }
+
+    // Requests in flight on a removed backend still hold it
+    backends_.swap(backends);
+}
+
+size_t
+BackendSet::size() const {
+    Guard guard(lock_);
+    return backends_.size();
+}
+
+size_t
+BackendSet::available(Clock::time_point now) const {
+    Guard guard(lock_);
+    return std::count_if(backends_.begin(), backends_.end(), [&](const std::shared_ptr<Backend>& backend) {
+        return backend->ejectedUntil <= now;
+    });
+}
+
+namespace {
+    // Value of a header, whether it is a known one or a raw one
+    Optional<std::string> headerValue(const Header::Collection& headers, const std::string& name) {
+        auto header = headers.tryGet(name);
+        if (header) {
+            std::ostringstream oss;
+            header->write(oss);
+            return Some(oss.str());
+        }
+
+        for (const auto& raw: headers.rawList()) {
+            if (!strcasecmp(raw.second.name().c_str(), name.c_str()))
+                return Some(raw.second.value());
+        }
+
+        return None();
+    }
+
+    // Returns false for "Vary: *", the response then varies on everything
+    bool varyOf(const Header::Collection& headers, std::vector<std::string>& names) {
+        auto vary = headerValue(headers, "Vary");
+        if (vary.isEmpty())
+            return true;
+
+        std::istringstream iss(vary.unsafeGet());
+        std::string name;
+        while (std::getline(iss, name, ',')) {
+            auto first = name.find_first_not_of(" \t");
+            if (first == std::string::npos)
+                continue;
+            auto last = name.find_last_not_of(" \t");
+            name = Header::toLowercase(name.substr(first, last - first + 1));
+            if (name == "*")
+                return false;
+            if (std::find(names.begin(), names.end(), name) == names.end())
+                names.push_back(std::move(name));
+        }
+
+        std::sort(names.begin(), names.end());
+        return true;
+    }
+
+    // The query as sent on the wire, with its parameters sorted since the
+    // order of a Uri::Query is not stable
+    std::string queryKey(const Uri::Query& query) {
+        std::vector<std::pair<std::string, std::string>> params(
+                query.parameters_begin(), query.parameters_end());
+        std::sort(params.begin(), params.end());
+
+        std::string key;
+        for (const auto& param: params) {
+            key += key.empty() ? '?' : '&';
+            key += param.first;
+            key += '=';
+            key += param.second;
+        }
+        return key;
+    }
+
+    struct Freshness {
+        bool storable;
+        std::chrono::seconds lifetime;
+    };
+
+    Freshness freshness(const Http::Header::Collection& headers) {
+        Freshness result { true, std::chrono::seconds(0) };
+
+        auto cc = headers.tryGet<Http::Header::CacheControl>();
+        if (!cc)
+            return result;
+
+        bool noCache = false;
+        for (const auto& directive: cc->directives()) {
+            switch (directive.directive()) {
+            case CacheDirective::NoStore:
+            case CacheDirective::Private:
+                result.storable = false;
+                break;
+            case CacheDirective::NoCache:
+                noCache = true;
+                break;
+            case CacheDirective::MaxAge:
+                result.lifetime = directive.delta();
+                break;
+            default:
+                break;
+            }
+        }
+
+        // no-cache means the entry can be kept but must always be revalidated
+        if (noCache)
+            result.lifetime = std::chrono::seconds(0);
+
+        return result;
+    }
+}
+
+ResponseCache::ResponseCache(size_t maxBytes, size_t shards)
+    : maxBytesPerShard_(maxBytes / std::max<size_t>(shards, 1))
+    , shards_()
+    , varyLock_()
+    , vary_()
+{
+    for (size_t i = 0; i < std::max<size_t>(shards, 1); ++i)
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+}
+
+std::string
+ResponseCache::keyFor(const std::string& resource, const Header::Collection& headers) const {
+    std::string key = resource;
+
+    Guard guard(varyLock_);
+    auto it = vary_.find(resource);
+    if (it == std::end(vary_))
+        return key;
+
+    // Line feeds can not appear in a resource nor in a header value
+    for (const auto& name: it->second) {
+        key += '\n';
+        key += name;
+        auto value = headerValue(headers, name);
+        if (!value.isEmpty()) {
+            key += '=';
+            key += value.unsafeGet();
+        }
+    }
+
+    return key;
+}
+
+ResponseCache::Shard&
+ResponseCache::shardFor(const std::string& key) const {
+    return *shards_[std::hash<std::string>()(key) % shards_.size()];
+}
+
+void
+ResponseCache::eraseLocked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it) {
+    shard.bytes -= it->second.size;
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+ResponseCache::Lookup
+ResponseCache::lookup(
+        const std::string& key, Response& response, std::string& etag,
+        Clock::time_point now) {
+    auto& shard = shardFor(key);
+    Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it == std::end(shard.entries))
+        return Lookup::Miss;
+
+    auto& entry = it->second;
+    if (entry.expires <= now && entry.etag.empty()) {
+        eraseLocked(shard, it);
+        return Lookup::Miss;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+    response = entry.response;
+    etag = entry.etag;
+
+    return entry.expires > now ? Lookup::Fresh : Lookup::Stale;
+}
+
+void
+ResponseCache::store(
+        const std::string& resource, const Header::Collection& headers,
+        const Response& response, Clock::time_point now) {
+    if (response.code() != Code::Ok)
+        return;
+
+    std::vector<std::string> vary;
+    if (!varyOf(response.headers(), vary)) {
+        erase(keyFor(resource, headers));
+        return;
+    }
+
+    {
+        Guard guard(varyLock_);
+        if (vary.empty())
+            vary_.erase(resource);
+        else
+            vary_[resource] = std::move(vary);
+    }
+
+    storeAt(keyFor(resource, headers), response, now);
+}
+
+void
+ResponseCache::storeAt(const std::string& key, const Response& response, Clock::time_point now) {
+    auto fresh = freshness(response.headers());
+    std::string etag;
+    auto etagHeader = response.headers().tryGet<Header::ETag>();
+    if (etagHeader)
+        etag = etagHeader->tag();
+
+    auto& shard = shardFor(key);
+    Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it != std::end(shard.entries))
+        eraseLocked(shard, it);
+
+    // Without a lifetime, an entry is only useful if it can be revalidated
+    if (!fresh.storable || (fresh.lifetime.count() == 0 && etag.empty()))
+        return;
+
+    size_t size = response.body().size() + key.size() + EntryOverhead;
+    if (size > maxBytesPerShard_)
+        return;
+
+    while (shard.bytes + size > maxBytesPerShard_ && !shard.lru.empty()) {
+        eraseLocked(shard, shard.entries.find(shard.lru.back()));
+    }
+
+    shard.lru.push_front(key);
+    Entry entry { response, std::move(etag), size, now + fresh.lifetime, shard.lru.begin() };
+    shard.entries.insert(std::make_pair(key, std::move(entry)));
+    shard.bytes += size;
+}
+
+void
+ResponseCache::refresh(const std::string& key, const Response& notModified, Clock::time_point now) {
+    auto fresh = freshness(notModified.headers());
+
+    auto& shard = shardFor(key);
+    Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it == std::end(shard.entries))
+        return;
+
+    if (!fresh.storable) {
+        eraseLocked(shard, it);
+        return;
+    }
+
+    it->second.expires = now + fresh.lifetime;
+}
+
+void
+ResponseCache::erase(const std::string& key) {
+    auto& shard = shardFor(key);
+    Guard guard(shard.lock);
+
+    auto it = shard.entries.find(key);
+    if (it != std::end(shard.entries))
+        eraseLocked(shard, it);
+}
+
+size_t
+ResponseCache::bytes() const {
+    size_t total = 0;
+    for (const auto& shard: shards_) {
+        Guard guard(shard->lock);
+        total += shard->bytes;
+    }
+    return total;
+}
+
+size_t
+ResponseCache::entries() const {
+    size_t total = 0;
+    for (const auto& shard: shards_) {
+        Guard guard(shard->lock);
+        total += shard->entries.size();
+    }
+    return total;
 }
 
 Client::Options&
@@ -730,6 +1627,93 @@ Client::Options::maxConnectionsPerHost(int val) {
     return *this;
 }
 
+Client::Options&
+Client::Options::hedgeDelay(std::chrono::milliseconds val) {
+    hedgeDelay_ = val;
+    return *this;
+}
+
+Client::Options&
+Client::Options::hedgePercentile(double val) {
+    hedgePercentile_ = val;
+    return *this;
+}
+
+Client::Options&
+Client::Options::retryBudget(size_t capacity, double refillPerSecond) {
+    retryBudgetCapacity_ = capacity;
+    retryBudgetRefill_ = refillPerSecond;
+    return *this;
+}
+
+Client::Options&
+Client::Options::outlierEjection(size_t consecutiveFailures, std::chrono::milliseconds duration) {
+    maxFailures_ = consecutiveFailures;
+    ejectionTime_ = duration;
+    return *this;
+}
+
+Client::Options&
+Client::Options::cache(size_t maxBytes) {
+    cacheBytes_ = maxBytes;
+    return *this;
+}
+
+// A caller waiting for the response of a GET that is already in flight
+struct Client::Waiter {
+    Waiter(Async::Resolver resolve, Async::Rejection reject)
+        : resolve(std::move(resolve))
+        , reject(std::move(reject))
+    { }
+
+    Async::Resolver resolve;
+    Async::Rejection reject;
+};
+
+/* State shared by all the attempts (original request, hedge and retries)
+ * made on behalf of a single call. The first attempt to succeed resolves
+ * the promise, the other ones are ignored.
+ */
+struct Client::Call {
+    Call(Async::Resolver resolve, Async::Rejection reject,
+         Http::Request request,
+         std::chrono::milliseconds timeout,
+         std::shared_ptr<HostStats> stats,
+         int retries,
+         Async::CancellationToken cancellation)
+        : resolve(std::move(resolve))
+        , reject(std::move(reject))
+        , request(std::move(request))
+        , timeout(timeout)
+        , stats(std::move(stats))
+        , cancellation(std::move(cancellation))
+        , attempts(this->cancellation.isCancellable()
+                ? this->cancellation.child() : Async::CancellationToken::create())
+        , done(false)
+        , outstanding(0)
+        , retriesLeft(retries)
+    { }
+
+    // Returns true for the only caller that gets to settle the promise
+    bool complete() {
+        return !done.exchange(true);
+    }
+
+    Async::Resolver resolve;
+    Async::Rejection reject;
+    const Http::Request request;
+    std::chrono::milliseconds timeout;
+    std::shared_ptr<HostStats> stats;
+    // Set by the caller, no retry nor hedge is sent once it is cancelled
+    const Async::CancellationToken cancellation;
+    // Cancelled once the call is settled, drops the attempts still running
+    const Async::CancellationToken attempts;
+
+    std::atomic<bool> done;
+    std::atomic<int> outstanding;
+    std::atomic<int> retriesLeft;
+};
+
 Client::Client()
     : reactor_(Aio::Reactor::create())
     , pool()
@@ -738,6 +1722,24 @@ Client::Client()
     , queuesLock()
     , requestsQueues()
     , stopProcessPequestsQueues(false)
+    , hedgeDelay_(0)
+    , hedgePercentile_(0.0)
+    , retryBudgetCapacity_(Default::RetryBudgetCapacity)
+    , retryBudgetRefill_(Default::RetryBudgetRefill)
+    , hostsLock()
+    , hostStats()
+    , maxFailures_(Default::MaxConsecutiveFailures)
+    , ejectionTime_(Default::EjectionTime)
+    , servicesLock()
+    , services()
+    , resolvedServices()
+    , resolverThread()
+    , resolverCv()
+    , pendingResolutions()
+    , stopResolver(false)
+    , cache_()
+    , inflightLock()
+    , inflight()
 { }
 
 Client::~Client() {
@@ -752,6 +1754,14 @@ Client::options() {
 void
 Client::init(const Client::Options& options) {
     pool.init(options.maxConnectionsPerHost_);
+    hedgeDelay_ = options.hedgeDelay_;
+    hedgePercentile_ = options.hedgePercentile_;
+    retryBudgetCapacity_ = options.retryBudgetCapacity_;
+    retryBudgetRefill_ = options.retryBudgetRefill_;
+    maxFailures_ = options.maxFailures_;
+    ejectionTime_ = options.ejectionTime_;
+    if (options.cacheBytes_ > 0)
+        cache_ = std::make_shared<ResponseCache>(options.cacheBytes_);
     reactor_->init(Aio::AsyncContext(options.threads_));
     transportKey = reactor_->addHandler(std::make_shared<Transport>());
     reactor_->run();
@@ -760,6 +1770,19 @@ Client::init(const Client::Options& options) {
 void
 Client::shutdown() {
     reactor_->shutdown();
+
+    // Their callbacks, e.g. of the hedges, would never run and refer to us
+    for (const auto& handler: reactor_->handlers(transportKey))
+        std::static_pointer_cast<Transport>(handler)->cancelTimers();
+
+    {
+        Guard guard(servicesLock);
+        stopResolver = true;
+    }
+    resolverCv.notify_one();
+    if (resolverThread.joinable())
+        resolverThread.join();
+
     Guard guard(queuesLock);
     stopProcessPequestsQueues = true;
 }
@@ -808,21 +1831,372 @@ Client::prepareRequest(const std::string& resource, Http::Method method)
 Async::Promise<Response>
 Client::doRequest(
         Http::Request request,
-        std::chrono::milliseconds timeout)
+        std::chrono::milliseconds timeout,
+        int retries,
+        Async::CancellationToken cancellation)
+{
+    // A conditional request from the caller is passed through as is
+    if (cache_ && request.method() == Http::Method::Get && !request.headers().has<Header::IfNoneMatch>())
+        return doCachedRequest(std::move(request), timeout, retries);
+
+    return doRequestImpl(std::move(request), timeout, retries, std::move(cancellation));
+}
+
+Async::Promise<Response>
+Client::doCachedRequest(
+        Http::Request request,
+        std::chrono::milliseconds timeout,
+        int retries)
+{
+    // Credentials make the response specific to the caller
+    if (!headerValue(request.headers(), "Authorization").isEmpty())
+        return doRequestImpl(std::move(request), timeout, retries);
+
+    // Different queries are different resources
+    const auto resource = request.resource_ + queryKey(request.query());
+    const auto key = cache_->keyFor(resource, request.headers());
+    // Kept to key the response on the headers it turns out to vary on
+    const auto headers = request.headers();
+
+    bool revalidate = false;
+    auto cc = request.headers().tryGet<Header::CacheControl>();
+    if (cc) {
+        for (const auto& directive: cc->directives()) {
+            if (directive.directive() == CacheDirective::NoStore)
+                return doRequestImpl(std::move(request), timeout, retries);
+            if (directive.directive() == CacheDirective::NoCache)
+                revalidate = true;
+        }
+    }
+
+    Response cached;
+    std::string etag;
+    auto state = cache_->lookup(key, cached, etag);
+    if (state == ResponseCache::Lookup::Fresh && !revalidate)
+        return Async::Promise<Response>::resolved(std::move(cached));
+
+    const bool conditional = state != ResponseCache::Lookup::Miss && !etag.empty();
+
+    return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
+        auto waiter = std::make_shared<Waiter>(std::move(resolve), std::move(reject));
+        {
+            Guard guard(inflightLock);
+            auto& waiters = inflight[key];
+            waiters.push_back(std::move(waiter));
+            // Somebody is already fetching it, we will get its response
+            if (waiters.size() > 1)
+                return;
+        }
+
+        if (conditional)
+            request.headers_.add<Header::IfNoneMatch>(etag);
+
+        auto cache = cache_;
+        auto takeWaiters = [this, key]() {
+            Guard guard(inflightLock);
+            auto it = inflight.find(key);
+            std::vector<std::shared_ptr<Waiter>> waiters = std::move(it->second);
+            inflight.erase(it);
+            return waiters;
+        };
+
+        doRequestImpl(std::move(request), timeout, retries).then(
+            [=](Response response) {
+                if (conditional && response.code() == Code::Not_Modified) {
+                    cache->refresh(key, response);
+                    response = cached;
+                } else {
+                    cache->store(resource, headers, response);
+                }
+
+                for (const auto& waiter: takeWaiters()) {
+                    Response copy = response;
+                    waiter->resolve(std::move(copy));
+                }
+            },
+            [=](std::exception_ptr exc) {
+                for (const auto& waiter: takeWaiters())
+                    waiter->reject(exc);
+            });
+    });
+}
+
+Async::Promise<Response>
+Client::doRequestImpl(
+        Http::Request request,
+        std::chrono::milliseconds timeout,
+        int retries,
+        Async::CancellationToken cancellation)
+{
+    // Sending any other request twice could apply it twice
+    const bool idempotent = isIdempotent(request.method());
+    const bool hedge = (hedgeDelay_.count() > 0 || hedgePercentile_ > 0.0) && idempotent;
+
+    if (!hedge && (retries <= 0 || !idempotent))
+        return sendRequest(std::move(request), timeout);
+
+    auto stats = statsFor(splitUrl(request.resource()).first.toString());
+
+    return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
+        auto call = std::make_shared<Call>(
+                std::move(resolve), std::move(reject), std::move(request), timeout, stats, retries,
+                std::move(cancellation));
+        launch(call);
+
+        if (!hedge)
+            return;
+
+        auto delay = hedgeDelayFor(*stats);
+        if (delay.isEmpty())
+            return;
+
+        // The hedge timer lives in one of our transports, no extra thread
+        auto transports = reactor_->handlers(transportKey);
+        auto index = ioIndex.fetch_add(1) % transports.size();
+        auto transport = std::static_pointer_cast<Transport>(transports[index]);
+        transport->armTimer(delay.unsafeGet(), [this, call]() {
+            if (call->done.load() || call->cancellation.isCancelled())
+                return;
+            if (call->stats->budget.tryAcquire())
+                launch(call);
+        });
+    });
+}
+
+void
+Client::launch(const std::shared_ptr<Call>& call) {
+    call->outstanding.fetch_add(1);
+    auto start = std::chrono::steady_clock::now();
+
+    // A copy of the head, the body is shared by all the attempts
+    auto response = sendRequest(call->request, call->timeout);
+    Async::cancellable(response, call->attempts).then(
+        [call, start](Response response) {
+            call->outstanding.fetch_sub(1);
+            call->stats->latency.record(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start));
+            if (call->complete()) {
+                call->resolve(std::move(response));
+                // The losing hedge, if any, is not waited for
+                call->attempts.cancel();
+            }
+        },
+        [this, call](std::exception_ptr exc) {
+            auto left = call->outstanding.fetch_sub(1) - 1;
+            if (call->done.load())
+                return;
+
+            if (!call->cancellation.isCancelled()
+                    && isIdempotent(call->request.method())
+                    && call->retriesLeft.fetch_sub(1) > 0 && call->stats->budget.tryAcquire()) {
+                launch(call);
+                return;
+            }
+
+            // Only give up once the hedge, if any, failed as well
+            if (left == 0 && call->complete()) {
+                call->reject(exc);
+                call->attempts.cancel();
+            }
+        });
+}
+
+std::shared_ptr<Client::HostStats>
+Client::statsFor(const std::string& host) {
+    Guard guard(hostsLock);
+    auto it = hostStats.find(host);
+    if (it == std::end(hostStats)) {
+        auto stats = std::make_shared<HostStats>(retryBudgetCapacity_, retryBudgetRefill_);
+        it = hostStats.insert(std::make_pair(host, std::move(stats))).first;
+    }
+    return it->second;
+}
+
+Optional<std::chrono::microseconds>
+Client::hedgeDelayFor(const HostStats& stats) const {
+    if (hedgePercentile_ > 0.0) {
+        auto delay = stats.latency.percentile(hedgePercentile_);
+        if (!delay.isEmpty())
+            return delay;
+    }
+
+    if (hedgeDelay_.count() > 0)
+        return Some(std::chrono::duration_cast<std::chrono::microseconds>(hedgeDelay_));
+
+    return None();
+}
+
+Async::Promise<Response>
+Client::sendToBackend(
+        Http::Request request,
+        std::chrono::milliseconds timeout,
+        std::shared_ptr<BackendSet> service,
+        Connection::OnData onData)
+{
+    auto backend = service->pick();
+
+    // Address the backend directly: the pool and the connections are then
+    // the per-endpoint ones. The backend still sees the name of the service.
+    auto s = splitUrl(request.resource_);
+    if (!request.headers().has<Header::Host>())
+        request.headers_.add<Header::Host>(s.first.toString(), Port(0));
+    std::string resource = backend->address;
+    if (s.second.size() == 0 || s.second[0] != '/')
+        resource += '/';
+    resource.append(s.second.data(), s.second.size());
+    request.resource_ = std::move(resource);
+
+    auto start = std::chrono::steady_clock::now();
+    return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
+        auto settle = std::make_shared<std::pair<Async::Resolver, Async::Rejection>>(
+                std::move(resolve), std::move(reject));
+
+        auto elapsed = [start]() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start);
+        };
+
+        sendRequest(std::move(request), timeout, std::move(onData)).then(
+            [=](Response response) {
+                // Server errors count as failures for outlier detection
+                bool success = static_cast<int>(response.code()) < 500;
+                service->release(backend, success, elapsed());
+                settle->first(std::move(response));
+            },
+            [=](std::exception_ptr exc) {
+                service->release(backend, false, elapsed());
+                settle->second(exc);
+            });
+    });
+}
+
+void
+Client::registerService(const std::string& name, const std::vector<std::string>& addresses) {
+    if (addresses.empty())
+        throw std::invalid_argument("A service needs at least one backend");
+
+    auto service = std::make_shared<BackendSet>(addresses, maxFailures_, ejectionTime_);
+
+    Guard guard(servicesLock);
+    services[name] = std::move(service);
+    resolvedServices.erase(name);
+}
+
+void
+Client::registerService(
+        const std::string& name, const std::string& host, Port port,
+        std::chrono::milliseconds refresh) {
+    registerService(name, resolveService(host, port));
+
+    Guard guard(servicesLock);
+    resolvedServices[name] = ResolvedService {
+        host, port, refresh, std::chrono::steady_clock::now() + refresh
+    };
+
+    if (!resolverThread.joinable())
+        resolverThread = std::thread([this]() { runResolver(); });
+}
+
+std::vector<std::string>
+Client::resolveService(const std::string& host, Port port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    AddrInfo addressInfo;
+    TRY(addressInfo.invoke(host.c_str(), port.toString().c_str(), &hints));
+
+    std::vector<std::string> addresses;
+    for (const addrinfo *addr = addressInfo.get_info_ptr(); addr; addr = addr->ai_next) {
+        auto address = Address::fromUnix(addr->ai_addr);
+        std::string str = address.family() == AF_INET6
+            ? "[" + address.host() + "]"
+            : address.host();
+        str += ":" + address.port().toString();
+
+        if (std::find(addresses.begin(), addresses.end(), str) == addresses.end())
+            addresses.push_back(std::move(str));
+    }
+
+    return addresses;
+}
+
+void
+Client::runResolver() {
+    std::unique_lock<Lock> guard(servicesLock);
+    for (;;) {
+        resolverCv.wait(guard, [this]() { return stopResolver || !pendingResolutions.empty(); });
+        if (stopResolver)
+            return;
+
+        auto name = std::move(pendingResolutions.front());
+        pendingResolutions.pop_front();
+
+        auto it = services.find(name);
+        auto resolved = resolvedServices.find(name);
+        // Registered again with a static list meanwhile
+        if (it == std::end(services) || resolved == std::end(resolvedServices))
+            continue;
+
+        auto service = it->second;
+        auto host = resolved->second.host;
+        auto port = resolved->second.port;
+
+        guard.unlock();
+        // A failed resolution keeps the previous backends
+        try {
+            service->update(resolveService(host, port));
+        } catch (const std::exception&) { }
+        guard.lock();
+    }
+}
+
+std::shared_ptr<BackendSet>
+Client::serviceFor(const std::string& name) {
+    Guard guard(servicesLock);
+    auto it = services.find(name);
+    if (it == std::end(services))
+        return nullptr;
+
+    auto now = std::chrono::steady_clock::now();
+    auto resolved = resolvedServices.find(name);
+    if (resolved != std::end(resolvedServices) && now >= resolved->second.nextRefresh) {
+        // Queued once, every caller goes on with the current backends
+        resolved->second.nextRefresh = now + resolved->second.refresh;
+        pendingResolutions.push_back(name);
+        resolverCv.notify_one();
+    }
+
+    return it->second;
+}
+
+Async::Promise<Response>
+Client::sendRequest(
+        Http::Request request,
+        std::chrono::milliseconds timeout,
+        Connection::OnData onData)
 {
     //request.headers_.add<Header::Connection>(ConnectionControl::KeepAlive);
     request.headers_.remove<Header::UserAgent>();
     auto resource = request.resource();
 
     auto s = splitUrl(resource);
+
+    auto service = serviceFor(s.first.toString());
+    if (service)
+        return sendToBackend(std::move(request), timeout, std::move(service), std::move(onData));
+
     auto conn = pool.pickConnection(s.first);
 
     if (conn == nullptr) {
-        // TODO: C++14 - use capture move for s
-        return Async::Promise<Response>([this, s, request, timeout](Async::Resolver& resolve, Async::Rejection& reject) {
+        return Async::Promise<Response>([&](Async::Resolver& resolve, Async::Rejection& reject) {
             Guard guard(queuesLock);
 
-            auto data = std::make_shared<Connection::RequestData>(std::move(resolve), std::move(reject), request, timeout, nullptr);
+            auto data = std::make_shared<Connection::RequestData>(
+                    std::move(resolve), std::move(reject), std::move(request), timeout, nullptr,
+                    std::move(onData));
             auto& queue = requestsQueues[s.first];
             if (!queue.enqueue(data))
                 data->reject(std::runtime_error("Queue is full"));
@@ -840,18 +2214,23 @@ Client::doRequest(
         }
 
         if (!conn->isConnected()) {
-            auto res = conn->asyncPerform(request, timeout, [this, conn]() {
+            auto res = conn->asyncPerform(std::move(request), timeout, [this, conn]() {
                 pool.releaseConnection(conn);
                 processRequestQueue();
-            });
-            conn->connect(helpers::httpAddr(s.first));
+            }, std::move(onData));
+            try {
+                conn->connect(helpers::httpAddr(s.first));
+            } catch (const std::exception& e) {
+                conn->abortRequestQueue(e.what());
+                pool.releaseConnection(conn);
+            }
             return res;
         }
 
-        return conn->perform(request, timeout, [this, conn]() {
+        return conn->perform(std::move(request), timeout, [this, conn]() {
             pool.releaseConnection(conn);
             processRequestQueue();
-        });
+        }, std::move(onData));
     }
 }
 
@@ -876,14 +2255,40 @@ Client::processRequestQueue() {
                 break;
             }
 
+            if (!conn->hasTransport()) {
+                auto transports = reactor_->handlers(transportKey);
+                auto index = ioIndex.fetch_add(1) % transports.size();
+
+                auto transport = std::static_pointer_cast<Transport>(transports[index]);
+                conn->associateTransport(transport);
+            }
+
+            auto onDone = [this, conn]() {
+                pool.releaseConnection(conn);
+                processRequestQueue();
+            };
+
+            // The connection might have been closed (or never opened) since
+            // it was last used
+            if (!conn->isConnected()) {
+                conn->asyncPerform(std::move(data->request), data->timeout, std::move(onDone), data->onData)
+                    .then([data](Response response) { data->resolve(std::move(response)); },
+                          [data](std::exception_ptr exc) { data->reject(exc); });
+                try {
+                    conn->connect(Address(domain));
+                } catch (const std::exception& e) {
+                    // Settles data through the promise above
+                    conn->abortRequestQueue(e.what());
+                    pool.releaseConnection(conn);
+                }
+                continue;
+            }
+
             conn->performImpl(
-                    data->request,
+                    std::move(data->request),
                     data->timeout,
                     std::move(data->resolve), std::move(data->reject),
-                    [this, conn]() {
-                        pool.releaseConnection(conn);
-                        processRequestQueue();
-                    });
+                    std::move(onDone), std::move(data->onData));
         }
     }
 }
@@ -0,0 +1,148 @@
+/* cancellation.cc
+
+   Implementation of the cancellation tokens
+*/
+
+#include <algorithm>
+
+#include <pistache/cancellation.h>
+
+namespace Pistache {
+namespace Async {
+
+struct CancellationToken::State {
+    State()
+        : lock()
+        , cancelled(false)
+        , callbacks()
+        , nextRegistration(1)
+        , parent()
+        , parentRegistration(0)
+    { }
+
+    ~State() {
+        auto p = parent.lock();
+        if (p)
+            p->unregister(parentRegistration);
+    }
+
+    void cancel() {
+        std::vector<std::pair<Registration, Callback>> toRun;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (cancelled.exchange(true))
+                return;
+
+            toRun.swap(callbacks);
+        }
+
+        // Outside of the lock, callbacks may register or cancel in turn
+        for (auto& callback: toRun)
+            callback.second();
+    }
+
+    Registration onCancel(Callback callback) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!cancelled.load()) {
+                auto registration = nextRegistration++;
+                callbacks.emplace_back(registration, std::move(callback));
+                return registration;
+            }
+        }
+
+        callback();
+        return 0;
+    }
+
+    void unregister(Registration registration) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = std::find_if(callbacks.begin(), callbacks.end(),
+                [registration](const std::pair<Registration, Callback>& callback) {
+                    return callback.first == registration;
+                });
+        if (it != callbacks.end())
+            callbacks.erase(it);
+    }
+
+    std::mutex lock;
+    std::atomic<bool> cancelled;
+    std::vector<std::pair<Registration, Callback>> callbacks;
+    Registration nextRegistration;
+
+    std::weak_ptr<State> parent;
+    Registration parentRegistration;
+};
+
+CancellationToken::CancellationToken()
+    : state_()
+{ }
+
+CancellationToken::CancellationToken(std::shared_ptr<State> state)
+    : state_(std::move(state))
+{ }
+
+CancellationToken
+CancellationToken::create() {
+    return CancellationToken(std::make_shared<State>());
+}
+
+void
+CancellationToken::cancel() const {
+    if (state_)
+        state_->cancel();
+}
+
+bool
+CancellationToken::isCancelled() const {
+    return state_ && state_->cancelled.load();
+}
+
+void
+CancellationToken::throwIfCancelled() const {
+    if (isCancelled())
+        throw Cancelled();
+}
+
+bool
+CancellationToken::hasListeners() const {
+    if (!state_)
+        return false;
+
+    std::lock_guard<std::mutex> guard(state_->lock);
+    return !state_->callbacks.empty();
+}
+
+CancellationToken::Registration
+CancellationToken::onCancel(Callback callback) const {
+    if (!state_)
+        return 0;
+
+    return state_->onCancel(std::move(callback));
+}
+
+void
+CancellationToken::unregister(Registration registration) const {
+    if (state_)
+        state_->unregister(registration);
+}
+
+CancellationToken
+CancellationToken::child() const {
+    auto token = create();
+    if (!state_)
+        return token;
+
+    std::weak_ptr<State> child = token.state_;
+    token.state_->parent = state_;
+    token.state_->parentRegistration = state_->onCancel([child]() {
+        auto state = child.lock();
+        if (state)
+            state->cancel();
+    });
+
+    return token;
+}
+
+} // namespace Async
+} // namespace Pistache
@@ -4,8 +4,9 @@
    Cookie implementation
 */
 
-#include <iterator>
-#include <unordered_map>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
 
 #include <pistache/cookie.h>
 #include <pistache/stream.h>
@@ -172,114 +173,272 @@ Cookie::fromString(const std::string& str) {
     return Cookie::fromRaw(str.c_str(), str.size());
 }
 
-void
-Cookie::write(std::ostream& os) const {
-    os << name << "=" << value;
-    optionally_do(path, [&](const std::string& value) {
-       os << "; ";
-       os << "Path=" << value;
-    });
-    optionally_do(domain, [&](const std::string& value) {
-        os << "; ";
-        os << "Domain=" << value;
-    });
-    optionally_do(maxAge, [&](int value) {
-        os << "; ";
-        os << "Max-Age=" << value;
-    });
-    optionally_do(expires, [&](const FullDate& value) {
-        os << "; ";
-        os << "Expires=";
-        value.write(os);
-    });
-    if (secure)
-        os << "; Secure";
-    if (httpOnly)
-        os << "; HttpOnly";
-    if (!ext.empty()) {
-        os << "; ";
-        for (auto it = std::begin(ext), end = std::end(ext); it != end; ++it) {
-            os << it->first << "=" << it->second;
-            if (std::distance(it, end) > 1)
-                os << "; ";
-        }
+namespace {
+
+    bool put(std::streambuf& buf, const char* str, size_t len) {
+        return buf.sputn(str, len) == static_cast<std::streamsize>(len);
+    }
+
+    bool put(std::streambuf& buf, const std::string& str) {
+        return put(buf, str.data(), str.size());
+    }
+
+    bool putInt(std::streambuf& buf, int value) {
+        char digits[12];
+        char* end = digits + sizeof digits;
+        char* p = end;
+
+        unsigned int n = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+        do {
+            *--p = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while (n > 0);
+        if (value < 0)
+            *--p = '-';
+
+        return put(buf, p, end - p);
+    }
+
+}
+
+#define STR(str) str, sizeof(str) - 1
+
+bool
+Cookie::write(std::streambuf& buf) const {
+    if (!put(buf, name) || !put(buf, STR("=")) || !put(buf, value))
+        return false;
+
+    if (!path.isEmpty()) {
+        if (!put(buf, STR("; Path=")) || !put(buf, path.unsafeGet()))
+            return false;
+    }
+    if (!domain.isEmpty()) {
+        if (!put(buf, STR("; Domain=")) || !put(buf, domain.unsafeGet()))
+            return false;
+    }
+    if (!maxAge.isEmpty()) {
+        if (!put(buf, STR("; Max-Age=")) || !putInt(buf, maxAge.unsafeGet()))
+            return false;
+    }
+    if (!expires.isEmpty()) {
+        char date[FullDate::RFC1123Length];
+        expires.unsafeGet().format(date);
+        if (!put(buf, STR("; Expires=")) || !put(buf, date, sizeof date))
+            return false;
+    }
+    if (secure && !put(buf, STR("; Secure")))
+        return false;
+    if (httpOnly && !put(buf, STR("; HttpOnly")))
+        return false;
+
+    for (const auto& attribute: ext) {
+        if (!put(buf, STR("; ")) || !put(buf, attribute.first)
+            || !put(buf, STR("=")) || !put(buf, attribute.second))
+            return false;
     }
 
+    return true;
 }
 
+#undef STR
+
 std::ostream& operator<<(std::ostream& os, const Cookie& cookie)
 {
-    cookie.write(os);
+    std::ostream::sentry sentry(os);
+    if (sentry && !cookie.write(*os.rdbuf()))
+        os.setstate(std::ios::badbit);
     return os;
 }
 
 CookieJar::CookieJar()
     : cookies()
+    , keys()
+    , raw()
+    , slices()
+    , pending(false)
+    , materializeLock()
 { }
 
-void
-CookieJar::add(const Cookie& cookie) {
+CookieJar::CookieJar(const CookieJar& other)
+    : CookieJar()
+{
+    *this = other;
+}
 
-    std::string cookieName = cookie.name;
-    std::string cookieValue = cookie.value;
+CookieJar::CookieJar(CookieJar&& other)
+    : CookieJar()
+{
+    *this = std::move(other);
+}
 
-    Storage::iterator it = cookies.find(cookieName);
-    if(it == cookies.end()) {
-        HashMapCookies hashmapWithFirstCookie;
-        hashmapWithFirstCookie.insert(std::make_pair(cookieValue,cookie));
-        cookies.insert(std::make_pair(cookieName, hashmapWithFirstCookie));
-    } else {
-        it->second.insert(std::make_pair(cookieValue,cookie));
-    }
+CookieJar&
+CookieJar::operator=(const CookieJar& other) {
+    if (this == &other)
+        return *this;
+
+    std::lock_guard<std::mutex> guard(other.materializeLock);
+    cookies = other.cookies;
+    keys = other.keys;
+    raw = other.raw;
+    slices = other.slices;
+    pending.store(other.pending.load());
+    return *this;
+}
 
+CookieJar&
+CookieJar::operator=(CookieJar&& other) {
+    cookies = std::move(other.cookies);
+    keys = std::move(other.keys);
+    raw = std::move(other.raw);
+    slices = std::move(other.slices);
+    pending.store(other.pending.load());
+    other.pending.store(false);
+    return *this;
 }
 
-void 
+void
+CookieJar::add(const Cookie& cookie) {
+    materialize();
+    append(cookie);
+}
+
+void
 CookieJar::removeAllCookies() {
-	cookies.clear();
+    cookies.clear();
+    keys.clear();
+    raw.clear();
+    slices.clear();
+    pending.store(false);
 }
 
 void
 CookieJar::addFromRaw(const char *str, size_t len) {
-    RawStreamBuf<> buf(const_cast<char *>(str), len);
-    StreamCursor cursor(&buf);
+    size_t pos = 0;
+    while (pos < len) {
+        auto cookieEnd = static_cast<const char*>(memchr(str + pos, ';', len - pos));
+        size_t next = cookieEnd ? cookieEnd - str : len;
 
-    while (!cursor.eof()) {
-        StreamCursor::Token nameToken(cursor);
+        if (next > pos)
+            appendRaw(str + pos, next - pos, false);
+
+        pos = next + 1;
+        while (pos < len && (str[pos] == ' ' || str[pos] == '\t'))
+            ++pos;
+    }
+}
 
-        if (!match_until('=', cursor))
-            throw std::runtime_error("Invalid cookie, missing value");
+void
+CookieJar::addSetCookieRaw(const char *str, size_t len) {
+    appendRaw(str, len, true);
+}
 
-        auto name = nameToken.text();
+/* Only the position of the name and of the value are computed here. The
+ * attributes of a Set-Cookie header are left untouched until the cookie is
+ * materialized.
+ */
+void
+CookieJar::appendRaw(const char* str, size_t len, bool setCookie) {
+    const char* valueEnd = str + len;
+    if (setCookie) {
+        auto semicolon = static_cast<const char*>(memchr(str, ';', len));
+        if (semicolon)
+            valueEnd = semicolon;
+    }
 
-        if (!cursor.advance(1))
-            throw std::runtime_error("Invalid cookie, missing value");
+    auto equal = static_cast<const char*>(memchr(str, '=', valueEnd - str));
+    if (!equal)
+        throw std::runtime_error("Invalid cookie, missing value");
 
-        StreamCursor::Token valueToken(cursor);
+    Slice slice;
+    slice.offset = static_cast<uint32_t>(raw.size());
+    slice.length = static_cast<uint32_t>(len);
+    slice.nameLength = static_cast<uint32_t>(equal - str);
+    slice.valueOffset = slice.offset + slice.nameLength + 1;
+    slice.valueLength = static_cast<uint32_t>(valueEnd - equal - 1);
+    slice.hasAttributes = valueEnd != str + len;
+
+    raw.append(str, len);
+    slices.push_back(slice);
+    pending.store(true, std::memory_order_release);
+}
 
-        match_until(';', cursor);
-        auto value = valueToken.text();
+void
+CookieJar::append(Cookie cookie) const {
+    // A cookie that is already in the jar with the same value is not repeated
+    if (!keys.insert(cookie.name + '=' + cookie.value).second)
+        return;
 
-        Cookie cookie(std::move(name), std::move(value));
-        add(cookie);
+    cookies.push_back(std::move(cookie));
+}
 
-        cursor.advance(1);
-        skip_whitespaces(cursor);
+void
+CookieJar::materialize() const {
+    if (!pending.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> guard(materializeLock);
+    if (!pending.load(std::memory_order_relaxed))
+        return;
+
+    for (const auto& slice: slices) {
+        std::string name(raw, slice.offset, slice.nameLength);
+        std::string value(raw, slice.valueOffset, slice.valueLength);
+
+        if (slice.hasAttributes) {
+            /* User agents ignore the attributes they can not parse (RFC 6265,
+             * section 5.2): the name and value of the cookie are kept
+             */
+            try {
+                append(Cookie::fromRaw(raw.data() + slice.offset, slice.length));
+                continue;
+            } catch (const std::exception&) {
+            }
+        }
+
+        append(Cookie(std::move(name), std::move(value)));
     }
+
+    raw.clear();
+    slices.clear();
+    pending.store(false, std::memory_order_release);
 }
 
 Cookie
 CookieJar::get(const std::string& name) const {
-    Storage::const_iterator it = cookies.find(name);
-    if(it != cookies.end()) {
-        return it->second.begin()->second;  // it returns begin(), first element, could be changed.
-    } 
+    materialize();
+    for (const auto& cookie: cookies) {
+        if (cookie.name == name)
+            return cookie;
+    }
     throw std::runtime_error("Could not find requested cookie");
 }
 
 bool
 CookieJar::has(const std::string& name) const {
-    return cookies.find(name) != cookies.end();
+    // The slices might be materialized by another thread meanwhile
+    std::unique_lock<std::mutex> guard(materializeLock, std::defer_lock);
+    if (pending.load(std::memory_order_acquire))
+        guard.lock();
+
+    for (const auto& cookie: cookies) {
+        if (cookie.name == name)
+            return true;
+    }
+
+    // Looking for a name does not require to build the pending cookies
+    for (const auto& slice: slices) {
+        if (slice.nameLength == name.size()
+            && !raw.compare(slice.offset, slice.nameLength, name))
+            return true;
+    }
+
+    return false;
+}
+
+size_t
+CookieJar::size() const {
+    materialize();
+    return cookies.size();
 }
 
 } // namespace Http
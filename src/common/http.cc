@@ -10,6 +10,7 @@
 #include <pistache/peer.h>
 #include <pistache/transport.h>
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
@@ -43,23 +44,14 @@ namespace Http {
 
 namespace {
     bool writeStatusLine(Version version, Code code, DynamicStreamBuf& buf) {
-        #define OUT(...) \
-            do { \
-                __VA_ARGS__; \
-                if (!os) return false; \
-            } while (0)
+        size_t length;
+        if (const char* line = statusLine(version, code, length))
+            return buf.sputn(line, length) == static_cast<std::streamsize>(length);
 
+        // A code that is not a standard one, without a reason phrase
         std::ostream os(&buf);
-
-        OUT(os << version << " ");
-        OUT(os << static_cast<int>(code));
-        OUT(os << ' ');
-        OUT(os << code);
-        OUT(os << crlf);
-
-        return true;
-
-        #undef OUT
+        os << version << ' ' << static_cast<int>(code) << ' ' << crlf;
+        return static_cast<bool>(os);
     }
 
     bool writeHeaders(const Header::Collection& headers, DynamicStreamBuf& buf) {
@@ -77,42 +69,77 @@ namespace {
             OUT(os << crlf);
         }
 
+        for (const auto& raw: headers.rawList()) {
+            OUT(os << raw.second.name() << ": " << raw.second.value() << crlf);
+        }
+
+        if (!headers.has<Header::Date>()) {
+            OUT(os << Header::Date::Name << ": " << FullDate::now() << crlf);
+        }
+
         return true;
 
         #undef OUT
     }
 
+    // The cookies are serialized straight into the response buffer
     bool writeCookies(const CookieJar& cookies, DynamicStreamBuf& buf) {
-        #define OUT(...) \
-            do { \
-                __VA_ARGS__; \
-                if (!os) return false; \
-            } while (0)
+        static const char SetCookie[] = "Set-Cookie: ";
+        static const std::streamsize SetCookieLength = sizeof(SetCookie) - 1;
 
-        std::ostream os(&buf);
         for (const auto& cookie: cookies) {
-            OUT(os << "Set-Cookie: ");
-            OUT(os << cookie);
-            OUT(os << crlf);
+            if (buf.sputn(SetCookie, SetCookieLength) != SetCookieLength)
+                return false;
+            if (!cookie.write(buf))
+                return false;
+            if (buf.sputn("\r\n", 2) != 2)
+                return false;
         }
 
         return true;
-
-        #undef OUT
     }
 
-    using HttpMethods = std::unordered_map<std::string, Method>;
+}
 
-    const HttpMethods httpMethods = {
-    #define METHOD(repr, str) \
-        { str, Method::repr },
-        HTTP_METHODS
-    #undef METHOD
-    };
+namespace {
+    const auto ParserSlot = Tcp::Peer::registerSlot<Private::Parser<Http::Request>>();
 
-}
+    // Cancelled on disconnection, the token of every request is a child of it
+    const auto CancellationSlot = Tcp::Peer::registerSlot<Async::CancellationToken>();
+
+    /* A parser is only attached to a peer while a request is being read.
+     * Those of the idle peers are kept by each thread, hence by each
+     * transport worker, for the next peer that sends data.
+     */
+    class ParserPool {
+    public:
+        typedef Private::Parser<Http::Request> Parser;
+
+        static constexpr size_t MaxIdle = 64;
 
-static constexpr const char* ParserData = "__Parser";
+        static std::shared_ptr<Parser> acquire() {
+            auto& parsers = idle();
+            if (parsers.empty())
+                return std::make_shared<Parser>();
+
+            auto parser = std::move(parsers.back());
+            parsers.pop_back();
+            return parser;
+        }
+
+        static void release(std::shared_ptr<Parser> parser) {
+            auto& parsers = idle();
+            if (parsers.size() < MaxIdle)
+                parsers.push_back(std::move(parser));
+        }
+
+    private:
+        static std::vector<std::shared_ptr<Parser>>& idle() {
+            thread_local std::vector<std::shared_ptr<Parser>> parsers;
+            return parsers;
+        }
+    };
+}
 
 namespace Private {
 
@@ -131,15 +158,8 @@ namespace Private {
         if (!match_until(' ', cursor))
             return State::Again;
 
-        auto it = httpMethods.find(methodToken.text());
-        if (it != httpMethods.end())
-        {
-            request->method_ = it->second;
-        }
-        else
-        {
+        if (!parseMethod(methodToken.rawText(), methodToken.size(), request->method_))
             raise("Unknown HTTP request method");
-        }
 
         int n;
 
@@ -150,8 +170,9 @@ namespace Private {
         if (!cursor.advance(1)) return State::Again;
 
         StreamCursor::Token resToken(cursor);
-        while ((n = cursor.current()) != '?' && n != ' ')
-            if (!cursor.advance(1)) return State::Again;
+        if (!match_until({ '?', ' ' }, cursor))
+            return State::Again;
+        n = cursor.current();
 
         request->resource_ = resToken.text();
 
@@ -159,6 +180,7 @@ namespace Private {
         if (n == '?') {
             if (!cursor.advance(1)) return State::Again;
 
+            StreamCursor::Token queryToken(cursor);
             while ((n = cursor.current()) != ' ') {
                 StreamCursor::Token keyToken(cursor);
                 if (!match_until({ '=', ' ', '&' }, cursor))
@@ -187,6 +209,7 @@ namespace Private {
                     }
                 }
             }
+            request->query_.raw_ = queryToken.text();
         }
 
         // @Todo: Fragment
@@ -197,20 +220,11 @@ namespace Private {
         // HTTP-Version
         StreamCursor::Token versionToken(cursor);
 
-        while (!cursor.eol())
-            if (!cursor.advance(1)) return State::Again;
+        if (!match_until_eol(cursor))
+            return State::Again;
 
-        const char* ver = versionToken.rawText();
-        const size_t size = versionToken.size();
-        if (strncmp(ver, "HTTP/1.0", size) == 0) {
-            request->version_ = Version::Http10;
-        }
-        else if (strncmp(ver, "HTTP/1.1", size) == 0) {
-            request->version_ = Version::Http11;
-        }
-        else {
+        if (!parseVersion(versionToken.rawText(), versionToken.size(), request->version_))
             raise("Encountered invalid HTTP version");
-        }
 
         if (!cursor.advance(2)) return State::Again;
 
@@ -225,14 +239,11 @@ namespace Private {
 
         auto *response = static_cast<Response *>(message);
 
-        if (match_raw("HTTP/1.1", strlen("HTTP/1.1"), cursor)) {
-            //response->version = Version::Http11;
-        }
-        else if (match_raw("HTTP/1.0", strlen("HTTP/1.0"), cursor)) {
-        }
-        else {
+        const size_t VersionLength = 8;
+        if (cursor.remaining() < VersionLength
+            || !parseVersion(cursor.offset(), VersionLength, response->version_))
             raise("Encountered invalid HTTP version");
-        }
+        cursor.advance(VersionLength);
 
         int n;
         // SP
@@ -252,10 +263,8 @@ namespace Private {
 
         if (!cursor.advance(1)) return State::Again;
 
-        while (!cursor.eol() && !cursor.eof())
-        {
-            cursor.advance(1);
-        }
+        if (!match_until_eol(cursor))
+            return State::Again;
 
         if (!cursor.advance(2)) return State::Again;
 
@@ -274,8 +283,8 @@ namespace Private {
             // Read the header name
             size_t start = cursor;
 
-            while (cursor.current() != ':')
-                if (!cursor.advance(1)) return State::Again;
+            if (!match_until(':', cursor))
+                return State::Again;
 
             // Skip the ':'
             if (!cursor.advance(1)) return State::Again;
@@ -288,16 +297,15 @@ namespace Private {
 
             // Read the header value
             start = cursor;
-            while (!cursor.eol()) {
-                if (!cursor.advance(1)) return State::Again;
-            }
+            if (!match_until_eol(cursor))
+                return State::Again;
 
             if (name == "Cookie") {
                 message->cookies_.removeAllCookies(); // removing existing cookies before re-adding them.
                 message->cookies_.addFromRaw(cursor.offset(start), cursor.diff(start));
             }
             else if (name == "Set-Cookie") {
-                message->cookies_.add(Cookie::fromRaw(cursor.offset(start), cursor.diff(start)));
+                message->cookies_.addSetCookieRaw(cursor.offset(start), cursor.diff(start));
             }
             else if (Header::Registry::instance().isRegistered(name)) {
                 std::shared_ptr<Header::Header> header = Header::Registry::instance().makeHeader(name);
@@ -370,7 +378,9 @@ namespace Private {
         }
         // This is the first time we are reading the payload
         else {
-            message->body_.reserve(contentLength);
+            // A streamed body can be larger than what a parser ever holds
+            message->body_.reserve(
+                    std::min<size_t>(contentLength, ArrayStreamBuf<char>::maxSize) + Message::BodyPadding);
             if (!readBody(contentLength)) return State::Again;
         }
 
@@ -384,7 +394,7 @@ namespace Private {
             StreamCursor::Revert revert(cursor);
             StreamCursor::Token chunkSize(cursor);
 
-            while (!cursor.eol()) if (!cursor.advance(1)) return Incomplete;
+            if (!match_until_eol(cursor)) return Incomplete;
 
             char *end;
             const char *raw = chunkSize.rawText();
@@ -402,20 +412,23 @@ namespace Private {
         if (size == 0)
             return Final;
 
-        message->body_.reserve(size);
-        StreamCursor::Token chunkData(cursor);
-        const ssize_t available = cursor.remaining();
-
-        if (available < size) {
+        // The data of a chunk can be split over several packets, keep what
+        // was received so far and only wait for the rest
+        const size_t chunkSize = static_cast<size_t>(size);
+        if (bytesRead < chunkSize) {
+            StreamCursor::Token chunkData(cursor);
+            const size_t available = std::min(cursor.remaining(), chunkSize - bytesRead);
             cursor.advance(available);
             message->body_.append(chunkData.rawText(), available);
-            return Incomplete;
+
+            bytesRead += available;
+            if (bytesRead < chunkSize)
+                return Incomplete;
         }
-        cursor.advance(size);
 
+        // CRLF
         if (!cursor.advance(2)) return Incomplete;
 
-        message->body_.append(chunkData.rawText(), size);
         return Complete;
     }
 
@@ -474,6 +487,8 @@ namespace Private {
 
 } // namespace Private
 
+constexpr size_t Message::BodyPadding;
+
 Message::Message()
     : version_(Version::Http11)
     , code_()
@@ -486,15 +501,18 @@ namespace Uri {
 
     Query::Query()
         : params()
+        , raw_()
     { }
 
     Query::Query(std::initializer_list<std::pair<const std::string, std::string>> params)
         : params(params)
+        , raw_()
     { }
 
     void
     Query::add(std::string name, std::string value) {
         params.insert(std::make_pair(std::move(name), std::move(value)));
+        raw_.clear();
     }
 
     Optional<std::string>
@@ -542,9 +560,14 @@ Request::resource() const {
     return resource_;
 }
 
-std::string
+const std::string&
 Request::body() const {
-    return body_;
+    return sharedBody_ ? *sharedBody_ : body_;
+}
+
+const Async::CancellationToken&
+Request::cancellation() const {
+    return cancellation_;
 }
 
 const Header::Collection&
@@ -562,6 +585,11 @@ Request::cookies() const {
     return cookies_;
 }
 
+const Address&
+Request::address() const {
+    return address_;
+}
+
 #ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
 std::shared_ptr<Tcp::Peer>
 Request::peer() const {
@@ -579,12 +607,15 @@ ResponseStream::ResponseStream(
         std::weak_ptr<Tcp::Peer> peer,
         Tcp::Transport* transport,
         Timeout timeout,
+        Async::CancellationToken cancellation,
         size_t streamSize)
     : Message(std::move(other))
     , peer_(std::move(peer))
     , buf_(streamSize)
     , transport_(transport)
     , timeout_(std::move(timeout))
+    , cancellation_(std::move(cancellation))
+    , chunked_(!headers_.has<Header::ContentLength>())
 {
     if (!writeStatusLine(version_, code_, buf_))
         throw Error("Response exceeded buffer size");
@@ -601,112 +632,190 @@ ResponseStream::ResponseStream(
         */
         // writeHeader<Header::Connection>(os, ConnectionControl::KeepAlive);
         // if (!os) throw Error("Response exceeded buffer size");
-        writeHeader<Header::TransferEncoding>(os, Header::Encoding::Chunked);
-        if (!os) throw Error("Response exceeded buffer size");
+        if (chunked_) {
+            writeHeader<Header::TransferEncoding>(os, Header::Encoding::Chunked);
+            if (!os) throw Error("Response exceeded buffer size");
+        }
         os << crlf;
     }
 }
 
-void
+Async::Promise<void>
 ResponseStream::flush() {
     timeout_.disarm();
-    auto buf = buf_.buffer();
+    auto buf = buf_.release();
 
     auto fd = peer()->fd();
     transport_->asyncWrite(fd, buf);
-
-    buf_.clear();
+    return transport_->whenWritable(fd);
 }
 
 void
 ResponseStream::ends() {
-    std::ostream os(&buf_);
-    os << "0" << crlf;
-    os << crlf;
+    if (chunked_) {
+        std::ostream os(&buf_);
+        os << "0" << crlf;
+        os << crlf;
 
-    if (!os) {
-        throw Error("Response exceeded buffer size");
+        if (!os) {
+            throw Error("Response exceeded buffer size");
+        }
     }
 
     flush();
 }
 
 Async::Promise<ssize_t>
-ResponseWriter::putOnWire(const char* data, size_t len)
+ResponseWriter::send(Code code, const BodyWriter& body, const Mime::MediaType& mime)
 {
-    try {
-        std::ostream os(&buf_);
+    code_ = code;
 
-#define OUT(...) \
-        do { \
-            __VA_ARGS__; \
-            if (!os) { \
-                return Async::Promise<ssize_t>::rejected(Error("Response exceeded buffer size")); \
-            } \
-        } while (0);
+    if (mime.isValid())
+        setMime(mime);
 
-        OUT(writeStatusLine(version_, code_, buf_));
-        OUT(writeHeaders(headers_, buf_));
-        OUT(writeCookies(cookies_, buf_));
+    return putOnWire(body);
+}
 
+ConnectionControl
+ResponseWriter::writeHead()
+{
+    if (!writeStatusLine(version_, code_, buf_)
+            || !writeHeaders(headers_, buf_)
+            || !writeCookies(cookies_, buf_))
+        throw Error("Response exceeded buffer size");
 
-        auto connection = headers_.tryGet<Header::Connection>();
-        auto control = ConnectionControl::Close;
+    /* @Todo @Major:
+     * Correctly handle non-keep alive requests
+     * Do not put Keep-Alive if version == Http::11 and request.keepAlive == true
+    */
+    auto connection = headers_.tryGet<Header::Connection>();
+    if (connection)
+        return connection->control();
 
-        if (connection)
-            control = connection->control();
+    return ConnectionControl::Close;
+}
 
-        /* @Todo @Major:
-         * Correctly handle non-keep alive requests
-         * Do not put Keep-Alive if version == Http::11 and request.keepAlive == true
-        */
-        //OUT(writeHeader<Header::Connection>(os, ConnectionControl::KeepAlive));
-        OUT(writeHeader<Header::ContentLength>(os, len));
+Async::Promise<ssize_t>
+ResponseWriter::putOnWire(const char* data, size_t len)
+{
+    try {
+        auto control = writeHead();
 
-        OUT(os << crlf);
+        std::ostream os(&buf_);
+        writeHeader<Header::ContentLength>(os, len);
+        os << crlf;
+        if (len > 0)
+            os.write(data, len);
+        if (!os)
+            throw Error("Response exceeded buffer size");
 
-        if (len > 0) {
-            OUT(os.write(data, len));
-        }
+        if (wireObserver_)
+            wireObserver_(*this, buf_.data(), buf_.size());
 
-        auto buffer = buf_.buffer();
+        auto buffer = buf_.release();
 
         timeout_.disarm();
 
-#undef OUT
+        return writeOnWire(buffer, control);
+
+    } catch (const std::runtime_error& e) {
+        return Async::Promise<ssize_t>::rejected(e);
+    }
+}
+
+Async::Promise<ssize_t>
+ResponseWriter::putOnWire(const BodyWriter& body)
+{
+    /* Room for the largest length is kept in the head and the actual one is
+     * patched in once the body is written. The rest of the field is left
+     * blank, which is whitespace allowed after a field value.
+     */
+    static const char ContentLength[] = "Content-Length: ";
+    static const char Blank[] = "                    \r\n\r\n";
+    static const size_t LengthWidth = 20;
 
-        auto fd = peer()->fd();
+    try {
+        auto control = writeHead();
 
-        return transport_->asyncWrite(fd, buffer)
-         .then
-                 <
-                         std::function< Async::Promise<ssize_t>(int)>,
-                         std::function<void(std::exception_ptr&)>
-                 >
-                 (
-                         [=](int l) {
+        std::ostream os(&buf_);
+        os.write(ContentLength, sizeof(ContentLength) - 1);
+        const size_t lengthOffset = buf_.size();
+        os.write(Blank, sizeof(Blank) - 1);
+        if (!os)
+            throw Error("Response exceeded buffer size");
+
+        const size_t bodyOffset = buf_.size();
+        body(buf_);
+
+        char digits[LengthWidth];
+        auto length = buf_.size() - bodyOffset;
+        size_t pos = LengthWidth;
+        do {
+            digits[--pos] = static_cast<char>('0' + length % 10);
+            length /= 10;
+        } while (length > 0);
+        buf_.overwrite(lengthOffset, digits + pos, LengthWidth - pos);
 
-                             return Async::Promise<ssize_t>( [=](Async::Deferred<ssize_t> deferred) mutable {
+        if (wireObserver_)
+            wireObserver_(*this, buf_.data(), buf_.size());
 
-                                 if (control == ConnectionControl::KeepAlive) return ;
+        auto buffer = buf_.release();
 
-                                 if (fd)
-                                     close(fd);
+        timeout_.disarm();
 
-                                return ;
-                             } );
-                         },
+        return writeOnWire(buffer, control);
 
-                         [=](std::exception_ptr& eptr){
-                             return Async::Promise<ssize_t>::rejected(eptr);
-                         }
-                 );
+    } catch (const std::runtime_error& e) {
+        return Async::Promise<ssize_t>::rejected(e);
+    }
+}
 
+Async::Promise<ssize_t>
+ResponseWriter::sendSerialized(
+        Code code, const std::vector<RawBuffer>& parts, ConnectionControl control)
+{
+    code_ = code;
+
+    try {
+        timeout_.disarm();
+        return writeOnWire(parts, control);
     } catch (const std::runtime_error& e) {
         return Async::Promise<ssize_t>::rejected(e);
     }
 }
 
+template<typename Buf>
+Async::Promise<ssize_t>
+ResponseWriter::writeOnWire(const Buf& buffer, ConnectionControl control)
+{
+    auto fd = peer()->fd();
+
+    return transport_->asyncWrite(fd, buffer)
+     .template then
+             <
+                     std::function< Async::Promise<ssize_t>(int)>,
+                     std::function<void(std::exception_ptr&)>
+             >
+             (
+                     [=](int l) {
+
+                         return Async::Promise<ssize_t>( [=](Async::Deferred<ssize_t> deferred) mutable {
+
+                             if (control == ConnectionControl::KeepAlive) return ;
+
+                             if (fd)
+                                 close(fd);
+
+                            return ;
+                         } );
+                     },
+
+                     [=](std::exception_ptr& eptr){
+                         return Async::Promise<ssize_t>::rejected(eptr);
+                     }
+             );
+}
+
 Async::Promise<ssize_t>
 serveFile(ResponseWriter& response, const std::string& fileName, const Mime::MediaType& contentType)
 {
@@ -775,7 +884,7 @@ serveFile(ResponseWriter& response, const std::string& fileName, const Mime::Med
     auto peer = response.peer();
     auto sockFd = peer->fd();
 
-    auto buffer = buf->buffer();
+    auto buffer = buf->release();
     return transport->asyncWrite(sockFd, buffer, MSG_MORE).then([=](ssize_t) {
         return transport->asyncWrite(sockFd, FileBuffer(fileName));
     }, Async::Throw);
@@ -794,16 +903,36 @@ Handler::onInput(const char* buffer, size_t len, const std::shared_ptr<Tcp::Peer
 
         auto state = parser.parse();
 
+        if (!parser.headChecked && parser.headersParsed()) {
+            parser.headChecked = true;
+            parser.request.address_ = peer->address();
+
+            checkHead(parser.request, peer, state == Private::State::Again);
+        }
+
         if (state == Private::State::Done) {
-            ResponseWriter response(transport(), parser.request, this);
-            response.associatePeer(peer);
+            auto cancellation = peer->tryGetData(CancellationSlot);
+            if (!cancellation) {
+                peer->putData(CancellationSlot,
+                        std::make_shared<Async::CancellationToken>(Async::CancellationToken::create()));
+                cancellation = peer->tryGetData(CancellationSlot);
+            }
+            parser.request.cancellation_ = cancellation->child();
+
+            // Moved once out of the parser, then shared with the response
+            std::shared_ptr<const Request> request =
+                std::make_shared<Request>(std::move(parser.request));
+            parser.reset();
+            transport()->requestRead();
 
 #ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
-            parser.request.associatePeer(peer);
+            std::const_pointer_cast<Request>(request)->associatePeer(peer);
 #endif
 
-            auto request = parser.request;
-            auto connection = request.headers().tryGet<Header::Connection>();
+            ResponseWriter response(transport(), request, this);
+            response.associatePeer(peer);
+
+            auto connection = request->headers().tryGet<Header::Connection>();
 
             if (connection) {
                 response.headers()
@@ -813,33 +942,77 @@ Handler::onInput(const char* buffer, size_t len, const std::shared_ptr<Tcp::Peer
                         .add<Header::Connection>(ConnectionControl::Close);
             }
 
-            onRequest(request, std::move(response));
-            parser.reset();
+            onRequest(*request, std::move(response));
         }
 
     } catch (const HttpError &err) {
-        ResponseWriter response(transport(), parser.request, this);
+        ResponseWriter response(transport(), std::make_shared<Request>(std::move(parser.request)), this);
+        parser.reset();
         response.associatePeer(peer);
         response.send(static_cast<Code>(err.code()), err.reason());
-        parser.reset();
     }
 
     catch (const std::exception& e) {
-        ResponseWriter response(transport(), parser.request, this);
+        ResponseWriter response(transport(), std::make_shared<Request>(std::move(parser.request)), this);
+        parser.reset();
         response.associatePeer(peer);
         response.send(Code::Internal_Server_Error, e.what());
-        parser.reset();
+    }
+
+    if (parser.idle()) {
+        releaseParser(peer);
+
+        // Like the parser, the token of the connection is only kept while
+        // requests are in flight. A request still answered asynchronously
+        // keeps it until the next input or the disconnection
+        auto cancellation = peer->tryGetData(CancellationSlot);
+        if (cancellation && !cancellation->hasListeners())
+            peer->takeData(CancellationSlot);
     }
 }
 
 void
-Handler::onConnection(const std::shared_ptr<Tcp::Peer>& peer) {
-    peer->putData(ParserData, std::make_shared<Private::Parser<Http::Request>>());
+Handler::onDisconnection(const shared_ptr<Tcp::Peer>& peer) {
+    auto cancellation = peer->tryGetData(CancellationSlot);
+    if (cancellation)
+        cancellation->cancel();
 }
 
 void
-Handler::onDisconnection(const shared_ptr<Tcp::Peer>& peer) {
-    UNUSED(peer)
+Handler::onHeaders(const Request& request) {
+    UNUSED(request)
+}
+
+void
+Handler::checkHead(const Request& request, const std::shared_ptr<Tcp::Peer>& peer, bool bodyPending) {
+    const auto& headers = request.headers();
+
+    auto cl = headers.tryGet<Header::ContentLength>();
+    if (cl) {
+        if (cl->value() == 0)
+            return;
+
+        // Do not wait for a body that would not fit in the buffer anyway
+        if (cl->value() > ArrayStreamBuf<char>::maxSize)
+            throw HttpError(Code::Request_Entity_Too_Large, "Request exceeded maximum buffer size");
+    } else if (!headers.has(Header::TransferEncoding::Name)) {
+        return;
+    }
+
+    std::shared_ptr<const Header::Expect> expect;
+    if (request.version() == Version::Http11)
+        expect = headers.tryGet<Header::Expect>();
+
+    if (expect && expect->expectation() != Expectation::Continue)
+        throw HttpError(Code::Expectation_Failed, "Unsupported expectation");
+
+    onHeaders(request);
+
+    // Nothing to ask for when the whole body came along with the head
+    if (expect && bodyPending) {
+        static const char Continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        transport()->asyncWrite(peer->fd(), RawBuffer(Continue, sizeof(Continue) - 1));
+    }
 }
 
 void
@@ -851,18 +1024,29 @@ Handler::onTimeout(const Request& request, ResponseWriter response) {
 void
 Timeout::onTimeout(uint64_t numWakeup) {
     UNUSED(numWakeup)
+    request->cancellation().cancel();
     if (!peer.lock()) return;
 
     ResponseWriter response(transport, request, handler);
     response.associatePeer(peer);
 
-    handler->onTimeout(request, std::move(response));
+    handler->onTimeout(*request, std::move(response));
 }
 
 
 Private::Parser<Http::Request>&
 Handler::getParser(const std::shared_ptr<Tcp::Peer>& peer) const {
-    return static_cast<Private::Parser<Http::Request>&>(*peer->getData(ParserData));
+    auto parser = peer->tryGetData(ParserSlot);
+    if (parser)
+        return *parser;
+
+    peer->putData(ParserSlot, ParserPool::acquire());
+    return peer->getData(ParserSlot);
+}
+
+void
+Handler::releaseParser(const std::shared_ptr<Tcp::Peer>& peer) const {
+    ParserPool::release(peer->takeData(ParserSlot));
 }
 
 
@@ -4,9 +4,12 @@
    Implementation of http definitions
 */
 
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 
+#include <strings.h>
+
 #include <pistache/http_defs.h>
 #include <pistache/common.h>
 #include <pistache/date.h>
@@ -17,27 +20,238 @@ namespace Http {
 namespace {
     using time_point = FullDate::time_point;
 
-    bool parse_RFC_1123(const std::string& s, time_point &tp)
-    {
-        std::istringstream in{s};
-        in >> date::parse("%a, %d %b %Y %T %Z", tp);
-        return !in.fail();
+    const char* const ShortDays[] = {
+        "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+    };
+
+    const char* const LongDays[] = {
+        "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"
+    };
+
+    const char* const Months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+
+    // The broken-down fields of a date, all three formats are made of them
+    struct Fields {
+        int year;
+        unsigned month;
+        unsigned day;
+        unsigned hour;
+        unsigned minute;
+        unsigned second;
+        unsigned weekday;
+        long nanoseconds;
+    };
+
+    Fields toFields(time_point tp) {
+        auto days = date::floor<date::days>(tp);
+        date::year_month_day ymd(days);
+        auto time = std::chrono::duration_cast<std::chrono::seconds>(tp - days).count();
+
+        Fields fields;
+        fields.year = static_cast<int>(ymd.year());
+        fields.month = static_cast<unsigned>(ymd.month());
+        fields.day = static_cast<unsigned>(ymd.day());
+        fields.hour = static_cast<unsigned>(time / 3600);
+        fields.minute = static_cast<unsigned>(time / 60 % 60);
+        fields.second = static_cast<unsigned>(time % 60);
+        fields.weekday = static_cast<unsigned>(date::weekday(days));
+        fields.nanoseconds = 0;
+        return fields;
+    }
+
+    bool fromFields(const Fields& fields, time_point& tp) {
+        date::year_month_day ymd(
+                date::year(fields.year), date::month(fields.month), date::day(fields.day));
+        if (!ymd.ok() || fields.hour > 23 || fields.minute > 59 || fields.second > 60)
+            return false;
+
+        tp = date::sys_days(ymd)
+            + std::chrono::hours(fields.hour)
+            + std::chrono::minutes(fields.minute)
+            + std::chrono::seconds(fields.second)
+            + std::chrono::duration_cast<time_point::duration>(
+                    std::chrono::nanoseconds(fields.nanoseconds));
+        return true;
+    }
+
+    class DateReader {
+    public:
+        explicit DateReader(const std::string& str)
+            : p(str.data())
+            , end(str.data() + str.size())
+        { }
+
+        bool atEnd() const { return p == end; }
+
+        char peek() const { return p == end ? '\0' : *p; }
+
+        bool literal(char c) {
+            if (p == end || *p != c) return false;
+            ++p;
+            return true;
+        }
+
+        bool spaces() {
+            if (!literal(' ')) return false;
+            while (literal(' ')) { }
+            return true;
+        }
+
+        // The day names are not checked against the date, only skipped
+        bool dayName() {
+            const char* start = p;
+            while (p != end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')))
+                ++p;
+            return p - start >= 3;
+        }
+
+        bool monthName(unsigned& month) {
+            if (end - p < 3) return false;
+            for (unsigned i = 0; i < 12; ++i) {
+                if (!strncasecmp(p, Months[i], 3)) {
+                    month = i + 1;
+                    p += 3;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template<typename T>
+        bool number(int minDigits, int maxDigits, T& value) {
+            int count = 0;
+            unsigned result = 0;
+            while (count < maxDigits && p != end && *p >= '0' && *p <= '9') {
+                result = result * 10 + static_cast<unsigned>(*p - '0');
+                ++p;
+                ++count;
+            }
+            value = static_cast<T>(result);
+            return count >= minDigits;
+        }
+
+        // HH:MM:SS with an optional fraction of a second
+        bool time(Fields& fields) {
+            if (!number(2, 2, fields.hour) || !literal(':') ||
+                !number(2, 2, fields.minute) || !literal(':') ||
+                !number(2, 2, fields.second))
+                return false;
+
+            fields.nanoseconds = 0;
+            if (literal('.')) {
+                long scale = 100000000;
+                if (p == end || *p < '0' || *p > '9') return false;
+                while (p != end && *p >= '0' && *p <= '9') {
+                    fields.nanoseconds += (*p - '0') * scale;
+                    scale /= 10;
+                    ++p;
+                }
+            }
+            return true;
+        }
+
+        bool zone() {
+            if (end - p != 3) return false;
+            if (memcmp(p, "GMT", 3) && memcmp(p, "UTC", 3)) return false;
+            p += 3;
+            return true;
+        }
+
+    private:
+        const char* p;
+        const char* end;
+    };
+
+    // Sun, 06 Nov 1994 08:49:37 GMT
+    bool parseRFC1123(DateReader& in, Fields& fields) {
+        return in.number(1, 2, fields.day) && in.spaces()
+            && in.monthName(fields.month) && in.spaces()
+            && in.number(4, 4, fields.year) && in.spaces()
+            && in.time(fields) && in.spaces()
+            && in.zone();
     }
 
-    bool parse_RFC_850(const std::string& s, time_point &tp)
-    {
-        std::istringstream in{s};
-        in >> date::parse("%a, %d-%b-%y %T %Z", tp);
-        return !in.fail();
+    // Sunday, 06-Nov-94 08:49:37 GMT
+    bool parseRFC850(DateReader& in, Fields& fields) {
+        if (!(in.number(1, 2, fields.day) && in.literal('-')
+            && in.monthName(fields.month) && in.literal('-')
+            && in.number(2, 2, fields.year) && in.spaces()
+            && in.time(fields) && in.spaces()
+            && in.zone()))
+            return false;
+
+        // Same pivot as strptime's %y
+        fields.year += fields.year < 69 ? 2000 : 1900;
+        return true;
+    }
+
+    // Sun Nov  6 08:49:37 1994
+    bool parseAscTime(DateReader& in, Fields& fields) {
+        return in.monthName(fields.month) && in.spaces()
+            && in.number(1, 2, fields.day) && in.spaces()
+            && in.time(fields) && in.spaces()
+            && in.number(4, 4, fields.year) && in.atEnd();
+    }
+
+    char* put2(char* out, unsigned value) {
+        out[0] = static_cast<char>('0' + value / 10 % 10);
+        out[1] = static_cast<char>('0' + value % 10);
+        return out + 2;
+    }
+
+    char* put4(char* out, unsigned value) {
+        put2(out, value / 100);
+        return put2(out + 2, value % 100);
+    }
+
+    char* putName(char* out, const char* name) {
+        size_t len = strlen(name);
+        memcpy(out, name, len);
+        return out + len;
     }
 
-    bool parse_asctime(const std::string& s, time_point &tp)
-    {
-        std::istringstream in{s};
-        in >> date::parse("%a %b %d %T %Y", tp);
-        return !in.fail();
+    char* putTime(char* out, const Fields& fields) {
+        out = put2(out, fields.hour);
+        *out++ = ':';
+        out = put2(out, fields.minute);
+        *out++ = ':';
+        return put2(out, fields.second);
     }
 
+    unsigned checkedYear(const Fields& fields) {
+        if (fields.year < 0 || fields.year > 9999)
+            throw std::range_error("Date out of the range of HTTP dates");
+        return static_cast<unsigned>(fields.year);
+    }
+
+    void formatRFC1123(const Fields& fields, char* out) {
+        out = putName(out, ShortDays[fields.weekday]);
+        *out++ = ',';
+        *out++ = ' ';
+        out = put2(out, fields.day);
+        *out++ = ' ';
+        out = putName(out, Months[fields.month - 1]);
+        *out++ = ' ';
+        out = put4(out, checkedYear(fields));
+        *out++ = ' ';
+        out = putTime(out, fields);
+        memcpy(out, " GMT", 4);
+    }
+
+    struct CachedNow {
+        CachedNow()
+            : second(-1)
+        {
+            text[FullDate::RFC1123Length] = '\0';
+        }
+
+        std::chrono::seconds::rep second;
+        char text[FullDate::RFC1123Length + 1];
+    };
+
 } // anonymous namespace
 
 CacheDirective::CacheDirective(Directive directive)
@@ -93,36 +307,181 @@ CacheDirective::init(Directive directive, std::chrono::seconds delta)
     }
 }
 
+constexpr size_t FullDate::RFC1123Length;
+
 FullDate
 FullDate::fromString(const std::string& str) {
+    // The three formats are told apart by what follows the day name
+    DateReader in(str);
+    Fields fields;
+    bool parsed = false;
+
+    if (in.dayName()) {
+        if (in.literal(',')) {
+            in.spaces();
+            DateReader rfc1123 = in;
+            parsed = parseRFC1123(rfc1123, fields) || parseRFC850(in, fields);
+        } else if (in.spaces()) {
+            parsed = parseAscTime(in, fields);
+        }
+    }
 
-    FullDate::time_point tp;
-    if(parse_RFC_1123(str, tp))
-        return FullDate(tp);
-    else if(parse_RFC_850(str, tp))
-        return FullDate(tp);
-    else if(parse_asctime(str, tp))
-        return FullDate(tp);
+    time_point tp;
+    if (!parsed || !fromFields(fields, tp))
+        throw std::runtime_error("Invalid Date format");
 
-    throw std::runtime_error("Invalid Date format");
+    return FullDate(tp);
+}
+
+void
+FullDate::format(char (&out)[RFC1123Length]) const
+{
+    formatRFC1123(toFields(date_), out);
 }
 
 void
 FullDate::write(std::ostream& os, Type type) const
 {
+    auto fields = toFields(date_);
+
+    // Long enough for the longest day name of RFC 850
+    char buf[40];
+    char* out = buf;
+
     switch (type) {
     case Type::RFC1123:
-        date::to_stream(os, "%a, %d %b %Y %T %Z", date_);
+        formatRFC1123(fields, buf);
+        out += RFC1123Length;
         break;
     case Type::RFC850:
-        date::to_stream(os, "%a, %d-%b-%y %T %Z", date_);
+        out = putName(out, LongDays[fields.weekday]);
+        *out++ = ',';
+        *out++ = ' ';
+        out = put2(out, fields.day);
+        *out++ = '-';
+        out = putName(out, Months[fields.month - 1]);
+        *out++ = '-';
+        out = put2(out, checkedYear(fields) % 100);
+        *out++ = ' ';
+        out = putTime(out, fields);
+        out = putName(out, " GMT");
         break;
     case Type::AscTime:
-        date::to_stream(os, "%a %b %d %T %Y", date_);
+        out = putName(out, ShortDays[fields.weekday]);
+        *out++ = ' ';
+        out = putName(out, Months[fields.month - 1]);
+        *out++ = ' ';
+        out = put2(out, fields.day);
+        if (fields.day < 10)
+            out[-2] = ' ';
+        *out++ = ' ';
+        out = putTime(out, fields);
+        *out++ = ' ';
+        out = put4(out, checkedYear(fields));
         break;
     default:
-        std::runtime_error("Invalid use of FullDate::write");
+        throw std::runtime_error("Invalid use of FullDate::write");
+    }
+
+    os.write(buf, out - buf);
+}
+
+const char*
+FullDate::now()
+{
+    static thread_local CachedNow cached;
+
+    auto current = std::chrono::system_clock::now();
+    auto second = std::chrono::duration_cast<std::chrono::seconds>(current.time_since_epoch()).count();
+    if (second != cached.second) {
+        cached.second = second;
+        formatRFC1123(toFields(current), cached.text);
+    }
+
+    return cached.text;
+}
+
+namespace {
+
+    /* The tokens of a request line are at most 8 bytes long: they are packed
+     * in an integer, the byte i in the bits 8i, and compared in a single
+     * instruction with the tables below, built at compile time.
+     */
+    constexpr uint64_t packToken(const char* str, size_t len) {
+        uint64_t packed = 0;
+        for (size_t i = 0; i < len; ++i)
+            packed |= static_cast<uint64_t>(static_cast<unsigned char>(str[i])) << (8 * i);
+        return packed;
+    }
+
+    struct MethodToken {
+        uint64_t packed;
+        Method method;
+    };
+
+    constexpr MethodToken MethodTokens[] = {
+#define METHOD(name, str) \
+        { packToken(str, sizeof(str) - 1), Method::name },
+        HTTP_METHODS
+#undef METHOD
+    };
+
+    constexpr uint64_t Http10Token = packToken("HTTP/1.0", 8);
+    constexpr uint64_t Http11Token = packToken("HTTP/1.1", 8);
+
+    // The status lines are spelled out by the preprocessor, one per version
+    struct StatusLine {
+        const char* http10;
+        const char* http11;
+        size_t length;
+        const char* reason;
+    };
+
+#define STATUS_LINE(version, value, str) "HTTP/" version " " #value " " str "\r\n"
+
+    constexpr StatusLine StatusLines[] = {
+#define CODE(value, _, str) \
+        { STATUS_LINE("1.0", value, str), STATUS_LINE("1.1", value, str), \
+          sizeof(STATUS_LINE("1.1", value, str)) - 1, str },
+        STATUS_CODES
+#undef CODE
+    };
+
+#undef STATUS_LINE
+
+    constexpr int StatusCodes[] = {
+#define CODE(value, name, str) value,
+        STATUS_CODES
+#undef CODE
+    };
+
+    constexpr size_t MaxStatusCode = 599;
+
+    // Slot of every code in StatusLines, plus one, 0 for the unknown codes
+    struct StatusIndex {
+        uint8_t slots[MaxStatusCode + 1];
+    };
+
+    constexpr StatusIndex makeStatusIndex() {
+        StatusIndex index { };
+        for (size_t i = 0; i < sizeof(StatusCodes) / sizeof(StatusCodes[0]); ++i)
+            index.slots[StatusCodes[i]] = static_cast<uint8_t>(i + 1);
+        return index;
     }
+
+    constexpr StatusIndex StatusSlots = makeStatusIndex();
+
+    static_assert(sizeof(StatusCodes) / sizeof(StatusCodes[0]) < 255,
+                  "Too many status codes for the index");
+
+    const StatusLine* findStatus(Code code) {
+        const auto value = static_cast<unsigned>(code);
+        if (value > MaxStatusCode || StatusSlots.slots[value] == 0)
+            return nullptr;
+
+        return &StatusLines[StatusSlots.slots[value] - 1];
+    }
+
 }
 
 const char *versionString(Version version) {
@@ -151,15 +510,47 @@ const char* methodString(Method method)
 
 const char* codeString(Code code)
 {
-    switch (code) {
-#define CODE(_, name, str) \
-    case Code::name: \
-         return str;
-    STATUS_CODES
-#undef CODE
+    const auto* status = findStatus(code);
+    return status ? status->reason : "";
+}
+
+bool parseMethod(const char* str, size_t len, Method& method) {
+    if (len == 0 || len > 8)
+        return false;
+
+    const auto packed = packToken(str, len);
+    for (const auto& token: MethodTokens) {
+        if (token.packed == packed) {
+            method = token.method;
+            return true;
+        }
     }
 
-    return "";
+    return false;
+}
+
+bool parseVersion(const char* str, size_t len, Version& version) {
+    if (len != 8)
+        return false;
+
+    const auto packed = packToken(str, len);
+    if (packed == Http11Token)
+        version = Version::Http11;
+    else if (packed == Http10Token)
+        version = Version::Http10;
+    else
+        return false;
+
+    return true;
+}
+
+const char* statusLine(Version version, Code code, size_t& length) {
+    const auto* status = findStatus(code);
+    if (!status)
+        return nullptr;
+
+    length = status->length;
+    return version == Version::Http10 ? status->http10 : status->http11;
 }
 
 std::ostream& operator<<(std::ostream& os, Version version) {
@@ -15,6 +15,8 @@
 #include <cstring>
 #include <iostream>
 
+#include <strings.h>
+
 namespace Pistache {
 namespace Http {
 namespace Header {
@@ -253,22 +255,42 @@ CacheControl::addDirectives(const std::vector<Http::CacheDirective>& directives)
 
 void
 Connection::parseRaw(const char* str, size_t len) {
-    char *p = const_cast<char *>(str);
-    RawStreamBuf<> buf(p, p + len);
-    StreamCursor cursor(&buf);
-
-#define STR(str) \
-    str, sizeof(str) - 1
+    bool close = false;
+    bool keepAlive = false;
+    options_.clear();
+
+    // A comma-separated list of tokens
+    const char* end = str + len;
+    while (str < end) {
+        while (str < end && (*str == ' ' || *str == '\t' || *str == ','))
+            ++str;
+
+        const char* token = str;
+        while (str < end && *str != ',')
+            ++str;
+
+        const char* last = str;
+        while (last > token && (last[-1] == ' ' || last[-1] == '\t'))
+            --last;
+
+        size_t size = last - token;
+        if (size == 0)
+            continue;
+
+        if (size == 5 && !strncasecmp(token, "close", size))
+            close = true;
+        else if (size == 10 && !strncasecmp(token, "keep-alive", size))
+            keepAlive = true;
+        else
+            options_.emplace_back(token, size);
+    }
 
-    if (match_string(STR("close"), cursor)) {
+    if (close)
         control_ = ConnectionControl::Close;
-    }
-    else if (match_string(STR("keep-alive"), cursor)) {
+    else if (keepAlive)
         control_ = ConnectionControl::KeepAlive;
-    }
-    else {
+    else
         control_ = ConnectionControl::Ext;
-    }
 }
 
 void
@@ -281,9 +303,18 @@ Connection::write(std::ostream& os) const {
         os << "Keep-Alive";
         break;
     case ConnectionControl::Ext:
-        os << "Ext";
+        if (options_.empty())
+            os << "Ext";
         break;
     }
+
+    bool first = control_ == ConnectionControl::Ext;
+    for (const auto& option: options_) {
+        if (!first)
+            os << ", ";
+        os << option;
+        first = false;
+    }
 }
 
 void
@@ -316,7 +347,7 @@ Date::write(std::ostream& os) const {
 
 void
 Expect::parseRaw(const char* str, size_t len) {
-    if (memcmp(str, "100-continue", len)) {
+    if (len == 12 && !strncasecmp(str, "100-continue", len)) {
         expectation_ = Expectation::Continue;
     } else {
         expectation_ = Expectation::Ext;
@@ -377,6 +408,68 @@ Location::write(std::ostream& os) const {
     os << location_;
 }
 
+namespace {
+    // Strips the W/ prefix of a weak entity tag
+    std::string opaqueTag(const std::string& tag) {
+        if (tag.size() >= 2 && tag[0] == 'W' && tag[1] == '/')
+            return tag.substr(2);
+        return tag;
+    }
+}
+
+void
+ETag::parse(const std::string& data) {
+    tag_ = data;
+}
+
+void
+ETag::write(std::ostream& os) const {
+    os << tag_;
+}
+
+bool
+ETag::isWeak() const {
+    return tag_.size() >= 2 && tag_[0] == 'W' && tag_[1] == '/';
+}
+
+void
+IfNoneMatch::parse(const std::string& data) {
+    tags_.clear();
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        auto end = data.find(',', pos);
+        if (end == std::string::npos)
+            end = data.size();
+
+        auto first = data.find_first_not_of(' ', pos);
+        auto last = data.find_last_not_of(' ', end - 1);
+        if (first != std::string::npos && first < end && last >= first)
+            tags_.push_back(data.substr(first, last - first + 1));
+
+        pos = end + 1;
+    }
+}
+
+void
+IfNoneMatch::write(std::ostream& os) const {
+    for (size_t i = 0; i < tags_.size(); ++i) {
+        if (i > 0)
+            os << ", ";
+        os << tags_[i];
+    }
+}
+
+bool
+IfNoneMatch::matches(const std::string& tag) const {
+    auto opaque = opaqueTag(tag);
+    for (const auto& candidate: tags_) {
+        if (candidate == "*" || opaqueTag(candidate) == opaque)
+            return true;
+    }
+    return false;
+}
+
 void
 UserAgent::parse(const std::string& data) {
     ua_ = data;
@@ -389,39 +482,73 @@ UserAgent::write(std::ostream& os) const {
 
 void
 Accept::parseRaw(const char *str, size_t len) {
+    mediaRange_.clear();
+    raw_.assign(str, len);
 
-    RawStreamBuf<char> buf(const_cast<char *>(str), len);
-    StreamCursor cursor(&buf);
+    // Every element of the list must be there, whatever it holds
+    const char* p = str;
+    const char* const end = str + len;
+    while (true) {
+        const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+        const char* elementEnd = comma ? comma : end;
 
-    do {
-        int c;
-        size_t beg = cursor;
-        while ((c = cursor.next()) != StreamCursor::Eof && c != ',')
-            cursor.advance(1);
+        if (elementEnd == p)
+            throw std::runtime_error("Ill-formed Accept header");
 
-        cursor.advance(1);
+        if (!comma)
+            break;
 
-        const size_t mimeLen = cursor.diff(beg);
+        p = comma + 1;
+        while (p != end && *p == ' ')
+            ++p;
+    }
 
-        mediaRange_.push_back(Mime::MediaType::fromRaw(cursor.offset(beg), mimeLen));
+    pending_.store(true, std::memory_order_release);
+}
 
-        if (!cursor.eof()) {
-            if (!cursor.advance(1))
-                throw std::runtime_error("Ill-formed Accept header");
+const std::vector<Mime::MediaType>&
+Accept::media() const {
+    if (pending_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> guard(parseLock_);
+        if (pending_.load(std::memory_order_relaxed)) {
+            parseMedia();
+            pending_.store(false, std::memory_order_release);
+        }
+    }
 
-            if ((c = cursor.next()) == StreamCursor::Eof || c == ',' || c == 0)
-                throw std::runtime_error("Ill-formed Accept header");
+    return mediaRange_;
+}
 
-            while (!cursor.eof() && cursor.current() == ' ')
-                cursor.advance(1);
-        }
+void
+Accept::parseMedia() const {
+    // Every element of the list is a media range, the q-values are parsed with them
+    std::vector<Mime::MediaType> media;
+    const char* p = raw_.data();
+    const char* const end = p + raw_.size();
+    while (true) {
+        const char* comma = static_cast<const char*>(memchr(p, ',', end - p));
+        const char* elementEnd = comma ? comma : end;
 
-    } while (!cursor.eof());
+        media.push_back(Mime::MediaType::fromRaw(p, elementEnd - p));
+
+        if (!comma)
+            break;
+
+        p = comma + 1;
+        while (p != end && *p == ' ')
+            ++p;
+    }
+
+    mediaRange_ = std::move(media);
 }
 
 void
 Accept::write(std::ostream& os) const {
-    UNUSED(os)
+    const char* sep = "";
+    for (const auto& mime: media()) {
+        os << sep << mime.toString();
+        sep = ", ";
+    }
 }
 
 void
@@ -491,6 +618,24 @@ EncodingHeader::write(std::ostream& os) const {
     os << encodingString(encoding_);
 }
 
+void
+RetryAfter::parse(const std::string& data) {
+    uint64_t seconds = 0;
+    for (char c: data) {
+        if (c < '0' || c > '9') {
+            seconds = 0;
+            break;
+        }
+        seconds = seconds * 10 + (c - '0');
+    }
+    delay_ = std::chrono::seconds(seconds);
+}
+
+void
+RetryAfter::write(std::ostream& os) const {
+    os << delay_.count();
+}
+
 Server::Server(const std::vector<std::string>& tokens)
     : tokens_(tokens)
 { }
@@ -528,7 +673,7 @@ ContentType::parseRaw(const char* str, size_t len)
 
 void
 ContentType::write(std::ostream& os) const {
-    os << mime_.toString();
+    mime_.write(os);
 }
 
 } // namespace Header
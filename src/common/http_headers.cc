@@ -28,9 +28,12 @@ RegisterHeader(TransferEncoding);
 RegisterHeader(ContentLength);
 RegisterHeader(ContentType);
 RegisterHeader(Date);
+RegisterHeader(ETag);
 RegisterHeader(Expect);
 RegisterHeader(Host);
+RegisterHeader(IfNoneMatch);
 RegisterHeader(Location);
+RegisterHeader(RetryAfter);
 RegisterHeader(Server);
 RegisterHeader(UserAgent);
 
@@ -5,6 +5,9 @@
 */
 
 #include <cstring>
+#include <vector>
+
+#include <strings.h>
 
 #include <pistache/mime.h>
 #include <pistache/http.h>
@@ -96,6 +99,116 @@ MediaType::fromFile(const char* fileName)
     return MediaType();
 }
 
+namespace {
+
+    bool equalsNoCase(const char* str, size_t len, const char* literal, size_t literalLen) {
+        return len == literalLen && !strncasecmp(str, literal, len);
+    }
+
+    // Returns the first byte of [p, end) that is one of the delimiters, or end
+    const char* scanUntil(const char* p, const char* end, const char* delimiters) {
+        while (p != end && !strchr(delimiters, *p))
+            ++p;
+        return p;
+    }
+
+    /* qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] ), read
+     * exactly, in hundredths, instead of going through a double
+     */
+    bool parseQValue(const char* p, const char* end, Q::Type& value) {
+        if (p == end || (*p != '0' && *p != '1'))
+            return false;
+
+        value = static_cast<Q::Type>((*p++ - '0') * 100);
+        if (p == end)
+            return true;
+
+        if (*p++ != '.')
+            return false;
+
+        Q::Type scale = 10;
+        for (size_t digits = 0; p != end; ++p, ++digits) {
+            if (digits == 3 || *p < '0' || *p > '9')
+                return false;
+            value = static_cast<Q::Type>(value + (*p - '0') * scale);
+            scale /= 10;
+        }
+
+        return value <= 100;
+    }
+
+    const char* typeString(Mime::Type top) {
+        switch (top) {
+#define TYPE(val, str)        \
+        case Mime::Type::val: \
+            return str;
+        MIME_TYPES
+#undef TYPE
+        default:
+            return "";
+        }
+    }
+
+    const char* subtypeString(Mime::Subtype sub) {
+        switch (sub) {
+#define SUB_TYPE(val, str)       \
+        case Mime::Subtype::val: \
+            return str;
+        MIME_SUBTYPES
+#undef SUB_TYPE
+        default:
+            return "";
+        }
+    }
+
+    const char* suffixString(Mime::Suffix suffix) {
+        switch (suffix) {
+#define SUFFIX(val, str, _)     \
+        case Mime::Suffix::val: \
+            return "+" str;
+        MIME_SUFFIXES
+#undef SUFFIX
+        default:
+            return "";
+        }
+    }
+
+    // The known values are the ones that come before the special ones
+    const size_t TypesCount = static_cast<size_t>(Mime::Type::None);
+    const size_t SubtypesCount = static_cast<size_t>(Mime::Subtype::Vendor);
+    const size_t SuffixesCount = static_cast<size_t>(Mime::Suffix::None) + 1;
+
+    std::vector<std::string>* makeInternTable() {
+        auto* table = new std::vector<std::string>(TypesCount * SubtypesCount * SuffixesCount);
+        for (size_t top = 0; top < TypesCount; ++top) {
+            for (size_t sub = 0; sub < SubtypesCount; ++sub) {
+                for (size_t suffix = 0; suffix < SuffixesCount; ++suffix) {
+                    auto& str = (*table)[(top * SubtypesCount + sub) * SuffixesCount + suffix];
+                    str += typeString(static_cast<Mime::Type>(top));
+                    str += '/';
+                    str += subtypeString(static_cast<Mime::Subtype>(sub));
+                    str += suffixString(static_cast<Mime::Suffix>(suffix));
+                }
+            }
+        }
+        return table;
+    }
+
+}
+
+const std::string*
+MediaType::intern(Mime::Type top, Mime::Subtype sub, Mime::Suffix suffix) {
+    const auto topIndex = static_cast<size_t>(top);
+    const auto subIndex = static_cast<size_t>(sub);
+    const auto suffixIndex = static_cast<size_t>(suffix);
+    if (topIndex >= TypesCount || subIndex >= SubtypesCount || suffixIndex >= SuffixesCount)
+        return nullptr;
+
+    // Never freed: the MediaTypes of static objects can outlive the table otherwise
+    static const std::vector<std::string>* const table = makeInternTable();
+    return &(*table)[(topIndex * SubtypesCount + subIndex) * SuffixesCount + suffixIndex];
+}
+
 void
 MediaType::parseRaw(const char* str, size_t len) {
     auto raise = [&](const char* str) {
@@ -105,53 +218,50 @@ MediaType::parseRaw(const char* str, size_t len) {
         throw HttpError(Http::Code::Unsupported_Media_Type, str);
     };
 
-    RawStreamBuf<char> buf(const_cast<char *>(str), len);
-    StreamCursor cursor(&buf);
-
     raw_ = string(str, len);
+    suffix_ = Suffix::None;
+    params.clear();
+    q_ = None();
+    interned_ = nullptr;
 
-    Mime::Type top = Type::None;
+    const char* const begin = str;
+    const char* const end = str + len;
+
+    // Top type
+    const char* slash = scanUntil(begin, end, "/");
 
-    // The reason we are using a do { } while (0); syntax construct here is to emulate
-    // if / else-if. Since we are using items-list macros to compare the strings,
-    // we want to avoid evaluating all the branches when one of them evaluates to true.
-    //
-    // Instead, we break the loop when a branch evaluates to true so that we do
-    // not evaluate all the subsequent ones.
-    //
-    // Watch out, this pattern is repeated throughout the function
+    Mime::Type top = Type::None;
     do {
-#define TYPE(val, s)                                                               \
-        if (match_string(s, sizeof s - 1, cursor, CaseSensitivity::Insensitive)) { \
-            top = Type::val;                                                       \
-            break;                                                                 \
+#define TYPE(val, s)                                                \
+        if (equalsNoCase(begin, slash - begin, s, sizeof s - 1)) {  \
+            top = Type::val;                                        \
+            break;                                                  \
         }
         MIME_TYPES
 #undef TYPE
-        raise("Unknown Media Type");
+        raise(slash == end ? "Malformed Media Type, expected a '/' after the top type"
+                           : "Unknown Media Type");
     } while (0);
 
     top_ = top;
 
-    if (!match_literal('/', cursor))
-        raise("Malformed Media Type, expected a '/' after the top type");
-
-    if (cursor.eof())
+    if (slash + 1 == end)
         raise("Malformed Media type, missing subtype");
+    const char* p = slash + 1;
 
-    // Parse subtype
-    Mime::Subtype sub;
-
-    StreamCursor::Token subToken(cursor);
+    // Subtype
+    const char* subEnd = scanUntil(p, end, ";+ ");
+    const size_t subLen = subEnd - p;
 
-    if (match_raw("vnd.", 4, cursor)) {
+    Mime::Subtype sub;
+    if (subLen >= 4 && !memcmp(p, "vnd.", 4)) {
         sub = Subtype::Vendor;
     } else {
         do {
-#define SUB_TYPE(val, s)                                                               \
-            if (match_string(s, sizeof s - 1, cursor, CaseSensitivity::Insensitive)) { \
-                sub = Subtype::val;                                                    \
-                break;                                                                 \
+#define SUB_TYPE(val, s)                                        \
+            if (equalsNoCase(p, subLen, s, sizeof s - 1)) {     \
+                sub = Subtype::val;                             \
+                break;                                          \
             }
             MIME_SUBTYPES
 #undef SUB_TYPE
@@ -160,28 +270,27 @@ MediaType::parseRaw(const char* str, size_t len) {
     }
 
     if (sub == Subtype::Ext || sub == Subtype::Vendor) {
-        (void) match_until({ ';', '+' }, cursor);
-        rawSubIndex.beg = subToken.start();
-        rawSubIndex.end = subToken.end() - 1;
+        rawSubIndex.beg = p - begin;
+        rawSubIndex.end = subEnd - begin - 1;
     }
 
     sub_ = sub;
+    p = subEnd;
 
-    if (cursor.eof()) return;
-
-    // Parse suffix
-    Mime::Suffix suffix = Suffix::None;
-    if (match_literal('+', cursor)) {
-
-        if (cursor.eof()) raise("Malformed Media Type, expected suffix, got EOF");
+    // Suffix
+    if (p != end && *p == '+') {
+        ++p;
+        if (p == end) raise("Malformed Media Type, expected suffix, got EOF");
 
-        StreamCursor::Token suffixToken(cursor);
+        const char* suffixEnd = scanUntil(p, end, ";+ ");
+        const size_t suffixLen = suffixEnd - p;
 
+        Mime::Suffix suffix;
         do {
-#define SUFFIX(val, s, _)                                                              \
-            if (match_string(s, sizeof s - 1, cursor, CaseSensitivity::Insensitive)) { \
-                suffix = Suffix::val;                                                  \
-                break;                                                                 \
+#define SUFFIX(val, s, _)                                       \
+            if (equalsNoCase(p, suffixLen, s, sizeof s - 1)) {  \
+                suffix = Suffix::val;                           \
+                break;                                          \
             }
             MIME_SUFFIXES
 #undef SUFFIX
@@ -189,56 +298,42 @@ MediaType::parseRaw(const char* str, size_t len) {
         } while (0);
 
         if (suffix == Suffix::Ext) {
-            (void) match_until({ ';', '+' }, cursor);
-            rawSuffixIndex.beg = suffixToken.start();
-            rawSuffixIndex.end = suffixToken.end() - 1;
+            rawSuffixIndex.beg = p - begin;
+            rawSuffixIndex.end = suffixEnd - begin - 1;
         }
 
         suffix_ = suffix;
+        p = suffixEnd;
     }
 
-    // Parse parameters
-    while (!cursor.eof()) {
-
-        if (cursor.current() == ';' || cursor.current() == ' ') {
-            int c;
-            if ((c = cursor.next()) == StreamCursor::Eof || c == 0)
-                raise("Malformed Media Type, expected parameter got EOF");
-            cursor.advance(1);
-        }
-
-        else if (match_literal('q', cursor)) {
-
-            if (cursor.eof()) raise("Invalid quality factor");
-
-            if (match_literal('=', cursor)) {
-                double val;
-                if (!match_double(&val, cursor))
-                    raise("Invalid quality factor");
-                q_ = Some(Q::fromFloat(val));
-            }
-            else {
-                raise("Missing quality factor");
-            }
-        }
-        else {
-            StreamCursor::Token keyToken(cursor);
-            (void) match_until('=', cursor);
-
-            int c;
-            if (cursor.eof() || (c = cursor.next()) == StreamCursor::Eof || c == 0)
-                raise("Unfinished Media Type parameter");
-
-            std::string key = keyToken.text();
-            cursor.advance(1);
-
-            StreamCursor::Token valueToken(cursor);
-            (void) match_until({ ' ', ';' }, cursor);
-            params.insert(std::make_pair(std::move(key), valueToken.text()));
+    // Parameters, each one after at least one ';' or ' '
+    while (p != end) {
+        if (*p != ';' && *p != ' ')
+            raise("Malformed Media Type, expected a parameter");
+
+        while (p != end && (*p == ';' || *p == ' '))
+            ++p;
+        if (p == end)
+            raise("Malformed Media Type, expected parameter got EOF");
+
+        const char* equal = scanUntil(p, end, "=; ");
+        if (equal == end || *equal != '=' || equal + 1 == end)
+            raise("Unfinished Media Type parameter");
+
+        const char* value = equal + 1;
+        const char* valueEnd = scanUntil(value, end, "; ");
+
+        if (equalsNoCase(p, equal - p, "q", 1)) {
+            Q::Type quality;
+            if (!parseQValue(value, valueEnd, quality))
+                raise("Invalid quality factor");
+            q_ = Some(Q(quality));
+        } else {
+            params.insert(std::make_pair(std::string(p, equal), std::string(value, valueEnd)));
         }
 
+        p = valueEnd;
     }
-
 }
 
 void
@@ -266,47 +361,13 @@ MediaType::toString() const {
 
     if (!raw_.empty()) return raw_;
 
-    auto topString = [](Mime::Type top) -> const char * {
-        switch (top) {
-#define TYPE(val, str)        \
-        case Mime::Type::val: \
-            return str;
-        MIME_TYPES
-#undef TYPE
-        default:
-            return "";
-        }
-    };
-
-    auto subString = [](Mime::Subtype sub) -> const char * {
-        switch (sub) {
-#define SUB_TYPE(val, str)       \
-        case Mime::Subtype::val: \
-            return str;
-        MIME_SUBTYPES
-#undef TYPE
-        default:
-            return "";
-        }
-    };
-
-    auto suffixString = [](Mime::Suffix suffix) -> const char * {
-        switch (suffix) {
-#define SUFFIX(val, str, _)     \
-        case Mime::Suffix::val: \
-            return "+" str;
-        MIME_SUFFIXES
-#undef SUFFIX
-        default:
-            return "";
-        }
-    };
+    if (interned_ && q_.isEmpty() && params.empty()) return *interned_;
 
     std::string res;
     res.reserve(128);
-    res += topString(top_);
+    res += typeString(top_);
     res += "/";
-    res += subString(sub_);
+    res += subtypeString(sub_);
     if (suffix_ != Suffix::None) {
         res += suffixString(suffix_);
     }
@@ -324,6 +385,16 @@ MediaType::toString() const {
     return res;
 }
 
+void
+MediaType::write(std::ostream& os) const {
+    if (!raw_.empty())
+        os << raw_;
+    else if (interned_ && q_.isEmpty() && params.empty())
+        os << *interned_;
+    else
+        os << toString();
+}
+
 bool
 MediaType::isValid() const {
     return top_ != Type::None && sub_ != Subtype::None;
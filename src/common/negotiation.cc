@@ -0,0 +1,138 @@
+/* negotiation.cc
+
+   Implementation of the content negotiation
+*/
+
+#include <strings.h>
+
+#include <atomic>
+#include <stdexcept>
+
+#include <pistache/negotiation.h>
+
+namespace Pistache {
+namespace Http {
+
+constexpr size_t ContentNegotiator::CacheSize;
+
+namespace {
+
+    bool sameSubtype(const Mime::MediaType& range, const Mime::MediaType& type) {
+        if (range.sub() != type.sub() || range.suffix() != type.suffix())
+            return false;
+
+        if (type.sub() == Mime::Subtype::Ext || type.sub() == Mime::Subtype::Vendor)
+            return !strcasecmp(range.rawSub().c_str(), type.rawSub().c_str());
+
+        return true;
+    }
+
+    // How specific a media range matching the type is, -1 when it does not match
+    int specificity(const Mime::MediaType& range, const Mime::MediaType& type) {
+        if (range.top() == Mime::Type::Star)
+            return 0;
+        if (range.top() != type.top())
+            return -1;
+        if (range.sub() == Mime::Subtype::Star)
+            return 1;
+
+        return sameSubtype(range, type) ? 2 : -1;
+    }
+
+    Mime::Q::Type quality(const Mime::MediaType& type, const std::vector<Mime::MediaType>& ranges) {
+        int best = -1;
+        Mime::Q::Type q = 0;
+        for (const auto& range: ranges) {
+            const int spec = specificity(range, type);
+            if (spec > best) {
+                best = spec;
+                q = range.q().isEmpty() ? 100 : range.q().unsafeGet().value();
+            }
+        }
+
+        return q;
+    }
+
+    struct Choice {
+        uint64_t negotiator;
+        std::string accept;
+        int index;
+    };
+
+    struct ChoiceCache {
+        std::vector<Choice> choices;
+        size_t nextEviction = 0;
+    };
+
+    ChoiceCache& choiceCache() {
+        thread_local ChoiceCache cache;
+        return cache;
+    }
+
+    // Never reused, so that a choice can not outlive its negotiator by mistake
+    std::atomic<uint64_t> nextNegotiatorId(0);
+
+}
+
+ContentNegotiator::ContentNegotiator(std::vector<Mime::MediaType> produces)
+    : produces_(std::move(produces))
+    , id_(nextNegotiatorId.fetch_add(1, std::memory_order_relaxed))
+{ }
+
+Mime::MediaType
+ContentNegotiator::negotiate(const Request& request) const {
+    if (produces_.empty())
+        return Mime::MediaType();
+
+    auto accept = request.headers().tryGet<Header::Accept>();
+    const int index = accept ? cachedSelect(*accept) : 0;
+    if (index < 0)
+        return Mime::MediaType();
+
+    return produces_[index];
+}
+
+int
+ContentNegotiator::select(const std::vector<Mime::MediaType>& ranges) const {
+    int best = -1;
+    Mime::Q::Type bestQuality = 0;
+    for (size_t i = 0; i < produces_.size(); ++i) {
+        const auto q = quality(produces_[i], ranges);
+        if (q > bestQuality) {
+            best = static_cast<int>(i);
+            bestQuality = q;
+        }
+    }
+
+    return best;
+}
+
+int
+ContentNegotiator::cachedSelect(const Header::Accept& accept) const {
+    const auto& raw = accept.raw();
+
+    auto& cache = choiceCache();
+    for (const auto& choice: cache.choices) {
+        if (choice.negotiator == id_ && choice.accept == raw)
+            return choice.index;
+    }
+
+    int index;
+    try {
+        index = select(accept.media());
+    } catch (const std::runtime_error&) {
+        throw HttpError(Code::Bad_Request, "Ill-formed Accept header");
+    }
+
+    if (cache.choices.size() < CacheSize) {
+        cache.choices.push_back(Choice { id_, raw, index });
+    } else {
+        cache.choices[cache.nextEviction] = Choice { id_, raw, index };
+        cache.nextEviction = (cache.nextEviction + 1) % CacheSize;
+    }
+
+    return index;
+}
+
+} // namespace Http
+} // namespace Pistache
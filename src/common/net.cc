@@ -18,22 +18,195 @@
 namespace Pistache {
 
 namespace {
-    bool IsIPv4HostName(const std::string& host)
-    {
-        in_addr addr;
-        char buff[INET_ADDRSTRLEN + 1] = {0, };
-        std::copy(host.begin(), host.end(), buff);
-        int res = inet_pton(AF_INET, buff, &addr);
-        return res;
+    bool isDigit(char c) {
+        return c >= '0' && c <= '9';
     }
 
-    bool IsIPv6HostName(const std::string& host)
-    {
-        in6_addr addr6;
-        char buff6[INET6_ADDRSTRLEN + 1] = {0, };
-        std::copy(host.begin(), host.end(), buff6);
-        int res = inet_pton(AF_INET6, buff6, &(addr6.s6_addr16));
-        return res;
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // A dotted quad, without the leading zeros inet_pton rejects as well
+    bool parseIpv4(const char* p, const char* end, uint8_t* out) {
+        uint8_t bytes[4];
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0) {
+                if (p == end || *p != '.')
+                    return false;
+                ++p;
+            }
+
+            if (p == end || !isDigit(*p))
+                return false;
+
+            unsigned value = *p++ - '0';
+            if (value == 0 && p != end && isDigit(*p))
+                return false;
+
+            while (p != end && isDigit(*p)) {
+                value = value * 10 + (*p++ - '0');
+                if (value > 255)
+                    return false;
+            }
+            bytes[i] = static_cast<uint8_t>(value);
+        }
+
+        if (p != end)
+            return false;
+
+        std::memcpy(out, bytes, sizeof bytes);
+        return true;
+    }
+
+    bool parseIpv6(const char* p, const char* end, uint8_t* out) {
+        uint8_t bytes[16] = { 0 };
+        int pos = 0;
+        int gap = -1;
+
+        if (p != end && *p == ':') {
+            if (end - p < 2 || p[1] != ':')
+                return false;
+            p += 2;
+            gap = 0;
+        }
+
+        while (p != end) {
+            if (pos == 16)
+                return false;
+
+            const char* group = p;
+            unsigned value = 0;
+            int digits = 0;
+            int digit;
+            while (p != end && (digit = hexValue(*p)) >= 0) {
+                if (++digits > 4)
+                    return false;
+                value = (value << 4) | digit;
+                ++p;
+            }
+
+            // An IPv4 address can only end the address
+            if (p != end && *p == '.') {
+                if (pos > 12 || !parseIpv4(group, end, bytes + pos))
+                    return false;
+                pos += 4;
+                break;
+            }
+
+            if (digits == 0)
+                return false;
+
+            bytes[pos++] = static_cast<uint8_t>(value >> 8);
+            bytes[pos++] = static_cast<uint8_t>(value);
+
+            if (p == end)
+                break;
+            if (*p++ != ':' || p == end)
+                return false;
+
+            if (*p == ':') {
+                if (gap >= 0)
+                    return false;
+                gap = pos;
+                ++p;
+            }
+        }
+
+        if (gap >= 0) {
+            // The gap stands for at least one group
+            if (pos == 16)
+                return false;
+
+            const int tail = pos - gap;
+            std::memcpy(out, bytes, gap);
+            std::memset(out + gap, 0, 16 - pos);
+            std::memcpy(out + 16 - tail, bytes + gap, tail);
+            return true;
+        }
+
+        if (pos != 16)
+            return false;
+
+        std::memcpy(out, bytes, 16);
+        return true;
+    }
+
+    char* formatDecimal(char* out, uint8_t value) {
+        if (value >= 100) {
+            *out++ = static_cast<char>('0' + value / 100);
+            *out++ = static_cast<char>('0' + value / 10 % 10);
+        } else if (value >= 10) {
+            *out++ = static_cast<char>('0' + value / 10);
+        }
+        *out++ = static_cast<char>('0' + value % 10);
+        return out;
+    }
+
+    char* formatIpv4(char* out, const uint8_t* bytes) {
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0)
+                *out++ = '.';
+            out = formatDecimal(out, bytes[i]);
+        }
+        return out;
+    }
+
+    // The same text as inet_ntop
+    char* formatIpv6(char* out, const uint8_t* bytes) {
+        static const char Hex[] = "0123456789abcdef";
+
+        uint16_t words[8];
+        for (int i = 0; i < 8; ++i)
+            words[i] = static_cast<uint16_t>(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+
+        // The longest run of zeros, the first one on ties, is elided
+        int best = -1, bestLength = 0;
+        for (int i = 0; i < 8; ) {
+            if (words[i] != 0) {
+                ++i;
+                continue;
+            }
+            int j = i;
+            while (j < 8 && words[j] == 0)
+                ++j;
+            if (j - i > bestLength) {
+                best = i;
+                bestLength = j - i;
+            }
+            i = j;
+        }
+        if (bestLength < 2)
+            best = -1;
+
+        for (int i = 0; i < 8; ++i) {
+            if (best >= 0 && i >= best && i < best + bestLength) {
+                if (i == best)
+                    *out++ = ':';
+                continue;
+            }
+
+            if (i > 0)
+                *out++ = ':';
+
+            if (i == 6 && best == 0
+                    && (bestLength == 6 || (bestLength == 5 && words[5] == 0xffff)))
+                return formatIpv4(out, bytes + 12);
+
+            const uint16_t word = words[i];
+            int shift = 12;
+            while (shift > 0 && (word >> shift) == 0)
+                shift -= 4;
+            for (; shift >= 0; shift -= 4)
+                *out++ = Hex[(word >> shift) & 0xf];
+        }
+
+        if (best >= 0 && best + bestLength == 8)
+            *out++ = ':';
+
+        return out;
     }
 }
 
@@ -88,17 +261,7 @@ Ipv4::loopback() {
 
 std::string
 Ipv4::toString() const {
-    
-    // Use the built-in ipv4 string length from arpa/inet.h
-    char buff[INET_ADDRSTRLEN+1];
-    
-    in_addr_t addr;
-    toNetwork(&addr);
-    
-    // Convert the network format address into display format
-    inet_ntop(AF_INET, &addr, buff, INET_ADDRSTRLEN);
-    
-    return std::string(buff);
+    return IpAddress(*this).toString();
 }
 
 void Ipv4::toNetwork(in_addr_t *addr) const {
@@ -129,16 +292,7 @@ Ipv6::loopback() {
 
 std::string
 Ipv6::toString() const {
-    
-    // Use the built-in ipv6 string length from arpa/inet.h
-    char buff6[INET6_ADDRSTRLEN+1];
-    
-    in6_addr addr;
-    toNetwork(&addr);
-    
-    inet_ntop(AF_INET6, &addr, buff6, INET6_ADDRSTRLEN);
-
-    return std::string(buff6);
+    return IpAddress(*this).toString();
 }
 
 void Ipv6::toNetwork(in6_addr *addr6) const {
@@ -186,6 +340,208 @@ bool Ipv6::supported() {
     return supportsIpv6;
 }
 
+constexpr size_t IpAddress::MaxLength;
+
+IpAddress::IpAddress()
+    : family_(AF_UNSPEC)
+    , bytes_()
+{ }
+
+IpAddress::IpAddress(const in_addr& addr)
+    : family_(AF_INET)
+    , bytes_()
+{
+    std::memcpy(bytes_, &addr, 4);
+}
+
+IpAddress::IpAddress(const in6_addr& addr)
+    : family_(AF_INET6)
+    , bytes_()
+{
+    std::memcpy(bytes_, &addr, 16);
+}
+
+IpAddress::IpAddress(Ipv4 ip)
+    : family_(AF_INET)
+    , bytes_()
+{
+    in_addr_t addr;
+    ip.toNetwork(&addr);
+    std::memcpy(bytes_, &addr, 4);
+}
+
+IpAddress::IpAddress(Ipv6 ip)
+    : family_(AF_INET6)
+    , bytes_()
+{
+    in6_addr addr;
+    ip.toNetwork(&addr);
+    std::memcpy(bytes_, &addr, 16);
+}
+
+bool
+IpAddress::parse(const char* data, size_t size, IpAddress& out) {
+    const char* end = data + size;
+    uint8_t bytes[16];
+
+    // Only an IPv6 address has colons
+    if (std::memchr(data, ':', size) != nullptr) {
+        if (!parseIpv6(data, end, bytes))
+            return false;
+        out.family_ = AF_INET6;
+        std::memcpy(out.bytes_, bytes, 16);
+        return true;
+    }
+
+    if (!parseIpv4(data, end, bytes))
+        return false;
+    out.family_ = AF_INET;
+    std::memcpy(out.bytes_, bytes, 4);
+    std::memset(out.bytes_ + 4, 0, 12);
+    return true;
+}
+
+IpAddress
+IpAddress::fromString(const std::string& data) {
+    IpAddress ip;
+    if (!parse(data.data(), data.size(), ip))
+        throw std::invalid_argument("Invalid IP address: " + data);
+    return ip;
+}
+
+IpAddress
+IpAddress::fromUnix(const struct sockaddr* addr) {
+    if (addr->sa_family == AF_INET)
+        return IpAddress(reinterpret_cast<const struct sockaddr_in *>(addr)->sin_addr);
+    if (addr->sa_family == AF_INET6)
+        return IpAddress(reinterpret_cast<const struct sockaddr_in6 *>(addr)->sin6_addr);
+    throw Error("Not an IP socket");
+}
+
+size_t
+IpAddress::size() const {
+    switch (family_) {
+    case AF_INET:
+        return 4;
+    case AF_INET6:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t
+IpAddress::format(char* out) const {
+    char* end = out;
+    if (family_ == AF_INET)
+        end = formatIpv4(out, bytes_);
+    else if (family_ == AF_INET6)
+        end = formatIpv6(out, bytes_);
+
+    *end = '\0';
+    return end - out;
+}
+
+std::string
+IpAddress::toString() const {
+    char buff[MaxLength];
+    return std::string(buff, format(buff));
+}
+
+bool
+IpAddress::isV4Mapped() const {
+    static const uint8_t Prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+    return family_ == AF_INET6 && std::memcmp(bytes_, Prefix, sizeof Prefix) == 0;
+}
+
+bool
+IpAddress::operator==(const IpAddress& other) const {
+    return family_ == other.family_ && std::memcmp(bytes_, other.bytes_, size()) == 0;
+}
+
+Cidr::Cidr()
+    : network_()
+    , prefix_(0)
+{ }
+
+Cidr::Cidr(const IpAddress& network, uint8_t prefix)
+    : network_(network)
+    , prefix_(prefix)
+{
+    const size_t bits = network.size() * 8;
+    if (prefix > bits)
+        throw std::invalid_argument("Invalid prefix length");
+
+    uint8_t* bytes = network_.bytes_;
+    size_t full = prefix / 8;
+    if (prefix % 8) {
+        bytes[full] &= static_cast<uint8_t>(0xff << (8 - prefix % 8));
+        ++full;
+    }
+    std::memset(bytes + full, 0, network.size() - full);
+}
+
+bool
+Cidr::parse(const char* data, size_t size, Cidr& out) {
+    const char* slash = static_cast<const char*>(std::memchr(data, '/', size));
+    const size_t length = slash ? slash - data : size;
+
+    IpAddress network;
+    if (!IpAddress::parse(data, length, network))
+        return false;
+
+    const unsigned bits = network.size() * 8;
+    unsigned prefix = bits;
+    if (slash) {
+        const char* p = slash + 1;
+        const char* end = data + size;
+        if (p == end || end - p > 3)
+            return false;
+
+        prefix = 0;
+        for (; p != end; ++p) {
+            if (!isDigit(*p))
+                return false;
+            prefix = prefix * 10 + (*p - '0');
+        }
+        if (prefix > bits)
+            return false;
+    }
+
+    out = Cidr(network, static_cast<uint8_t>(prefix));
+    return true;
+}
+
+Cidr
+Cidr::fromString(const std::string& data) {
+    Cidr cidr;
+    if (!parse(data.data(), data.size(), cidr))
+        throw std::invalid_argument("Invalid CIDR block: " + data);
+    return cidr;
+}
+
+bool
+Cidr::contains(const IpAddress& ip) const {
+    const uint8_t* bytes = ip.bytes();
+    if (ip.family() != network_.family()) {
+        if (network_.family() != AF_INET || !ip.isV4Mapped())
+            return false;
+        bytes += 12;
+    }
+
+    const uint8_t* network = network_.bytes();
+    const size_t full = prefix_ / 8;
+    if (std::memcmp(bytes, network, full) != 0)
+        return false;
+
+    const unsigned rest = prefix_ % 8;
+    if (rest == 0)
+        return true;
+
+    const uint8_t mask = static_cast<uint8_t>(0xff << (8 - rest));
+    return (bytes[full] & mask) == network[full];
+}
+
 AddressParser::AddressParser(const std::string& data)
 {
     std::size_t end_pos = data.find(']');
@@ -229,7 +585,8 @@ int AddressParser::family() const
 }
 
 Address::Address()
-    : host_("")
+    : ip_()
+    , host_()
     , port_(0)
 { }
 
@@ -253,40 +610,38 @@ Address::Address(const char* addr)
 }
 
 Address::Address(Ipv4 ip, Port port)
-    : host_(ip.toString())
+    : ip_(ip)
+    , host_()
     , port_(port)
-    , family_(AF_INET)
 { }
 
 Address::Address(Ipv6 ip, Port port)
-    : host_(ip.toString())
+    : ip_(ip)
+    , host_()
     , port_(port)
-    , family_(AF_INET6)
 { }
 
 Address
 Address::fromUnix(struct sockaddr* addr) {
-    if (addr->sa_family == AF_INET) { 
-        struct sockaddr_in *in_addr = reinterpret_cast<struct sockaddr_in *>(addr);
-        char host[INET_ADDRSTRLEN+1];
-        inet_ntop(AF_INET, &(in_addr->sin_addr), host, INET_ADDRSTRLEN);
-        int port = ntohs(in_addr->sin_port);
-        assert(addr);
-        return Address(host, port);
-    } else if (addr->sa_family == AF_INET6) {
-        struct sockaddr_in6 *in_addr = reinterpret_cast<struct sockaddr_in6 *>(addr);
-        char host[INET6_ADDRSTRLEN+1];
-        inet_ntop(AF_INET6, &(in_addr->sin6_addr), host, INET6_ADDRSTRLEN);
-        int port = ntohs(in_addr->sin6_port);
-        assert(addr);
-        return Address(host, port);
-    }
-    throw Error("Not an IP socket");    
+    Address address;
+    address.ip_ = IpAddress::fromUnix(addr);
+    if (addr->sa_family == AF_INET)
+        address.port_ = ntohs(reinterpret_cast<struct sockaddr_in *>(addr)->sin_port);
+    else
+        address.port_ = ntohs(reinterpret_cast<struct sockaddr_in6 *>(addr)->sin6_port);
+    return address;
 }
 
 std::string
 Address::host() const {
-    return host_;
+    if (!host_.empty())
+        return host_;
+    return ip_.toString();
+}
+
+const IpAddress&
+Address::ip() const {
+    return ip_;
 }
 
 Port
@@ -296,25 +651,27 @@ Address::port() const {
 
 int
 Address::family() const {
-    return family_;
+    // An address that was never set is an IPv4 one
+    if (ip_.family() == AF_UNSPEC)
+        return AF_INET;
+    return ip_.family();
 }
 
 void Address::init(const std::string& addr)
 {
     AddressParser parser(addr);
-    family_ = parser.family();
-    if (family_ == AF_INET6)
+    if (parser.family() == AF_INET6)
     {
         const std::string& raw_host = parser.rawHost();
         assert(raw_host.size() > 2);
         host_ = addr.substr(1, raw_host.size() - 2);
 
-        if (!IsIPv6HostName(host_))
+        if (!IpAddress::parse(host_.data(), host_.size(), ip_) || ip_.family() != AF_INET6)
         {
             throw std::invalid_argument("Invalid IPv6 address");
         }
     }
-    else if (family_ == AF_INET)
+    else if (parser.family() == AF_INET)
     {
         host_ = parser.rawHost();
         if (host_ == "*")
@@ -326,7 +683,7 @@ void Address::init(const std::string& addr)
             host_ = "127.0.0.1";
         }
 
-        if (!IsIPv4HostName(host_))
+        if (!IpAddress::parse(host_.data(), host_.size(), ip_) || ip_.family() != AF_INET)
         {
             throw std::invalid_argument("Invalid IPv4 address");
         }
@@ -3,6 +3,8 @@
 
 */
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <stdexcept>
 
@@ -17,9 +19,17 @@ namespace Tcp {
 
 using namespace std;
 
+namespace {
+    std::atomic<size_t> registeredSlots(0);
+}
+
+// Slots are only allocated once some data is put in them, most idle peers
+// never need any
 Peer::Peer()
     : transport_(nullptr)
     , fd_(-1)
+    , slots_()
+    , data_()
     , ssl_(NULL)
 { }
 
@@ -27,6 +37,8 @@ Peer::Peer(const Address& addr)
     : transport_(nullptr)
     , addr(addr)
     , fd_(-1)
+    , slots_()
+    , data_()
     , ssl_(NULL)
 { }
 
@@ -67,6 +79,24 @@ Peer::fd() const {
     return fd_;
 }
 
+size_t
+Peer::nextSlot() {
+    return registeredSlots.fetch_add(1);
+}
+
+size_t
+Peer::slotsCount() {
+    return registeredSlots.load();
+}
+
+std::shared_ptr<void>&
+Peer::slotAt(size_t index) {
+    if (index >= slots_.size())
+        slots_.resize(std::max(index + 1, slotsCount()));
+
+    return slots_[index];
+}
+
 void
 Peer::putData(std::string name, std::shared_ptr<Pistache::Http::Private::ParserBase> data) {
     auto it = data_.find(name);
@@ -79,16 +109,16 @@ Peer::putData(std::string name, std::shared_ptr<Pistache::Http::Private::ParserB
 
 std::shared_ptr<Pistache::Http::Private::ParserBase>
 Peer::getData(std::string name) const {
-    auto data = tryGetData(std::move(name));
-    if (data == nullptr) {
+    auto it = data_.find(name);
+    if (it == std::end(data_)) {
         throw std::runtime_error("The data does not exist");
     }
 
-    return data;
+    return it->second;
 }
 
 std::shared_ptr<Pistache::Http::Private::ParserBase>
-Peer::tryGetData(std::string(name)) const {
+Peer::tryGetData(std::string name) const {
     auto it = data_.find(name);
     if (it == std::end(data_)) return nullptr;
 
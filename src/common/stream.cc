@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cctype>
 #include <string>
 
 #include <sys/types.h>
@@ -17,44 +18,155 @@
 
 namespace Pistache {
 
+constexpr size_t BufferPool::MinBlockSize;
+constexpr size_t BufferPool::MaxPooledSize;
+constexpr size_t BufferPool::MaxFreeBytes;
+
+namespace {
+    // One class per power of two, from MinBlockSize to MaxPooledSize
+    constexpr size_t SizeClasses = 12;
+    static_assert((BufferPool::MinBlockSize << (SizeClasses - 1)) == BufferPool::MaxPooledSize,
+                  "Size classes do not cover the pooled sizes");
+
+    // Blocks released while the thread is torn down are not pooled anymore
+    thread_local bool freeListsAlive = true;
+
+    struct FreeLists {
+        ~FreeLists() {
+            freeListsAlive = false;
+            for (auto& list: lists) {
+                for (char* block: list)
+                    delete[] block;
+            }
+        }
+
+        std::vector<char*> lists[SizeClasses];
+        // Bytes held by all the lists together
+        size_t bytes = 0;
+    };
+
+    FreeLists* freeLists() {
+        if (!freeListsAlive)
+            return nullptr;
+
+        thread_local FreeLists lists;
+        return &lists;
+    }
+
+    size_t sizeClass(size_t size) {
+        size_t index = 0;
+        while ((BufferPool::MinBlockSize << index) < size)
+            ++index;
+        return index;
+    }
+}
+
+char*
+BufferPool::acquire(size_t size, size_t& capacity) {
+    if (size > MaxPooledSize) {
+        capacity = size;
+        return new char[size];
+    }
+
+    const size_t index = sizeClass(size);
+    capacity = MinBlockSize << index;
+
+    auto lists = freeLists();
+    if (lists && !lists->lists[index].empty()) {
+        char* block = lists->lists[index].back();
+        lists->lists[index].pop_back();
+        lists->bytes -= capacity;
+        return block;
+    }
+
+    return new char[capacity];
+}
+
+void
+BufferPool::release(char* block, size_t capacity) {
+    if (capacity <= MaxPooledSize) {
+        auto lists = freeLists();
+        // Blocks freed by another thread than the one which took them land
+        // here too, so the cap is what bounds the bytes drifting to a thread
+        if (lists && lists->bytes + capacity <= MaxFreeBytes) {
+            lists->lists[sizeClass(capacity)].push_back(block);
+            lists->bytes += capacity;
+            return;
+        }
+    }
+
+    delete[] block;
+}
+
+size_t
+BufferPool::freeBlocks() {
+    auto lists = freeLists();
+    if (!lists)
+        return 0;
+
+    size_t count = 0;
+    for (const auto& list: lists->lists)
+        count += list.size();
+    return count;
+}
+
+size_t
+BufferPool::freeBytes() {
+    auto lists = freeLists();
+    return lists ? lists->bytes : 0;
+}
+
 RawBuffer::RawBuffer()
-    : data_()
+    : storage_()
+    , offset_(0)
     , length_(0)
     , isDetached_(false)
 { }
 
 RawBuffer::RawBuffer(std::string data, size_t length, bool isDetached)
-    : data_(std::move(data))
+    : storage_()
+    , offset_(0)
     , length_(length)
     , isDetached_(isDetached)
-{ }
+{
+    if (length_ > data.size())
+        throw std::range_error("Buffer length is bigger than its data.");
+
+    auto str = std::make_shared<const std::string>(std::move(data));
+    storage_ = std::shared_ptr<const char>(str, str->data());
+}
 
 RawBuffer::RawBuffer(const char* data, size_t length, bool isDetached)
-    : data_()
+    : storage_()
+    , offset_(0)
     , length_(length)
     , isDetached_(isDetached)
 {
-    data_.resize(length_ + 1);
-    data_.assign(data, length_ + 1);
+    auto str = std::make_shared<const std::string>(data, length);
+    storage_ = std::shared_ptr<const char>(str, str->data());
 }
 
-RawBuffer RawBuffer::detach(size_t fromIndex)
+RawBuffer::RawBuffer(std::shared_ptr<const char> storage, size_t offset, size_t length, bool isDetached)
+    : storage_(std::move(storage))
+    , offset_(offset)
+    , length_(length)
+    , isDetached_(isDetached)
+{ }
+
+RawBuffer RawBuffer::detach(size_t fromIndex) const
 {
-    if (data_.empty())
+    if (!storage_ || length_ == 0)
         return RawBuffer();
 
     if (length_ < fromIndex)
-        throw std::range_error("Trying to detach buffer from an index bigger than lengthght.");
+        throw std::range_error("Trying to detach buffer from an index bigger than length.");
 
-    auto newDatalength = length_ - fromIndex;
-    std::string newData = data_.substr(fromIndex, newDatalength);
-
-    return RawBuffer(std::move(newData), newDatalength, true);
+    return RawBuffer(storage_, offset_ + fromIndex, length_ - fromIndex, true);
 }
 
-const std::string& RawBuffer::data() const
+const char* RawBuffer::data() const
 {
-    return data_;
+    return storage_ ? storage_.get() + offset_ : nullptr;
 }
 
 size_t RawBuffer::size() const
@@ -101,45 +213,81 @@ size_t FileBuffer::size() const
     return size_;
 }
 
+RawBuffer
+DynamicStreamBuf::release() {
+    if (!data_)
+        return RawBuffer();
+
+    char* block = data_;
+    const size_t capacity = capacity_;
+    const size_t length = size();
+
+    data_ = nullptr;
+    capacity_ = 0;
+    this->setp(nullptr, nullptr);
+
+    std::shared_ptr<const char> storage(block, [capacity](const char* bytes) {
+        BufferPool::release(const_cast<char*>(bytes), capacity);
+    });
+    return RawBuffer(std::move(storage), 0, length, false);
+}
+
 DynamicStreamBuf::int_type
 DynamicStreamBuf::overflow(DynamicStreamBuf::int_type ch) {
-    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
-        const auto size = data_.size();
-        if (size < maxSize_) {
-            reserve(size * 2);
-            *pptr() = ch;
-            pbump(1);
-            return traits_type::not_eof(ch);
-        }
-    }
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::eof();
+
+    if (!data_)
+        reserve(std::max<size_t>(initialSize_, 1));
+    else
+        reserve(capacity_ * 2);
+
+    if (this->pptr() == this->epptr())
+        return traits_type::eof();
 
-    return traits_type::eof();
+    *this->pptr() = ch;
+    this->pbump(1);
+    return traits_type::not_eof(ch);
 }
 
 void
 DynamicStreamBuf::reserve(size_t size)
 {
     if (size > maxSize_) size = maxSize_;
-    const size_t oldSize = data_.size();
-    data_.resize(size);
-    this->setp(&data_[0] + oldSize, &data_[0] + size);
+    if (size <= capacity_)
+        return;
+
+    // Only the bytes written so far are carried over, nothing is zero-filled
+    const size_t used = this->size();
+    size_t capacity;
+    char* block = BufferPool::acquire(size, capacity);
+    if (used > 0)
+        std::memcpy(block, data_, used);
+    if (data_)
+        BufferPool::release(data_, capacity_);
+
+    data_ = block;
+    capacity_ = capacity;
+    this->setp(data_ + used, data_ + std::min(capacity_, maxSize_));
 }
 
+/* The cursor works directly on the get area of the buffer: the generic
+ * std::basic_streambuf accessors are only a slower way to read the same
+ * pointers.
+ */
 bool
 StreamCursor::advance(size_t count) {
-    if (static_cast<ssize_t>(count) > buf->in_avail())
+    if (count > remaining())
         return false;
 
-    for (size_t i = 0; i < count; ++i) {
-        buf->sbumpc();
-    }
-
+    buf->setArea(buf->begptr(), buf->curptr() + count, buf->endptr());
     return true;
 }
 
 bool
 StreamCursor::eol() const {
-    return buf->sgetc() == CR && next() == LF;
+    const char* cur = buf->curptr();
+    return remaining() >= 2 && cur[0] == CR && cur[1] == LF;
 }
 
 bool
@@ -149,15 +297,18 @@ StreamCursor::eof() const {
 
 int
 StreamCursor::next() const {
-    if (buf->in_avail() < 1)
+    if (remaining() < 2)
         return Eof;
 
-    return buf->snext();
+    return buf->curptr()[1];
 }
 
 char
 StreamCursor::current() const {
-    return buf->sgetc();
+    if (remaining() == 0)
+        return static_cast<char>(Eof);
+
+    return *buf->curptr();
 }
 
 const char*
@@ -182,7 +333,7 @@ StreamCursor::diff(const StreamCursor& other) const {
 
 size_t
 StreamCursor::remaining() const {
-    return buf->in_avail();
+    return buf->endptr() - buf->curptr();
 }
 
 void
@@ -244,9 +395,38 @@ match_literal(char c, StreamCursor& cursor, CaseSensitivity cs) {
     return false;
 }
 
+namespace {
+
+    // Moves the cursor to found, or to the end of the buffer when it is null
+    bool stopAt(const char* found, StreamCursor& cursor) {
+        cursor.advance(found ? found - cursor.offset() : cursor.remaining());
+        return found != nullptr;
+    }
+
+    const char* findByte(const char* begin, size_t len, char c) {
+        return static_cast<const char*>(memchr(begin, c, len));
+    }
+
+}
+
 bool
 match_until(char c, StreamCursor& cursor, CaseSensitivity cs) {
-    return match_until( { c }, cursor, cs);
+    if (cursor.eof())
+        return false;
+
+    const char* begin = cursor.offset();
+    size_t len = cursor.remaining();
+
+    const char* found = findByte(begin, len, c);
+    if (cs == CaseSensitivity::Insensitive && std::isalpha(static_cast<unsigned char>(c))) {
+        // Only the bytes before the first match need to be searched again
+        const char other = std::islower(static_cast<unsigned char>(c)) ? std::toupper(c) : std::tolower(c);
+        const char* otherFound = findByte(begin, found ? found - begin : len, other);
+        if (otherFound)
+            found = otherFound;
+    }
+
+    return stopAt(found, cursor);
 }
 
 bool
@@ -254,24 +434,52 @@ match_until(std::initializer_list<char> chars, StreamCursor& cursor, CaseSensiti
     if (cursor.eof())
         return false;
 
-    auto find = [&](char val) {
-        for (auto c: chars) {
-            char lhs = cs == CaseSensitivity::Sensitive ? c : std::tolower(c);
-            char rhs = cs == CaseSensitivity::Insensitive ? val : std::tolower(val);
+    if (chars.size() == 1)
+        return match_until(*chars.begin(), cursor, cs);
 
-            if (lhs == rhs) return true;
+    bool delimiters[256] = { };
+    for (char c: chars) {
+        const auto byte = static_cast<unsigned char>(c);
+        delimiters[byte] = true;
+        if (cs == CaseSensitivity::Insensitive) {
+            delimiters[static_cast<unsigned char>(std::tolower(byte))] = true;
+            delimiters[static_cast<unsigned char>(std::toupper(byte))] = true;
         }
+    }
 
-        return false;
-    };
+    const char* begin = cursor.offset();
+    const char* end = begin + cursor.remaining();
+    for (const char* p = begin; p != end; ++p) {
+        if (delimiters[static_cast<unsigned char>(*p)])
+            return stopAt(p, cursor);
+    }
 
-    while (!cursor.eof()) {
-        const char c = cursor.current();
-        if (find(c)) return true;
-        cursor.advance(1);
+    return stopAt(nullptr, cursor);
+}
+
+bool
+match_until_eol(StreamCursor& cursor) {
+    const char* p = cursor.offset();
+    const char* end = p + cursor.remaining();
+
+    while (p != end) {
+        const char* cr = findByte(p, end - p, CR);
+        if (!cr)
+            break;
+
+        // A CR that ends the buffer might be followed by a LF that is still to come
+        if (cr + 1 == end) {
+            stopAt(cr, cursor);
+            return false;
+        }
+
+        if (cr[1] == LF)
+            return stopAt(cr, cursor);
+
+        p = cr + 1;
     }
 
-    return false;
+    return stopAt(nullptr, cursor);
 }
 
 bool
@@ -288,13 +496,14 @@ match_double(double* val, StreamCursor &cursor) {
 
 void
 skip_whitespaces(StreamCursor& cursor) {
-    if (cursor.eof())
-        return;
+    const char* begin = cursor.offset();
+    const char* end = begin + cursor.remaining();
 
-    int c;
-    while ((c = cursor.current()) != StreamCursor::Eof && (c == ' ' || c == '\t')) {
-        cursor.advance(1);
-    }
+    const char* p = begin;
+    while (p != end && (*p == ' ' || *p == '\t'))
+        ++p;
+
+    cursor.advance(p - begin);
 }
 
 } // namespace Pistache
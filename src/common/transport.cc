@@ -6,6 +6,8 @@
 */
 
 #include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/timerfd.h>
 
 #include <pistache/transport.h>
@@ -24,15 +26,33 @@ Transport::Transport(const std::shared_ptr<Tcp::Handler>& handler) {
     init(handler);
 }
 
+Transport::~Transport() {
+    if (stallTimer_ != -1)
+        close(stallTimer_);
+}
+
 void
 Transport::init(const std::shared_ptr<Tcp::Handler>& handler) {
     handler_ = handler;
     handler_->associateTransport(this);
 }
 
+void
+Transport::setWriteLimits(const WriteLimits& limits) {
+    writeLimits_ = limits;
+}
+
+void
+Transport::setReadBudget(const ReadBudget& budget) {
+    readBudget_ = budget;
+}
+
 std::shared_ptr<Aio::Handler>
 Transport::clone() const {
-    return std::make_shared<Transport>(handler_->clone());
+    auto transport = std::make_shared<Transport>(handler_->clone());
+    transport->setWriteLimits(writeLimits_);
+    transport->setReadBudget(readBudget_);
+    return transport;
 }
 
 void
@@ -41,6 +61,12 @@ Transport::registerPoller(Polling::Epoll& poller) {
     timersQueue.bind(poller);
     peersQueue.bind(poller);
     notifier.bind(poller);
+    readableNotifier.bind(poller);
+
+    if (writeLimits_.stallTimeout.count() > 0) {
+        stallTimer_ = TRY_RET(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+        poller.addFd(stallTimer_, NotifyOn::Read, Polling::Tag(stallTimer_), Polling::Mode::Edge);
+    }
 }
 
 void
@@ -53,11 +79,32 @@ Transport::handleNewPeer(const std::shared_ptr<Tcp::Peer>& peer) {
     } else {
         handlePeer(peer);
     }
-    int fd = peer->fd();
-    {
-        Guard guard(toWriteLock);
-        toWrite.emplace(fd, std::deque<WriteEntry>{});
-    }
+}
+
+Async::Promise<void>
+Transport::whenWritable(Fd fd) {
+    Guard guard(toWriteLock);
+
+    // Nothing is queued for that peer
+    auto it = toWrite.find(fd);
+    if (it == std::end(toWrite) || !it->second.blocked)
+        return Async::Promise<void>::resolved();
+
+    auto& queue = it->second;
+    return Async::Promise<void>([&](Async::Deferred<void> deferred) {
+        queue.waiters.push_back(std::move(deferred));
+    });
+}
+
+size_t
+Transport::queuedBytes(Fd fd) {
+    Guard guard(toWriteLock);
+
+    auto it = toWrite.find(fd);
+    if (it == std::end(toWrite))
+        return 0;
+
+    return it->second.bytes;
 }
 
 void
@@ -75,6 +122,12 @@ Transport::onReady(const Aio::FdSet& fds) {
         else if (entry.getTag() == notifier.tag()) {
             handleNotify();
         }
+        else if (entry.getTag() == readableNotifier.tag()) {
+            handleReadable();
+        }
+        else if (entry.getTag() == Polling::Tag(stallTimer_)) {
+            handleStalledPeers();
+        }
 
         else if (entry.isReadable()) {
             auto tag = entry.getTag();
@@ -129,8 +182,23 @@ Transport::handleIncoming(const std::shared_ptr<Peer>& peer) {
     ssize_t totalBytes = 0;
     int fd = peer->fd();
 
+    size_t bytesRead = 0;
+    requestsRead_ = 0;
+
     for (;;) {
 
+        // The socket might still be readable but, being edge-triggered, it
+        // will not be reported again: put it on the run queue
+        if ((readBudget_.bytes && bytesRead >= readBudget_.bytes)
+                || (readBudget_.requests && requestsRead_ >= readBudget_.requests)) {
+            if (readableSet_.insert(fd).second) {
+                if (readable_.empty())
+                    readableNotifier.notify();
+                readable_.push_back(fd);
+            }
+            break;
+        }
+
         ssize_t bytes;
 
 #ifdef PISTACHE_USE_SSL
@@ -165,11 +233,36 @@ Transport::handleIncoming(const std::shared_ptr<Peer>& peer) {
         }
 
         else {
+            bytesRead += bytes;
             handler_->onInput(buffer, bytes, peer);
         }
     }
 }
 
+void
+Transport::handleReadable() {
+    while (readableNotifier.tryRead()) ;
+
+    // Only the peers queued so far, those that use up their budget again go
+    // after the events that came in meanwhile
+    auto count = readable_.size();
+    for (size_t i = 0; i < count; ++i) {
+        auto fd = readable_.front();
+        readable_.pop_front();
+
+        // Erased from the set when the peer was disconnected
+        if (readableSet_.erase(fd) == 0 || !isPeerFd(fd))
+            continue;
+
+        auto peer = getPeer(fd);
+        handleIncoming(peer);
+    }
+
+    // The peers pushed back while others were still queued did not notify
+    if (!readable_.empty())
+        readableNotifier.notify();
+}
+
 void
 Transport::handlePeerDisconnection(const std::shared_ptr<Peer>& peer) {
     handler_->onDisconnection(peer);
@@ -186,32 +279,43 @@ Transport::handlePeerDisconnection(const std::shared_ptr<Peer>& peer) {
 #endif /* PISTACHE_USE_SSL */
 
     peers.erase(it->first);
+    readableSet_.erase(fd);
 
+    std::vector<Async::Deferred<void>> waiters;
     {
         // Clean up buffers
         Guard guard(toWriteLock);
-        auto & wq = toWrite[fd];
-        while (wq.size() > 0) {
-            wq.pop_front();
+        generations_.erase(fd);
+        auto wq = toWrite.find(fd);
+        if (wq != std::end(toWrite)) {
+            waiters = std::move(wq->second.waiters);
+            toWrite.erase(wq);
         }
-        toWrite.erase(fd);
     }
 
     close(fd);
+
+    for (auto& waiter: waiters)
+        waiter.reject(Error("Peer disconnected"));
 }
 
 void
 Transport::asyncWriteImpl(Fd fd)
 {
+    // Resolved once the lock is released, they are likely to write again
+    std::vector<Async::Deferred<void>> writable;
+
     bool stop = false;
     while (!stop) {
-        Guard guard(toWriteLock);
+        // Released before the write is settled, its callbacks might write again
+        std::unique_lock<Lock> guard(toWriteLock);
 
         auto it = toWrite.find(fd);
 
         // cleanup will have been handled by handlePeerDisconnection
-        if (it == std::end(toWrite)) { return; }
-        auto & wq = it->second;
+        if (it == std::end(toWrite)) { break; }
+        auto & queue = it->second;
+        auto & wq = queue.entries;
         if (wq.size() == 0) {
             break;
         }
@@ -224,7 +328,9 @@ Transport::asyncWriteImpl(Fd fd)
         auto cleanUp = [&]() {
             wq.pop_front();
             if (wq.size() == 0) {
-                toWrite.erase(fd);
+                // Writes might still be on their way through writesQueue
+                if (queue.bytes == 0 && !queue.blocked)
+                    toWrite.erase(it);
                 reactor()->modifyFd(key(), fd, NotifyOn::Read, Polling::Mode::Edge);
                 stop = true;
             }
@@ -236,8 +342,7 @@ Transport::asyncWriteImpl(Fd fd)
             auto len = buffer.size() - totalWritten;
 
             if (buffer.isRaw()) {
-                auto raw = buffer.raw();
-                auto ptr = raw.data().c_str() + totalWritten;
+                auto ptr = buffer.raw().data() + totalWritten;
 
 #ifdef PISTACHE_USE_SSL
                 auto it = peers.find(fd);
@@ -252,6 +357,46 @@ Transport::asyncWriteImpl(Fd fd)
                     bytesWritten = ::send(fd, ptr, len, flags);
 #ifdef PISTACHE_USE_SSL
                 }
+#endif /* PISTACHE_USE_SSL */
+            } else if (buffer.isChain()) {
+                const auto& chain = buffer.chain();
+
+                // Skips the buffers already written
+                size_t index = 0;
+                size_t skip = totalWritten;
+                while (index < chain.size() && skip >= chain[index].size()) {
+                    skip -= chain[index].size();
+                    ++index;
+                }
+
+#ifdef PISTACHE_USE_SSL
+                auto it = peers.find(fd);
+
+                if (it == std::end(peers))
+                    throw std::runtime_error("No peer found for fd: " + std::to_string(fd));
+
+                if (it->second->ssl() != NULL) {
+                    // One buffer at a time, the loop goes on with the next one
+                    bytesWritten = SSL_write((SSL *)it->second->ssl(),
+                            chain[index].data() + skip, chain[index].size() - skip);
+                } else {
+#endif /* PISTACHE_USE_SSL */
+                    static constexpr size_t MaxIovecs = 16;
+                    iovec iov[MaxIovecs];
+                    size_t count = 0;
+                    for (; index < chain.size() && count < MaxIovecs; ++index) {
+                        iov[count].iov_base = const_cast<char*>(chain[index].data() + skip);
+                        iov[count].iov_len = chain[index].size() - skip;
+                        skip = 0;
+                        ++count;
+                    }
+
+                    msghdr msg = {};
+                    msg.msg_iov = iov;
+                    msg.msg_iovlen = count;
+                    bytesWritten = ::sendmsg(fd, &msg, flags);
+#ifdef PISTACHE_USE_SSL
+                }
 #endif /* PISTACHE_USE_SSL */
             } else {
                 auto file = buffer.fd();
@@ -261,6 +406,7 @@ Transport::asyncWriteImpl(Fd fd)
             if (bytesWritten < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
 
+                    // Only the offset moves, the bytes stay where they are
                     auto bufferHolder = buffer.detach(totalWritten);
 
                     // pop_front kills buffer - so we cannot continue loop or use buffer after this point
@@ -269,13 +415,19 @@ Transport::asyncWriteImpl(Fd fd)
                     reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write, Polling::Mode::Edge);
                 }
                 else {
+                    if (buffer.inMemory())
+                        written(queue, buffer.size() - totalWritten, writable);
                     cleanUp();
-                    deferred.reject(Pistache::Error::system("Could not write data"));
+                    auto error = Pistache::Error::system("Could not write data");
+                    guard.unlock();
+                    deferred.reject(error);
                 }
                 break;
             }
             else {
                 totalWritten += bytesWritten;
+                if (buffer.inMemory())
+                    written(queue, bytesWritten, writable);
                 if (totalWritten >= buffer.size()) {
                     if (buffer.isFile()) {
                         // done with the file buffer, nothing else knows whether to
@@ -285,6 +437,8 @@ Transport::asyncWriteImpl(Fd fd)
 
                     cleanUp();
 
+                    guard.unlock();
+
                     // Cast to match the type of defered template
                     // to avoid a BadType exception
                     deferred.resolve(static_cast<ssize_t>(totalWritten));
@@ -293,6 +447,98 @@ Transport::asyncWriteImpl(Fd fd)
             }
         }
     }
+
+    for (auto& waiter: writable)
+        waiter.resolve();
+}
+
+uint64_t
+Transport::enqueued(Fd fd, size_t bytes) {
+    Guard guard(toWriteLock);
+
+    auto generation = generations_.find(fd);
+    if (generation == std::end(generations_))
+        return 0;
+
+    // Queues only exist while there is something to write
+    auto& queue = toWrite[fd];
+    queue.bytes += bytes;
+
+    if (queue.blocked || queue.bytes <= writeLimits_.highWatermark)
+        return generation->second;
+
+    queue.blocked = true;
+    queue.blockedSince = std::chrono::steady_clock::now();
+
+    if (stallTimer_ != -1 && !stallTimerArmed_) {
+        armStallTimer(writeLimits_.stallTimeout);
+        stallTimerArmed_ = true;
+    }
+
+    return generation->second;
+}
+
+// Must be called with toWriteLock held
+void
+Transport::written(WriteQueue& queue, size_t bytes,
+                   std::vector<Async::Deferred<void>>& writable) {
+    queue.bytes -= std::min(bytes, queue.bytes);
+
+    if (queue.blocked && (queue.bytes == 0 || queue.bytes < writeLimits_.lowWatermark)) {
+        queue.blocked = false;
+        for (auto& waiter: queue.waiters)
+            writable.push_back(std::move(waiter));
+        queue.waiters.clear();
+    }
+}
+
+void
+Transport::armStallTimer(std::chrono::steady_clock::duration delay) {
+    using namespace std::chrono;
+
+    // A zero value would disarm the timer
+    auto ns = std::max(duration_cast<nanoseconds>(delay), nanoseconds(1));
+
+    itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = duration_cast<seconds>(ns).count();
+    spec.it_value.tv_nsec = (ns % seconds(1)).count();
+
+    TRY(timerfd_settime(stallTimer_, 0, &spec, 0));
+}
+
+void
+Transport::handleStalledPeers() {
+    uint64_t numWakeups;
+    while (::read(stallTimer_, &numWakeups, sizeof numWakeups) > 0) ;
+
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::duration::max();
+
+    Guard guard(toWriteLock);
+    stallTimerArmed_ = false;
+
+    for (auto& entry: toWrite) {
+        auto& queue = entry.second;
+        if (!queue.blocked || queue.closing)
+            continue;
+
+        auto left = queue.blockedSince + writeLimits_.stallTimeout - now;
+        if (left.count() > 0) {
+            next = std::min(next, left);
+            continue;
+        }
+
+        // The peer is then disconnected by the usual path, when it reads EOF
+        queue.closing = true;
+        ::shutdown(entry.first, SHUT_RDWR);
+    }
+
+    if (next != std::chrono::steady_clock::duration::max()) {
+        armStallTimer(next);
+        stallTimerArmed_ = true;
+    }
 }
 
 void
@@ -352,11 +598,22 @@ Transport::handleWriteQueue() {
         if (!write) break;
 
         auto fd = write->peerFd;
-        if (!isPeerFd(fd)) continue;
-
+        bool current;
         {
+            // The peer went away before its write got here, the fd might even
+            // belong to another peer by now. The bytes of the write were
+            // dropped along with the queue of the peer it was counted for
             Guard guard(toWriteLock);
-            toWrite[fd].push_back(std::move(*write));
+            auto generation = generations_.find(fd);
+            current = generation != std::end(generations_)
+                   && generation->second == write->generation;
+            if (current)
+                toWrite[fd].entries.push_back(std::move(*write));
+        }
+
+        if (!current) {
+            write->deferred.reject(Error("Peer disconnected"));
+            continue;
         }
 
         reactor()->modifyFd(key(), fd, NotifyOn::Read | NotifyOn::Write, Polling::Mode::Edge);
@@ -388,6 +645,11 @@ Transport::handlePeer(const std::shared_ptr<Peer>& peer) {
     int fd = peer->fd();
     peers.insert(std::make_pair(fd, peer));
 
+    {
+        Guard guard(toWriteLock);
+        generations_[fd] = ++nextGeneration_;
+    }
+
     peer->associateTransport(this);
 
     handler_->onConnection(peer);
@@ -17,6 +17,9 @@ Endpoint::Options::Options()
     , flags_()
     , backlog_(Const::MaxBacklog)
     , maxPayload_(Const::DefaultMaxPayload)
+    , connectionLimiter_()
+    , writeLimits_()
+    , readBudget_()
 { }
 
 Endpoint::Options&
@@ -43,6 +46,29 @@ Endpoint::Options::maxPayload(size_t val) {
     return *this;
 }
 
+Endpoint::Options&
+Endpoint::Options::connectionLimiter(std::shared_ptr<RateLimiter> limiter) {
+    connectionLimiter_ = std::move(limiter);
+    return *this;
+}
+
+Endpoint::Options&
+Endpoint::Options::writeWatermarks(size_t low, size_t high) {
+    if (low > high)
+        throw std::invalid_argument("The low watermark must not exceed the high one");
+
+    writeLimits_.lowWatermark = low;
+    writeLimits_.highWatermark = high;
+    return *this;
+}
+
+Endpoint::Options&
+Endpoint::Options::readBudget(size_t bytes, size_t requests) {
+    readBudget_.bytes = bytes;
+    readBudget_.requests = requests;
+    return *this;
+}
+
 Endpoint::Endpoint()
 { }
 
@@ -53,6 +79,9 @@ Endpoint::Endpoint(const Address& addr)
 void
 Endpoint::init(const Endpoint::Options& options) {
     listener.init(options.threads_, options.flags_);
+    listener.setConnectionLimiter(options.connectionLimiter_);
+    listener.setWriteLimits(options.writeLimits_);
+    listener.setReadBudget(options.readBudget_);
     ArrayStreamBuf<char>::maxSize = options.maxPayload_;
 }
 
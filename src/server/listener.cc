@@ -146,6 +146,21 @@ Listener::setHandler(const std::shared_ptr<Handler>& handler) {
     handler_ = handler;
 }
 
+void
+Listener::setConnectionLimiter(const std::shared_ptr<RateLimiter>& limiter) {
+    connectionLimiter_ = limiter;
+}
+
+void
+Listener::setWriteLimits(const WriteLimits& limits) {
+    writeLimits_ = limits;
+}
+
+void
+Listener::setReadBudget(const ReadBudget& budget) {
+    readBudget_ = budget;
+}
+
 void
 Listener::pinWorker(size_t worker, const CpuSet& set)
 {
@@ -217,6 +232,8 @@ Listener::bind(const Address& address) {
     g_listen_fd = fd;
 
     auto transport = std::make_shared<Transport>(handler_);
+    transport->setWriteLimits(writeLimits_);
+    transport->setReadBudget(readBudget_);
 
     reactor_.init(Aio::AsyncContext(workers_));
     transportKey = reactor_.addHandler(transport);
@@ -362,9 +379,15 @@ Listener::options() const {
 
 void Listener::handleNewConnection()
 {
-    struct sockaddr_in peer_addr;
+    struct sockaddr_storage peer_addr;
     int client_fd = acceptConnection(peer_addr);
 
+    auto address = Address::fromUnix((struct sockaddr *)&peer_addr);
+    if (connectionLimiter_ && !connectionLimiter_->acquire(RateLimiter::keyOf(address.ip()))) {
+        close(client_fd);
+        return;
+    }
+
 #ifdef PISTACHE_USE_SSL
     SSL *ssl;
 
@@ -388,7 +411,7 @@ void Listener::handleNewConnection()
 
     make_non_blocking(client_fd);
 
-    auto peer = std::make_shared<Peer>(Address::fromUnix((struct sockaddr *)&peer_addr));
+    auto peer = std::make_shared<Peer>(address);
     peer->associateFd(client_fd);
 
 #ifdef PISTACHE_USE_SSL
@@ -399,7 +422,7 @@ void Listener::handleNewConnection()
     dispatchPeer(peer);
 }
 
-int Listener::acceptConnection(struct sockaddr_in& peer_addr) const
+int Listener::acceptConnection(struct sockaddr_storage& peer_addr) const
 {
     socklen_t peer_addr_len = sizeof(peer_addr);
     int client_fd = ::accept(listen_fd, (struct sockaddr *)&peer_addr, &peer_addr_len);
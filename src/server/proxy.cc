@@ -0,0 +1,247 @@
+/* proxy.cc
+
+   Implementation of the proxy route handler
+*/
+
+#include <strings.h>
+#include <sys/socket.h>
+
+#include <pistache/peer.h>
+#include <pistache/proxy.h>
+
+namespace Pistache {
+namespace Rest {
+
+namespace {
+    const char* const HopByHopHeaders[] = {
+        "Connection",
+        "Keep-Alive",
+        "Proxy-Authenticate",
+        "Proxy-Authorization",
+        "Proxy-Connection",
+        "TE",
+        "Trailer",
+        "Transfer-Encoding",
+        "Upgrade"
+    };
+
+    // Set by the client (or the response stream) for the new message
+    bool isFraming(const std::string& name) {
+        return !strcasecmp(name.c_str(), "Host")
+            || !strcasecmp(name.c_str(), "Content-Length");
+    }
+
+    // The headers named by the Connection header only apply to the hop
+    // they came from too
+    std::vector<std::string> connectionOptions(const Http::Header::Collection& headers) {
+        auto connection = headers.tryGet<Http::Header::Connection>();
+        if (!connection)
+            return std::vector<std::string>();
+
+        return connection->options();
+    }
+
+    bool isForwarded(const std::string& name, const std::vector<std::string>& options) {
+        if (Proxy::isHopByHop(name) || isFraming(name))
+            return false;
+
+        for (const auto& option: options) {
+            if (!strcasecmp(name.c_str(), option.c_str()))
+                return false;
+        }
+        return true;
+    }
+}
+
+/* The response of the upstream is relayed from the client transport thread.
+ * The head is written as soon as it is received, then every piece of the
+ * body as it comes: as is when the upstream gave its length, as a chunk
+ * otherwise. The upstream is not read any further while the downstream peer
+ * is not writable.
+ */
+struct Proxy::Exchange {
+    explicit Exchange(Http::ResponseWriter response)
+        : response(std::move(response))
+        , stream()
+        , peer()
+        , broken(false)
+    { }
+
+    Async::Promise<void> relay(const Http::Response& upstream, const char* data, size_t size) {
+        if (broken)
+            return Async::Promise<void>::resolved();
+
+        try {
+            if (!stream) {
+                auto& headers = response.headers();
+                auto options = connectionOptions(upstream.headers());
+                for (const auto& header: upstream.headers().list()) {
+                    if (isForwarded(header->name(), options))
+                        headers.add(header);
+                }
+                for (const auto& raw: upstream.headers().rawList()) {
+                    if (isForwarded(raw.second.name(), options))
+                        headers.addRaw(raw.second);
+                }
+
+                auto length = upstream.headers().tryGet<Http::Header::ContentLength>();
+                if (length && !upstream.headers().has<Http::Header::TransferEncoding>())
+                    headers.add<Http::Header::ContentLength>(length->value());
+
+                for (const auto& cookie: upstream.cookies())
+                    response.cookies().add(cookie);
+
+                peer = response.peer();
+                stream.reset(new Http::ResponseStream(response.stream(upstream.code())));
+            }
+
+            if (size > 0)
+                stream->write(data, size);
+            return stream->flush();
+        } catch (const std::exception&) {
+            // The downstream peer went away, drop the rest of the body
+            broken = true;
+            return Async::Promise<void>::resolved();
+        }
+    }
+
+    void finish() {
+        if (broken || !stream)
+            return;
+
+        try {
+            stream->ends();
+        } catch (const std::exception&) {
+        }
+    }
+
+    // The error of the upstream is not disclosed to the client
+    void fail(Http::Code code) {
+        if (broken)
+            return;
+
+        if (!stream) {
+            response.send(code, Http::codeString(code));
+            return;
+        }
+
+        // The head was already sent: the only way to tell the client that the
+        // response is incomplete is to cut the connection
+        auto p = peer.lock();
+        if (p)
+            ::shutdown(p->fd(), SHUT_RDWR);
+    }
+
+    Http::ResponseWriter response;
+    std::unique_ptr<Http::ResponseStream> stream;
+    std::weak_ptr<Tcp::Peer> peer;
+    bool broken;
+};
+
+Proxy::Proxy(std::shared_ptr<Http::Client> client, std::string upstream)
+    : client_(std::move(client))
+    , upstream_(std::move(upstream))
+    , prefix_()
+    , timeout_(0)
+{ }
+
+Proxy&
+Proxy::stripPrefix(std::string prefix) {
+    prefix_ = std::move(prefix);
+    return *this;
+}
+
+Proxy&
+Proxy::timeout(std::chrono::milliseconds timeout) {
+    timeout_ = timeout;
+    return *this;
+}
+
+bool
+Proxy::isHopByHop(const std::string& name) {
+    for (const char* hop: HopByHopHeaders) {
+        if (!strcasecmp(name.c_str(), hop))
+            return true;
+    }
+    return false;
+}
+
+std::string
+Proxy::upstreamResource(const Rest::Request& request) const {
+    auto resource = request.resource();
+    // "/api" is the prefix of "/api" and "/api/foo", not of "/apix"
+    if (!prefix_.empty() && resource.compare(0, prefix_.size(), prefix_) == 0
+            && (resource.size() == prefix_.size() || resource[prefix_.size()] == '/'
+                || prefix_.back() == '/'))
+        resource.erase(0, prefix_.size());
+    if (resource.empty() || resource[0] != '/')
+        resource.insert(resource.begin(), '/');
+
+    // The query goes through as received, the parsed one lost its order,
+    // its repeated keys and which keys had no value
+    const auto& query = request.query().raw();
+    if (!query.empty()) {
+        resource += '?';
+        resource += query;
+    }
+
+    return upstream_ + resource;
+}
+
+Route::Result
+Proxy::operator()(const Rest::Request& request, Http::ResponseWriter response) const {
+    auto builder = client_->get(upstreamResource(request));
+    builder.method(request.method());
+
+    // The body stays in the parsed request, which is kept alive until sent
+    const auto& parsed = response.request();
+    if (!parsed->body().empty())
+        builder.body(std::shared_ptr<const std::string>(parsed, &parsed->body()));
+
+    if (timeout_.count() > 0)
+        builder.timeout(timeout_);
+
+    auto options = connectionOptions(request.headers());
+    for (const auto& header: request.headers().list()) {
+        if (isForwarded(header->name(), options))
+            builder.header(header);
+    }
+
+    std::string forwardedFor;
+    for (const auto& raw: request.headers().rawList()) {
+        const auto& header = raw.second;
+        if (!strcasecmp(header.name().c_str(), "X-Forwarded-For"))
+            forwardedFor = header.value() + ", ";
+        else if (isForwarded(header.name(), options))
+            builder.header(header);
+    }
+    builder.header(Http::Header::Raw("X-Forwarded-For", forwardedFor + request.address().host()));
+
+    for (const auto& cookie: request.cookies())
+        builder.cookie(cookie);
+
+    auto exchange = std::make_shared<Exchange>(std::move(response));
+
+    builder.stream([exchange](const Http::Response& upstream, const char* data, size_t size) {
+        return exchange->relay(upstream, data, size);
+    });
+
+    builder.send().then(
+        [exchange](Http::Response) {
+            exchange->finish();
+        },
+        [exchange](std::exception_ptr exc) {
+            try {
+                std::rethrow_exception(exc);
+            } catch (const Http::TimeoutError&) {
+                exchange->fail(Http::Code::Gateway_Timeout);
+            } catch (...) {
+                exchange->fail(Http::Code::Bad_Gateway);
+            }
+        });
+
+    return Route::Result::Ok;
+}
+
+} // namespace Rest
+} // namespace Pistache
@@ -0,0 +1,91 @@
+/* rate_limiter.cc
+
+   Implementation of the rate limiter
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+#include <pistache/rate_limiter.h>
+
+namespace Pistache {
+
+constexpr size_t RateLimiter::DefaultMaxKeys;
+constexpr size_t RateLimiter::DefaultShards;
+
+RateLimiter::RateLimiter(double rate, double burst, size_t maxKeys, size_t shards)
+    : rate_(rate)
+    , burst_(burst)
+    , keysPerShard_(0)
+    , shards_()
+{
+    if (rate <= 0 || burst < 1)
+        throw std::invalid_argument("Invalid rate limit");
+    if (shards == 0)
+        shards = 1;
+
+    keysPerShard_ = std::max<size_t>(1, (maxKeys + shards - 1) / shards);
+    shards_.reserve(shards);
+    for (size_t i = 0; i < shards; ++i)
+        shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+}
+
+RateLimiter::Decision
+RateLimiter::acquire(const std::string& key, Clock::time_point now) {
+    auto& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    Bucket* bucket;
+    auto it = shard.index.find(key);
+    if (it != std::end(shard.index)) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        bucket = &it->second->second;
+
+        auto elapsed = std::chrono::duration<double>(now - bucket->last).count();
+        if (elapsed > 0) {
+            bucket->tokens = std::min(burst_, bucket->tokens + elapsed * rate_);
+            bucket->last = now;
+        }
+    } else {
+        if (shard.lru.size() >= keysPerShard_) {
+            shard.index.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+        }
+
+        shard.lru.emplace_front(key, Bucket { burst_, now });
+        shard.index.emplace(key, shard.lru.begin());
+        bucket = &shard.lru.front().second;
+    }
+
+    if (bucket->tokens >= 1) {
+        bucket->tokens -= 1;
+        return Decision { true, std::chrono::milliseconds(0) };
+    }
+
+    auto wait = std::ceil((1 - bucket->tokens) / rate_ * 1000);
+    return Decision { false, std::chrono::milliseconds(static_cast<int64_t>(wait)) };
+}
+
+size_t
+RateLimiter::size() const {
+    size_t total = 0;
+    for (const auto& shard: shards_) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total += shard->lru.size();
+    }
+    return total;
+}
+
+std::string
+RateLimiter::keyOf(const IpAddress& ip) {
+    return std::string(reinterpret_cast<const char*>(ip.bytes()), ip.size());
+}
+
+RateLimiter::Shard&
+RateLimiter::shardFor(const std::string& key) {
+    return *shards_[std::hash<std::string>()(key) % shards_.size()];
+}
+
+} // namespace Pistache
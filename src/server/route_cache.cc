@@ -0,0 +1,391 @@
+/* route_cache.cc
+
+   Implementation of the route cache
+*/
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <utility>
+
+#include <pistache/route_cache.h>
+
+namespace Pistache {
+namespace Rest {
+
+namespace {
+    bool isHeader(const char* line, size_t size, const char* name) {
+        auto length = std::strlen(name);
+        return size > length && line[length] == ':' && !strncasecmp(line, name, length);
+    }
+
+    // Written for every request instead of being replayed
+    bool isPerRequest(const char* line, size_t size) {
+        return isHeader(line, size, "Date") || isHeader(line, size, "Connection");
+    }
+
+    // Whether the value of a Cache-Control line holds the directive, which
+    // might come with an argument as in private="Set-Cookie"
+    bool hasDirective(const char* value, const char* end, const char* directive) {
+        auto length = std::strlen(directive);
+        while (value < end) {
+            while (value < end && (*value == ' ' || *value == '\t' || *value == ','))
+                ++value;
+
+            const char* token = value;
+            while (value < end && *value != ',' && *value != '=' && *value != ' ' && *value != '\t')
+                ++value;
+
+            if (static_cast<size_t>(value - token) == length && !strncasecmp(token, directive, length))
+                return true;
+
+            // Skips the argument, which might be a quoted list
+            bool quoted = false;
+            while (value < end && (quoted || *value != ',')) {
+                if (*value == '"')
+                    quoted = !quoted;
+                ++value;
+            }
+        }
+        return false;
+    }
+
+    const char* connectionValue(Http::ConnectionControl control) {
+        switch (control) {
+        case Http::ConnectionControl::Close:
+            return "Close";
+        case Http::ConnectionControl::KeepAlive:
+            return "Keep-Alive";
+        case Http::ConnectionControl::Ext:
+            return "Ext";
+        }
+        return "Close";
+    }
+
+    Http::ConnectionControl connectionFor(const Rest::Request& request) {
+        auto connection = request.headers().tryGet<Http::Header::Connection>();
+        if (connection)
+            return connection->control();
+
+        return request.version() == Http::Version::Http11
+            ? Http::ConnectionControl::KeepAlive
+            : Http::ConnectionControl::Close;
+    }
+
+    // Keys are made of length-prefixed fields, so that no value can be
+    // mistaken for a separator
+    void appendField(std::string& key, const std::string& field) {
+        key += std::to_string(field.size());
+        key += ':';
+        key += field;
+    }
+}
+
+/* A miss being served. The flight is owned by the observer installed on the
+ * response of the handler that runs, so that it goes away with it: if the
+ * handler never sends a response (or streams it), the requests that were
+ * waiting run the handler themselves.
+ */
+class RouteCache::Flight {
+public:
+    Flight(std::shared_ptr<RouteCache> cache, std::string key, Route::Handler handler, Sharing sharing)
+        : cache_(std::move(cache))
+        , key_(std::move(key))
+        , handler_(std::move(handler))
+        , sharing_(sharing)
+        , waiters_()
+        , done_(false)
+    { }
+
+    ~Flight() {
+        std::vector<Waiter> waiters;
+        {
+            Guard guard(cache_->lock_);
+            if (done_)
+                return;
+
+            waiters = std::move(waiters_);
+            auto it = cache_->flights_.find(key_);
+            if (it != std::end(cache_->flights_) && it->second.expired())
+                cache_->flights_.erase(it);
+        }
+
+        for (auto& waiter: waiters)
+            RouteCache::run(handler_, waiter);
+    }
+
+    // Must be called with the lock of the cache held
+    void join(const Rest::Request& request, Http::ResponseWriter response) {
+        waiters_.emplace_back(request, std::move(response));
+    }
+
+    void complete(const Http::Response& response, const char* data, size_t size) {
+        std::vector<Waiter> waiters;
+        bool cached = false;
+        Entry entry;
+
+        {
+            Guard guard(cache_->lock_);
+            if (done_)
+                return;
+
+            done_ = true;
+            waiters = std::move(waiters_);
+
+            auto it = cache_->flights_.find(key_);
+            if (it != std::end(cache_->flights_) && it->second.lock().get() == this)
+                cache_->flights_.erase(it);
+
+            const char* end = static_cast<const char*>(memmem(data, size, "\r\n\r\n", 4));
+            if (response.code() == Http::Code::Ok && end) {
+                // Keeps every line of the head but the per-request headers
+                std::string head;
+                bool storable = true;
+                const char* line = data;
+                while (line < end + 2) {
+                    const char* eol = static_cast<const char*>(memmem(line, end + 2 - line, "\r\n", 2));
+                    size_t length = eol - line;
+
+                    if (isHeader(line, length, "Cache-Control")) {
+                        const char* value = line + std::strlen("Cache-Control") + 1;
+                        if (hasDirective(value, eol, "no-store")
+                                || (sharing_ == Sharing::PublicOnly && hasDirective(value, eol, "private")))
+                            storable = false;
+                    } else if (sharing_ == Sharing::PublicOnly && isHeader(line, length, "Set-Cookie")) {
+                        storable = false;
+                    }
+
+                    if (line == data || !isPerRequest(line, length))
+                        head.append(line, length + 2);
+                    line = eol + 2;
+                }
+
+                if (storable) {
+                    auto headSize = head.size();
+                    entry.head = RawBuffer(std::move(head), headSize);
+                    entry.rest = RawBuffer(end + 2, size - (end + 2 - data));
+                    entry.code = response.code();
+                    entry.expires = Clock::now() + cache_->ttl_;
+
+                    cache_->insertLocked(key_, entry);
+                    cached = true;
+                }
+            }
+        }
+
+        for (auto& waiter: waiters) {
+            if (cached)
+                RouteCache::serve(entry, waiter.request, waiter.response);
+            else
+                RouteCache::run(handler_, waiter);
+        }
+    }
+
+private:
+    std::shared_ptr<RouteCache> cache_;
+    std::string key_;
+    Route::Handler handler_;
+    Sharing sharing_;
+    std::vector<Waiter> waiters_;
+    bool done_;
+};
+
+RouteCache::RouteCache(
+        std::chrono::milliseconds ttl,
+        std::vector<std::string> vary,
+        size_t maxEntries)
+    : ttl_(ttl)
+    , vary_(std::move(vary))
+    , maxEntries_(maxEntries)
+    , lock_()
+    , entries_()
+    , flights_()
+{ }
+
+Route::Handler
+RouteCache::wrap(Route::Handler handler, Sharing sharing) {
+    auto self = shared_from_this();
+    return [self, handler, sharing](const Rest::Request& request, Http::ResponseWriter response) {
+        return self->handle(handler, sharing, request, std::move(response));
+    };
+}
+
+Route::Result
+RouteCache::handle(
+        const Route::Handler& handler,
+        Sharing sharing,
+        const Rest::Request& request,
+        Http::ResponseWriter response) {
+    if (request.method() != Http::Method::Get)
+        return handler(request, std::move(response));
+
+    // The response is likely to be specific to the user
+    if (sharing == Sharing::PublicOnly
+            && (!request.headers().tryGetRaw("Authorization").isEmpty() || request.cookies().size() > 0))
+        return handler(request, std::move(response));
+
+    auto key = keyFor(request);
+    std::shared_ptr<Flight> flight;
+    Entry hit;
+
+    {
+        Guard guard(lock_);
+
+        auto it = entries_.find(key);
+        if (it != std::end(entries_) && it->second.expires <= Clock::now()) {
+            eraseLocked(it);
+            it = std::end(entries_);
+        }
+
+        if (it != std::end(entries_)) {
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            hit = it->second;
+        } else {
+            auto& slot = flights_[key];
+            flight = slot.lock();
+            if (flight) {
+                flight->join(request, std::move(response));
+                return Route::Result::Ok;
+            }
+
+            flight = std::make_shared<Flight>(shared_from_this(), key, handler, sharing);
+            slot = flight;
+        }
+    }
+
+    if (!flight) {
+        serve(hit, request, response);
+        return Route::Result::Ok;
+    }
+
+    response.observeWire([flight](const Http::Response& resp, const char* data, size_t size) {
+        flight->complete(resp, data, size);
+    });
+
+    return handler(request, std::move(response));
+}
+
+void
+RouteCache::invalidate(const std::string& resource) {
+    const std::string prefix = std::string(Http::methodString(Http::Method::Get)) + ' ' + resource;
+
+    Guard guard(lock_);
+    for (auto it = entries_.begin(); it != entries_.end(); ) {
+        const auto& key = it->first;
+        bool match = key.compare(0, prefix.size(), prefix) == 0
+                  && (key.size() == prefix.size() || key[prefix.size()] == '?' || key[prefix.size()] == '\n');
+        if (match) {
+            lru_.erase(it->second.position);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+RouteCache::clear() {
+    Guard guard(lock_);
+    entries_.clear();
+    lru_.clear();
+}
+
+size_t
+RouteCache::size() const {
+    Guard guard(lock_);
+    return entries_.size();
+}
+
+std::string
+RouteCache::keyFor(const Rest::Request& request) const {
+    std::string key = Http::methodString(request.method());
+    key += ' ';
+    key += request.resource();
+
+    // Parameters are not ordered in the query, sort them to get a stable key
+    const auto& query = request.query();
+    std::vector<std::pair<std::string, std::string>> params(
+            query.parameters_begin(), query.parameters_end());
+    std::sort(params.begin(), params.end());
+
+    key += '?';
+    for (const auto& param: params) {
+        appendField(key, param.first);
+        appendField(key, param.second);
+    }
+
+    for (const auto& name: vary_) {
+        key += '\n';
+        appendField(key, name);
+
+        auto header = request.headers().tryGet(name);
+        if (header) {
+            std::ostringstream oss;
+            header->write(oss);
+            appendField(key, oss.str());
+        } else {
+            auto raw = request.headers().tryGetRaw(name);
+            if (!raw.isEmpty())
+                appendField(key, raw.unsafeGet().value());
+            else
+                key += '-';
+        }
+    }
+
+    return key;
+}
+
+void
+RouteCache::insertLocked(const std::string& key, Entry entry) {
+    auto it = entries_.find(key);
+    if (it != std::end(entries_))
+        eraseLocked(it);
+
+    while (!lru_.empty() && entries_.size() >= maxEntries_)
+        eraseLocked(entries_.find(lru_.back()));
+
+    lru_.push_front(key);
+    entry.position = lru_.begin();
+    entries_.emplace(key, std::move(entry));
+}
+
+void
+RouteCache::eraseLocked(std::unordered_map<std::string, Entry>::iterator it) {
+    lru_.erase(it->second.position);
+    entries_.erase(it);
+}
+
+void
+RouteCache::serve(const Entry& entry, const Rest::Request& request, Http::ResponseWriter& response) {
+    auto control = connectionFor(request);
+
+    std::string lines;
+    lines.reserve(64);
+    lines += Http::Header::Date::Name;
+    lines += ": ";
+    lines += Http::FullDate::now();
+    lines += "\r\n";
+    lines += Http::Header::Connection::Name;
+    lines += ": ";
+    lines += connectionValue(control);
+    lines += "\r\n";
+
+    auto size = lines.size();
+    response.sendSerialized(
+            entry.code, { entry.head, RawBuffer(std::move(lines), size), entry.rest }, control);
+}
+
+void
+RouteCache::run(const Route::Handler& handler, Waiter& waiter) {
+    auto fallback = waiter.response.clone();
+    try {
+        handler(waiter.request, std::move(waiter.response));
+    } catch (const std::exception& e) {
+        fallback.send(Http::Code::Internal_Server_Error, e.what());
+    }
+}
+
+} // namespace Rest
+} // namespace Pistache
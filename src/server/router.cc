@@ -13,15 +13,74 @@ namespace Pistache {
 namespace Rest {
 
 Request::Request(
-        const Http::Request& request,
+        std::shared_ptr<const Http::Request> request,
         std::vector<TypedParam>&& params,
-        std::vector<TypedParam>&& splats)
-    : Http::Request(request)
+        std::vector<TypedParam>&& splats,
+        Http::Mime::MediaType representation)
+    : request_(std::move(request))
     , params_(std::move(params))
     , splats_(std::move(splats))
+    , representation_(std::move(representation))
 {
 }
 
+Http::Version
+Request::version() const {
+    return request_->version();
+}
+
+Http::Method
+Request::method() const {
+    return request_->method();
+}
+
+std::string
+Request::resource() const {
+    return request_->resource();
+}
+
+const std::string&
+Request::body() const {
+    return request_->body();
+}
+
+const Http::Header::Collection&
+Request::headers() const {
+    return request_->headers();
+}
+
+const Http::Uri::Query&
+Request::query() const {
+    return request_->query();
+}
+
+const Http::CookieJar&
+Request::cookies() const {
+    return request_->cookies();
+}
+
+const Address&
+Request::address() const {
+    return request_->address();
+}
+
+const Async::CancellationToken&
+Request::cancellation() const {
+    return request_->cancellation();
+}
+
+#ifdef LIBSTDCPP_SMARTPTR_LOCK_FIXME
+std::shared_ptr<Tcp::Peer>
+Request::peer() const {
+    return request_->peer();
+}
+#endif
+
+const Http::Request&
+Request::http() const {
+    return *request_;
+}
+
 bool
 Request::hasParam(const std::string& name) const {
     auto it = std::find_if(params_.begin(), params_.end(),
@@ -59,6 +118,11 @@ Request::splat() const {
     return splats_;
 }
 
+const Http::Mime::MediaType&
+Request::representation() const {
+    return representation_;
+}
+
 std::regex SegmentTreeNode::multiple_slash = std::regex("//+",
     std::regex_constants::optimize);
 
@@ -109,7 +173,8 @@ std::string SegmentTreeNode::sanitizeResource(const std::string& path) {
 void
 SegmentTreeNode::addRoute(const std::string_view& path,
                            const Route::Handler &handler,
-                           const std::shared_ptr<char> &resource_reference) {
+                           const std::shared_ptr<char> &resource_reference,
+                           const std::shared_ptr<Http::ContentNegotiator> &negotiator) {
   // recursion to correct path segment
   if (!path.empty()) {
       const auto segment_delimiter = path.find('/');
@@ -140,7 +205,7 @@ SegmentTreeNode::addRoute(const std::string_view& path,
           if (splat_ == nullptr) {
             splat_ = std::make_shared<SegmentTreeNode>(resource_reference);
           }
-          splat_->addRoute(lower_path, handler, resource_reference);
+          splat_->addRoute(lower_path, handler, resource_reference, negotiator);
           return;
       }
 
@@ -151,11 +216,11 @@ SegmentTreeNode::addRoute(const std::string_view& path,
             std::make_shared<SegmentTreeNode>(resource_reference)));
       }
       collection->at(current_segment)->addRoute(lower_path, handler,
-          resource_reference);
+          resource_reference, negotiator);
     } else {  // current path segment requested
       if (route_ != nullptr)
         throw std::runtime_error("Requested route already exist.");
-      route_ = std::make_shared<Route>(handler);
+      route_ = std::make_shared<Route>(handler, negotiator);
     }
 }
 
@@ -320,8 +385,13 @@ RouterHandler::onRequest(
         const Http::Request& req,
         Http::ResponseWriter response)
 {
-    auto resp = response.clone();
-    router->route(req, std::move(resp));
+    router->route(req, std::move(response));
+}
+
+void
+RouterHandler::onHeaders(const Http::Request& req)
+{
+    router->checkHeaders(req);
 }
 
 } // namespace Private
@@ -355,7 +425,7 @@ Router::initFromDescription(const Rest::Description& desc) {
                 throw std::runtime_error(oss.str());
             }
 
-            addRoute(path.method, path.value, path.handler);
+            addRoute(path.method, path.value, path.handler, path.pc.produce);
         }
     }
 }
@@ -410,7 +480,50 @@ Router::addNotFoundHandler(Route::Handler handler) {
 }
 
 void
-Router::invokeNotFoundHandler(const Http::Request &req, Http::ResponseWriter resp) const
+Router::addHeadersHandler(HeadersHandler handler) {
+    headersHandlers.push_back(std::move(handler));
+}
+
+void
+Router::checkHeaders(const Http::Request& req) const {
+    const auto resource = req.resource();
+    if (resource.empty()) return;
+
+    std::tuple<std::shared_ptr<Route>,
+    std::vector<TypedParam>, std::vector<TypedParam>> result;
+
+    auto it = routes.find(req.method());
+    if (it != std::end(routes)) {
+        const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
+        const std::string_view path {sanitized.data(), sanitized.size()};
+        result = it->second.findRoute(path);
+    }
+
+    const auto& route = std::get<0>(result);
+
+    // Custom and not found handlers might still want the body
+    if (route == nullptr && customHandlers.empty() && !notFoundHandler)
+        throw Http::HttpError(Http::Code::Not_Found, "Could not find a matching route");
+
+    Http::Mime::MediaType representation;
+    if (route != nullptr && route->negotiator_) {
+        representation = route->negotiator_->negotiate(req);
+        if (!representation.isValid())
+            throw Http::HttpError(Http::Code::Not_Acceptable, "No acceptable representation");
+    }
+
+    if (headersHandlers.empty()) return;
+
+    // The handlers run while the request is parsed: it is referred to, not owned
+    std::shared_ptr<const Http::Request> head(std::shared_ptr<const Http::Request>(), &req);
+    Request request(std::move(head), std::move(std::get<1>(result)), std::move(std::get<2>(result)),
+                    std::move(representation));
+    for (const auto& handler: headersHandlers)
+        handler(request);
+}
+
+void
+Router::invokeNotFoundHandler(std::shared_ptr<const Http::Request> req, Http::ResponseWriter resp) const
 {
     notFoundHandler(Rest::Request(std::move(req), std::vector<TypedParam>(), std::vector<TypedParam>()), std::move(resp));
 }
@@ -420,6 +533,11 @@ Router::route(const Http::Request& req, Http::ResponseWriter response) {
     const auto resource = req.resource();
     if (resource.empty()) throw std::runtime_error("Invalid zero-length URL.");
 
+    // A request received by the server is owned by its response, and shared from there
+    std::shared_ptr<const Http::Request> request = response.request();
+    if (request.get() != &req)
+        request = std::make_shared<Http::Request>(req);
+
     auto& r = routes[req.method()];
     const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
     const std::string_view path {sanitized.data(), sanitized.size()};
@@ -427,22 +545,32 @@ Router::route(const Http::Request& req, Http::ResponseWriter response) {
 
     auto route = std::get<0>(result);
     if (route != nullptr) {
+        Http::Mime::MediaType representation;
+        if (route->negotiator_) {
+            representation = route->negotiator_->negotiate(req);
+            if (!representation.isValid()) {
+                response.send(Http::Code::Not_Acceptable, "No acceptable representation");
+                return Route::Status::Match;
+            }
+        }
+
         auto params = std::get<1>(result);
         auto splats = std::get<2>(result);
-        route->invokeHandler(Request(req, std::move(params), std::move(splats)),
+        route->invokeHandler(Request(request, std::move(params), std::move(splats),
+                                     std::move(representation)),
             std::move(response));
         return Route::Status::Match;
     }
 
     for (const auto& handler: customHandlers) {
         auto resp = response.clone();
-        auto handler1 = handler(Request(req, std::vector<TypedParam>(),
+        auto handler1 = handler(Request(request, std::vector<TypedParam>(),
             std::vector<TypedParam>()), std::move(resp));
         if (handler1 == Route::Result::Ok) return Route::Status::Match;
     }
 
     if (hasNotFoundHandler()) {
-      invokeNotFoundHandler(req, std::move(response));
+      invokeNotFoundHandler(std::move(request), std::move(response));
     } else {
       response.send(Http::Code::Not_Found, "Could not find a matching route");
     }
@@ -451,6 +579,11 @@ Router::route(const Http::Request& req, Http::ResponseWriter response) {
 
 void Router::addRoute(Http::Method method,
     const std::string& resource, Route::Handler handler) {
+    addRoute(method, resource, std::move(handler), std::vector<Http::Mime::MediaType>());
+}
+
+void Router::addRoute(Http::Method method, const std::string& resource,
+    Route::Handler handler, std::vector<Http::Mime::MediaType> produces) {
     if (resource.empty()) throw std::runtime_error("Invalid zero-length URL.");
     auto& r = routes[method];
     const auto sanitized = SegmentTreeNode::sanitizeResource(resource);
@@ -458,7 +591,10 @@ void Router::addRoute(Http::Method method,
                               std::default_delete<char[]>());
     memcpy(ptr.get(), sanitized.data(), sanitized.length());
     const std::string_view path {ptr.get(), sanitized.length()};
-    r.addRoute(path, handler, ptr);
+    std::shared_ptr<Http::ContentNegotiator> negotiator;
+    if (!produces.empty())
+        negotiator = std::make_shared<Http::ContentNegotiator>(std::move(produces));
+    r.addRoute(path, handler, ptr, negotiator);
 }
 
 namespace Routes {
@@ -0,0 +1,297 @@
+#include "gtest/gtest.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pistache/async.h>
+#include <pistache/cancellation.h>
+#include <pistache/client.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+struct State {
+    std::atomic<int> requests { 0 };
+    std::atomic<bool> cancelled { false };
+
+    std::mutex lock;
+    std::vector<std::shared_ptr<Http::ResponseWriter>> parked;
+    std::vector<std::shared_ptr<Http::ResponseStream>> streams;
+};
+
+// Never answers, only watches the cancellation of the requests
+class ParkingHandler : public Http::Handler {
+public:
+    HTTP_PROTOTYPE(ParkingHandler)
+
+    ParkingHandler(std::shared_ptr<State> state, std::chrono::milliseconds timeout)
+        : state_(std::move(state))
+        , timeout_(timeout)
+    { }
+
+    void onRequest(const Http::Request& request, Http::ResponseWriter response) override {
+        ++state_->requests;
+
+        auto state = state_;
+        request.cancellation().onCancel([state]() {
+            state->cancelled = true;
+        });
+
+        // The timeout refers to the writer, which must not move once armed
+        auto parked = std::make_shared<Http::ResponseWriter>(std::move(response));
+        if (timeout_.count() > 0)
+            parked->timeoutAfter(timeout_);
+
+        std::lock_guard<std::mutex> guard(state_->lock);
+        state_->parked.push_back(std::move(parked));
+    }
+
+private:
+    std::shared_ptr<State> state_;
+    std::chrono::milliseconds timeout_;
+};
+
+// Streams a response that never ends, watching the cancellation through the
+// writer it moved out of and through the stream
+class StreamingHandler : public Http::Handler {
+public:
+    HTTP_PROTOTYPE(StreamingHandler)
+
+    explicit StreamingHandler(std::shared_ptr<State> state)
+        : state_(std::move(state))
+    { }
+
+    void onRequest(const Http::Request&, Http::ResponseWriter response) override {
+        ++state_->requests;
+
+        auto stream = std::make_shared<Http::ResponseStream>(response.stream(Http::Code::Ok));
+
+        auto state = state_;
+        if (response.cancellation().isCancellable() && stream->cancellation().isCancellable()) {
+            stream->cancellation().onCancel([state]() {
+                state->cancelled = true;
+            });
+        }
+
+        std::lock_guard<std::mutex> guard(state_->lock);
+        state_->streams.push_back(std::move(stream));
+    }
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+class Server : public TestServer {
+public:
+    explicit Server(std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+        : state(std::make_shared<State>())
+    {
+        serve(Http::make_handler<ParkingHandler>(state, timeout));
+    }
+
+    std::shared_ptr<State> state;
+};
+
+bool isCancelled(std::exception_ptr exc) {
+    try {
+        std::rethrow_exception(exc);
+    } catch (const Async::Cancelled&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+}
+
+TEST(cancellation_test, default_token_is_never_cancelled) {
+    Async::CancellationToken token;
+    bool called = false;
+    token.onCancel([&]() { called = true; });
+    token.cancel();
+
+    ASSERT_FALSE(token.isCancelled());
+    ASSERT_FALSE(called);
+    ASSERT_NO_THROW(token.throwIfCancelled());
+}
+
+TEST(cancellation_test, callbacks_run_once) {
+    auto token = Async::CancellationToken::create();
+    auto copy = token;
+    int calls = 0;
+    copy.onCancel([&]() { ++calls; });
+
+    token.cancel();
+    token.cancel();
+
+    ASSERT_TRUE(copy.isCancelled());
+    ASSERT_EQ(calls, 1);
+    ASSERT_THROW(copy.throwIfCancelled(), Async::Cancelled);
+
+    // Registered too late, runs right away
+    copy.onCancel([&]() { ++calls; });
+    ASSERT_EQ(calls, 2);
+}
+
+TEST(cancellation_test, unregistered_callback_does_not_run) {
+    auto token = Async::CancellationToken::create();
+    bool called = false;
+    auto registration = token.onCancel([&]() { called = true; });
+    token.unregister(registration);
+    token.cancel();
+
+    ASSERT_FALSE(called);
+}
+
+TEST(cancellation_test, child_follows_its_parent) {
+    auto parent = Async::CancellationToken::create();
+    auto child = parent.child();
+    auto other = parent.child();
+
+    other.cancel();
+    ASSERT_TRUE(other.isCancelled());
+    ASSERT_FALSE(parent.isCancelled());
+    ASSERT_FALSE(child.isCancelled());
+
+    parent.cancel();
+    ASSERT_TRUE(child.isCancelled());
+}
+
+TEST(cancellation_test, children_listen_while_they_live) {
+    auto parent = Async::CancellationToken::create();
+    ASSERT_FALSE(parent.hasListeners());
+
+    {
+        auto child = parent.child();
+        ASSERT_TRUE(parent.hasListeners());
+    }
+
+    ASSERT_FALSE(parent.hasListeners());
+}
+
+TEST(cancellation_test, cancellable_promise) {
+    auto token = Async::CancellationToken::create();
+
+    Async::Resolver* resolver = nullptr;
+    Async::Promise<int> promise([&](Async::Resolver& resolve, Async::Rejection&) {
+        resolver = &resolve;
+    });
+    auto linked = Async::cancellable(promise, token);
+
+    bool rejected = false;
+    linked.then([](int) { }, [&](std::exception_ptr exc) {
+        rejected = isCancelled(exc);
+    });
+
+    token.cancel();
+    ASSERT_TRUE(rejected);
+
+    // Settling the original promise afterwards is ignored
+    (*resolver)(42);
+    ASSERT_TRUE(linked.isRejected());
+}
+
+TEST(cancellation_test, cancellable_promise_settles_first) {
+    auto token = Async::CancellationToken::create();
+    auto promise = Async::Promise<int>::resolved(42);
+    auto linked = Async::cancellable(promise, token);
+
+    token.cancel();
+    ASSERT_TRUE(linked.isFulfilled());
+}
+
+TEST(cancellation_test, request_is_cancelled_on_disconnection) {
+    Server server;
+
+    int fd = connectTo(server.port());
+    ASSERT_NE(fd, -1);
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+    ASSERT_TRUE(waitFor([&] { return server.state->requests.load() == 1; }));
+    ASSERT_FALSE(server.state->cancelled);
+
+    ::close(fd);
+    ASSERT_TRUE(waitFor([&] { return server.state->cancelled.load(); }));
+}
+
+TEST(cancellation_test, stream_is_cancelled_on_disconnection) {
+    TestServer server;
+    auto state = std::make_shared<State>();
+    server.serve(Http::make_handler<StreamingHandler>(state));
+
+    int fd = connectTo(server.port());
+    ASSERT_NE(fd, -1);
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+    ASSERT_TRUE(waitFor([&] { return state->requests.load() == 1; }));
+    ASSERT_FALSE(state->cancelled);
+
+    ::close(fd);
+    ASSERT_TRUE(waitFor([&] { return state->cancelled.load(); }));
+}
+
+TEST(cancellation_test, request_is_cancelled_on_timeout) {
+    Server server(std::chrono::milliseconds(100));
+
+    int fd = connectTo(server.port());
+    ASSERT_NE(fd, -1);
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+    ASSERT_TRUE(waitFor([&] { return server.state->cancelled.load(); }));
+
+    ::close(fd);
+}
+
+TEST(cancellation_test, client_request_is_rejected_once_cancelled) {
+    Server server;
+
+    Http::Client client;
+    client.init();
+
+    auto token = Async::CancellationToken::create();
+    auto response = client.get(server.address()).cancellation(token).send();
+
+    std::atomic<bool> cancelled(false);
+    response.then([](Http::Response) { }, [&](std::exception_ptr exc) {
+        cancelled = isCancelled(exc);
+    });
+
+    ASSERT_TRUE(waitFor([&] { return server.state->requests.load() == 1; }));
+    token.cancel();
+    ASSERT_TRUE(cancelled);
+
+    client.shutdown();
+}
+
+TEST(cancellation_test, cancelled_client_request_is_not_sent) {
+    Server server;
+
+    Http::Client client;
+    client.init();
+
+    auto token = Async::CancellationToken::create();
+    token.cancel();
+    auto response = client.get(server.address()).cancellation(token).send();
+
+    ASSERT_TRUE(response.isRejected());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(server.state->requests.load(), 0);
+
+    client.shutdown();
+}
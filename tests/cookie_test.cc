@@ -1,5 +1,10 @@
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <pistache/cookie.h>
 #include <pistache/date.h>
 
@@ -165,3 +170,81 @@ TEST(cookie_test, cookiejar_test_2) {
     ASSERT_FALSE(jar.has("k1"));
     ASSERT_FALSE(jar.has("k2"));
 }
+
+TEST(cookie_test, cookiejar_keeps_insertion_order) {
+    CookieJar jar;
+    const char* raw = "b=2; a=1;  c=3;";
+    jar.addFromRaw(raw, strlen(raw));
+    jar.add(Cookie("d", "4"));
+    jar.add(Cookie("a", "1"));
+
+    ASSERT_TRUE(jar.has("c"));
+    ASSERT_FALSE(jar.has("e"));
+    ASSERT_EQ(jar.size(), 4u);
+
+    std::string names;
+    for (const auto& cookie: jar)
+        names += cookie.name + cookie.value;
+    ASSERT_EQ(names, "b2a1c3d4");
+}
+
+TEST(cookie_test, cookiejar_set_cookie_is_parsed_lazily) {
+    CookieJar jar;
+    const char* raw = "SID=31d4d96e407aad42; Path=/; Max-Age=12ab";
+    jar.addSetCookieRaw(raw, strlen(raw));
+
+    // Invalid attributes are ignored, the cookie itself is kept
+    auto cookie = jar.get("SID");
+    ASSERT_EQ(cookie.value, "31d4d96e407aad42");
+    ASSERT_TRUE(cookie.path.isEmpty());
+
+    const char* valid = "lang=en-US; Path=/; Secure";
+    jar.addSetCookieRaw(valid, strlen(valid));
+    auto lang = jar.get("lang");
+    ASSERT_EQ(lang.path.getOrElse(""), "/");
+    ASSERT_TRUE(lang.secure);
+
+    ASSERT_THROW(jar.addSetCookieRaw("lang; Path=/", 12), std::runtime_error);
+}
+
+TEST(cookie_test, cookiejar_is_materialized_once_for_concurrent_readers) {
+    std::string raw;
+    for (int i = 0; i < 200; ++i)
+        raw += "k" + std::to_string(i) + "=" + std::to_string(i) + "; ";
+
+    for (int round = 0; round < 20; ++round) {
+        CookieJar jar;
+        jar.addFromRaw(raw.data(), raw.size());
+        const CookieJar& shared = jar;
+
+        std::atomic<int> mismatches(0);
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&shared, &mismatches, i]() {
+                size_t count = 0;
+                if (i % 2)
+                    count = shared.size();
+                else {
+                    for (const auto& cookie: shared)
+                        count += !cookie.name.empty();
+                }
+                if (count != 200 || !shared.has("k199") || shared.get("k42").value != "42")
+                    ++mismatches;
+            });
+        }
+        for (auto& reader: readers)
+            reader.join();
+
+        ASSERT_EQ(mismatches.load(), 0);
+    }
+}
+
+TEST(cookie_test, write_to_buffer) {
+    Cookie cookie("lang", "en-US");
+    cookie.maxAge = Some(-30);
+    cookie.httpOnly = true;
+
+    std::stringbuf buf;
+    ASSERT_TRUE(cookie.write(buf));
+    ASSERT_EQ(buf.str(), "lang=en-US; Max-Age=-30; HttpOnly");
+}
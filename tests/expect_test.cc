@@ -0,0 +1,154 @@
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+using namespace Pistache;
+
+namespace {
+
+class UploadServer {
+public:
+    UploadServer()
+        : endpoint(std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0))))
+        , router()
+    {
+        auto opts = Http::Endpoint::options()
+            .threads(1)
+            .flags(Tcp::Options::ReuseAddr);
+        endpoint->init(opts);
+
+        Rest::Routes::Post(router, "/upload", [](const Rest::Request& request, Http::ResponseWriter response) {
+            response.send(Http::Code::Ok, request.body());
+            return Rest::Route::Result::Ok;
+        });
+
+        router.addHeadersHandler([](const Rest::Request& request) {
+            if (request.headers().tryGetRaw("X-Token").isEmpty())
+                throw Http::HttpError(Http::Code::Unauthorized, "Missing token");
+        });
+
+        endpoint->setHandler(router.handler());
+        endpoint->serveThreaded();
+    }
+
+    ~UploadServer() {
+        endpoint->shutdown();
+    }
+
+    std::shared_ptr<Http::Endpoint> endpoint;
+    Rest::Router router;
+};
+
+class RawClient {
+public:
+    explicit RawClient(Port port)
+        : fd(::socket(AF_INET, SOCK_STREAM, 0))
+    {
+        struct timeval tv;
+        tv.tv_sec = 2;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connected = ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0;
+    }
+
+    ~RawClient() {
+        ::close(fd);
+    }
+
+    void send(const std::string& data) {
+        ::send(fd, data.data(), data.size(), 0);
+    }
+
+    // Reads until the given marker is found or the server stops talking
+    std::string receive(const std::string& until) {
+        std::string data;
+        char buf[1024];
+        while (data.find(until) == std::string::npos) {
+            auto n = ::recv(fd, buf, sizeof buf, 0);
+            if (n <= 0)
+                break;
+            data.append(buf, n);
+        }
+        return data;
+    }
+
+    int fd;
+    bool connected;
+};
+
+std::string head(const std::string& extra, size_t length) {
+    return "POST /upload HTTP/1.1\r\n"
+           "Host: localhost\r\n"
+           "Content-Length: " + std::to_string(length) + "\r\n"
+           + extra + "\r\n";
+}
+
+}
+
+TEST(expect_test, continue_is_sent_before_the_body) {
+    UploadServer server;
+    RawClient client(server.endpoint->getPort());
+    ASSERT_TRUE(client.connected);
+
+    client.send(head("Expect: 100-continue\r\nX-Token: a\r\n", 5));
+    ASSERT_EQ(client.receive("\r\n\r\n"), "HTTP/1.1 100 Continue\r\n\r\n");
+
+    client.send("hello");
+    auto response = client.receive("hello");
+    ASSERT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+    ASSERT_NE(response.find("\r\n\r\nhello"), std::string::npos);
+}
+
+TEST(expect_test, rejected_uploads_get_a_final_response_right_away) {
+    UploadServer server;
+
+    {
+        RawClient client(server.endpoint->getPort());
+        client.send(head("Expect: 100-continue\r\n", 5));
+        ASSERT_EQ(client.receive("\r\n\r\n").compare(0, 12, "HTTP/1.1 401"), 0);
+    }
+
+    {
+        RawClient client(server.endpoint->getPort());
+        client.send(head("Expect: 100-continue\r\nX-Token: a\r\n", 1 << 20));
+        ASSERT_EQ(client.receive("\r\n\r\n").compare(0, 12, "HTTP/1.1 413"), 0);
+    }
+
+    {
+        RawClient client(server.endpoint->getPort());
+        client.send(head("Expect: something-else\r\nX-Token: a\r\n", 5));
+        ASSERT_EQ(client.receive("\r\n\r\n").compare(0, 12, "HTTP/1.1 417"), 0);
+    }
+
+    {
+        RawClient client(server.endpoint->getPort());
+        client.send("POST /missing HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n");
+        ASSERT_EQ(client.receive("\r\n\r\n").compare(0, 12, "HTTP/1.1 404"), 0);
+    }
+}
+
+TEST(expect_test, request_without_expectation_is_unchanged) {
+    UploadServer server;
+    RawClient client(server.endpoint->getPort());
+
+    client.send(head("X-Token: a\r\n", 5) + "hello");
+    auto response = client.receive("hello");
+    ASSERT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0);
+    ASSERT_EQ(response.find("100 Continue"), std::string::npos);
+}
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <sstream>
 
 using namespace Pistache::Http;
 
@@ -199,6 +200,26 @@ TEST(headers_test, connection) {
     }
 }
 
+TEST(headers_test, connection_options) {
+    Header::Connection connection;
+    connection.parse("Upgrade , keep-alive,X-Hop");
+
+    ASSERT_EQ(connection.control(), ConnectionControl::KeepAlive);
+    ASSERT_EQ(connection.options(), std::vector<std::string>({ "Upgrade", "X-Hop" }));
+
+    std::ostringstream oss;
+    connection.write(oss);
+    ASSERT_EQ(oss.str(), "Keep-Alive, Upgrade, X-Hop");
+
+    Header::Connection upgrade;
+    upgrade.parse("Upgrade");
+    ASSERT_EQ(upgrade.control(), ConnectionControl::Ext);
+
+    oss.str("");
+    upgrade.write(oss);
+    ASSERT_EQ(oss.str(), "Upgrade");
+}
+
 
 TEST(headers_test, date_test_rfc_1123) {
 
@@ -246,7 +267,54 @@ TEST(headers_test, date_test_ostream) {
     Header::Date d4;
     d4.parse("Fri, 25 Jan 2019 21:04:45.000000000 UTC");
     d4.write(os);
-    ASSERT_EQ("Fri, 25 Jan 2019 21:04:45.000000000 UTC", os.str());
+    ASSERT_EQ("Fri, 25 Jan 2019 21:04:45 GMT", os.str());
+}
+
+TEST(headers_test, date_test_formats) {
+
+    using namespace std::chrono;
+    FullDate date(date::sys_days(date::year{1994}/11/6)
+                    + hours(8) + minutes(49) + seconds(37));
+
+    std::ostringstream os;
+    date.write(os, FullDate::Type::RFC1123);
+    ASSERT_EQ(os.str(), "Sun, 06 Nov 1994 08:49:37 GMT");
+
+    os.str("");
+    date.write(os, FullDate::Type::RFC850);
+    ASSERT_EQ(os.str(), "Sunday, 06-Nov-94 08:49:37 GMT");
+
+    os.str("");
+    date.write(os, FullDate::Type::AscTime);
+    ASSERT_EQ(os.str(), "Sun Nov  6 08:49:37 1994");
+
+    char buf[FullDate::RFC1123Length];
+    date.format(buf);
+    ASSERT_EQ(std::string(buf, sizeof buf), "Sun, 06 Nov 1994 08:49:37 GMT");
+
+    ASSERT_EQ(FullDate::fromString("Thu, 01 Jan 2015 00:00:00 GMT").date(),
+              FullDate::time_point(date::sys_days(date::year{2015}/1/1)));
+    ASSERT_EQ(FullDate::fromString("Saturday, 01-Jan-00 00:00:00 GMT").date(),
+              FullDate::time_point(date::sys_days(date::year{2000}/1/1)));
+}
+
+TEST(headers_test, date_test_invalid) {
+    ASSERT_THROW(FullDate::fromString(""), std::runtime_error);
+    ASSERT_THROW(FullDate::fromString("Sun, 06 Foo 1994 08:49:37 GMT"), std::runtime_error);
+    ASSERT_THROW(FullDate::fromString("Sun, 31 Nov 1994 08:49:37 GMT"), std::runtime_error);
+    ASSERT_THROW(FullDate::fromString("Sun, 06 Nov 1994 25:49:37 GMT"), std::runtime_error);
+    ASSERT_THROW(FullDate::fromString("Sun, 06 Nov 1994 08:49:37 CET"), std::runtime_error);
+    ASSERT_THROW(FullDate::fromString("Sun Nov  6 08:49:37 1994 trailing"), std::runtime_error);
+}
+
+TEST(headers_test, date_test_now) {
+    const std::string first = FullDate::now();
+    ASSERT_EQ(first.size(), FullDate::RFC1123Length);
+
+    auto parsed = FullDate::fromString(first).date();
+    auto delta = std::chrono::system_clock::now() - parsed;
+    ASSERT_LT(delta, std::chrono::seconds(2));
+    ASSERT_GE(delta, std::chrono::seconds(0));
 }
 
 TEST(headers_test, host) {
@@ -338,6 +406,68 @@ TEST(headers_test, access_control_allow_methods_test)
 
 CUSTOM_HEADER(TestHeader)
 
+TEST(headers_test, etag) {
+    Header::ETag etag;
+    etag.parse("W/\"xyzzy\"");
+    ASSERT_EQ(etag.tag(), "W/\"xyzzy\"");
+    ASSERT_TRUE(etag.isWeak());
+
+    std::ostringstream oss;
+    etag.write(oss);
+    ASSERT_EQ(oss.str(), "W/\"xyzzy\"");
+}
+
+TEST(headers_test, if_none_match) {
+    Header::IfNoneMatch inm;
+    inm.parse("\"xyzzy\", W/\"r2d2xxxx\" ,\"c3piozzzz\"");
+
+    auto tags = inm.tags();
+    ASSERT_EQ(tags.size(), 3U);
+    ASSERT_EQ(tags[1], "W/\"r2d2xxxx\"");
+
+    ASSERT_TRUE(inm.matches("\"xyzzy\""));
+    ASSERT_TRUE(inm.matches("W/\"xyzzy\""));
+    ASSERT_TRUE(inm.matches("\"r2d2xxxx\""));
+    ASSERT_FALSE(inm.matches("\"other\""));
+
+    Header::IfNoneMatch any;
+    any.parse("*");
+    ASSERT_TRUE(any.matches("\"anything\""));
+
+    std::ostringstream oss;
+    inm.write(oss);
+    ASSERT_EQ(oss.str(), "\"xyzzy\", W/\"r2d2xxxx\", \"c3piozzzz\"");
+}
+
+TEST(headers_test, retry_after) {
+    Header::RetryAfter retry;
+    retry.parse("120");
+    ASSERT_EQ(retry.delay(), std::chrono::seconds(120));
+
+    retry.parse("Fri, 31 Dec 1999 23:59:59 GMT");
+    ASSERT_EQ(retry.delay(), std::chrono::seconds(0));
+
+    std::ostringstream oss;
+    Header::RetryAfter(std::chrono::seconds(3)).write(oss);
+    ASSERT_EQ(oss.str(), "3");
+}
+
+TEST(headers_test, expect) {
+    Header::Expect expect;
+    expect.parse("100-continue");
+    ASSERT_EQ(expect.expectation(), Pistache::Http::Expectation::Continue);
+
+    expect.parse("100-Continue");
+    ASSERT_EQ(expect.expectation(), Pistache::Http::Expectation::Continue);
+
+    expect.parse("200-ok");
+    ASSERT_EQ(expect.expectation(), Pistache::Http::Expectation::Ext);
+
+    std::ostringstream oss;
+    Header::Expect(Pistache::Http::Expectation::Continue).write(oss);
+    ASSERT_EQ(oss.str(), "100-continue");
+}
+
 TEST(header_test, macro_for_custom_headers)
 {
     TestHeader testHeader;
@@ -6,6 +6,16 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 using namespace Pistache;
 
@@ -30,6 +40,155 @@ struct DelayHandler : public Http::Handler
     }
 };
 
+struct EchoSizeHandler : public Http::Handler
+{
+    HTTP_PROTOTYPE(EchoSizeHandler)
+
+    void onRequest(const Http::Request& request, Http::ResponseWriter writer) override
+    {
+        writer.send(Http::Code::Ok, std::to_string(request.body().size()));
+    }
+};
+
+struct SlowFirstHandler : public Http::Handler
+{
+    HTTP_PROTOTYPE(SlowFirstHandler)
+
+    void onRequest(const Http::Request& /*request*/, Http::ResponseWriter writer) override
+    {
+        if (counter().fetch_add(1) == 0) {
+            // Answer late without holding up the server thread, which might
+            // also be the one of the hedged request
+            auto response = std::make_shared<Http::ResponseWriter>(std::move(writer));
+            slow() = std::thread([response]() {
+                std::this_thread::sleep_for(std::chrono::seconds(2));
+                try {
+                    response->send(Http::Code::Ok, "Hello, World!");
+                } catch (const std::exception&) {
+                    // The client gave up on this connection
+                }
+            });
+            return;
+        }
+        writer.send(Http::Code::Ok, "Hello, World!");
+    }
+
+    static std::atomic<int>& counter()
+    {
+        static std::atomic<int> value(0);
+        return value;
+    }
+
+    static std::thread& slow()
+    {
+        static std::thread value;
+        return value;
+    }
+};
+
+// Never answers the first request, so that the client times out on it
+struct FirstUnansweredHandler : public Http::Handler
+{
+    HTTP_PROTOTYPE(FirstUnansweredHandler)
+
+    void onRequest(const Http::Request& /*request*/, Http::ResponseWriter writer) override
+    {
+        if (counter().fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> guard(lock());
+            parked().push_back(std::make_shared<Http::ResponseWriter>(std::move(writer)));
+            return;
+        }
+        writer.send(Http::Code::Ok, "Hello, World!");
+    }
+
+    static std::atomic<int>& counter()
+    {
+        static std::atomic<int> value(0);
+        return value;
+    }
+
+    static std::mutex& lock()
+    {
+        static std::mutex value;
+        return value;
+    }
+
+    static std::vector<std::shared_ptr<Http::ResponseWriter>>& parked()
+    {
+        static std::vector<std::shared_ptr<Http::ResponseWriter>> value;
+        return value;
+    }
+};
+
+struct HostEchoHandler : public Http::Handler
+{
+    HTTP_PROTOTYPE(HostEchoHandler)
+
+    void onRequest(const Http::Request& request, Http::ResponseWriter writer) override
+    {
+        auto host = request.headers().tryGet<Http::Header::Host>();
+        writer.send(Http::Code::Ok, host ? host->host() : "");
+    }
+};
+
+struct CachedHandler : public Http::Handler
+{
+    HTTP_PROTOTYPE(CachedHandler)
+
+    void onRequest(const Http::Request& request, Http::ResponseWriter writer) override
+    {
+        ++hits();
+        if (request.resource() == "/slow")
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        auto inm = request.headers().tryGet<Http::Header::IfNoneMatch>();
+        if (inm) {
+            ++conditionals();
+            if (inm->matches("\"v1\"")) {
+                writer.send(Http::Code::Not_Modified);
+                return;
+            }
+        }
+
+        const Http::CacheDirective maxAge(Http::CacheDirective::MaxAge, std::chrono::seconds(60));
+        if (request.resource() == "/revalidate")
+            writer.headers().add<Http::Header::CacheControl>(Http::CacheDirective::NoCache);
+        else if (request.resource() == "/private")
+            writer.headers().add<Http::Header::CacheControl>(
+                    std::vector<Http::CacheDirective> { Http::CacheDirective::Private, maxAge });
+        else
+            writer.headers().add<Http::Header::CacheControl>(maxAge);
+
+        if (request.resource() == "/query") {
+            auto value = request.query().get("a");
+            writer.send(Http::Code::Ok, value.isEmpty() ? "" : value.unsafeGet());
+            return;
+        }
+
+        if (request.resource() == "/vary") {
+            auto language = request.headers().tryGetRaw("Accept-Language");
+            writer.headers().addRaw(Http::Header::Raw("Vary", "Accept-Language"));
+            writer.send(Http::Code::Ok, language.isEmpty() ? "" : language.unsafeGet().value());
+            return;
+        }
+
+        writer.headers().add<Http::Header::ETag>("\"v1\"");
+        writer.send(Http::Code::Ok, "cached body");
+    }
+
+    static std::atomic<int>& hits()
+    {
+        static std::atomic<int> value(0);
+        return value;
+    }
+
+    static std::atomic<int>& conditionals()
+    {
+        static std::atomic<int> value(0);
+        return value;
+    }
+};
+
 TEST(http_client_test, one_client_with_one_request)
 {
     const Pistache::Address address("localhost", Pistache::Port(0));
@@ -305,3 +464,591 @@ TEST(http_client_test, one_client_with_multiple_requests_and_two_connections_per
 
     ASSERT_TRUE(response_counter == RESPONSE_SIZE);
 }
+
+TEST(http_client_test, one_client_with_large_body)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+    const size_t BODY_SIZE = 1024 * 1024;
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags).maxPayload(2 * BODY_SIZE);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<EchoSizeHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+    std::cout << "Server address: " << server_address << "\n";
+
+    Http::Client client;
+    client.init();
+
+    std::string received;
+    auto response = client.post(server_address).body(std::string(BODY_SIZE, 'x')).send();
+    response.then([&received](Http::Response rsp)
+                  {
+                      if (rsp.code() == Http::Code::Ok)
+                          received = rsp.body();
+                  },
+                  Async::IgnoreException);
+
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+
+    server.shutdown();
+    client.shutdown();
+
+    ASSERT_EQ(received, std::to_string(BODY_SIZE));
+}
+
+TEST(http_client_test, retry_budget)
+{
+    using Clock = Http::RetryBudget::Clock;
+
+    Http::RetryBudget budget(2, 1.0);
+    auto now = Clock::now();
+
+    ASSERT_TRUE(budget.tryAcquire(now));
+    ASSERT_TRUE(budget.tryAcquire(now));
+    ASSERT_FALSE(budget.tryAcquire(now));
+
+    ASSERT_EQ(budget.available(now + std::chrono::milliseconds(500)), 0u);
+    ASSERT_TRUE(budget.tryAcquire(now + std::chrono::seconds(1)));
+
+    // Never refills above its capacity
+    ASSERT_EQ(budget.available(now + std::chrono::seconds(60)), 2u);
+}
+
+TEST(http_client_test, latency_tracker_percentile)
+{
+    Http::LatencyTracker tracker(100);
+    ASSERT_TRUE(tracker.percentile(0.5).isEmpty());
+
+    for (int i = 1; i <= 100; ++i)
+        tracker.record(std::chrono::microseconds(i));
+
+    ASSERT_EQ(tracker.samples(), 100u);
+    ASSERT_EQ(tracker.percentile(0.5).unsafeGet().count(), 51);
+    ASSERT_EQ(tracker.percentile(0.99).unsafeGet().count(), 100);
+
+    // Oldest samples get overwritten once the tracker is full
+    for (int i = 0; i < 100; ++i)
+        tracker.record(std::chrono::microseconds(1000));
+    ASSERT_EQ(tracker.samples(), 100u);
+    ASSERT_EQ(tracker.percentile(0.0).unsafeGet().count(), 1000);
+}
+
+TEST(http_client_test, hedged_request_wins_over_slow_one)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags).threads(2);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<SlowFirstHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+    std::cout << "Server address: " << server_address << "\n";
+
+    Http::Client client;
+    auto opts = Http::Client::options().hedgeDelay(std::chrono::milliseconds(100));
+    client.init(opts);
+
+    std::atomic<bool> done(false);
+    auto start = std::chrono::steady_clock::now();
+    auto response = client.get(server_address).send();
+    response.then([&done](Http::Response rsp)
+                  {
+                      if (rsp.code() == Http::Code::Ok)
+                          done = true;
+                  },
+                  Async::IgnoreException);
+
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (SlowFirstHandler::slow().joinable())
+        SlowFirstHandler::slow().join();
+
+    server.shutdown();
+    client.shutdown();
+
+    ASSERT_TRUE(done);
+    ASSERT_LT(elapsed, std::chrono::seconds(2));
+}
+
+TEST(http_client_test, shutdown_with_pending_hedge)
+{
+    FirstUnansweredHandler::counter() = 0;
+
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    server.init(Http::Endpoint::options().flags(flags));
+    server.setHandler(Http::make_handler<FirstUnansweredHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+
+    {
+        // The hedge is still pending when the client goes away
+        Http::Client client;
+        client.init(Http::Client::options().hedgeDelay(std::chrono::seconds(1)));
+
+        auto response = client.get(server_address).send();
+        Async::Barrier<Http::Response> barrier(response);
+        barrier.wait_for(std::chrono::milliseconds(200));
+
+        client.shutdown();
+    }
+
+    // Past the hedge delay, nothing may fire into the destroyed client
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+
+    FirstUnansweredHandler::parked().clear();
+    server.shutdown();
+}
+
+namespace {
+
+    // Sends one request that times out the first time, and returns whether
+    // it eventually succeeded
+    bool sendWithRetries(Http::Method method)
+    {
+        FirstUnansweredHandler::counter() = 0;
+
+        const Pistache::Address address("localhost", Pistache::Port(0));
+
+        Http::Endpoint server(address);
+        auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+        server.init(Http::Endpoint::options().flags(flags));
+        server.setHandler(Http::make_handler<FirstUnansweredHandler>());
+        server.serveThreaded();
+
+        const std::string server_address = "localhost:" + server.getPort().toString();
+
+        Http::Client client;
+        client.init();
+
+        auto rb = method == Http::Method::Get
+            ? client.get(server_address)
+            : client.post(server_address);
+        auto response = rb.timeout(std::chrono::milliseconds(200)).retries(2).send();
+
+        bool done = false;
+        response.then([&done](Http::Response rsp)
+                      {
+                          done = rsp.code() == Http::Code::Ok;
+                      },
+                      Async::IgnoreException);
+
+        Async::Barrier<Http::Response> barrier(response);
+        barrier.wait_for(std::chrono::seconds(5));
+
+        FirstUnansweredHandler::parked().clear();
+        server.shutdown();
+        client.shutdown();
+
+        return done;
+    }
+
+}
+
+TEST(http_client_test, idempotent_request_is_retried)
+{
+    ASSERT_TRUE(sendWithRetries(Http::Method::Get));
+    ASSERT_EQ(FirstUnansweredHandler::counter().load(), 2);
+}
+
+TEST(http_client_test, post_is_not_retried)
+{
+    ASSERT_FALSE(sendWithRetries(Http::Method::Post));
+    ASSERT_EQ(FirstUnansweredHandler::counter().load(), 1);
+}
+
+TEST(http_client_test, backend_set_prefers_least_loaded)
+{
+    Http::BackendSet service({ "127.0.0.1:1", "127.0.0.1:2" });
+
+    auto first = service.pick();
+    auto second = service.pick();
+    // With only two backends, both are always compared
+    ASSERT_NE(first->address, second->address);
+
+    service.release(first, true, std::chrono::microseconds(10));
+    service.release(second, true, std::chrono::microseconds(10));
+
+    // Same latency, the busy one is avoided
+    auto busy = service.pick();
+    auto idle = service.pick();
+    ASSERT_NE(busy->address, idle->address);
+    service.release(idle, true, std::chrono::microseconds(10));
+    ASSERT_EQ(service.pick()->address, idle->address);
+
+    // Same load, the slow one is avoided
+    service.release(busy, true, std::chrono::microseconds(10000));
+    service.release(idle, true, std::chrono::microseconds(10));
+    ASSERT_EQ(service.pick()->address, idle->address);
+}
+
+TEST(http_client_test, backend_set_ejects_failing_backend)
+{
+    using Clock = Http::BackendSet::Clock;
+
+    Http::BackendSet service({ "127.0.0.1:1", "127.0.0.1:2" }, 2, std::chrono::seconds(10));
+    auto now = Clock::now();
+
+    auto backend = service.pick(now);
+    service.release(backend, false, std::chrono::microseconds(0), now);
+    ASSERT_EQ(service.available(now), 2u);
+
+    backend = service.pick(now);
+    auto failing = backend->address;
+    service.release(backend, false, std::chrono::microseconds(0), now);
+    if (service.available(now) == 2u) {
+        // The two failures did not hit the same backend, fail it once more
+        backend = service.pick(now);
+        failing = backend->address;
+        service.release(backend, false, std::chrono::microseconds(0), now);
+    }
+    ASSERT_EQ(service.available(now), 1u);
+
+    for (int i = 0; i < 10; ++i) {
+        auto picked = service.pick(now);
+        ASSERT_NE(picked->address, failing);
+        service.release(picked, true, std::chrono::microseconds(10), now);
+    }
+
+    // Back in the set once the ejection time elapsed
+    ASSERT_EQ(service.available(now + std::chrono::seconds(11)), 2u);
+}
+
+TEST(http_client_test, service_skips_dead_backend)
+{
+    const Pistache::Address address("127.0.0.1", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<HelloHandler>());
+    server.serveThreaded();
+
+    // Grab a port nobody listens on
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    ASSERT_EQ(::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len), 0);
+    ASSERT_EQ(::getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len), 0);
+    ::close(fd);
+
+    const std::string live = "127.0.0.1:" + server.getPort().toString();
+    const std::string dead = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+
+    Http::Client client;
+    auto opts = Http::Client::options().outlierEjection(1, std::chrono::seconds(10));
+    client.init(opts);
+    client.registerService("backend", { dead, live });
+
+    std::vector<Async::Promise<Http::Response>> responses;
+    const int RESPONSE_SIZE = 4;
+    std::atomic<int> response_counter(0);
+
+    for (int i = 0; i < RESPONSE_SIZE; ++i)
+    {
+        auto response = client.get("backend/").retries(1).send();
+        response.then([&](Http::Response rsp)
+                      {
+                          if (rsp.code() == Http::Code::Ok)
+                              ++response_counter;
+                      },
+                      Async::IgnoreException);
+        responses.push_back(std::move(response));
+    }
+
+    auto sync = Async::whenAll(responses.begin(), responses.end());
+    Async::Barrier<std::vector<Http::Response>> barrier(sync);
+
+    barrier.wait_for(std::chrono::seconds(5));
+
+    server.shutdown();
+    client.shutdown();
+
+    ASSERT_EQ(response_counter, RESPONSE_SIZE);
+}
+
+TEST(http_client_test, backend_set_update_keeps_known_backends)
+{
+    using Clock = Http::BackendSet::Clock;
+
+    Http::BackendSet service({ "127.0.0.1:1" }, 1, std::chrono::seconds(10));
+    auto now = Clock::now();
+
+    auto backend = service.pick(now);
+    service.release(backend, false, std::chrono::microseconds(0), now);
+    ASSERT_EQ(service.available(now), 0u);
+
+    service.update({ "127.0.0.1:1", "127.0.0.1:2" });
+    ASSERT_EQ(service.size(), 2u);
+    // Still ejected
+    ASSERT_EQ(service.available(now), 1u);
+
+    service.update({ });
+    ASSERT_EQ(service.size(), 2u);
+
+    service.update({ "127.0.0.1:2" });
+    ASSERT_EQ(service.size(), 1u);
+    ASSERT_EQ(service.available(now), 1u);
+}
+
+namespace {
+    std::string getBody(Http::Client& client, const std::string& resource)
+    {
+        std::string body;
+        auto response = client.get(resource).send();
+        response.then([&body](Http::Response rsp)
+                      {
+                          if (rsp.code() == Http::Code::Ok)
+                              body = rsp.body();
+                      },
+                      Async::IgnoreException);
+
+        Async::Barrier<Http::Response> barrier(response);
+        barrier.wait_for(std::chrono::seconds(5));
+        return body;
+    }
+}
+
+TEST(http_client_test, cache_serves_fresh_responses)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<CachedHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+
+    Http::Client client;
+    client.init(Http::Client::options().cache(1024 * 1024));
+
+    CachedHandler::hits() = 0;
+    CachedHandler::conditionals() = 0;
+
+    ASSERT_EQ(getBody(client, server_address + "/fresh"), "cached body");
+    ASSERT_EQ(getBody(client, server_address + "/fresh"), "cached body");
+    ASSERT_EQ(CachedHandler::hits(), 1);
+
+    // no-cache: stored but revalidated every time
+    ASSERT_EQ(getBody(client, server_address + "/revalidate"), "cached body");
+    ASSERT_EQ(getBody(client, server_address + "/revalidate"), "cached body");
+    ASSERT_EQ(CachedHandler::hits(), 3);
+    ASSERT_EQ(CachedHandler::conditionals(), 1);
+
+    server.shutdown();
+    client.shutdown();
+}
+
+TEST(http_client_test, cache_is_not_shared_across_callers)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    server.init(Http::Endpoint::options().flags(flags));
+    server.setHandler(Http::make_handler<CachedHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+
+    Http::Client client;
+    client.init(Http::Client::options().cache(1024 * 1024));
+
+    auto get = [&](const std::string& resource, const Http::Header::Raw& header) {
+        std::string body;
+        auto response = client.get(server_address + resource).header(header).send();
+        response.then([&body](Http::Response rsp) { body = rsp.body(); }, Async::IgnoreException);
+
+        Async::Barrier<Http::Response> barrier(response);
+        barrier.wait_for(std::chrono::seconds(5));
+        return body;
+    };
+
+    CachedHandler::hits() = 0;
+
+    // Requests with credentials bypass the cache
+    get("/fresh", Http::Header::Raw("Authorization", "Bearer a"));
+    get("/fresh", Http::Header::Raw("Authorization", "Bearer a"));
+    ASSERT_EQ(CachedHandler::hits(), 2);
+
+    // Private responses are never stored
+    getBody(client, server_address + "/private");
+    getBody(client, server_address + "/private");
+    ASSERT_EQ(CachedHandler::hits(), 4);
+
+    // Vary: the listed request headers are part of the key
+    ASSERT_EQ(get("/vary", Http::Header::Raw("Accept-Language", "fr")), "fr");
+    ASSERT_EQ(get("/vary", Http::Header::Raw("Accept-Language", "en")), "en");
+    ASSERT_EQ(get("/vary", Http::Header::Raw("Accept-Language", "en")), "en");
+    ASSERT_EQ(CachedHandler::hits(), 6);
+
+    server.shutdown();
+    client.shutdown();
+}
+
+TEST(http_client_test, cache_keys_on_the_query)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    server.init(Http::Endpoint::options().flags(flags));
+    server.setHandler(Http::make_handler<CachedHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+
+    Http::Client client;
+    client.init(Http::Client::options().cache(1024 * 1024));
+
+    auto get = [&](const std::string& value) {
+        std::string body;
+        auto response = client.get(server_address + "/query").params(Http::Uri::Query { { "a", value } }).send();
+        response.then([&body](Http::Response rsp) { body = rsp.body(); }, Async::IgnoreException);
+
+        Async::Barrier<Http::Response> barrier(response);
+        barrier.wait_for(std::chrono::seconds(5));
+        return body;
+    };
+
+    CachedHandler::hits() = 0;
+
+    ASSERT_EQ(get("1"), "1");
+    ASSERT_EQ(get("2"), "2");
+    ASSERT_EQ(get("1"), "1");
+    ASSERT_EQ(CachedHandler::hits(), 2);
+
+    server.shutdown();
+    client.shutdown();
+}
+
+TEST(http_client_test, cache_coalesces_identical_requests)
+{
+    const Pistache::Address address("localhost", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    auto server_opts = Http::Endpoint::options().flags(flags).threads(2);
+    server.init(server_opts);
+    server.setHandler(Http::make_handler<CachedHandler>());
+    server.serveThreaded();
+
+    const std::string server_address = "localhost:" + server.getPort().toString();
+
+    Http::Client client;
+    client.init(Http::Client::options().cache(1024 * 1024));
+
+    CachedHandler::hits() = 0;
+
+    std::vector<Async::Promise<Http::Response>> responses;
+    const int RESPONSE_SIZE = 4;
+    std::atomic<int> response_counter(0);
+
+    for (int i = 0; i < RESPONSE_SIZE; ++i)
+    {
+        auto response = client.get(server_address + "/slow").send();
+        response.then([&](Http::Response rsp)
+                      {
+                          if (rsp.code() == Http::Code::Ok && rsp.body() == "cached body")
+                              ++response_counter;
+                      },
+                      Async::IgnoreException);
+        responses.push_back(std::move(response));
+    }
+
+    auto sync = Async::whenAll(responses.begin(), responses.end());
+    Async::Barrier<std::vector<Http::Response>> barrier(sync);
+    barrier.wait_for(std::chrono::seconds(5));
+
+    server.shutdown();
+    client.shutdown();
+
+    ASSERT_EQ(response_counter, RESPONSE_SIZE);
+    ASSERT_EQ(CachedHandler::hits(), 1);
+}
+
+TEST(http_client_test, service_backends_see_the_service_name)
+{
+    const Pistache::Address address("127.0.0.1", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    server.init(Http::Endpoint::options().flags(flags));
+    server.setHandler(Http::make_handler<HostEchoHandler>());
+    server.serveThreaded();
+
+    Http::Client client;
+    client.init();
+    client.registerService("backend", { "127.0.0.1:" + server.getPort().toString() });
+
+    auto host = getBody(client, "backend/");
+
+    server.shutdown();
+    client.shutdown();
+
+    ASSERT_EQ(host, "backend");
+}
+
+TEST(http_client_test, resolved_service_is_refreshed_in_the_background)
+{
+    const Pistache::Address address("127.0.0.1", Pistache::Port(0));
+
+    Http::Endpoint server(address);
+    auto flags = Tcp::Options::InstallSignalHandler | Tcp::Options::ReuseAddr;
+    server.init(Http::Endpoint::options().flags(flags));
+    server.setHandler(Http::make_handler<HostEchoHandler>());
+    server.serveThreaded();
+
+    Http::Client client;
+    client.init();
+    client.registerService("backend", "127.0.0.1", server.getPort(), std::chrono::milliseconds(50));
+
+    ASSERT_EQ(getBody(client, "backend/"), "backend");
+
+    // Each of these finds a refresh due, and goes on with the current backends
+    for (int i = 0; i < 3; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ASSERT_EQ(getBody(client, "backend/"), "backend");
+    }
+
+    server.shutdown();
+    client.shutdown();
+}
+
+TEST(http_client_test, unresolvable_host_is_rejected)
+{
+    Http::Client client;
+    client.init();
+
+    bool rejected = false;
+    auto response = client.get("nonexistent.invalid/").send();
+    response.then([](Http::Response) { },
+                  [&rejected](std::exception_ptr) { rejected = true; });
+
+    Async::Barrier<Http::Response> barrier(response);
+    barrier.wait_for(std::chrono::seconds(5));
+
+    client.shutdown();
+
+    ASSERT_TRUE(rejected);
+}
@@ -176,4 +176,70 @@ TEST(http_parsing_test, succ_method_parse_request)
             ASSERT_THROW(step.apply(cursor), Http::HttpError);
         }
     }
-}
\ No newline at end of file
+}
+TEST(http_parsing_test, method_and_version_tokens)
+{
+    const std::vector<std::pair<std::string, Http::Method>> methods = {
+        { "OPTIONS", Http::Method::Options }, { "GET", Http::Method::Get },
+        { "POST", Http::Method::Post }, { "HEAD", Http::Method::Head },
+        { "PUT", Http::Method::Put }, { "PATCH", Http::Method::Patch },
+        { "DELETE", Http::Method::Delete }, { "TRACE", Http::Method::Trace },
+        { "CONNECT", Http::Method::Connect }
+    };
+    for (const auto& item: methods)
+    {
+        Http::Method method = Http::Method::Options;
+        ASSERT_TRUE(Http::parseMethod(item.first.data(), item.first.size(), method));
+        ASSERT_EQ(method, item.second);
+    }
+
+    Http::Method method;
+    ASSERT_FALSE(Http::parseMethod("get", 3, method));
+    ASSERT_FALSE(Http::parseMethod("GE", 2, method));
+    ASSERT_FALSE(Http::parseMethod("GETS", 4, method));
+    ASSERT_FALSE(Http::parseMethod("CONNECTED", 9, method));
+    ASSERT_FALSE(Http::parseMethod("", 0, method));
+
+    Http::Version version;
+    ASSERT_TRUE(Http::parseVersion("HTTP/1.0", 8, version));
+    ASSERT_EQ(version, Http::Version::Http10);
+    ASSERT_TRUE(Http::parseVersion("HTTP/1.1", 8, version));
+    ASSERT_EQ(version, Http::Version::Http11);
+    ASSERT_FALSE(Http::parseVersion("HTTP/1", 6, version));
+    ASSERT_FALSE(Http::parseVersion("HTTP/2.0", 8, version));
+}
+
+TEST(http_parsing_test, status_lines)
+{
+    size_t length = 0;
+    const char* line = Http::statusLine(Http::Version::Http11, Http::Code::Ok, length);
+    ASSERT_EQ(std::string(line, length), "HTTP/1.1 200 OK\r\n");
+
+    line = Http::statusLine(Http::Version::Http10, Http::Code::Not_Found, length);
+    ASSERT_EQ(std::string(line, length), "HTTP/1.0 404 Not Found\r\n");
+
+    ASSERT_STREQ(Http::codeString(Http::Code::Service_Unavailable), "Service Unavailable");
+
+    ASSERT_EQ(Http::statusLine(Http::Version::Http11, static_cast<Http::Code>(299), length), nullptr);
+    ASSERT_EQ(Http::statusLine(Http::Version::Http11, static_cast<Http::Code>(1000), length), nullptr);
+    ASSERT_STREQ(Http::codeString(static_cast<Http::Code>(299)), "");
+}
+
+TEST(http_parsing_test, request_line_keeps_the_raw_query)
+{
+    Http::Request request;
+    Http::Private::RequestLineStep step(&request);
+
+    std::string line("GET /search?a=1&a=2&flag HTTP/1.1\r\n");
+    RawStreamBuf<> buf(&line[0], line.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_EQ(step.apply(cursor), Http::Private::State::Next);
+    ASSERT_EQ(request.resource(), "/search");
+    ASSERT_EQ(request.query().raw(), "a=1&a=2&flag");
+    ASSERT_TRUE(request.query().has("flag"));
+
+    Http::Uri::Query built;
+    built.add("a", "1");
+    ASSERT_TRUE(built.raw().empty());
+}
@@ -0,0 +1,124 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+#include <pistache/endpoint.h>
+#include <pistache/middleware.h>
+
+#include "httplib.h"
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+// Rejects the requests that do not carry the expected key
+struct RequireKey {
+    std::string key;
+
+    template<typename Next>
+    Rest::Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response,
+                                   const Next& next) const {
+        auto header = request.headers().tryGetRaw("X-Key");
+        if (header.isEmpty() || header.unsafeGet().value() != key) {
+            response.send(Http::Code::Unauthorized, "denied");
+            return Rest::Route::Result::Ok;
+        }
+        return next(request, std::move(response));
+    }
+};
+
+// Records the order in which filters ran
+struct Trace {
+    std::string name;
+    std::shared_ptr<std::vector<std::string>> trace;
+
+    template<typename Next>
+    Rest::Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response,
+                                   const Next& next) const {
+        trace->push_back(name);
+        return next(request, std::move(response));
+    }
+};
+
+// Decorates the response before the handler writes it
+struct Cors {
+    std::string origin;
+
+    template<typename Next>
+    Rest::Route::Result operator()(const Rest::Request& request, Http::ResponseWriter response,
+                                   const Next& next) const {
+        response.headers().add<Http::Header::AccessControlAllowOrigin>(origin);
+        return next(request, std::move(response));
+    }
+};
+
+class Server : public TestServer {
+public:
+    Server()
+        : trace(std::make_shared<std::vector<std::string>>())
+        , calls(0)
+    {
+        auto handler = [this](const Rest::Request&, Http::ResponseWriter response) {
+            ++calls;
+            trace->push_back("handler");
+            response.send(Http::Code::Ok, "ok");
+        };
+
+        auto filters = Rest::Middleware::chain(Trace { "first", trace }, RequireKey { "secret" });
+        Rest::Routes::Get(router, "/guarded", filters.to(handler));
+        Rest::Routes::Get(router, "/tagged", filters.with(Cors { "*" }).with(Trace { "last", trace }).to(handler));
+        Rest::Routes::Get(router, "/plain", Rest::Middleware::chain().to(handler));
+
+        serve();
+    }
+
+    httplib::Client client() const {
+        return httplib::Client("localhost", port());
+    }
+
+    std::shared_ptr<std::vector<std::string>> trace;
+    std::atomic<int> calls;
+};
+
+}
+
+TEST(middleware_test, filter_short_circuits_the_chain) {
+    Server server;
+    auto client = server.client();
+
+    auto res = client.Get("/guarded");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 401);
+    ASSERT_EQ(res->body, "denied");
+    ASSERT_EQ(server.calls, 0);
+}
+
+TEST(middleware_test, filters_run_in_order_and_wrap_the_response) {
+    Server server;
+    auto client = server.client();
+
+    auto res = client.Get("/tagged", { { "X-Key", "secret" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "ok");
+    ASSERT_EQ(res->get_header_value("Access-Control-Allow-Origin"), "*");
+
+    std::vector<std::string> expected { "first", "last", "handler" };
+    ASSERT_EQ(*server.trace, expected);
+}
+
+TEST(middleware_test, empty_chain_calls_the_handler) {
+    Server server;
+    auto client = server.client();
+
+    auto res = client.Get("/plain");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(server.calls, 1);
+}
@@ -154,4 +154,40 @@ TEST(mime_test, should_parse_case_insensitive_issue_179)
     parse("Application/Xhtml+XML; q=0.78", [](const MediaType& mime) {
         ASSERT_EQ(mime.q().getOrElse(Q(0)), Q(78));
     });
-}
\ No newline at end of file
+}
+TEST(mime_test, quality_values_are_exact)
+{
+    ASSERT_EQ(MediaType::fromString("text/plain; q=0.29").q().getOrElse(Q(0)), Q(29));
+    ASSERT_EQ(MediaType::fromString("text/plain; q=0.5").q().getOrElse(Q(0)), Q(50));
+    ASSERT_EQ(MediaType::fromString("text/plain; q=1.000").q().getOrElse(Q(0)), Q(100));
+    ASSERT_EQ(MediaType::fromString("text/plain; q=0").q().getOrElse(Q(1)), Q(0));
+
+    ASSERT_THROW(MediaType::fromString("text/plain; q=1.5"), HttpError);
+    ASSERT_THROW(MediaType::fromString("text/plain; q=0.1234"), HttpError);
+    ASSERT_THROW(MediaType::fromString("text/plain; q=2"), HttpError);
+
+    // Only "q" itself is the quality
+    auto mime = MediaType::fromString("text/plain; qs=1");
+    ASSERT_TRUE(mime.q().isEmpty());
+    ASSERT_EQ(mime.getParam("qs").getOrElse(""), "1");
+}
+
+TEST(mime_test, write_known_types)
+{
+    std::ostringstream oss;
+    MIME3(Application, Xhtml, Xml).write(oss);
+    ASSERT_EQ(oss.str(), "application/xhtml+xml");
+
+    auto mime = MIME(Text, Html);
+    mime.setParam("charset", "utf-8");
+    oss.str("");
+    mime.write(oss);
+    ASSERT_EQ(oss.str(), "text/html; charset=utf-8");
+
+    // The interned text is not changed by the parameters of a copy
+    ASSERT_EQ(MIME(Text, Html).toString(), "text/html");
+
+    oss.str("");
+    MediaType::fromString("Text/HTML;level=1").write(oss);
+    ASSERT_EQ(oss.str(), "Text/HTML;level=1");
+}
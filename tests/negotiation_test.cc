@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+
+#include <csignal>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/negotiation.h>
+#include <pistache/router.h>
+
+#include "httplib.h"
+
+using namespace Pistache;
+
+namespace {
+
+std::vector<Http::Mime::MediaType> accept(const char* value) {
+    Http::Header::Accept header;
+    header.parse(value);
+    return header.media();
+}
+
+}
+
+TEST(negotiation_test, picks_the_preferred_type) {
+    Http::ContentNegotiator negotiator({ MIME(Application, Json), MIME(Text, Html) });
+
+    ASSERT_EQ(negotiator.select(accept("application/json")), 0);
+    ASSERT_EQ(negotiator.select(accept("text/html")), 1);
+    ASSERT_EQ(negotiator.select(accept("text/*;q=0.9, application/json;q=0.5")), 1);
+
+    // Equal qualities are decided by the order of the produced types
+    ASSERT_EQ(negotiator.select(accept("*/*")), 0);
+    ASSERT_EQ(negotiator.select(accept("text/html, application/json")), 0);
+
+    // The most specific range gives the quality
+    ASSERT_EQ(negotiator.select(accept("application/*;q=0.8, application/json;q=0.1, text/html;q=0.5")), 1);
+    ASSERT_EQ(negotiator.select(accept("*/*, application/json;q=0")), 1);
+
+    ASSERT_EQ(negotiator.select(accept("image/png")), -1);
+    ASSERT_EQ(negotiator.select(accept("application/json;q=0, text/*;q=0")), -1);
+}
+
+TEST(negotiation_test, matches_extension_subtypes) {
+    Http::ContentNegotiator negotiator({
+            Http::Mime::MediaType::fromString("application/vnd.api+json") });
+
+    ASSERT_EQ(negotiator.select(accept("application/vnd.api+json")), 0);
+    ASSERT_EQ(negotiator.select(accept("application/vnd.other+json")), -1);
+    ASSERT_EQ(negotiator.select(accept("application/vnd.api")), -1);
+}
+
+TEST(negotiation_test, route_answers_406_without_running_the_handler) {
+    auto endpoint = std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0)));
+    endpoint->init(Http::Endpoint::options().threads(1).flags(Tcp::Options::ReuseAddr));
+
+    int calls = 0;
+    Rest::Router router;
+    router.addRoute(Http::Method::Get, "/doc",
+            [&calls](const Rest::Request& request, Http::ResponseWriter response) {
+                ++calls;
+                response.send(Http::Code::Ok, request.representation().toString());
+                return Rest::Route::Result::Ok;
+            },
+            { MIME(Application, Json), MIME(Text, Plain) });
+
+    endpoint->setHandler(router.handler());
+    endpoint->serveThreaded();
+
+    httplib::Client client("localhost", endpoint->getPort());
+
+    auto res = client.Get("/doc", { { "Accept", "text/plain, application/json;q=0.5" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "text/plain");
+
+    // The choice comes from the cache the second time
+    res = client.Get("/doc", { { "Accept", "text/plain, application/json;q=0.5" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->body, "text/plain");
+
+    res = client.Get("/doc");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->body, "application/json");
+
+    res = client.Get("/doc", { { "Accept", "image/png" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 406);
+    ASSERT_EQ(calls, 3);
+
+    endpoint->shutdown();
+}
+
+TEST(negotiation_test, accept_is_only_parsed_when_negotiated) {
+    // The connection is closed after an error response, possibly while the
+    // client still writes on it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto endpoint = std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0)));
+    endpoint->init(Http::Endpoint::options().threads(1).flags(Tcp::Options::ReuseAddr));
+
+    auto handler = [](const Rest::Request&, Http::ResponseWriter response) {
+        response.send(Http::Code::Ok, "done");
+        return Rest::Route::Result::Ok;
+    };
+
+    Rest::Router router;
+    Rest::Routes::Get(router, "/plain", handler);
+    router.addRoute(Http::Method::Get, "/doc", handler, { MIME(Application, Json) });
+
+    endpoint->setHandler(router.handler());
+    endpoint->serveThreaded();
+
+    httplib::Client client("localhost", endpoint->getPort());
+
+    // The media ranges of the list are never looked at
+    auto res = client.Get("/plain", { { "Accept", "garbage" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+
+    res = client.Get("/doc", { { "Accept", "garbage" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 415);
+
+    // A list with a missing element is still rejected upfront
+    res = client.Get("/plain", { { "Accept", "text/plain," } });
+    ASSERT_TRUE(res);
+    ASSERT_NE(res->status, 200);
+
+    endpoint->shutdown();
+}
@@ -2,6 +2,7 @@
 
 #include <pistache/net.h>
 
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 
@@ -111,3 +112,100 @@ TEST(net_test, address_parser)
     ASSERT_THROW(AddressParser("127.0.0.1:");, std::invalid_argument);
     ASSERT_THROW(AddressParser("[::]:");, std::invalid_argument);
 }
+
+TEST(net_test, ip_address_matches_libc)
+{
+    const char* const addresses[] = {
+        "0.0.0.0", "127.0.0.1", "255.255.255.255", "10.20.30.40",
+        "::", "::1", "1::", "::ffff:1.2.3.4", "::1.2.3.4", "::0.0.0.2",
+        "2001:db8::1", "2001:DB8:0:0:1:0:0:1", "fe80::1:0:0:0", "1:0:0:2:0:0:0:3",
+        "1:2:3:4:5:6:7:8", "0:0:0:0:0:0:0:0", "1:0:2:0:3:0:4:0", "64:ff9b::10.0.0.1"
+    };
+
+    for (const char* text: addresses) {
+        const bool v6 = std::strchr(text, ':') != nullptr;
+        unsigned char expected[16];
+        ASSERT_EQ(inet_pton(v6 ? AF_INET6 : AF_INET, text, expected), 1) << text;
+        char expectedText[INET6_ADDRSTRLEN];
+        inet_ntop(v6 ? AF_INET6 : AF_INET, expected, expectedText, sizeof expectedText);
+
+        IpAddress ip;
+        ASSERT_TRUE(IpAddress::parse(text, std::strlen(text), ip)) << text;
+        ASSERT_EQ(ip.family(), v6 ? AF_INET6 : AF_INET);
+        ASSERT_EQ(std::memcmp(ip.bytes(), expected, ip.size()), 0) << text;
+
+        char formatted[IpAddress::MaxLength];
+        ASSERT_EQ(ip.format(formatted), std::strlen(expectedText));
+        ASSERT_STREQ(formatted, expectedText);
+    }
+
+    const char* const invalid[] = {
+        "", "1.2.3", "1.2.3.4.5", "1.2.3.256", "01.2.3.4", "1..2.3", "1.2.3.4 ",
+        ":", ":::", "1:::2", "1::2::3", ":1::", "1:", "12345::", "g::",
+        "1:2:3:4:5:6:7:8:9", "1:2:3:4:5:6:7::8", "::1.2.3", "1.2.3.4::", "::ffff:1.2.3.4:5"
+    };
+
+    for (const char* text: invalid) {
+        IpAddress ip;
+        ASSERT_FALSE(IpAddress::parse(text, std::strlen(text), ip)) << text;
+    }
+    ASSERT_THROW(IpAddress::fromString("1.2.3"), std::invalid_argument);
+}
+
+TEST(net_test, address_from_unix_keeps_the_raw_address)
+{
+    struct sockaddr_in6 in6;
+    std::memset(&in6, 0, sizeof in6);
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = htons(8080);
+    inet_pton(AF_INET6, "2001:db8::42", &in6.sin6_addr);
+
+    auto address = Address::fromUnix(reinterpret_cast<struct sockaddr *>(&in6));
+    ASSERT_EQ(address.family(), AF_INET6);
+    ASSERT_EQ(address.port(), 8080);
+    ASSERT_EQ(address.host(), "2001:db8::42");
+    ASSERT_EQ(address.ip(), IpAddress::fromString("2001:db8::42"));
+
+    struct sockaddr_in in;
+    std::memset(&in, 0, sizeof in);
+    in.sin_family = AF_INET;
+    in.sin_port = htons(80);
+    inet_pton(AF_INET, "192.168.1.2", &in.sin_addr);
+
+    address = Address::fromUnix(reinterpret_cast<struct sockaddr *>(&in));
+    ASSERT_EQ(address.family(), AF_INET);
+    ASSERT_EQ(address.host(), "192.168.1.2");
+    ASSERT_EQ(address.port(), 80);
+}
+
+TEST(net_test, cidr_matching)
+{
+    auto block = Cidr::fromString("10.1.0.0/16");
+    ASSERT_TRUE(block.contains(IpAddress::fromString("10.1.255.3")));
+    ASSERT_FALSE(block.contains(IpAddress::fromString("10.2.0.1")));
+    ASSERT_TRUE(block.contains(IpAddress::fromString("::ffff:10.1.2.3")));
+    ASSERT_FALSE(block.contains(IpAddress::fromString("::10.1.2.3")));
+
+    // The bits past the prefix are ignored
+    auto odd = Cidr::fromString("192.168.1.77/26");
+    ASSERT_EQ(odd.network(), IpAddress::fromString("192.168.1.64"));
+    ASSERT_EQ(odd.prefix(), 26);
+    ASSERT_TRUE(odd.contains(IpAddress::fromString("192.168.1.127")));
+    ASSERT_FALSE(odd.contains(IpAddress::fromString("192.168.1.128")));
+
+    auto v6 = Cidr::fromString("fe80::/10");
+    ASSERT_TRUE(v6.contains(IpAddress::fromString("febf::1")));
+    ASSERT_FALSE(v6.contains(IpAddress::fromString("fec0::1")));
+    ASSERT_FALSE(v6.contains(IpAddress::fromString("10.0.0.1")));
+
+    ASSERT_TRUE(Cidr::fromString("0.0.0.0/0").contains(IpAddress::fromString("8.8.8.8")));
+    ASSERT_TRUE(Cidr::fromString("::1").contains(IpAddress::fromString("::1")));
+    ASSERT_FALSE(Cidr::fromString("::1").contains(IpAddress::fromString("::2")));
+
+    Cidr cidr;
+    ASSERT_FALSE(Cidr::parse("10.0.0.0/33", 11, cidr));
+    ASSERT_FALSE(Cidr::parse("10.0.0.0/", 9, cidr));
+    ASSERT_FALSE(Cidr::parse("10.0.0.0/a", 10, cidr));
+    ASSERT_FALSE(Cidr::parse("::/129", 6, cidr));
+    ASSERT_THROW(Cidr::fromString("10.0.0/8"), std::invalid_argument);
+}
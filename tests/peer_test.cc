@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <pistache/http.h>
+#include <pistache/peer.h>
+
+using namespace Pistache;
+
+namespace {
+
+struct Session {
+    explicit Session(std::string user)
+        : user(std::move(user))
+    { }
+
+    std::string user;
+};
+
+const auto SessionSlot = Tcp::Peer::registerSlot<Session>();
+const auto CounterSlot = Tcp::Peer::registerSlot<int>();
+
+}
+
+TEST(peer_test, slots_have_distinct_indexes) {
+    ASSERT_NE(SessionSlot.index(), CounterSlot.index());
+}
+
+TEST(peer_test, put_and_get_data) {
+    Tcp::Peer peer;
+
+    ASSERT_EQ(peer.tryGetData(SessionSlot), nullptr);
+    ASSERT_THROW(peer.getData(SessionSlot), std::runtime_error);
+
+    peer.putData(SessionSlot, std::make_shared<Session>("alice"));
+    peer.putData(CounterSlot, std::make_shared<int>(42));
+
+    ASSERT_EQ(peer.getData(SessionSlot).user, "alice");
+    ASSERT_EQ(peer.getData(CounterSlot), 42);
+
+    peer.getData(CounterSlot) += 1;
+    ASSERT_EQ(*peer.tryGetData(CounterSlot), 43);
+
+    ASSERT_THROW(peer.putData(SessionSlot, std::make_shared<Session>("bob")), std::runtime_error);
+    ASSERT_EQ(peer.getData(SessionSlot).user, "alice");
+}
+
+TEST(peer_test, slot_registered_after_peer_creation) {
+    Tcp::Peer peer;
+
+    auto late = Tcp::Peer::registerSlot<std::string>();
+    ASSERT_EQ(peer.tryGetData(late), nullptr);
+
+    peer.putData(late, std::make_shared<std::string>("late"));
+    ASSERT_EQ(peer.getData(late), "late");
+}
+
+TEST(peer_test, take_data_empties_the_slot) {
+    Tcp::Peer peer;
+    ASSERT_EQ(peer.takeData(SessionSlot), nullptr);
+
+    peer.putData(SessionSlot, std::make_shared<Session>("alice"));
+    auto session = peer.takeData(SessionSlot);
+    ASSERT_EQ(session->user, "alice");
+    ASSERT_EQ(peer.tryGetData(SessionSlot), nullptr);
+
+    // The slot can be filled again
+    peer.putData(SessionSlot, std::make_shared<Session>("bob"));
+    ASSERT_EQ(peer.getData(SessionSlot).user, "bob");
+}
+
+TEST(peer_test, const_peer_gives_const_data) {
+    Tcp::Peer peer;
+    peer.putData(CounterSlot, std::make_shared<int>(42));
+
+    const Tcp::Peer& view = peer;
+    static_assert(std::is_same<decltype(view.getData(CounterSlot)), const int&>::value,
+                  "A const peer hands out const data");
+    static_assert(std::is_same<decltype(view.tryGetData(CounterSlot)), const int*>::value,
+                  "A const peer hands out const data");
+    ASSERT_EQ(view.getData(CounterSlot), 42);
+    ASSERT_EQ(*view.tryGetData(CounterSlot), 42);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+TEST(peer_test, string_keyed_data_still_works) {
+    Tcp::Peer peer;
+    ASSERT_EQ(peer.tryGetData("parser"), nullptr);
+    ASSERT_THROW(peer.getData("parser"), std::runtime_error);
+
+    auto parser = std::make_shared<Http::Private::Parser<Http::Request>>();
+    peer.putData("parser", parser);
+    ASSERT_EQ(peer.getData("parser"), parser);
+    ASSERT_EQ(peer.tryGetData("parser"), parser);
+    ASSERT_THROW(peer.putData("parser", parser), std::runtime_error);
+}
+#pragma GCC diagnostic pop
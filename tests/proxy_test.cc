@@ -0,0 +1,323 @@
+#include "gtest/gtest.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <pistache/client.h>
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/proxy.h>
+#include <pistache/router.h>
+
+#include "httplib.h"
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+const size_t BigSize = 1 << 20;
+const size_t HugeSize = 64 << 20;
+
+std::string pattern(size_t size) {
+    std::string body(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+        body[i] = 'a' + (i % 26);
+    return body;
+}
+
+// Writes chunks for as long as the peer is writable, then waits for it
+class Producer : public std::enable_shared_from_this<Producer> {
+public:
+    Producer(Http::ResponseStream stream, std::shared_ptr<std::atomic<size_t>> produced)
+        : stream_(std::move(stream))
+        , produced_(std::move(produced))
+        , chunk_(64 * 1024, 'x')
+    { }
+
+    void run() {
+        while (*produced_ < HugeSize) {
+            stream_.write(chunk_.data(), chunk_.size());
+            *produced_ += chunk_.size();
+
+            auto writable = stream_.flush();
+            if (writable.isPending()) {
+                auto self = shared_from_this();
+                writable.then([self]() { self->run(); }, [](std::exception_ptr) { });
+                return;
+            }
+        }
+
+        stream_.ends();
+    }
+
+private:
+    Http::ResponseStream stream_;
+    std::shared_ptr<std::atomic<size_t>> produced_;
+    std::string chunk_;
+};
+
+class Upstream : public TestServer {
+public:
+    Upstream()
+        : produced(std::make_shared<std::atomic<size_t>>(0))
+    {
+        // Echoes the request target as it came on the wire
+        auto echo = [](const Rest::Request& request, Http::ResponseWriter response) {
+            std::string body = request.resource();
+            if (!request.query().raw().empty())
+                body += "?" + request.query().raw();
+            auto custom = request.headers().tryGetRaw("X-Custom");
+            body += "|" + (custom.isEmpty() ? std::string() : custom.unsafeGet().value());
+            auto forwarded = request.headers().tryGetRaw("X-Forwarded-For");
+            body += "|" + (forwarded.isEmpty() ? std::string() : forwarded.unsafeGet().value());
+
+            response.headers().addRaw(Http::Header::Raw("X-Upstream", "yes"));
+            response.send(Http::Code::Ok, body);
+            return Rest::Route::Result::Ok;
+        };
+        Rest::Routes::Get(router, "/echo", echo);
+        Rest::Routes::Get(router, "/apix/echo", echo);
+
+        Rest::Routes::Post(router, "/echo", [](const Rest::Request& request, Http::ResponseWriter response) {
+            response.send(Http::Code::Created, request.body());
+            return Rest::Route::Result::Ok;
+        });
+
+        Rest::Routes::Get(router, "/big", [](const Rest::Request&, Http::ResponseWriter response) {
+            response.send(Http::Code::Ok, pattern(BigSize));
+            return Rest::Route::Result::Ok;
+        });
+
+        Rest::Routes::Get(router, "/chunked", [](const Rest::Request&, Http::ResponseWriter response) {
+            const auto body = pattern(BigSize);
+            auto stream = response.stream(Http::Code::Ok);
+            for (size_t offset = 0; offset < body.size(); offset += 10000) {
+                stream.write(body.data() + offset, std::min<size_t>(10000, body.size() - offset));
+                stream.flush();
+            }
+            stream.ends();
+            return Rest::Route::Result::Ok;
+        });
+
+        Rest::Routes::Get(router, "/slow", [](const Rest::Request&, Http::ResponseWriter response) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            response.send(Http::Code::Ok, "late");
+            return Rest::Route::Result::Ok;
+        });
+
+        Rest::Routes::Get(router, "/hop", [](const Rest::Request&, Http::ResponseWriter response) {
+            const std::string connection = "keep-alive, X-Hop";
+            auto header = std::make_shared<Http::Header::Connection>();
+            header->parseRaw(connection.data(), connection.size());
+            response.headers().remove<Http::Header::Connection>();
+            response.headers().add(header);
+            response.headers().addRaw(Http::Header::Raw("X-Hop", "upstream"));
+            response.headers().addRaw(Http::Header::Raw("X-End", "upstream"));
+            response.send(Http::Code::Ok, "hop");
+            return Rest::Route::Result::Ok;
+        });
+
+        auto counter = produced;
+        Rest::Routes::Get(router, "/huge", [counter](const Rest::Request&, Http::ResponseWriter response) {
+            std::make_shared<Producer>(response.stream(Http::Code::Ok), counter)->run();
+            return Rest::Route::Result::Ok;
+        });
+
+        serve();
+    }
+
+    std::shared_ptr<std::atomic<size_t>> produced;
+};
+
+class Gateway : public TestServer {
+public:
+    explicit Gateway(const std::string& upstream,
+                     std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+        : client(std::make_shared<Http::Client>())
+    {
+        client->init(Http::Client::options().threads(1));
+
+        auto proxy = Rest::Proxy(client, upstream).stripPrefix("/api").timeout(timeout);
+        Rest::Routes::Get(router, "/api/*", proxy);
+        Rest::Routes::Post(router, "/api/*", proxy);
+        // Shares the beginning of the prefix, but not its segment
+        Rest::Routes::Get(router, "/apix/*", proxy);
+
+        serve();
+    }
+
+    ~Gateway() {
+        client->shutdown();
+    }
+
+    std::shared_ptr<Http::Client> client;
+};
+
+}
+
+TEST(proxy_test, forwards_request_and_response) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    httplib::Client client("localhost", gateway.port());
+
+    auto res = client.Get("/api/echo?x=1", {
+            { "X-Custom", "value" },
+            { "X-Forwarded-For", "10.0.0.1" },
+            { "Proxy-Authorization", "secret" } });
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "/echo?x=1|value|10.0.0.1, 127.0.0.1");
+    ASSERT_EQ(res->get_header_value("X-Upstream"), "yes");
+
+    auto posted = client.Post("/api/echo", "payload", "text/plain");
+    ASSERT_TRUE(posted);
+    ASSERT_EQ(posted->status, 201);
+    ASSERT_EQ(posted->body, "payload");
+}
+
+TEST(proxy_test, forwards_the_query_as_received) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    httplib::Client client("localhost", gateway.port());
+
+    auto res = client.Get("/api/echo?a=1&a=2&flag&b=");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "/echo?a=1&a=2&flag&b=||127.0.0.1");
+}
+
+TEST(proxy_test, strips_the_prefix_on_a_segment_boundary) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    httplib::Client client("localhost", gateway.port());
+
+    auto res = client.Get("/apix/echo");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "/apix/echo||127.0.0.1");
+}
+
+TEST(proxy_test, streams_large_bodies) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    httplib::Client client("localhost", gateway.port());
+
+    // The length of the upstream is passed through
+    auto res = client.Get("/api/big");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body.size(), BigSize);
+    ASSERT_TRUE(res->body == pattern(BigSize));
+    ASSERT_EQ(res->get_header_value("Content-Length"), std::to_string(BigSize));
+    ASSERT_FALSE(res->has_header("Transfer-Encoding"));
+
+    auto chunked = client.Get("/api/chunked");
+    ASSERT_TRUE(chunked);
+    ASSERT_EQ(chunked->status, 200);
+    ASSERT_TRUE(chunked->body == pattern(BigSize));
+    ASSERT_EQ(chunked->get_header_value("Transfer-Encoding"), "chunked");
+}
+
+TEST(proxy_test, unreachable_upstream_is_a_bad_gateway) {
+    Gateway gateway("127.0.0.1:1");
+
+    httplib::Client client("localhost", gateway.port());
+    auto res = client.Get("/api/echo");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 502);
+    ASSERT_EQ(res->body, "Bad Gateway");
+}
+
+TEST(proxy_test, upstream_timeout_is_a_gateway_timeout) {
+    Upstream upstream;
+    Gateway gateway(upstream.address(), std::chrono::milliseconds(100));
+
+    httplib::Client client("localhost", gateway.port());
+    auto res = client.Get("/api/slow");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 504);
+    ASSERT_EQ(res->body, "Gateway Timeout");
+}
+
+TEST(proxy_test, drops_headers_named_by_connection) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    int fd = connectTo(gateway.port());
+    ASSERT_NE(fd, -1);
+
+    const std::string request =
+        "GET /api/echo HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Connection: keep-alive, X-Custom\r\n"
+        "X-Custom: value\r\n"
+        "\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+
+    // The echo ends with the address of the client
+    std::string response;
+    char buffer[4096];
+    while (response.find("127.0.0.1") == std::string::npos) {
+        ssize_t bytes = ::recv(fd, buffer, sizeof buffer, 0);
+        ASSERT_GT(bytes, 0);
+        response.append(buffer, bytes);
+    }
+    ::close(fd);
+
+    ASSERT_NE(response.find("/echo||127.0.0.1"), std::string::npos);
+
+    httplib::Client client("localhost", gateway.port());
+    auto res = client.Get("/api/hop");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_FALSE(res->has_header("X-Hop"));
+    ASSERT_EQ(res->get_header_value("X-End"), "upstream");
+}
+
+TEST(proxy_test, slow_client_holds_the_upstream_back) {
+    Upstream upstream;
+    Gateway gateway(upstream.address());
+
+    int fd = connectTo(gateway.port());
+    ASSERT_NE(fd, -1);
+
+    const std::string request = "GET /api/huge HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+
+    // Nothing is read: the upstream only gets as far as the socket buffers
+    // and the write queue of the gateway let it
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    ASSERT_GT(upstream.produced->load(), 0u);
+    EXPECT_LT(upstream.produced->load(), HugeSize / 2);
+
+    // The whole body still goes through once the client reads
+    const std::string last = "\r\n0\r\n\r\n";
+    std::string tail;
+    size_t received = 0;
+    char buffer[64 * 1024];
+    for (;;) {
+        ssize_t bytes = ::recv(fd, buffer, sizeof buffer, 0);
+        ASSERT_GT(bytes, 0);
+        received += bytes;
+        tail.append(buffer, bytes);
+        if (tail.size() > last.size())
+            tail.erase(0, tail.size() - last.size());
+        if (tail == last)
+            break;
+    }
+
+    ::close(fd);
+    ASSERT_GT(received, HugeSize);
+    ASSERT_EQ(upstream.produced->load(), HugeSize);
+}
@@ -0,0 +1,149 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <csignal>
+#include <memory>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/middleware.h>
+#include <pistache/rate_limiter.h>
+#include <pistache/router.h>
+
+#include "httplib.h"
+
+using namespace Pistache;
+
+TEST(rate_limiter_test, bucket_refills_over_time) {
+    RateLimiter limiter(10, 2);
+    auto now = RateLimiter::Clock::now();
+
+    ASSERT_TRUE(limiter.acquire("a", now));
+    ASSERT_TRUE(limiter.acquire("a", now));
+
+    auto denied = limiter.acquire("a", now);
+    ASSERT_FALSE(denied);
+    ASSERT_EQ(denied.retryAfter, std::chrono::milliseconds(100));
+
+    // Keys are independent
+    ASSERT_TRUE(limiter.acquire("b", now));
+
+    ASSERT_FALSE(limiter.acquire("a", now + std::chrono::milliseconds(50)));
+    ASSERT_TRUE(limiter.acquire("a", now + std::chrono::milliseconds(150)));
+}
+
+TEST(rate_limiter_test, keeps_a_bounded_number_of_keys) {
+    RateLimiter limiter(1, 1, 4, 1);
+    auto now = RateLimiter::Clock::now();
+
+    for (int i = 0; i < 10; ++i)
+        limiter.acquire(std::to_string(i), now);
+    ASSERT_EQ(limiter.size(), 4u);
+
+    // "9" is still tracked, "0" was evicted and starts over with a full bucket
+    ASSERT_FALSE(limiter.acquire("9", now));
+    ASSERT_TRUE(limiter.acquire("0", now));
+}
+
+TEST(rate_limiter_test, addresses_are_keyed_by_their_bytes) {
+    auto v4 = RateLimiter::keyOf(IpAddress::fromString("10.0.0.1"));
+    ASSERT_EQ(v4, std::string("\x0a\x00\x00\x01", 4));
+    ASSERT_NE(v4, RateLimiter::keyOf(IpAddress::fromString("10.0.0.2")));
+    ASSERT_EQ(RateLimiter::keyOf(IpAddress::fromString("::1")).size(), 16u);
+}
+
+namespace {
+
+class LimitedServer {
+public:
+    explicit LimitedServer(Http::Endpoint::Options opts)
+        : endpoint(std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0))))
+    {
+        endpoint->init(opts.threads(1).flags(Tcp::Options::ReuseAddr));
+
+        auto limiter = std::make_shared<RateLimiter>(0.01, 2);
+        auto handler = [](const Rest::Request&, Http::ResponseWriter response) {
+            response.send(Http::Code::Ok, "ok");
+            return Rest::Route::Result::Ok;
+        };
+
+        Rest::Routes::Get(router, "/ip",
+                Rest::Middleware::chain(Rest::Middleware::RateLimit(limiter)).to(handler));
+        Rest::Routes::Get(router, "/key",
+                Rest::Middleware::chain(Rest::Middleware::RateLimit(
+                        limiter, Rest::Middleware::RateLimit::byHeader("X-Api-Key"))).to(handler));
+        Rest::Routes::Get(router, "/client",
+                Rest::Middleware::chain(Rest::Middleware::RateLimit(
+                        limiter, Rest::Middleware::RateLimit::byHeader(
+                                "X-Api-Key", Rest::Middleware::RateLimit::byHeader("X-Client")))).to(handler));
+        Rest::Routes::Get(router, "/free", handler);
+
+        endpoint->setHandler(router.handler());
+        endpoint->serveThreaded();
+    }
+
+    ~LimitedServer() {
+        endpoint->shutdown();
+    }
+
+    int get(const char* path, const httplib::Headers& headers = httplib::Headers()) {
+        httplib::Client client("localhost", endpoint->getPort());
+        auto res = client.Get(path, headers);
+        if (!res)
+            return -1;
+        if (res->status == 429)
+            retryAfter = res->get_header_value("Retry-After");
+        return res->status;
+    }
+
+    std::shared_ptr<Http::Endpoint> endpoint;
+    Rest::Router router;
+    std::string retryAfter;
+};
+
+}
+
+TEST(rate_limiter_test, route_answers_429_with_retry_after) {
+    LimitedServer server(Http::Endpoint::options());
+
+    ASSERT_EQ(server.get("/ip"), 200);
+    ASSERT_EQ(server.get("/ip"), 200);
+    ASSERT_EQ(server.get("/ip"), 429);
+    ASSERT_EQ(server.retryAfter, "100");
+
+    ASSERT_EQ(server.get("/key", { { "X-Api-Key", "alice" } }), 200);
+    ASSERT_EQ(server.get("/key", { { "X-Api-Key", "alice" } }), 200);
+    ASSERT_EQ(server.get("/key", { { "X-Api-Key", "alice" } }), 429);
+    ASSERT_EQ(server.get("/key", { { "X-Api-Key", "bob" } }), 200);
+
+    // Routes without the filter are not limited
+    ASSERT_EQ(server.get("/free"), 200);
+}
+
+TEST(rate_limiter_test, requests_without_the_key_use_the_fallback) {
+    LimitedServer server(Http::Endpoint::options());
+
+    // Keyed by address
+    ASSERT_EQ(server.get("/key"), 200);
+    ASSERT_EQ(server.get("/key"), 200);
+    ASSERT_EQ(server.get("/key"), 429);
+    ASSERT_EQ(server.get("/key", { { "X-Api-Key", "alice" } }), 200);
+
+    // Keyed by another header, so keyless clients do not throttle each other
+    ASSERT_EQ(server.get("/client", { { "X-Client", "a" } }), 200);
+    ASSERT_EQ(server.get("/client", { { "X-Client", "a" } }), 200);
+    ASSERT_EQ(server.get("/client", { { "X-Client", "a" } }), 429);
+    ASSERT_EQ(server.get("/client", { { "X-Client", "b" } }), 200);
+}
+
+TEST(rate_limiter_test, listener_closes_connections_over_the_limit) {
+    // The client might still be writing its request when the connection is
+    // closed on it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto limiter = std::make_shared<RateLimiter>(0.01, 1);
+    LimitedServer server(Http::Endpoint::options().connectionLimiter(limiter));
+
+    ASSERT_EQ(server.get("/free"), 200);
+    ASSERT_EQ(server.get("/free"), -1);
+}
@@ -0,0 +1,103 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+#include "httplib.h"
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+class Server : public TestServer {
+public:
+    explicit Server(Http::Endpoint::Options opts)
+        : TestServer(opts.maxPayload(8 << 20))
+    {
+        Rest::Routes::Post(router, "/upload", [](const Rest::Request& request, Http::ResponseWriter response) {
+            response.send(Http::Code::Ok, std::to_string(request.body().size()));
+            return Rest::Route::Result::Ok;
+        });
+        Rest::Routes::Get(router, "/ping", [](const Rest::Request&, Http::ResponseWriter response) {
+            response.send(Http::Code::Ok, "pong");
+            return Rest::Route::Result::Ok;
+        });
+
+        serve();
+    }
+};
+
+}
+
+TEST(read_budget_test, peer_over_budget_is_read_again) {
+    // Every read uses up the budget, the body is only read through the run
+    // queue
+    Server server(Http::Endpoint::options().readBudget(1, 1));
+
+    httplib::Client client("localhost", server.port());
+    const std::string body(4 << 20, 'a');
+
+    auto res = client.Post("/upload", body, "application/octet-stream");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, std::to_string(body.size()));
+}
+
+TEST(read_budget_test, other_peers_are_served_during_an_upload) {
+    Server server(Http::Endpoint::options().readBudget(4096, 1));
+    const auto port = server.port();
+
+    auto upload = std::async(std::launch::async, [port] {
+        httplib::Client client("localhost", port);
+        auto res = client.Post("/upload", std::string(6 << 20, 'a'), "application/octet-stream");
+        return res ? res->body : std::string();
+    });
+
+    httplib::Client client("localhost", port);
+    for (int i = 0; i < 10; ++i) {
+        auto res = client.Get("/ping");
+        ASSERT_TRUE(res);
+        ASSERT_EQ(res->body, "pong");
+    }
+
+    ASSERT_EQ(upload.get(), std::to_string(6 << 20));
+}
+
+TEST(read_budget_test, concurrent_uploads_all_complete) {
+    // Several peers are over their budget at once, each of them is pushed
+    // back on the run queue while the others are still on it
+    Server server(Http::Endpoint::options());
+    const auto port = server.port();
+    const size_t size = 2 << 20;
+
+    std::vector<std::future<std::string>> uploads;
+    for (int i = 0; i < 4; ++i) {
+        uploads.push_back(std::async(std::launch::async, [port, size] {
+            httplib::Client client("localhost", port);
+            auto res = client.Post("/upload", std::string(size, 'a'), "application/octet-stream");
+            return res ? res->body : std::string();
+        }));
+    }
+
+    for (auto& upload: uploads) {
+        ASSERT_EQ(upload.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+        ASSERT_EQ(upload.get(), std::to_string(size));
+    }
+}
+
+TEST(read_budget_test, zero_means_no_limit) {
+    Server server(Http::Endpoint::options().readBudget(0, 0));
+
+    httplib::Client client("localhost", server.port());
+    auto res = client.Post("/upload", std::string(1 << 20, 'a'), "application/octet-stream");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->body, std::to_string(1 << 20));
+}
@@ -0,0 +1,297 @@
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+#include <pistache/endpoint.h>
+#include <pistache/route_cache.h>
+
+#include "httplib.h"
+
+using namespace Pistache;
+
+namespace {
+
+class CachedServer {
+public:
+    explicit CachedServer(std::shared_ptr<Rest::RouteCache> cache,
+                          std::chrono::milliseconds delay = std::chrono::milliseconds(0))
+        : endpoint(std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0))))
+        , cache(std::move(cache))
+        , delay(delay)
+        , calls(0)
+    {
+        auto opts = Http::Endpoint::options()
+            .threads(2)
+            .flags(Tcp::Options::ReuseAddr);
+        endpoint->init(opts);
+
+        Rest::Routes::Get(router, "/value", this->cache->wrap(
+            [this](const Rest::Request& request, Http::ResponseWriter response) {
+                auto n = ++calls;
+                if (this->delay.count() > 0)
+                    std::this_thread::sleep_for(this->delay);
+
+                std::string body = std::to_string(n);
+                auto lang = request.headers().tryGetRaw("X-Lang");
+                if (!lang.isEmpty())
+                    body += " " + lang.unsafeGet().value();
+
+                response.send(Http::Code::Ok, body);
+                return Rest::Route::Result::Ok;
+            }));
+
+        auto counted = [this](std::function<void(Http::ResponseWriter&)> setup) {
+            return [this, setup](const Rest::Request&, Http::ResponseWriter response) {
+                auto n = ++calls;
+                setup(response);
+                response.send(Http::Code::Ok, std::to_string(n));
+                return Rest::Route::Result::Ok;
+            };
+        };
+        auto setCookie = [](Http::ResponseWriter& response) {
+            response.cookies().add(Http::Cookie("session", "abc"));
+        };
+
+        Rest::Routes::Get(router, "/cookie", this->cache->wrap(counted(setCookie)));
+        Rest::Routes::Get(router, "/shared-cookie", this->cache->wrap(
+            counted(setCookie), Rest::RouteCache::Sharing::Everything));
+        Rest::Routes::Get(router, "/private", this->cache->wrap(
+            counted([](Http::ResponseWriter& response) {
+                response.headers().add<Http::Header::CacheControl>(Http::CacheDirective::Private);
+            })));
+        Rest::Routes::Get(router, "/no-store", this->cache->wrap(
+            counted([](Http::ResponseWriter& response) {
+                response.headers().add<Http::Header::CacheControl>(Http::CacheDirective::NoStore);
+            }), Rest::RouteCache::Sharing::Everything));
+        Rest::Routes::Get(router, "/shared", this->cache->wrap(
+            counted([](Http::ResponseWriter&) { }), Rest::RouteCache::Sharing::Everything));
+
+        endpoint->setHandler(router.handler());
+        endpoint->serveThreaded();
+    }
+
+    ~CachedServer() {
+        endpoint->shutdown();
+    }
+
+    std::shared_ptr<httplib::Response> fetch(const char* path) {
+        httplib::Client client("localhost", endpoint->getPort());
+        return client.Get(path);
+    }
+
+    std::string get(const char* path, const httplib::Headers& headers = httplib::Headers()) {
+        httplib::Client client("localhost", endpoint->getPort());
+        auto res = client.Get(path, headers);
+        if (!res || res->status != 200)
+            return std::string();
+        return res->body;
+    }
+
+    std::shared_ptr<Http::Endpoint> endpoint;
+    Rest::Router router;
+    std::shared_ptr<Rest::RouteCache> cache;
+    std::chrono::milliseconds delay;
+    std::atomic<int> calls;
+};
+
+}
+
+TEST(route_cache_test, serves_fresh_responses_without_running_the_handler) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value"), "1");
+    ASSERT_EQ(server.get("/value"), "1");
+    ASSERT_EQ(server.get("/value"), "1");
+    ASSERT_EQ(server.calls, 1);
+    ASSERT_EQ(cache->size(), 1u);
+
+    // A different query is a different entry
+    ASSERT_EQ(server.get("/value?a=1&b=2"), "2");
+    ASSERT_EQ(server.get("/value?b=2&a=1"), "2");
+    ASSERT_EQ(server.calls, 2);
+}
+
+TEST(route_cache_test, query_parameters_are_not_ambiguous) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value?a=1%26b%3D2"), "1");
+    ASSERT_EQ(server.get("/value?a=1&b=2"), "2");
+    ASSERT_EQ(cache->size(), 2u);
+}
+
+TEST(route_cache_test, hits_get_their_own_date_and_connection) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    // The first response closes its connection
+    auto first = server.fetch("/value");
+    ASSERT_TRUE(first);
+    ASSERT_EQ(first->body, "1");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    auto second = server.fetch("/value");
+    ASSERT_TRUE(second);
+    ASSERT_EQ(second->body, "1");
+    ASSERT_NE(second->get_header_value("Date"), first->get_header_value("Date"));
+
+    // A keep-alive request is answered twice on the same connection
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(server.endpoint->getPort()));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr), 0);
+
+    const std::string request = "GET /value HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+
+        std::string response;
+        char buffer[512];
+        while (response.find("\r\n\r\n1") == std::string::npos) {
+            auto bytes = ::recv(fd, buffer, sizeof buffer, 0);
+            ASSERT_GT(bytes, 0);
+            response.append(buffer, static_cast<size_t>(bytes));
+        }
+        ASSERT_NE(response.find("Connection: Keep-Alive"), std::string::npos);
+        ASSERT_EQ(response.find("Connection: Close"), std::string::npos);
+    }
+    ::close(fd);
+
+    ASSERT_EQ(server.calls, 1);
+}
+
+TEST(route_cache_test, expired_entries_are_refreshed) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::milliseconds(50));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value"), "1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(server.get("/value"), "2");
+    ASSERT_EQ(server.calls, 2);
+}
+
+TEST(route_cache_test, keys_on_vary_headers) {
+    auto cache = std::make_shared<Rest::RouteCache>(
+            std::chrono::seconds(10), std::vector<std::string>{ "X-Lang" });
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value", { { "X-Lang", "en" } }), "1 en");
+    ASSERT_EQ(server.get("/value", { { "X-Lang", "fr" } }), "2 fr");
+    ASSERT_EQ(server.get("/value", { { "X-Lang", "en" } }), "1 en");
+    ASSERT_EQ(server.calls, 2);
+}
+
+TEST(route_cache_test, invalidate_drops_all_variants) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value"), "1");
+    ASSERT_EQ(server.get("/value?x=1"), "2");
+    ASSERT_EQ(cache->size(), 2u);
+
+    cache->invalidate("/value");
+    ASSERT_EQ(cache->size(), 0u);
+    ASSERT_EQ(server.get("/value"), "3");
+}
+
+TEST(route_cache_test, concurrent_misses_run_the_handler_once) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache, std::chrono::milliseconds(300));
+
+    std::vector<std::future<std::string>> results;
+    for (int i = 0; i < 4; ++i) {
+        results.push_back(std::async(std::launch::async, [&]() {
+            return server.get("/value");
+        }));
+    }
+
+    for (auto& result: results)
+        ASSERT_EQ(result.get(), "1");
+    ASSERT_EQ(server.calls, 1);
+}
+
+TEST(route_cache_test, responses_setting_cookies_are_not_shared) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/cookie"), "1");
+    ASSERT_EQ(server.get("/cookie"), "2");
+    ASSERT_EQ(cache->size(), 0u);
+
+    // Unless the route opts in
+    ASSERT_EQ(server.get("/shared-cookie"), "3");
+    ASSERT_EQ(server.get("/shared-cookie"), "3");
+    ASSERT_EQ(cache->size(), 1u);
+}
+
+TEST(route_cache_test, private_responses_are_not_shared) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/private"), "1");
+    ASSERT_EQ(server.get("/private"), "2");
+    ASSERT_EQ(cache->size(), 0u);
+}
+
+TEST(route_cache_test, no_store_responses_are_never_kept) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/no-store"), "1");
+    ASSERT_EQ(server.get("/no-store"), "2");
+    ASSERT_EQ(cache->size(), 0u);
+}
+
+TEST(route_cache_test, requests_with_credentials_bypass_the_cache) {
+    auto cache = std::make_shared<Rest::RouteCache>(std::chrono::seconds(10));
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value", { { "Authorization", "Bearer a" } }), "1");
+    ASSERT_EQ(server.get("/value", { { "Authorization", "Bearer b" } }), "2");
+    ASSERT_EQ(server.get("/value", { { "Cookie", "session=a" } }), "3");
+    ASSERT_EQ(server.get("/value", { { "Cookie", "session=b" } }), "4");
+    ASSERT_EQ(cache->size(), 0u);
+
+    // A response cached for anonymous requests is not served to them either
+    ASSERT_EQ(server.get("/value"), "5");
+    ASSERT_EQ(server.get("/value", { { "Cookie", "session=a" } }), "6");
+
+    // Unless the route opts in
+    ASSERT_EQ(server.get("/shared", { { "Authorization", "Bearer a" } }), "7");
+    ASSERT_EQ(server.get("/shared", { { "Authorization", "Bearer b" } }), "7");
+}
+
+TEST(route_cache_test, evicts_the_least_recently_used_entry) {
+    auto cache = std::make_shared<Rest::RouteCache>(
+            std::chrono::seconds(10), std::vector<std::string>(), 2);
+    CachedServer server(cache);
+
+    ASSERT_EQ(server.get("/value?k=a"), "1");
+    ASSERT_EQ(server.get("/value?k=b"), "2");
+
+    // a is used again, b is then the one to go
+    ASSERT_EQ(server.get("/value?k=a"), "1");
+    ASSERT_EQ(server.get("/value?k=c"), "3");
+    ASSERT_EQ(cache->size(), 2u);
+
+    ASSERT_EQ(server.get("/value?k=a"), "1");
+    ASSERT_EQ(server.get("/value?k=c"), "3");
+    ASSERT_EQ(server.get("/value?k=b"), "4");
+}
@@ -204,3 +204,46 @@ TEST(router_test, test_notfound_exactly_once) {
 
     endpoint->shutdown();
 }
+
+TEST(router_test, test_request_is_shared_not_copied) {
+    Address addr(Ipv4::any(), 0);
+    auto endpoint = std::make_shared<Http::Endpoint>(addr);
+
+    auto opts = Http::Endpoint::options()
+        .threads(1)
+        .flags(Tcp::Options::ReuseAddr)
+        .maxPayload(1 << 20);
+    endpoint->init(opts);
+
+    bool shared = false;
+    std::string body;
+
+    Rest::Router router;
+    Routes::Post(router, "/upload", [&](
+            const Pistache::Rest::Request& request,
+            Pistache::Http::ResponseWriter response) {
+        auto clone = response.clone();
+        // Code written against Http::Request still takes it, without a copy
+        auto asHttp = [](const Pistache::Http::Request& http) { return &http; };
+        shared = asHttp(request) == response.request().get()
+              && &request.http() == response.request().get()
+              && clone.request() == response.request()
+              && request.body().data() == response.request()->body().data();
+        body = request.body();
+        response.send(Pistache::Http::Code::Ok);
+        return Pistache::Rest::Route::Result::Ok;
+    });
+
+    endpoint->setHandler(router.handler());
+    endpoint->serveThreaded();
+
+    httplib::Client client("localhost", endpoint->getPort());
+    const std::string payload(100000, 'x');
+    auto res = client.Post("/upload", payload, "text/plain");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_TRUE(shared);
+    ASSERT_EQ(body, payload);
+
+    endpoint->shutdown();
+}
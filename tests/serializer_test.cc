@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+#include <pistache/serializer/body.h>
+
+#if defined(PISTACHE_USE_RAPIDJSON) || defined(PISTACHE_USE_SIMDJSON)
+#include <pistache/serializer/json.h>
+#endif
+
+// Set by the build whenever the RapidJSON headers are found
+#ifdef PISTACHE_TEST_RAPIDJSON
+#include <pistache/serializer/rapidjson.h>
+#endif
+
+#include "httplib.h"
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+// One value per line
+struct Lines {
+    typedef std::vector<std::string> Document;
+
+    static Http::Mime::MediaType mime() {
+        return MIME(Text, Plain);
+    }
+
+    static void write(std::streambuf& buf, const Document& lines) {
+        for (const auto& line: lines) {
+            buf.sputn(line.data(), line.size());
+            buf.sputc('\n');
+        }
+    }
+
+    static Document parse(const std::string& body) {
+        if (!body.empty() && body.back() != '\n')
+            throw Http::HttpError(Http::Code::Bad_Request, "Unterminated line");
+
+        Document lines;
+        size_t start = 0;
+        for (size_t end; (end = body.find('\n', start)) != std::string::npos; start = end + 1)
+            lines.push_back(body.substr(start, end - start));
+        return lines;
+    }
+};
+
+class Server : public TestServer {
+public:
+    Server() {
+        Rest::Routes::Get(router, "/lines/:count", [](const Rest::Request& request, Http::ResponseWriter response) {
+            Lines::Document lines(request.param(":count").as<size_t>(), "line");
+            Rest::Serializer::send<Lines>(response, Http::Code::Ok, lines);
+            return Rest::Route::Result::Ok;
+        });
+
+        Rest::Routes::Post(router, "/reverse", [](const Rest::Request& request, Http::ResponseWriter response) {
+            auto lines = Rest::Serializer::parse<Lines>(request);
+            Rest::Serializer::send<Lines>(response, Http::Code::Ok,
+                    Lines::Document(lines.rbegin(), lines.rend()));
+            return Rest::Route::Result::Ok;
+        });
+
+#if defined(PISTACHE_USE_RAPIDJSON) || defined(PISTACHE_USE_SIMDJSON)
+        Rest::Routes::Post(router, "/json", [](const Rest::Request& request, Http::ResponseWriter response) {
+            auto document = Rest::Serializer::parse<Rest::Serializer::Json>(request);
+            Rest::Serializer::send<Rest::Serializer::Json>(response, Http::Code::Ok, document);
+            return Rest::Route::Result::Ok;
+        });
+#endif
+
+#ifdef PISTACHE_TEST_RAPIDJSON
+        Rest::Routes::Post(router, "/rapidjson", [](const Rest::Request& request, Http::ResponseWriter response) {
+            auto document = Rest::Serializer::parse<Rest::Serializer::RapidJson>(request);
+            Rest::Serializer::send<Rest::Serializer::RapidJson>(response, Http::Code::Ok, document);
+            return Rest::Route::Result::Ok;
+        });
+#endif
+
+        serve();
+    }
+};
+
+}
+
+TEST(serializer_test, writes_the_body_after_the_head) {
+    Server server;
+    httplib::Client client("localhost", server.port());
+
+    auto res = client.Get("/lines/2");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "line\nline\n");
+    ASSERT_EQ(res->get_header_value("Content-Length"), "10");
+    ASSERT_EQ(res->get_header_value("Content-Type"), "text/plain");
+
+    auto empty = client.Get("/lines/0");
+    ASSERT_TRUE(empty);
+    ASSERT_EQ(empty->body, "");
+    ASSERT_EQ(empty->get_header_value("Content-Length"), "0");
+
+    // Well past the initial size of the response buffer
+    auto large = client.Get("/lines/20000");
+    ASSERT_TRUE(large);
+    ASSERT_EQ(large->body.size(), 100000u);
+    ASSERT_EQ(large->get_header_value("Content-Length"), "100000");
+}
+
+TEST(serializer_test, parses_the_request_body) {
+    Server server;
+    httplib::Client client("localhost", server.port());
+
+    auto res = client.Post("/reverse", "a\nb\nc\n", "text/plain");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "c\nb\na\n");
+
+    auto bad = client.Post("/reverse", "a\nb", "text/plain");
+    ASSERT_TRUE(bad);
+    ASSERT_EQ(bad->status, 400);
+}
+
+#if defined(PISTACHE_USE_RAPIDJSON) || defined(PISTACHE_USE_SIMDJSON)
+TEST(serializer_test, round_trips_json) {
+    Server server;
+    httplib::Client client("localhost", server.port());
+
+    auto res = client.Post("/json", "{ \"a\": [1, 2], \"b\": \"c\" }", "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "{\"a\":[1,2],\"b\":\"c\"}");
+    ASSERT_EQ(res->get_header_value("Content-Type"), "application/json");
+
+    auto bad = client.Post("/json", "{ \"a\": ", "application/json");
+    ASSERT_TRUE(bad);
+    ASSERT_EQ(bad->status, 400);
+}
+#endif
+
+#ifdef PISTACHE_TEST_RAPIDJSON
+TEST(serializer_test, round_trips_rapidjson) {
+    Server server;
+    httplib::Client client("localhost", server.port());
+
+    auto res = client.Post("/rapidjson", "{ \"a\": [1, 2], \"b\": \"c\" }", "application/json");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body, "{\"a\":[1,2],\"b\":\"c\"}");
+    ASSERT_EQ(res->get_header_value("Content-Type"), "application/json");
+
+    auto bad = client.Post("/rapidjson", "{ \"a\": ", "application/json");
+    ASSERT_TRUE(bad);
+    ASSERT_EQ(bad->status, 400);
+}
+#endif
@@ -9,6 +9,8 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace Pistache;
 
@@ -33,6 +35,119 @@ TEST(stream, test_buffer)
     ASSERT_THROW(buffer1.detach(2 * len);, std::range_error);
 }
 
+TEST(stream, test_buffer_slices_share_storage)
+{
+    RawBuffer buffer(std::string("Hello World!"), 12);
+    ASSERT_EQ(std::string(buffer.data(), buffer.size()), "Hello World!");
+
+    RawBuffer slice = buffer.detach(6);
+    ASSERT_EQ(slice.size(), 6u);
+    ASSERT_EQ(slice.data(), buffer.data() + 6);
+    ASSERT_EQ(std::string(slice.data(), slice.size()), "World!");
+
+    RawBuffer tail = slice.detach(5);
+    ASSERT_EQ(std::string(tail.data(), tail.size()), "!");
+
+    RawBuffer copy = tail;
+    ASSERT_EQ(copy.data(), tail.data());
+
+    ASSERT_EQ(slice.detach(6).size(), 0u);
+    ASSERT_THROW(slice.detach(7), std::range_error);
+}
+
+TEST(stream, test_dynamic_buffer_grows_without_losing_bytes)
+{
+    DynamicStreamBuf buf(16);
+    ASSERT_EQ(buf.size(), 0u);
+
+    std::string expected;
+    for (int i = 0; i < 1000; ++i) {
+        auto line = std::to_string(i) + "\n";
+        buf.sputn(line.data(), line.size());
+        expected += line;
+    }
+
+    ASSERT_EQ(std::string(buf.data(), buf.size()), expected);
+
+    buf.clear();
+    ASSERT_EQ(buf.size(), 0u);
+    buf.sputn("abc", 3);
+    ASSERT_EQ(std::string(buf.data(), buf.size()), "abc");
+
+    // Reserving keeps what was written
+    buf.reserve(1 << 16);
+    ASSERT_EQ(std::string(buf.data(), buf.size()), "abc");
+}
+
+TEST(stream, test_dynamic_buffer_respects_its_max_size)
+{
+    DynamicStreamBuf buf(4, 1000);
+    std::string data(2000, 'x');
+
+    ASSERT_EQ(buf.sputn(data.data(), data.size()), 1000);
+    ASSERT_EQ(buf.size(), 1000u);
+}
+
+TEST(stream, test_released_buffer_returns_to_the_pool)
+{
+    DynamicStreamBuf buf(BufferPool::MinBlockSize);
+    buf.sputn("hello", 5);
+    const char* bytes = buf.data();
+
+    const size_t freeBlocks = BufferPool::freeBlocks();
+    {
+        // The bytes are handed over, not copied
+        auto released = buf.release();
+        ASSERT_EQ(released.data(), bytes);
+        ASSERT_EQ(released.size(), 5u);
+        ASSERT_EQ(buf.size(), 0u);
+
+        auto slice = released.detach(1);
+        ASSERT_EQ(std::string(slice.data(), slice.size()), "ello");
+    }
+    ASSERT_EQ(BufferPool::freeBlocks(), freeBlocks + 1);
+
+    // The next write reuses the block
+    buf.sputn("world", 5);
+    ASSERT_EQ(buf.data(), bytes);
+    ASSERT_EQ(BufferPool::freeBlocks(), freeBlocks);
+
+    DynamicStreamBuf empty(BufferPool::MinBlockSize);
+    ASSERT_EQ(empty.release().size(), 0u);
+}
+
+TEST(stream, test_pool_caps_the_bytes_of_a_thread)
+{
+    // Blocks taken elsewhere and freed here, as when a buffer outlives the
+    // worker which wrote it
+    std::vector<char*> blocks;
+    for (size_t i = 0; i < 8; ++i) {
+        size_t capacity;
+        blocks.push_back(BufferPool::acquire(BufferPool::MaxPooledSize, capacity));
+        blocks.push_back(BufferPool::acquire(BufferPool::MaxPooledSize / 2, capacity));
+    }
+
+    std::thread([&blocks]() {
+        for (size_t i = 0; i < blocks.size(); ++i)
+            BufferPool::release(blocks[i], i % 2 ? BufferPool::MaxPooledSize / 2 : BufferPool::MaxPooledSize);
+
+        ASSERT_GT(BufferPool::freeBlocks(), 0u);
+        ASSERT_LE(BufferPool::freeBytes(), BufferPool::MaxFreeBytes);
+    }).join();
+}
+
+TEST(stream, test_dynamic_buffer_overwrite_stays_in_bounds)
+{
+    DynamicStreamBuf buf(BufferPool::MinBlockSize);
+    buf.sputn("0000 body", 9);
+
+    buf.overwrite(0, "0009", 4);
+    ASSERT_EQ(std::string(buf.data(), buf.size()), "0009 body");
+
+    ASSERT_THROW(buf.overwrite(6, "abcd", 4), std::range_error);
+    ASSERT_THROW(buf.overwrite(10, "a", 1), std::range_error);
+}
+
 TEST(stream, test_file_buffer)
 {
     char fileName[PATH_MAX] = "/tmp/pistacheioXXXXXX";
@@ -51,4 +166,46 @@ TEST(stream, test_file_buffer)
     ASSERT_EQ(fileBuffer.size(), dataToWrite.size());
 
     unlink(fileName);
-}
\ No newline at end of file
+}
+TEST(stream, test_cursor_match_until)
+{
+    std::string str = "Name: value; Other=x\r\n";
+    RawStreamBuf<> buf(&str[0], str.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_TRUE(match_until(':', cursor));
+    ASSERT_EQ(cursor.diff(0), 4u);
+
+    ASSERT_TRUE(match_until({ '=', ';' }, cursor));
+    ASSERT_EQ(cursor.current(), ';');
+
+    ASSERT_TRUE(match_until('o', cursor));
+    ASSERT_EQ(cursor.current(), 'O');
+    ASSERT_FALSE(match_until({ 'o', '&' }, cursor, CaseSensitivity::Sensitive));
+    ASSERT_TRUE(cursor.eof());
+    ASSERT_FALSE(match_until({ '&', '#' }, cursor));
+    ASSERT_EQ(cursor.next(), StreamCursor::Eof);
+}
+
+TEST(stream, test_cursor_match_until_eol)
+{
+    std::string str = "a\rb\r\nc\r";
+    RawStreamBuf<> buf(&str[0], str.size());
+    StreamCursor cursor(&buf);
+
+    ASSERT_TRUE(match_until_eol(cursor));
+    ASSERT_EQ(cursor.diff(0), 3u);
+    ASSERT_TRUE(cursor.eol());
+
+    ASSERT_TRUE(cursor.advance(2));
+    ASSERT_FALSE(match_until_eol(cursor));
+
+    // Stopped on the last CR, the LF is not there yet
+    ASSERT_EQ(cursor.current(), '\r');
+    ASSERT_FALSE(cursor.eol());
+    ASSERT_EQ(cursor.remaining(), 1u);
+
+    ASSERT_FALSE(cursor.advance(2));
+    ASSERT_TRUE(cursor.advance(1));
+    ASSERT_FALSE(match_until_eol(cursor));
+}
@@ -0,0 +1,95 @@
+/* test_server.h
+
+   An endpoint listening on a port picked by the system, and the helpers
+   shared by the tests that talk to it
+*/
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/router.h>
+
+namespace Pistache {
+
+/* Serves with a single worker thread until it is destroyed. The routes are
+ * added to the router (or a handler is given) before calling serve().
+ */
+class TestServer {
+public:
+    explicit TestServer(Http::Endpoint::Options opts = Http::Endpoint::options())
+        : endpoint(std::make_shared<Http::Endpoint>(Address(Ipv4::any(), Port(0))))
+        , router()
+    {
+        endpoint->init(opts.threads(1).flags(Tcp::Options::ReuseAddr));
+    }
+
+    TestServer(const TestServer&) = delete;
+    TestServer& operator=(const TestServer&) = delete;
+
+    ~TestServer() {
+        endpoint->shutdown();
+    }
+
+    void serve() {
+        serve(router.handler());
+    }
+
+    void serve(const std::shared_ptr<Http::Handler>& handler) {
+        endpoint->setHandler(handler);
+        endpoint->serveThreaded();
+    }
+
+    Port port() const {
+        return endpoint->getPort();
+    }
+
+    // As given to Http::Client
+    std::string address() const {
+        return "127.0.0.1:" + port().toString();
+    }
+
+    std::shared_ptr<Http::Endpoint> endpoint;
+    Rest::Router router;
+};
+
+template<typename Pred>
+bool waitFor(Pred pred, std::chrono::seconds timeout = std::chrono::seconds(5)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+// A blocking socket connected to the port on the loopback, -1 on failure
+inline int connectTo(Port port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == -1) {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+} // namespace Pistache
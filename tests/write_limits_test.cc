@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+#include <pistache/reactor.h>
+#include <pistache/transport.h>
+
+#include "httplib.h"
+#include "test_server.h"
+
+using namespace Pistache;
+
+namespace {
+
+struct State {
+    std::atomic<size_t> produced { 0 };
+    std::atomic<bool> done { false };
+    std::atomic<bool> disconnected { false };
+};
+
+// Streams chunks for as long as the peer is writable, then waits for it
+class Producer : public std::enable_shared_from_this<Producer> {
+public:
+    static constexpr size_t ChunkSize = 16 * 1024;
+
+    Producer(Http::ResponseStream stream, size_t total, std::shared_ptr<State> state)
+        : stream_(std::move(stream))
+        , total_(total)
+        , state_(std::move(state))
+        , chunk_(ChunkSize, 'x')
+    { }
+
+    void run() {
+        enum Step { Pending, Ready, Waiting };
+
+        while (state_->produced < total_) {
+            stream_.write(chunk_.data(), chunk_.size());
+            state_->produced += chunk_.size();
+
+            auto self = shared_from_this();
+            auto step = std::make_shared<Step>(Pending);
+            stream_.flush().then([self, step]() {
+                if (*step == Pending)
+                    *step = Ready;
+                else
+                    self->run();
+            }, [self](std::exception_ptr&) {
+                self->state_->disconnected = true;
+            });
+
+            if (*step != Ready) {
+                *step = Waiting;
+                return;
+            }
+        }
+
+        stream_.ends();
+        state_->done = true;
+    }
+
+private:
+    Http::ResponseStream stream_;
+    size_t total_;
+    std::shared_ptr<State> state_;
+    std::string chunk_;
+};
+
+constexpr size_t Producer::ChunkSize;
+
+class StreamHandler : public Http::Handler {
+public:
+    HTTP_PROTOTYPE(StreamHandler)
+
+    StreamHandler(size_t total, std::shared_ptr<State> state)
+        : total_(total)
+        , state_(std::move(state))
+    { }
+
+    void onRequest(const Http::Request&, Http::ResponseWriter response) override {
+        auto producer = std::make_shared<Producer>(
+                response.stream(Http::Code::Ok), total_, state_);
+        producer->run();
+    }
+
+private:
+    size_t total_;
+    std::shared_ptr<State> state_;
+};
+
+class Server : public TestServer {
+public:
+    Server(Http::Endpoint::Options opts, size_t total)
+        : TestServer(opts)
+        , state(std::make_shared<State>())
+    {
+        serve(Http::make_handler<StreamHandler>(total, state));
+    }
+
+    std::shared_ptr<State> state;
+};
+
+}
+
+TEST(write_limits_test, watermarks_must_be_ordered) {
+    ASSERT_THROW(Http::Endpoint::options().writeWatermarks(2, 1), std::invalid_argument);
+}
+
+TEST(write_limits_test, reader_gets_the_whole_stream) {
+    const size_t total = 4 * 1024 * 1024;
+    Server server(Http::Endpoint::options().writeWatermarks(16 * 1024, 64 * 1024), total);
+
+    httplib::Client client("localhost", server.port());
+    auto res = client.Get("/");
+    ASSERT_TRUE(res);
+    ASSERT_EQ(res->status, 200);
+    ASSERT_EQ(res->body.size(), total);
+    ASSERT_TRUE(server.state->done);
+}
+
+TEST(write_limits_test, stalled_reader_is_disconnected) {
+    // Much more than the socket buffers can hold
+    const size_t total = 256 * 1024 * 1024;
+    Server server(Http::Endpoint::options()
+                        .writeWatermarks(16 * 1024, 64 * 1024)
+                        .slowPeerTimeout(std::chrono::milliseconds(200)), total);
+
+    // Sends a request and never reads the response
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+    int size = 4096;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(server.port()));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr), 0);
+
+    const std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ASSERT_EQ(::send(fd, request.data(), request.size(), 0), static_cast<ssize_t>(request.size()));
+
+    ASSERT_TRUE(waitFor([&] { return server.state->disconnected.load(); }));
+
+    // The producer stopped once the queue filled up instead of queueing it all
+    ASSERT_FALSE(server.state->done);
+    ASSERT_LT(server.state->produced.load(), total);
+
+    ::close(fd);
+}
+
+TEST(write_limits_test, write_for_a_gone_peer_is_rejected) {
+    auto reactor = Aio::Reactor::create();
+    reactor->init(Aio::AsyncContext(1));
+    auto key = reactor->addHandler(std::make_shared<Tcp::Transport>(
+            Http::make_handler<StreamHandler>(0, std::make_shared<State>())));
+    reactor->run();
+
+    auto transport = std::static_pointer_cast<Tcp::Transport>(reactor->handlers(key)[0]);
+
+    // No peer has that fd, as when it went away before the write got queued
+    const Fd fd = 1000;
+    std::atomic<bool> rejected(false);
+    transport->asyncWrite(fd, RawBuffer("data", 4)).then(
+            [](ssize_t) { }, [&](std::exception_ptr) { rejected = true; });
+
+    // Not counted, no queue is made for a fd that is not a peer
+    ASSERT_EQ(transport->queuedBytes(fd), 0u);
+
+    ASSERT_TRUE(waitFor([&] { return rejected.load(); }));
+    ASSERT_EQ(transport->queuedBytes(fd), 0u);
+
+    reactor->shutdown();
+}